@@ -0,0 +1,277 @@
+#include <cassert>
+#include <algorithm>
+#include <atomic>
+#include "rocksdb/compressed_physical_range.h"
+#include "rocksdb/vec_physical_range.h"
+#include "util/compression.h"
+
+namespace ROCKSDB_NAMESPACE {
+
+// same as blob files, the uncompressed size is stored in the compressed block
+static const uint32_t kCompressFormatVersion = 2;
+
+static std::atomic<uint64_t> next_range_id(1);
+
+CompressedPhysicalRange::CompressedPhysicalRange(CompressionType compression_type_, size_t block_size_)
+    : PhysicalRange(true), range_id(next_range_id.fetch_add(1, std::memory_order_relaxed)), compression_type(compression_type_),
+      block_size(block_size_) {
+}
+
+std::unique_ptr<CompressedPhysicalRange> CompressedPhysicalRange::buildFromPhysicalRange(const PhysicalRange& range, CompressionType compression_type,
+                                                                                         size_t block_size) {
+    return build(range, compression_type, block_size, true);
+}
+
+std::unique_ptr<CompressedPhysicalRange> CompressedPhysicalRange::build(const PhysicalRange& range, CompressionType compression_type,
+                                                                        size_t block_size, bool require_saving) {
+    if (compression_type == kNoCompression || !CompressionTypeSupported(compression_type) || range.length() == 0) {
+        return nullptr;
+    }
+    std::unique_ptr<CompressedPhysicalRange> newRange(new CompressedPhysicalRange(compression_type, block_size));
+    size_t len = range.length();
+
+    newRange->value_offsets.reserve(len + 1);
+    std::vector<size_t> key_sizes;
+    key_sizes.reserve(len);
+
+    CompressionOptions compression_opts;
+    CompressionContext compression_context(compression_type, compression_opts);
+    CompressionInfo compression_info(compression_opts, compression_context, CompressionDict::GetEmptyDict(), compression_type,
+                                     0 /* sample_for_compression */);
+
+    std::string raw_block;
+    std::string compressed_block;
+    size_t raw_values_size = 0;
+    size_t block_first_index = 0;
+    auto flushBlock = [&](size_t end_index) {
+        ValueBlock block{newRange->blocks_buffer.size(), 0, block_first_index, raw_values_size - raw_block.size(), false};
+        compressed_block.clear();
+        // keep the block plain if the compression does not save at least 1/8
+        if (CompressData(raw_block, compression_info, kCompressFormatVersion, &compressed_block) &&
+            compressed_block.size() < raw_block.size() - raw_block.size() / 8) {
+            newRange->blocks_buffer.append(compressed_block);
+            block.size = compressed_block.size();
+            block.compressed = true;
+        } else {
+            newRange->blocks_buffer.append(raw_block);
+            block.size = raw_block.size();
+        }
+        newRange->blocks.push_back(block);
+        raw_block.clear();
+        block_first_index = end_index;
+    };
+
+    PhysicalRangeKeyBuffer key_buffer;
+    PhysicalRangeValueBuffer value_buffer;
+    for (size_t i = 0; i < len; i++) {
+        Slice internal_key = range.readInternalKeyAt(i, &key_buffer);
+        newRange->keys_buffer.append(internal_key.data(), internal_key.size());
+        key_sizes.push_back(internal_key.size());
+        newRange->value_offsets.push_back(raw_values_size);
+        Slice value = range.readValueAt(i, &value_buffer);
+        raw_block.append(value.data(), value.size());
+        raw_values_size += value.size();
+        if (raw_block.size() >= block_size) {
+            flushBlock(i + 1);
+        }
+    }
+    newRange->value_offsets.push_back(raw_values_size);
+    if (block_first_index < len) {
+        flushBlock(len);
+    }
+
+    if (require_saving && newRange->blocks_buffer.size() >= raw_values_size - raw_values_size / 8) {
+        // not worth it
+        return nullptr;
+    }
+
+    // slices after the keys buffer is complete (no more reallocation)
+    newRange->keys_buffer.shrink_to_fit();
+    newRange->internal_key_slices.reserve(len);
+    newRange->user_key_slices.reserve(len);
+    size_t key_offset = 0;
+    for (size_t i = 0; i < len; i++) {
+        size_t key_size = key_sizes[i];
+        newRange->internal_key_slices.emplace_back(newRange->keys_buffer.data() + key_offset, key_size);
+        newRange->user_key_slices.emplace_back(newRange->keys_buffer.data() + key_offset, key_size - internal_key_extra_bytes);
+        key_offset += key_size;
+    }
+    newRange->blocks_buffer.shrink_to_fit();
+    newRange->range_length = len;
+    newRange->delete_length = range.deleteLength();
+    newRange->timestamp = range.getTimestamp();
+    newRange->byte_size = newRange->keys_buffer.size() + newRange->blocks_buffer.size();
+    return newRange;
+}
+
+size_t CompressedPhysicalRange::blockOf(size_t index) const {
+    auto it = std::upper_bound(blocks.begin(), blocks.end(), index,
+        [](size_t index_, const ValueBlock& block) {
+            return index_ < block.first_index;
+        });
+    assert(it != blocks.begin());
+    return std::distance(blocks.begin(), it) - 1;
+}
+
+bool CompressedPhysicalRange::uncompressBlock(size_t block, std::string* output) const {
+    const ValueBlock& value_block = blocks[block];
+    if (!value_block.compressed) {
+        output->assign(blocks_buffer.data() + value_block.offset, value_block.size);
+        return true;
+    }
+    UncompressionContext uncompression_context(compression_type);
+    UncompressionInfo uncompression_info(uncompression_context, UncompressionDict::GetEmptyDict(), compression_type);
+    size_t uncompressed_size = 0;
+    CacheAllocationPtr uncompressed = UncompressData(uncompression_info, blocks_buffer.data() + value_block.offset, value_block.size,
+                                                     &uncompressed_size, kCompressFormatVersion);
+    size_t next_first_index = block + 1 < blocks.size() ? blocks[block + 1].first_index : range_length;
+    if (!uncompressed || uncompressed_size != value_offsets[next_first_index] - value_block.raw_offset) {
+        return false;
+    }
+    output->assign(uncompressed.get(), uncompressed_size);
+    return true;
+}
+
+bool CompressedPhysicalRange::getEntries(std::vector<Slice>* internal_keys, std::vector<Slice>* values, std::string* raw_values) const {
+    raw_values->clear();
+    raw_values->reserve(value_offsets.back());
+    std::string block_values;
+    for (size_t b = 0; b < blocks.size(); b++) {
+        if (!uncompressBlock(b, &block_values)) {
+            return false;
+        }
+        raw_values->append(block_values);
+    }
+    if (raw_values->size() != value_offsets.back()) {
+        return false;
+    }
+    internal_keys->assign(internal_key_slices.begin(), internal_key_slices.end());
+    values->clear();
+    values->reserve(range_length);
+    for (size_t i = 0; i < range_length; i++) {
+        values->emplace_back(raw_values->data() + value_offsets[i], value_offsets[i + 1] - value_offsets[i]);
+    }
+    return true;
+}
+
+Slice CompressedPhysicalRange::startUserKey() const {
+    assert(valid && range_length > 0);
+    return user_key_slices[0];
+}
+
+Slice CompressedPhysicalRange::endUserKey() const {
+    assert(valid && range_length > 0);
+    return user_key_slices[range_length - 1];
+}
+
+Slice CompressedPhysicalRange::startInternalKey() const {
+    assert(valid && range_length > 0);
+    return internal_key_slices[0];
+}
+
+Slice CompressedPhysicalRange::endInternalKey() const {
+    assert(valid && range_length > 0);
+    return internal_key_slices[range_length - 1];
+}
+
+Slice CompressedPhysicalRange::internalKeyAt(size_t index) const {
+    assert(valid && range_length > index);
+    return internal_key_slices[index];
+}
+
+Slice CompressedPhysicalRange::userKeyAt(size_t index) const {
+    assert(valid && range_length > index);
+    return user_key_slices[index];
+}
+
+Slice CompressedPhysicalRange::valueAt(size_t index) const {
+    static thread_local PhysicalRangeValueBuffer value_buffer;
+    return readValueAt(index, &value_buffer);
+}
+
+Slice CompressedPhysicalRange::readValueAt(size_t index, PhysicalRangeValueBuffer* buffer) const {
+    assert(valid && range_length > index && buffer);
+    buffer->corrupted = false;
+    size_t block = blockOf(index);
+    const ValueBlock& value_block = blocks[block];
+    size_t value_size = value_offsets[index + 1] - value_offsets[index];
+    size_t offset_in_block = value_offsets[index] - value_block.raw_offset;
+    if (!value_block.compressed) {
+        return Slice(blocks_buffer.data() + value_block.offset + offset_in_block, value_size);
+    }
+    if (buffer->range_id != range_id || buffer->block != block) {
+        if (!uncompressBlock(block, &buffer->data)) {
+            buffer->range_id = 0;
+            buffer->corrupted = true;
+            return Slice();
+        }
+        buffer->range_id = range_id;
+        buffer->block = block;
+    }
+    return Slice(buffer->data.data() + offset_in_block, value_size);
+}
+
+PhysicalRangeUpdateResult CompressedPhysicalRange::update(const Slice& internal_key, const Slice& value) const {
+    assert(valid && range_length > 0 && internal_key.size() > internal_key_extra_bytes);
+    std::vector<Slice> internal_keys;
+    std::vector<Slice> values;
+    std::string raw_values;
+    if (!getEntries(&internal_keys, &values, &raw_values)) {
+        return PhysicalRangeUpdateResult::ERROR;
+    }
+    // update a hot copy (same results as a hot range), then compress it again even if it is not compressible any more
+    std::unique_ptr<VecPhysicalRange> hotRange = VecPhysicalRange::buildFromInternalEntries(internal_keys, values);
+    hotRange->setTimestamp(timestamp);
+    PhysicalRangeUpdateResult result = hotRange->update(internal_key, value);
+    if (result != PhysicalRangeUpdateResult::UPDATED && result != PhysicalRangeUpdateResult::INSERTED) {
+        return result;
+    }
+    std::unique_ptr<CompressedPhysicalRange> newRange = build(*hotRange, compression_type, block_size, false);
+    if (!newRange) {
+        return PhysicalRangeUpdateResult::ERROR;
+    }
+    // a new range id, the blocks decompressed in the buffers of readers are stale
+    range_id = newRange->range_id;
+    keys_buffer.swap(newRange->keys_buffer);
+    // the slices refer to this keys buffer (a short one is not moved by swap())
+    internal_key_slices.clear();
+    user_key_slices.clear();
+    size_t key_offset = 0;
+    for (const Slice& new_internal_key : newRange->internal_key_slices) {
+        internal_key_slices.emplace_back(keys_buffer.data() + key_offset, new_internal_key.size());
+        user_key_slices.emplace_back(keys_buffer.data() + key_offset, new_internal_key.size() - internal_key_extra_bytes);
+        key_offset += new_internal_key.size();
+    }
+    value_offsets.swap(newRange->value_offsets);
+    blocks_buffer.swap(newRange->blocks_buffer);
+    blocks.swap(newRange->blocks);
+    range_length = newRange->range_length;
+    delete_length = newRange->delete_length;
+    byte_size = newRange->byte_size;
+    return result;
+}
+
+int CompressedPhysicalRange::find(const Slice& key) const {
+    assert(valid && range_length > 0 && key.size() > 0);
+    auto it = std::lower_bound(user_key_slices.begin(), user_key_slices.end(), key,
+        [](const Slice& user_key, const Slice& key_) {
+            return user_key.compare(key_) < 0;
+        });
+    if (it == user_key_slices.end()) {
+        return -1;
+    }
+    return static_cast<int>(std::distance(user_key_slices.begin(), it));
+}
+
+void CompressedPhysicalRange::reserve(size_t len) {
+    // read-only
+}
+
+std::string CompressedPhysicalRange::toString() const {
+    std::string str = "< " + ToStringPlain(this->startUserKey().ToString()) + " -> " + ToStringPlain(this->endUserKey().ToString()) + " >"
+        + " ( len = " + std::to_string(this->length()) + ", compressed = " + std::to_string(blocks_buffer.size()) + " / "
+        + std::to_string(value_offsets.back()) + " )";
+    return str;
+}
+
+}  // namespace ROCKSDB_NAMESPACE
@@ -1,99 +1,190 @@
 #include <cassert>
-#include <algorithm> 
-#include <thread>
-#include <mutex>
-#include <condition_variable>
-#include <queue>
-#include <functional>
+#include <algorithm>
 #include <atomic>
+#include <mutex>
 #include "db/dbformat.h"
 #include "rocksdb/continuous_physical_range.h"
+#include "util/coding.h"
 
 namespace ROCKSDB_NAMESPACE {
 
-std::string ContinuousPhysicalRange::toString() const {
-    std::shared_lock<std::shared_mutex> lock(physical_range_mutex_);
-    std::string str = "< " + ToStringPlain(this->startUserKey().ToString()) + " -> " + ToStringPlain(this->endUserKey().ToString()) + " >"
-        + " ( len = " + std::to_string(this->length()) + " )";
-    return str;
+static std::atomic<uint64_t> next_version(1);
+
+static uint64_t newVersion() {
+    return next_version.fetch_add(1, std::memory_order_relaxed);
 }
 
-// ContinuousPhysicalRange implementation
-ContinuousPhysicalRange::ContinuousPhysicalRange(bool valid_) : PhysicalRange(valid_) {
-    this->data = std::make_shared<RangeData>();
-    if (valid) {
-        data = std::make_shared<RangeData>();
-        data->keys_buffer_size = 0;
-        data->values_buffer_size = 0;
+// User key of an internal key, empty for an empty key
+static Slice userKeyOf(const Slice& internal_key) {
+    if (internal_key.empty()) {
+        return Slice();
     }
+    assert(internal_key.size() >= PhysicalRange::internal_key_extra_bytes);
+    return Slice(internal_key.data(), internal_key.size() - PhysicalRange::internal_key_extra_bytes);
 }
 
-ContinuousPhysicalRange::~ContinuousPhysicalRange() {
-    data.reset();
+// Append the key to dst as the bytes its user key shares with prev_user_key, the non-shared suffix,
+// and its trailer if it differs from base_trailer
+static void encodeKey(std::string* dst, const Slice& prev_user_key, const Slice& internal_key, uint64_t base_trailer) {
+    Slice user_key = userKeyOf(internal_key);
+    uint64_t trailer = ExtractInternalKeyFooter(internal_key);
+    bool has_trailer = trailer != base_trailer;
+    uint32_t shared = static_cast<uint32_t>(prev_user_key.difference_offset(user_key));
+    uint32_t non_shared = static_cast<uint32_t>(user_key.size() - shared);
+    PutVarint32Varint32(dst, shared, (non_shared << 1) | (has_trailer ? 1 : 0));
+    dst->append(user_key.data() + shared, non_shared);
+    if (has_trailer) {
+        PutVarint64(dst, i64ToZigzag(static_cast<int64_t>(trailer >> 8) - static_cast<int64_t>(base_trailer >> 8)));
+        dst->push_back(static_cast<char>(trailer & 0xff));
+    }
 }
 
-ContinuousPhysicalRange::ContinuousPhysicalRange(const ContinuousPhysicalRange& other) : PhysicalRange(other.valid) {
-    this->range_length = other.range_length;
-    this->byte_size = other.byte_size;
-    this->timestamp = other.timestamp;
-    
-    if (other.valid && other.data) {
-        this->data = std::make_shared<RangeData>();
-        
-        // Copy continuous buffers
-        if (other.data->keys_buffer_size > 0) {
-            this->data->keys_buffer = std::make_unique<char[]>(other.data->keys_buffer_size);
-            memcpy(this->data->keys_buffer.get(), other.data->keys_buffer.get(), other.data->keys_buffer_size);
-            this->data->keys_buffer_size = other.data->keys_buffer_size;
-        }
-        
-        if (other.data->values_buffer_size > 0) {
-            this->data->values_buffer = std::make_unique<char[]>(other.data->values_buffer_size);
-            memcpy(this->data->values_buffer.get(), other.data->values_buffer.get(), other.data->values_buffer_size);
-            this->data->values_buffer_size = other.data->values_buffer_size;
-        }
-        
-        // Copy offset and size arrays
-        this->data->key_offsets = other.data->key_offsets;
-        this->data->key_sizes = other.data->key_sizes;
-        this->data->value_offsets = other.data->value_offsets;
-        this->data->value_sizes = other.data->value_sizes;
-        this->data->original_value_sizes = other.data->original_value_sizes;
-        this->data->is_overflow = other.data->is_overflow;
-        
-        // Copy overflow values
-        this->data->overflow_values.resize(other.data->overflow_values.size());
-        for (size_t i = 0; i < other.data->overflow_values.size(); i++) {
-            if (other.data->overflow_values[i]) {
-                this->data->overflow_values[i] = std::make_unique<std::string>(*other.data->overflow_values[i]);
-            }
+Slice ContinuousPhysicalRange::Chunk::restartUserKey(size_t restart) const {
+    uint32_t shared = 0;
+    Slice non_shared;
+    uint64_t trailer = 0;
+    decodeEntry(restarts[restart], &shared, &non_shared, &trailer);
+    assert(shared == 0);
+    return non_shared;
+}
+
+void ContinuousPhysicalRange::Chunk::decodeEntry(size_t local_index, uint32_t* shared, Slice* non_shared, uint64_t* trailer) const {
+    const char* p = keys.data() + key_offsets[local_index];
+    const char* limit = keys.data() + key_offsets[local_index + 1];
+    uint32_t non_shared_and_flag = 0;
+    p = GetVarint32Ptr(p, limit, shared);
+    p = GetVarint32Ptr(p, limit, &non_shared_and_flag);
+    assert(p != nullptr);
+    *non_shared = Slice(p, non_shared_and_flag >> 1);
+    p += non_shared_and_flag >> 1;
+    if (non_shared_and_flag & 1) {
+        uint64_t sequence_delta = 0;
+        p = GetVarint64Ptr(p, limit, &sequence_delta);
+        assert(p != nullptr && p < limit);
+        uint64_t sequence = static_cast<uint64_t>(static_cast<int64_t>(base_trailer >> 8) + zigzagToI64(sequence_delta));
+        *trailer = (sequence << 8) | static_cast<unsigned char>(*p);
+        p++;
+    } else {
+        *trailer = base_trailer;
+    }
+    assert(p == limit);
+}
+
+bool ContinuousPhysicalRange::Chunk::isRestart(size_t local_index) const {
+    return std::binary_search(restarts.begin(), restarts.end(), static_cast<uint32_t>(local_index));
+}
+
+void ContinuousPhysicalRange::Chunk::keyAt(size_t local_index, std::string* key) const {
+    auto it = std::upper_bound(restarts.begin(), restarts.end(), static_cast<uint32_t>(local_index));
+    assert(it != restarts.begin());
+    key->clear();
+    uint32_t shared = 0;
+    Slice non_shared;
+    uint64_t trailer = 0;
+    for (size_t i = *(it - 1); i <= local_index; i++) {
+        decodeEntry(i, &shared, &non_shared, &trailer);
+        key->resize(shared);
+        key->append(non_shared.data(), non_shared.size());
+    }
+    PutFixed64(key, trailer);
+}
+
+void ContinuousPhysicalRange::Chunk::append(const Slice& internal_key, const Slice& value, const Slice& prev_user_key) {
+    if (key_offsets.empty()) {
+        key_offsets.push_back(0);
+    }
+    bool restart = size() == 0 || size() - restarts.back() >= kRestartInterval;
+    if (restart) {
+        restarts.push_back(static_cast<uint32_t>(size()));
+    }
+    encodeKey(&keys, restart ? Slice() : prev_user_key, internal_key, base_trailer);
+    key_offsets.push_back(static_cast<uint32_t>(keys.size()));
+    value_offsets.push_back(static_cast<uint32_t>(values.size()));
+    value_sizes.push_back(static_cast<uint32_t>(value.size()));
+    values.append(value.data(), value.size());
+}
+
+void ContinuousPhysicalRange::Chunk::insertEncodedKey(size_t local_index, const Slice& prev_user_key, const Slice& internal_key) {
+    std::string encoded;
+    encodeKey(&encoded, prev_user_key, internal_key, base_trailer);
+    uint32_t key_offset = key_offsets[local_index];
+    keys.insert(key_offset, encoded);
+    key_offsets.insert(key_offsets.begin() + local_index, key_offset);
+    for (size_t i = local_index + 1; i < key_offsets.size(); i++) {
+        key_offsets[i] += static_cast<uint32_t>(encoded.size());
+    }
+
+    // the restart point at local_index (if any) is moved with its key, the new key is a restart point only at the head
+    for (auto& restart : restarts) {
+        if (restart >= local_index) {
+            restart++;
         }
-        
-        // Rebuild slices
-        rebuildSlices();
+    }
+    if (local_index == 0) {
+        assert(prev_user_key.empty());
+        restarts.insert(restarts.begin(), 0);
     }
 }
 
-ContinuousPhysicalRange::ContinuousPhysicalRange(ContinuousPhysicalRange&& other) noexcept : PhysicalRange(other.valid) {
-    this->data = std::move(other.data);
-    this->valid = other.valid;
-    this->range_length = other.range_length;
-    this->byte_size = other.byte_size;
-    this->timestamp = other.timestamp;
+void ContinuousPhysicalRange::Chunk::reencodeKey(size_t local_index, const Slice& prev_user_key, const Slice& internal_key) {
+    std::string encoded;
+    encodeKey(&encoded, prev_user_key, internal_key, base_trailer);
+    uint32_t old_size = key_offsets[local_index + 1] - key_offsets[local_index];
+    keys.replace(key_offsets[local_index], old_size, encoded);
+    for (size_t i = local_index + 1; i < key_offsets.size(); i++) {
+        key_offsets[i] = key_offsets[i] - old_size + static_cast<uint32_t>(encoded.size());
+    }
+}
 
-    other.valid = false;
-    other.range_length = 0;
-    other.timestamp = 0;
+void ContinuousPhysicalRange::Chunk::splitRestartInterval(size_t local_index) {
+    auto it = std::upper_bound(restarts.begin(), restarts.end(), static_cast<uint32_t>(local_index));
+    assert(it != restarts.begin());
+    size_t interval_start = *(it - 1);
+    size_t interval_end = it == restarts.end() ? size() : *it;
+    if (interval_end - interval_start < 2 * kRestartInterval) {
+        return;
+    }
+    size_t middle = interval_start + kRestartInterval;
+    std::string key;
+    keyAt(middle, &key);
+    reencodeKey(middle, Slice(), key);
+    restarts.insert(it, static_cast<uint32_t>(middle));
 }
 
-ContinuousPhysicalRange::ContinuousPhysicalRange(std::shared_ptr<RangeData> data_, size_t range_length_) : PhysicalRange(true) {
-    this->data = data_;
-    this->range_length = range_length_;
-    this->byte_size = 0;
-    for (size_t i = 0; i < range_length_; i++) {
-        this->byte_size += data_->key_sizes[i];
-        this->byte_size += data_->value_sizes[i];
+void ContinuousPhysicalRange::Chunk::compact() {
+    std::string new_values;
+    new_values.reserve((values.size() - garbage_bytes) * 9 / 8);
+    for (size_t i = 0; i < size(); i++) {
+        uint32_t offset = static_cast<uint32_t>(new_values.size());
+        new_values.append(values.data() + value_offsets[i], value_sizes[i]);
+        value_offsets[i] = offset;
     }
+    values.swap(new_values);
+    garbage_bytes = 0;
+}
+
+std::string ContinuousPhysicalRange::toString() const {
+    std::shared_lock<std::shared_mutex> lock(physical_range_mutex_);
+    std::string str = "< " + ToStringPlain(this->startUserKey().ToString()) + " -> " + ToStringPlain(userKeyOf(data->end_internal_key).ToString()) + " >"
+        + " ( len = " + std::to_string(this->length()) + ", chunks = " + std::to_string(data->chunks.size()) + " )";
+    return str;
+}
+
+// ContinuousPhysicalRange implementation
+ContinuousPhysicalRange::ContinuousPhysicalRange(bool valid_) : PhysicalRange(valid_), version(newVersion()) {
+    this->data = std::make_shared<RangeData>();
+}
+
+ContinuousPhysicalRange::~ContinuousPhysicalRange() {
+    data.reset();
+}
+
+ContinuousPhysicalRange::ContinuousPhysicalRange(const ContinuousPhysicalRange& other) : PhysicalRange(other.valid), version(newVersion()) {
+    *this = other;
+}
+
+ContinuousPhysicalRange::ContinuousPhysicalRange(ContinuousPhysicalRange&& other) noexcept : PhysicalRange(other.valid), version(newVersion()) {
+    *this = std::move(other);
 }
 
 ContinuousPhysicalRange& ContinuousPhysicalRange::operator=(const ContinuousPhysicalRange& other) {
@@ -101,44 +192,19 @@ ContinuousPhysicalRange& ContinuousPhysicalRange::operator=(const ContinuousPhys
         this->valid = other.valid;
         this->range_length = other.range_length;
         this->byte_size = other.byte_size;
+        this->delete_length = other.delete_length;
         this->timestamp = other.timestamp;
-        
-        if (other.valid && other.data) {
-            this->data = std::make_shared<RangeData>();
-            
-            // Copy continuous buffers
-            if (other.data->keys_buffer_size > 0) {
-                this->data->keys_buffer = std::make_unique<char[]>(other.data->keys_buffer_size);
-                memcpy(this->data->keys_buffer.get(), other.data->keys_buffer.get(), other.data->keys_buffer_size);
-                this->data->keys_buffer_size = other.data->keys_buffer_size;
-            }
-            
-            if (other.data->values_buffer_size > 0) {
-                this->data->values_buffer = std::make_unique<char[]>(other.data->values_buffer_size);
-                memcpy(this->data->values_buffer.get(), other.data->values_buffer.get(), other.data->values_buffer_size);
-                this->data->values_buffer_size = other.data->values_buffer_size;
-            }
-            
-            // Copy offset and size arrays
-            this->data->key_offsets = other.data->key_offsets;
-            this->data->key_sizes = other.data->key_sizes;
-            this->data->value_offsets = other.data->value_offsets;
-            this->data->value_sizes = other.data->value_sizes;
-            this->data->original_value_sizes = other.data->original_value_sizes;
-            this->data->is_overflow = other.data->is_overflow;
-            
-            // Copy overflow values
-            this->data->overflow_values.resize(other.data->overflow_values.size());
-            for (size_t i = 0; i < other.data->overflow_values.size(); i++) {
-                if (other.data->overflow_values[i]) {
-                    this->data->overflow_values[i] = std::make_unique<std::string>(*other.data->overflow_values[i]);
-                }
+        this->version = newVersion();
+
+        // deep copy of the chunks
+        this->data = std::make_shared<RangeData>();
+        if (other.data) {
+            for (const auto& chunk : other.data->chunks) {
+                this->data->chunks.emplace_back(new Chunk(*chunk));
             }
-            
-            // Rebuild slices
-            rebuildSlices();
-        } else {
-            this->data.reset();
+            this->data->chunk_first_index = other.data->chunk_first_index;
+            this->data->end_internal_key = other.data->end_internal_key;
+            this->data->base_trailer = other.data->base_trailer;
         }
     }
     return *this;
@@ -146,19 +212,20 @@ ContinuousPhysicalRange& ContinuousPhysicalRange::operator=(const ContinuousPhys
 
 ContinuousPhysicalRange& ContinuousPhysicalRange::operator=(ContinuousPhysicalRange&& other) noexcept {
     if (this != &other) {
-        // Clean up current object's resources
-        this->data.reset();
-        
         // Move resources from other
         this->data = std::move(other.data);
         this->valid = other.valid;
         this->range_length = other.range_length;
         this->byte_size = other.byte_size;
+        this->delete_length = other.delete_length;
         this->timestamp = other.timestamp;
+        this->version = newVersion();
 
         // Reset other object's state
         other.valid = false;
         other.range_length = 0;
+        other.byte_size = 0;
+        other.delete_length = 0;
         other.timestamp = 0;
     }
     return *this;
@@ -166,74 +233,168 @@ ContinuousPhysicalRange& ContinuousPhysicalRange::operator=(ContinuousPhysicalRa
 
 std::unique_ptr<ContinuousPhysicalRange> ContinuousPhysicalRange::buildFromReferringRange(const ReferringRange& refRange) {
     auto newRange = std::make_unique<ContinuousPhysicalRange>(true);
-    newRange->initializeFromReferringRange(refRange);
-    
+    // all the entries share the sequence number of the referring range
+    newRange->data->base_trailer = PackSequenceAndType(refRange.getSeqNum(), kTypeRangeCacheValue);
+    std::string internal_key_str;
     for (size_t i = 0; i < refRange.length(); i++) {
-        Slice user_key = refRange.keyAt(i);
-        std::string internal_key_str = InternalKey(user_key, refRange.getSeqNum(), kTypeRangeCacheValue).Encode().ToString();
-        Slice value = refRange.valueAt(i);
-        newRange->emplaceInternal(Slice(internal_key_str), value, i);
+        internal_key_str.clear();
+        AppendInternalKey(&internal_key_str, ParsedInternalKey(refRange.keyAt(i), refRange.getSeqNum(), refRange.isBlobIndexAt(i) ? kTypeBlobIndex : kTypeRangeCacheValue));
+        newRange->emplaceInternal(Slice(internal_key_str), refRange.valueAt(i));
     }
-    
-    newRange->range_length = refRange.length();
-    newRange->byte_size = refRange.keysByteSize() + refRange.valuesByteSize();
-    newRange->rebuildSlices();
+    newRange->finishBuilding();
     return newRange;
 }
 
-// Override virtual functions
-// key methods in continuous physical range does NOT need be read locked since key vector is immutable after initialization (no random insertion)
-const Slice& ContinuousPhysicalRange::startUserKey() const {
-    assert(valid && range_length > 0 && data->key_sizes.size() > 0 && data->key_sizes[0] > internal_key_extra_bytes);
-    return this->data->user_key_slices[0];
+std::unique_ptr<ContinuousPhysicalRange> ContinuousPhysicalRange::buildFromInternalEntries(const std::vector<Slice>& internal_keys, const std::vector<Slice>& values) {
+    assert(internal_keys.size() == values.size());
+    auto newRange = std::make_unique<ContinuousPhysicalRange>(true);
+    if (!internal_keys.empty()) {
+        newRange->data->base_trailer = ExtractInternalKeyFooter(internal_keys[0]);
+    }
+    for (size_t i = 0; i < internal_keys.size(); i++) {
+        newRange->emplaceInternal(internal_keys[i], values[i]);
+        ValueType type = ExtractValueType(internal_keys[i]);
+        if (type == kTypeDeletion || type == kTypeSingleDeletion || type == kTypeDeletionWithTimestamp) {
+            newRange->delete_length++;
+        }
+    }
+    newRange->finishBuilding();
+    return newRange;
+}
+
+void ContinuousPhysicalRange::emplaceInternal(const Slice& internal_key, const Slice& value) {
+    assert(valid);
+    auto& chunks = data->chunks;
+    if (chunks.empty() || chunks.back()->keys.size() + chunks.back()->values.size() >= kChunkTargetBytes) {
+        chunks.emplace_back(new Chunk());
+        chunks.back()->base_trailer = data->base_trailer;
+        data->chunk_first_index.push_back(range_length);
+    }
+    Chunk& chunk = *chunks.back();
+    size_t old_keys_size = chunk.keys.size();
+    // end_internal_key is the previous key while building
+    chunk.append(internal_key, value, userKeyOf(data->end_internal_key));
+    data->end_internal_key.assign(internal_key.data(), internal_key.size());
+    range_length++;
+    byte_size += chunk.keys.size() - old_keys_size + value.size();
 }
 
-const Slice& ContinuousPhysicalRange::endUserKey() const {
-    assert(valid && range_length > 0 && data->key_sizes.size() > 0 && data->key_sizes[range_length - 1] > internal_key_extra_bytes);
-    return this->data->user_key_slices[range_length - 1];
+void ContinuousPhysicalRange::finishBuilding() {
+    // leave 1/8 slack in the chunks for insertions and growing values
+    for (auto& chunk : data->chunks) {
+        chunk->keys.reserve(chunk->keys.size() * 9 / 8);
+        chunk->values.reserve(chunk->values.size() * 9 / 8);
+    }
 }
 
-const Slice& ContinuousPhysicalRange::startInternalKey() const {
-    assert(valid && range_length > 0 && data->key_sizes.size() > 0);
-    return this->data->internal_key_slices[0];
+size_t ContinuousPhysicalRange::chunkOf(size_t index) const {
+    const auto& chunk_first_index = data->chunk_first_index;
+    auto it = std::upper_bound(chunk_first_index.begin(), chunk_first_index.end(), index);
+    assert(it != chunk_first_index.begin());
+    return std::distance(chunk_first_index.begin(), it) - 1;
 }
 
-const Slice& ContinuousPhysicalRange::endInternalKey() const {
-    assert(valid && range_length > 0 && data->key_sizes.size() > 0);
-    return this->data->internal_key_slices[range_length - 1];
+void ContinuousPhysicalRange::splitChunk(size_t chunk) const {
+    auto& chunks = data->chunks;
+    Chunk& old_chunk = *chunks[chunk];
+    size_t half = old_chunk.size() / 2;
+    std::unique_ptr<Chunk> left(new Chunk());
+    std::unique_ptr<Chunk> right(new Chunk());
+    left->base_trailer = old_chunk.base_trailer;
+    right->base_trailer = old_chunk.base_trailer;
+    std::string user_key;
+    std::string prev_user_key;
+    std::string internal_key;
+    uint32_t shared = 0;
+    Slice non_shared;
+    uint64_t trailer = 0;
+    for (size_t i = 0; i < old_chunk.size(); i++) {
+        old_chunk.decodeEntry(i, &shared, &non_shared, &trailer);
+        user_key.resize(shared);
+        user_key.append(non_shared.data(), non_shared.size());
+        internal_key = user_key;
+        PutFixed64(&internal_key, trailer);
+        (i < half ? left : right)->append(internal_key, old_chunk.valueAt(i), prev_user_key);
+        prev_user_key = user_key;
+    }
+    left->keys.reserve(left->keys.size() * 9 / 8);
+    left->values.reserve(left->values.size() * 9 / 8);
+    right->keys.reserve(right->keys.size() * 9 / 8);
+    right->values.reserve(right->values.size() * 9 / 8);
+
+    // the restart points are realigned, so the size of the keys may change
+    byte_size = byte_size - old_chunk.keys.size() + left->keys.size() + right->keys.size();
+    size_t right_first_index = data->chunk_first_index[chunk] + half;
+    chunks[chunk] = std::move(left);
+    chunks.insert(chunks.begin() + chunk + 1, std::move(right));
+    data->chunk_first_index.insert(data->chunk_first_index.begin() + chunk + 1, right_first_index);
 }
 
-const Slice& ContinuousPhysicalRange::internalKeyAt(size_t index) const {
-    assert(valid && range_length > index);
-    return this->data->internal_key_slices[index];
+// Override virtual functions
+// start key does NOT need be read locked since it never changes after initialization (no insertion before it)
+Slice ContinuousPhysicalRange::startUserKey() const {
+    assert(valid && range_length > 0);
+    return data->chunks.front()->restartUserKey(0);
 }
 
-const Slice& ContinuousPhysicalRange::userKeyAt(size_t index) const {
-    return userKeyAtInternal(index);
+Slice ContinuousPhysicalRange::endUserKey() const {
+    std::shared_lock<std::shared_mutex> lock(physical_range_mutex_);
+    assert(valid && range_length > 0);
+    return userKeyOf(data->end_internal_key);
 }
 
-const Slice& ContinuousPhysicalRange::userKeyAtInternal(size_t index) const {
-    assert(valid && range_length > index && data->key_sizes[index] > internal_key_extra_bytes);
-    return this->data->user_key_slices[index];
+Slice ContinuousPhysicalRange::endInternalKey() const {
+    std::shared_lock<std::shared_mutex> lock(physical_range_mutex_);
+    assert(valid && range_length > 0);
+    return Slice(data->end_internal_key);
+}
+
+Slice ContinuousPhysicalRange::readInternalKeyAt(size_t index, PhysicalRangeKeyBuffer* buffer) const {
+    std::shared_lock<std::shared_mutex> lock(physical_range_mutex_);
+    return readInternalKeyAtInternal(index, buffer);
+}
+
+Slice ContinuousPhysicalRange::readInternalKeyAtInternal(size_t index, PhysicalRangeKeyBuffer* buffer) const {
+    assert(valid && range_length > index && buffer);
+    if (buffer->version == version && buffer->index == index) {
+        return Slice(buffer->key);
+    }
+    size_t chunk = chunkOf(index);
+    size_t local_index = index - data->chunk_first_index[chunk];
+    const Chunk& target_chunk = *data->chunks[chunk];
+    if (buffer->version == version && buffer->index + 1 == index && local_index > 0) {
+        // sequential read, apply the delta to the previous key
+        uint32_t shared = 0;
+        Slice non_shared;
+        uint64_t trailer = 0;
+        target_chunk.decodeEntry(local_index, &shared, &non_shared, &trailer);
+        assert(shared + internal_key_extra_bytes <= buffer->key.size());
+        buffer->key.resize(shared);
+        buffer->key.append(non_shared.data(), non_shared.size());
+        PutFixed64(&buffer->key, trailer);
+    } else {
+        target_chunk.keyAt(local_index, &buffer->key);
+    }
+    buffer->version = version;
+    buffer->index = index;
+    return Slice(buffer->key);
 }
 
-const Slice& ContinuousPhysicalRange::valueAt(size_t index) const {
+Slice ContinuousPhysicalRange::valueAt(size_t index) const {
     std::shared_lock<std::shared_mutex> lock(physical_range_mutex_);
     assert(valid && range_length > index);
-    return this->data->value_slices[index];
+    size_t chunk = chunkOf(index);
+    return data->chunks[chunk]->valueAt(index - data->chunk_first_index[chunk]);
 }
 
 PhysicalRangeUpdateResult ContinuousPhysicalRange::update(const Slice& internal_key, const Slice& value) const {
     std::unique_lock<std::shared_mutex> lock(physical_range_mutex_);
-    assert(valid && range_length > 0 && internal_key.size() > internal_key_extra_bytes);    
+    assert(valid && range_length > 0 && internal_key.size() > internal_key_extra_bytes);
     Slice user_key = Slice(internal_key.data(), internal_key.size() - PhysicalRange::internal_key_extra_bytes);
     int index = findInternal(user_key);
-    if (index < 0) {
-        assert(false);
-        return PhysicalRangeUpdateResult::OUT_OF_RANGE;
-    }
+    // index == -1 indicates an tail insertion of middle physical range
 
-    // Update sequence number in key (in-place since size doesn't change)
+    // Parse the internal key to get sequence number
     ParsedInternalKey parsed_internal_key;
     Status s = ParseInternalKey(internal_key, &parsed_internal_key, false);
     if (!s.ok()) {
@@ -245,38 +406,127 @@ PhysicalRangeUpdateResult ContinuousPhysicalRange::update(const Slice& internal_
     bool is_delete_entry = (parsed_internal_key.type == kTypeDeletion || parsed_internal_key.type == kTypeSingleDeletion || parsed_internal_key.type == kTypeDeletionWithTimestamp);
     if (is_delete_entry) {
         // reserve deletion types for range cache
-        type_in_range_cache = parsed_internal_key.type; 
+        type_in_range_cache = parsed_internal_key.type;
+    } else if (parsed_internal_key.type == kTypeBlobIndex) {
+        // the value is a blob reference (BLOB_INDEX range cache)
+        type_in_range_cache = kTypeBlobIndex;
     } else {
         // parsed_internal_key.type should be kTypeValue here
         // TODO(jr): is there any other type that should be considered in range cache?
-        type_in_range_cache = kTypeRangeCacheValue;  
+        type_in_range_cache = kTypeRangeCacheValue;
     }
     std::string new_internal_key_str = InternalKey(user_key, seq_num, type_in_range_cache).Encode().ToString();
+    // keys read into buffers before are outdated
+    version = newVersion();
+
+    std::string found_key;
+    size_t chunk_index = 0;
+    size_t local_index = 0;
+    if (index >= 0) {
+        chunk_index = chunkOf(index);
+        local_index = index - data->chunk_first_index[chunk_index];
+        data->chunks[chunk_index]->keyAt(local_index, &found_key);
+    }
 
+    if (index >= 0 && userKeyOf(found_key) == user_key) {
+        Chunk& chunk = *data->chunks[chunk_index];
+        ValueType old_type = ExtractValueType(found_key);
+        bool was_delete_entry = (old_type == kTypeDeletion || old_type == kTypeSingleDeletion || old_type == kTypeDeletionWithTimestamp);
+
+        // Update key in the chunk, the delta of the next key is rebuilt since the trailer may be shared with it
+        size_t old_keys_size = chunk.keys.size();
+        std::string prev_key;
+        std::string next_key;
+        if (!chunk.isRestart(local_index)) {
+            chunk.keyAt(local_index - 1, &prev_key);
+        }
+        bool reencode_next = local_index + 1 < chunk.size() && !chunk.isRestart(local_index + 1);
+        if (reencode_next) {
+            chunk.keyAt(local_index + 1, &next_key);
+        }
+        chunk.reencodeKey(local_index, userKeyOf(prev_key), new_internal_key_str);
+        if (reencode_next) {
+            chunk.reencodeKey(local_index + 1, user_key, next_key);
+        }
+        byte_size = byte_size + chunk.keys.size() - old_keys_size;
+        if (static_cast<size_t>(index) == range_length - 1) {
+            data->end_internal_key = new_internal_key_str;
+        }
 
-    if (userKeyAtInternal(index) == user_key) {
-        // Update key in continuous buffer (same size, so in-place)
-        memcpy(data->keys_buffer.get() + data->key_offsets[index], 
-               new_internal_key_str.data(), new_internal_key_str.size());
-        
-        // Update value
-        updateValueAt(index, value);
-        
-        // Rebuild affected slices
-        rebuildSlicesAt(index);
-
-        if (is_delete_entry) {
-            delete_length++;
+        // Update value in place if it fits, or append it to the slack of the chunk
+        size_t old_value_size = chunk.value_sizes[local_index];
+        byte_size = byte_size - old_value_size + value.size();
+        if (value.size() <= old_value_size) {
+            memcpy(&chunk.values[chunk.value_offsets[local_index]], value.data(), value.size());
+            chunk.garbage_bytes += old_value_size - value.size();
+        } else {
+            chunk.value_offsets[local_index] = static_cast<uint32_t>(chunk.values.size());
+            chunk.values.append(value.data(), value.size());
+            chunk.garbage_bytes += old_value_size;
         }
+        chunk.value_sizes[local_index] = static_cast<uint32_t>(value.size());
+        if (chunk.garbage_bytes > chunk.values.size() / 2) {
+            chunk.compact();
+        }
+
+        // an overwritten deletion is not counted any more
+        delete_length = delete_length - (was_delete_entry ? 1 : 0) + (is_delete_entry ? 1 : 0);
         return PhysicalRangeUpdateResult::UPDATED;
-    } else if (userKeyAtInternal(index) != user_key) {
-        // continuous physical range does NOT support random insertion
+    } else if (index == -1 || userKeyOf(found_key) != user_key) {
+        assert(index == -1 || userKeyOf(found_key) > user_key);
+        if (index == -1) {
+            // tail insertion
+            chunk_index = data->chunks.size() - 1;
+            local_index = data->chunks.back()->size();
+        } else if (local_index == 0 && chunk_index > 0) {
+            // append to the previous chunk rather than shifting all keys of this one
+            chunk_index--;
+            local_index = data->chunks[chunk_index]->size();
+        }
+        Chunk& chunk = *data->chunks[chunk_index];
+        size_t old_keys_size = chunk.keys.size();
+
+        std::string prev_key;
+        if (local_index > 0) {
+            chunk.keyAt(local_index - 1, &prev_key);
+        }
+        if (local_index == chunk.size()) {
+            chunk.append(new_internal_key_str, value, userKeyOf(prev_key));
+        } else {
+            // shift the keys after the insertion position in the chunk, and append the value to the slack
+            bool reencode_next = !chunk.isRestart(local_index);
+            std::string next_key;
+            if (reencode_next) {
+                chunk.keyAt(local_index, &next_key);
+            }
+            chunk.insertEncodedKey(local_index, userKeyOf(prev_key), new_internal_key_str);
+            chunk.value_offsets.insert(chunk.value_offsets.begin() + local_index, static_cast<uint32_t>(chunk.values.size()));
+            chunk.value_sizes.insert(chunk.value_sizes.begin() + local_index, static_cast<uint32_t>(value.size()));
+            chunk.values.append(value.data(), value.size());
+            if (reencode_next) {
+                chunk.reencodeKey(local_index + 1, user_key, next_key);
+            }
+            chunk.splitRestartInterval(local_index);
+        }
+        byte_size = byte_size + chunk.keys.size() - old_keys_size + value.size();
+        if (index == -1) {
+            data->end_internal_key = new_internal_key_str;
+        }
+
+        for (size_t i = chunk_index + 1; i < data->chunk_first_index.size(); i++) {
+            data->chunk_first_index[i]++;
+        }
+        if (chunk.keys.size() + chunk.values.size() - chunk.garbage_bytes > kChunkMaxBytes && chunk.size() > 1) {
+            splitChunk(chunk_index);
+        }
+
+        range_length++;
         if (is_delete_entry) {
             delete_length++;
         }
-        return PhysicalRangeUpdateResult::UNABLE_TO_INSERT;
+        return PhysicalRangeUpdateResult::INSERTED;
     }
-    
+
     return PhysicalRangeUpdateResult::ERROR;
 }
 
@@ -291,147 +541,56 @@ int ContinuousPhysicalRange::findInternal(const Slice& key) const {
     if (!valid || range_length == 0) {
         return -1;
     }
-    
-    int left = 0;
-    int right = range_length - 1;
-    
-    while (left <= right) {
-        int mid = left + (right - left) / 2;
-        Slice mid_user_key = userKeyAtInternal(mid);
-        if (mid_user_key == key) {
-            return mid;
-        } else if (mid_user_key < key) {
+
+    // the last chunk whose first key <= key
+    const auto& chunks = data->chunks;
+    auto chunk_it = std::upper_bound(chunks.begin(), chunks.end(), key,
+        [](const Slice& key_, const std::unique_ptr<Chunk>& chunk) {
+            return key_.compare(chunk->restartUserKey(0)) < 0;
+        });
+    if (chunk_it != chunks.begin()) {
+        --chunk_it;
+    }
+    const Chunk& chunk = **chunk_it;
+
+    // the first restart point whose key >= key, the target is in the restart interval before it (or is it)
+    size_t left = 0;
+    size_t right = chunk.restarts.size();
+    while (left < right) {
+        size_t mid = left + (right - left) / 2;
+        if (chunk.restartUserKey(mid).compare(key) < 0) {
             left = mid + 1;
         } else {
-            right = mid - 1;
+            right = mid;
         }
     }
-    
-    if ((size_t)left >= range_length) {
-        return -1;
-    }
-    return left;
-}
-
-void ContinuousPhysicalRange::reserve(size_t len) {
-    std::unique_lock<std::shared_mutex> lock(physical_range_mutex_);
-    assert(valid);
-    data->key_offsets.reserve(len);
-    data->key_sizes.reserve(len);
-    data->value_offsets.reserve(len);
-    data->value_sizes.reserve(len);
-    data->original_value_sizes.reserve(len);
-    data->is_overflow.reserve(len);
-    data->overflow_values.reserve(len);
-    data->internal_key_slices.reserve(len);
-    data->user_key_slices.reserve(len);
-    data->value_slices.reserve(len);
-}
-
-void ContinuousPhysicalRange::initializeFromReferringRange(const ReferringRange& refRange) {
-    size_t keys_total_size = refRange.keysByteSize();
-    size_t values_total_size = refRange.valuesByteSize();
-    
-    // Allocate continuous buffers
-    data->keys_buffer = std::make_unique<char[]>(keys_total_size);
-    data->values_buffer = std::make_unique<char[]>(values_total_size);
-    data->keys_buffer_size = keys_total_size;
-    data->values_buffer_size = values_total_size;
-    
-    // Reserve vectors
-    reserve(refRange.length());
-}
-
-void ContinuousPhysicalRange::initializeFromReferringRangeSubset(const ReferringRange& refRange, int start_pos, int end_pos) {
-    size_t num_elements = end_pos - start_pos + 1;
-    size_t keys_total_size = 0;
-    size_t values_total_size = 0;
-    
-    for (int i = start_pos; i <= end_pos; i++) {
-        keys_total_size += refRange.keyAt(i).size() + internal_key_extra_bytes;
-        values_total_size += refRange.valueAt(i).size();
-    }
-    
-    data->keys_buffer = std::make_unique<char[]>(keys_total_size);
-    data->values_buffer = std::make_unique<char[]>(values_total_size);
-    data->keys_buffer_size = keys_total_size;
-    data->values_buffer_size = values_total_size;
-    
-    reserve(num_elements);
-}
-
-void ContinuousPhysicalRange::emplaceInternal(const Slice& internal_key, const Slice& value, size_t index) {
-    assert(valid);
-    // Calculate offsets
-    size_t key_offset = (index == 0) ? 0 : data->key_offsets[index - 1] + data->key_sizes[index - 1];
-    size_t value_offset = (index == 0) ? 0 : data->value_offsets[index - 1] + data->value_sizes[index - 1];
-    
-    // Store key
-    memcpy(data->keys_buffer.get() + key_offset, internal_key.data(), internal_key.size());
-    data->key_offsets.emplace_back(key_offset);
-    data->key_sizes.emplace_back(internal_key.size());
-    
-    // Store value
-    memcpy(data->values_buffer.get() + value_offset, value.data(), value.size());
-    data->value_offsets.emplace_back(value_offset);
-    data->value_sizes.emplace_back(value.size());
-    data->original_value_sizes.emplace_back(value.size()); // Record original size
-    data->is_overflow.emplace_back(false);
-    data->overflow_values.emplace_back(nullptr);
-}
-
-void ContinuousPhysicalRange::updateValueAt(size_t index, const Slice& new_value) const {
-    size_t original_size = data->original_value_sizes[index]; // Use original size
-    
-    if (new_value.size() <= original_size) {
-        // Can fit in original space
-        if (data->is_overflow[index]) {
-            // Move back from overflow to continuous storage
-            data->overflow_values[index].reset();
-            data->is_overflow[index] = false;
-        }
-        
-        // Update in continuous buffer
-        memcpy(data->values_buffer.get() + data->value_offsets[index], 
-               new_value.data(), new_value.size());
-        data->value_sizes[index] = new_value.size();
-    } else {
-        // Need overflow storage
-        if (!data->is_overflow[index]) {
-            data->overflow_values[index] = std::make_unique<std::string>();
-            data->is_overflow[index] = true;
+    size_t local_index = 0;
+    if (left > 0) {
+        size_t interval_end = left == chunk.restarts.size() ? chunk.size() : chunk.restarts[left];
+        std::string current_user_key;
+        uint32_t shared = 0;
+        Slice non_shared;
+        uint64_t trailer = 0;
+        for (local_index = chunk.restarts[left - 1]; local_index < interval_end; local_index++) {
+            chunk.decodeEntry(local_index, &shared, &non_shared, &trailer);
+            current_user_key.resize(shared);
+            current_user_key.append(non_shared.data(), non_shared.size());
+            if (Slice(current_user_key).compare(key) >= 0) {
+                break;
+            }
         }
-        *data->overflow_values[index] = new_value.ToString();
-        data->value_sizes[index] = new_value.size();
     }
-}
 
-void ContinuousPhysicalRange::rebuildSlices() const {
-    data->internal_key_slices.clear();
-    data->user_key_slices.clear();
-    data->value_slices.clear();
-    
-    for (size_t i = 0; i < range_length; i++) {
-        data->internal_key_slices.emplace_back(data->keys_buffer.get() + data->key_offsets[i], data->key_sizes[i]);
-        data->user_key_slices.emplace_back(data->keys_buffer.get() + data->key_offsets[i], data->key_sizes[i] - internal_key_extra_bytes);
-        
-        if (data->is_overflow[i]) {
-            data->value_slices.emplace_back(*data->overflow_values[i]);
-        } else {
-            data->value_slices.emplace_back(data->values_buffer.get() + data->value_offsets[i], data->value_sizes[i]);
-        }
+    // the first key of the next chunk if all keys in the chunk are smaller
+    size_t index = data->chunk_first_index[std::distance(chunks.begin(), chunk_it)] + local_index;
+    if (index >= range_length) {
+        return -1;
     }
+    return static_cast<int>(index);
 }
 
-void ContinuousPhysicalRange::rebuildSlicesAt(size_t index) const {
-    data->internal_key_slices[index] = Slice(data->keys_buffer.get() + data->key_offsets[index], data->key_sizes[index]);
-    data->user_key_slices[index] = Slice(data->keys_buffer.get() + data->key_offsets[index], data->key_sizes[index] - internal_key_extra_bytes);
-    
-    if (data->is_overflow[index]) {
-        data->value_slices[index] = Slice(*data->overflow_values[index]);
-    } else {
-        data->value_slices[index] = Slice(data->values_buffer.get() + data->value_offsets[index], data->value_sizes[index]);
-    }
+void ContinuousPhysicalRange::reserve(size_t len) {
+    // chunks grow on demand
 }
 
 }  // namespace ROCKSDB_NAMESPACE
@@ -0,0 +1,348 @@
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+#include <mutex>
+#include "db/dbformat.h"
+#include "rocksdb/fixed_key_physical_range.h"
+
+namespace ROCKSDB_NAMESPACE {
+
+template <size_t KeyLen>
+int FixedKeyPhysicalRange<KeyLen>::compareUserKey(const char* entry, const Slice& key) {
+    if (key.size() == KeyLen) {
+        // constant size, inlined by the compiler
+        return memcmp(entry, key.data(), KeyLen);
+    }
+    return Slice(entry, KeyLen).compare(key);
+}
+
+template <size_t KeyLen>
+std::string FixedKeyPhysicalRange<KeyLen>::toString() const {
+    std::shared_lock<std::shared_mutex> lock(physical_range_mutex_);
+    const Chunk& last_chunk = *data->chunks.back();
+    std::string str = "< " + ToStringPlain(this->startUserKey().ToString()) + " -> "
+        + ToStringPlain(Slice(last_chunk.entryAt(last_chunk.size() - 1), KeyLen).ToString()) + " >"
+        + " ( len = " + std::to_string(this->length()) + ", key size = " + std::to_string(KeyLen) + " )";
+    return str;
+}
+
+template <size_t KeyLen>
+FixedKeyPhysicalRange<KeyLen>::FixedKeyPhysicalRange(bool valid_) : PhysicalRange(valid_) {
+    this->data = std::make_shared<RangeData>();
+}
+
+template <size_t KeyLen>
+std::unique_ptr<FixedKeyPhysicalRange<KeyLen>> FixedKeyPhysicalRange<KeyLen>::buildFromReferringRange(const ReferringRange& refRange) {
+    auto newRange = std::make_unique<FixedKeyPhysicalRange<KeyLen>>(true);
+    std::string internal_key_str;
+    for (size_t i = 0; i < refRange.length(); i++) {
+        Slice user_key = refRange.keyAt(i);
+        if (user_key.size() != KeyLen) {
+            return nullptr;
+        }
+        internal_key_str.clear();
+        AppendInternalKey(&internal_key_str, ParsedInternalKey(user_key, refRange.getSeqNum(), refRange.isBlobIndexAt(i) ? kTypeBlobIndex : kTypeRangeCacheValue));
+        newRange->emplaceInternal(Slice(internal_key_str), refRange.valueAt(i));
+    }
+    return newRange;
+}
+
+template <size_t KeyLen>
+std::unique_ptr<FixedKeyPhysicalRange<KeyLen>> FixedKeyPhysicalRange<KeyLen>::buildFromInternalEntries(const std::vector<Slice>& internal_keys,
+                                                                                                     const std::vector<Slice>& values) {
+    assert(internal_keys.size() == values.size());
+    auto newRange = std::make_unique<FixedKeyPhysicalRange<KeyLen>>(true);
+    for (size_t i = 0; i < internal_keys.size(); i++) {
+        if (internal_keys[i].size() != kEntrySize) {
+            return nullptr;
+        }
+        newRange->emplaceInternal(internal_keys[i], values[i]);
+        ValueType type = ExtractValueType(internal_keys[i]);
+        if (type == kTypeDeletion || type == kTypeSingleDeletion || type == kTypeDeletionWithTimestamp) {
+            newRange->delete_length++;
+        }
+    }
+    return newRange;
+}
+
+template <size_t KeyLen>
+void FixedKeyPhysicalRange<KeyLen>::emplaceInternal(const Slice& internal_key, const Slice& value) {
+    assert(valid && internal_key.size() == kEntrySize);
+    auto& chunks = data->chunks;
+    if (chunks.empty() || chunks.back()->size() >= kChunkTargetEntries) {
+        chunks.emplace_back(new Chunk());
+        chunks.back()->entries.reserve(kChunkMaxEntries * kEntrySize);
+        chunks.back()->values.reserve(kChunkMaxEntries);
+        data->chunk_first_index.push_back(range_length);
+    }
+    chunks.back()->entries.append(internal_key.data(), kEntrySize);
+    chunks.back()->values.emplace_back(value.data(), value.size());
+    range_length++;
+    byte_size += kEntrySize + value.size();
+}
+
+template <size_t KeyLen>
+size_t FixedKeyPhysicalRange<KeyLen>::chunkOf(size_t index) const {
+    const auto& chunk_first_index = data->chunk_first_index;
+    auto it = std::upper_bound(chunk_first_index.begin(), chunk_first_index.end(), index);
+    assert(it != chunk_first_index.begin());
+    return std::distance(chunk_first_index.begin(), it) - 1;
+}
+
+template <size_t KeyLen>
+void FixedKeyPhysicalRange<KeyLen>::splitChunk(size_t chunk) const {
+    auto& chunks = data->chunks;
+    Chunk& old_chunk = *chunks[chunk];
+    size_t half = old_chunk.size() / 2;
+    std::unique_ptr<Chunk> right(new Chunk());
+    right->entries.reserve(kChunkMaxEntries * kEntrySize);
+    right->values.reserve(kChunkMaxEntries);
+    right->entries.assign(old_chunk.entries, half * kEntrySize, std::string::npos);
+    std::move(old_chunk.values.begin() + half, old_chunk.values.end(), std::back_inserter(right->values));
+    old_chunk.entries.resize(half * kEntrySize);
+    old_chunk.values.resize(half);
+
+    size_t right_first_index = data->chunk_first_index[chunk] + half;
+    chunks.insert(chunks.begin() + chunk + 1, std::move(right));
+    data->chunk_first_index.insert(data->chunk_first_index.begin() + chunk + 1, right_first_index);
+}
+
+template <size_t KeyLen>
+const char* FixedKeyPhysicalRange<KeyLen>::entryAtInternal(size_t index) const {
+    assert(valid && range_length > index);
+    size_t chunk = chunkOf(index);
+    return data->chunks[chunk]->entryAt(index - data->chunk_first_index[chunk]);
+}
+
+// start key does NOT need be read locked since it never changes after initialization (no insertion before it)
+template <size_t KeyLen>
+Slice FixedKeyPhysicalRange<KeyLen>::startUserKey() const {
+    assert(valid && range_length > 0);
+    return Slice(data->chunks.front()->entryAt(0), KeyLen);
+}
+
+template <size_t KeyLen>
+Slice FixedKeyPhysicalRange<KeyLen>::endUserKey() const {
+    std::shared_lock<std::shared_mutex> lock(physical_range_mutex_);
+    assert(valid && range_length > 0);
+    const Chunk& chunk = *data->chunks.back();
+    return Slice(chunk.entryAt(chunk.size() - 1), KeyLen);
+}
+
+template <size_t KeyLen>
+Slice FixedKeyPhysicalRange<KeyLen>::startInternalKey() const {
+    std::shared_lock<std::shared_mutex> lock(physical_range_mutex_);
+    assert(valid && range_length > 0);
+    return Slice(data->chunks.front()->entryAt(0), kEntrySize);
+}
+
+template <size_t KeyLen>
+Slice FixedKeyPhysicalRange<KeyLen>::endInternalKey() const {
+    std::shared_lock<std::shared_mutex> lock(physical_range_mutex_);
+    assert(valid && range_length > 0);
+    const Chunk& chunk = *data->chunks.back();
+    return Slice(chunk.entryAt(chunk.size() - 1), kEntrySize);
+}
+
+template <size_t KeyLen>
+Slice FixedKeyPhysicalRange<KeyLen>::internalKeyAt(size_t index) const {
+    std::shared_lock<std::shared_mutex> lock(physical_range_mutex_);
+    return Slice(entryAtInternal(index), kEntrySize);
+}
+
+template <size_t KeyLen>
+Slice FixedKeyPhysicalRange<KeyLen>::userKeyAt(size_t index) const {
+    std::shared_lock<std::shared_mutex> lock(physical_range_mutex_);
+    return Slice(entryAtInternal(index), KeyLen);
+}
+
+template <size_t KeyLen>
+Slice FixedKeyPhysicalRange<KeyLen>::valueAt(size_t index) const {
+    std::shared_lock<std::shared_mutex> lock(physical_range_mutex_);
+    assert(valid && range_length > index);
+    size_t chunk = chunkOf(index);
+    return Slice(data->chunks[chunk]->values[index - data->chunk_first_index[chunk]]);
+}
+
+template <size_t KeyLen>
+PhysicalRangeUpdateResult FixedKeyPhysicalRange<KeyLen>::update(const Slice& internal_key, const Slice& value) const {
+    std::unique_lock<std::shared_mutex> lock(physical_range_mutex_);
+    assert(valid && range_length > 0 && internal_key.size() > internal_key_extra_bytes);
+    if (internal_key.size() != kEntrySize) {
+        // the range is rebuilt with variable size keys by the cache
+        return PhysicalRangeUpdateResult::UNABLE_TO_INSERT;
+    }
+    Slice user_key = Slice(internal_key.data(), KeyLen);
+    int index = findInternal(user_key);
+    // index == -1 indicates an tail insertion of middle physical range
+
+    // Parse the internal key to get sequence number
+    ParsedInternalKey parsed_internal_key;
+    Status s = ParseInternalKey(internal_key, &parsed_internal_key, false);
+    if (!s.ok()) {
+        return PhysicalRangeUpdateResult::ERROR;
+    }
+    SequenceNumber seq_num = parsed_internal_key.sequence;
+    // Create new internal key with correct type for range cache
+    ValueType type_in_range_cache;
+    bool is_delete_entry = (parsed_internal_key.type == kTypeDeletion || parsed_internal_key.type == kTypeSingleDeletion || parsed_internal_key.type == kTypeDeletionWithTimestamp);
+    if (is_delete_entry) {
+        // reserve deletion types for range cache
+        type_in_range_cache = parsed_internal_key.type;
+    } else if (parsed_internal_key.type == kTypeBlobIndex) {
+        // the value is a blob reference (BLOB_INDEX range cache)
+        type_in_range_cache = kTypeBlobIndex;
+    } else {
+        // parsed_internal_key.type should be kTypeValue here
+        // TODO(jr): is there any other type that should be considered in range cache?
+        type_in_range_cache = kTypeRangeCacheValue;
+    }
+    std::string new_internal_key_str = InternalKey(user_key, seq_num, type_in_range_cache).Encode().ToString();
+
+    size_t chunk_index = 0;
+    size_t local_index = 0;
+    if (index >= 0) {
+        chunk_index = chunkOf(index);
+        local_index = index - data->chunk_first_index[chunk_index];
+    }
+
+    if (index >= 0 && compareUserKey(data->chunks[chunk_index]->entryAt(local_index), user_key) == 0) {
+        Chunk& chunk = *data->chunks[chunk_index];
+        ValueType old_type = ExtractValueType(Slice(chunk.entryAt(local_index), kEntrySize));
+        bool was_delete_entry = (old_type == kTypeDeletion || old_type == kTypeSingleDeletion || old_type == kTypeDeletionWithTimestamp);
+        // same size, so in place
+        memcpy(&chunk.entries[local_index * kEntrySize], new_internal_key_str.data(), kEntrySize);
+        byte_size = byte_size - chunk.values[local_index].size() + value.size();
+        chunk.values[local_index].assign(value.data(), value.size());
+
+        // an overwritten deletion is not counted any more
+        delete_length = delete_length - (was_delete_entry ? 1 : 0) + (is_delete_entry ? 1 : 0);
+        return PhysicalRangeUpdateResult::UPDATED;
+    } else {
+        assert(index == -1 || compareUserKey(data->chunks[chunk_index]->entryAt(local_index), user_key) > 0);
+        if (index == -1) {
+            // tail insertion
+            chunk_index = data->chunks.size() - 1;
+            local_index = data->chunks.back()->size();
+        } else if (local_index == 0 && chunk_index > 0) {
+            // append to the previous chunk rather than shifting all entries of this one
+            chunk_index--;
+            local_index = data->chunks[chunk_index]->size();
+        }
+
+        // only the entries of one chunk are shifted
+        Chunk& chunk = *data->chunks[chunk_index];
+        chunk.entries.insert(local_index * kEntrySize, new_internal_key_str);
+        chunk.values.insert(chunk.values.begin() + local_index, value.ToString());
+        for (size_t i = chunk_index + 1; i < data->chunk_first_index.size(); i++) {
+            data->chunk_first_index[i]++;
+        }
+        if (chunk.size() > kChunkMaxEntries) {
+            splitChunk(chunk_index);
+        }
+
+        range_length++;
+        byte_size += kEntrySize + value.size();
+        if (is_delete_entry) {
+            delete_length++;
+        }
+        return PhysicalRangeUpdateResult::INSERTED;
+    }
+}
+
+template <size_t KeyLen>
+int FixedKeyPhysicalRange<KeyLen>::find(const Slice& key) const {
+    std::shared_lock<std::shared_mutex> lock(physical_range_mutex_);
+    return findInternal(key);
+}
+
+template <size_t KeyLen>
+int FixedKeyPhysicalRange<KeyLen>::findInternal(const Slice& key) const {
+    assert(valid && range_length > 0 && key.size() > 0);
+
+    if (!valid || range_length == 0) {
+        return -1;
+    }
+
+    // the last chunk whose first key <= key
+    const auto& chunks = data->chunks;
+    size_t left = 0;
+    size_t right = chunks.size();
+    while (left < right) {
+        size_t mid = left + (right - left) / 2;
+        if (compareUserKey(chunks[mid]->entryAt(0), key) <= 0) {
+            left = mid + 1;
+        } else {
+            right = mid;
+        }
+    }
+    size_t chunk_index = left == 0 ? 0 : left - 1;
+
+    // the first key >= key in the chunk, positions are computed from the fixed entry size
+    const Chunk& chunk = *chunks[chunk_index];
+    left = 0;
+    right = chunk.size();
+    while (left < right) {
+        size_t mid = left + (right - left) / 2;
+        if (compareUserKey(chunk.entryAt(mid), key) < 0) {
+            left = mid + 1;
+        } else {
+            right = mid;
+        }
+    }
+
+    // the first key of the next chunk if all keys in the chunk are smaller
+    size_t index = data->chunk_first_index[chunk_index] + left;
+    if (index >= range_length) {
+        return -1;
+    }
+    return static_cast<int>(index);
+}
+
+template <size_t KeyLen>
+void FixedKeyPhysicalRange<KeyLen>::reserve(size_t len) {
+    // chunks grow on demand
+}
+
+template class FixedKeyPhysicalRange<8>;
+template class FixedKeyPhysicalRange<16>;
+template class FixedKeyPhysicalRange<24>;
+template class FixedKeyPhysicalRange<32>;
+
+std::unique_ptr<PhysicalRange> buildFixedKeyPhysicalRangeFromReferringRange(const ReferringRange& refRange) {
+    if (refRange.length() == 0) {
+        return nullptr;
+    }
+    switch (refRange.keyAt(0).size()) {
+        case 8:
+            return FixedKeyPhysicalRange<8>::buildFromReferringRange(refRange);
+        case 16:
+            return FixedKeyPhysicalRange<16>::buildFromReferringRange(refRange);
+        case 24:
+            return FixedKeyPhysicalRange<24>::buildFromReferringRange(refRange);
+        case 32:
+            return FixedKeyPhysicalRange<32>::buildFromReferringRange(refRange);
+        default:
+            return nullptr;
+    }
+}
+
+std::unique_ptr<PhysicalRange> buildFixedKeyPhysicalRangeFromInternalEntries(const std::vector<Slice>& internal_keys, const std::vector<Slice>& values) {
+    if (internal_keys.empty()) {
+        return nullptr;
+    }
+    switch (internal_keys[0].size() - PhysicalRange::internal_key_extra_bytes) {
+        case 8:
+            return FixedKeyPhysicalRange<8>::buildFromInternalEntries(internal_keys, values);
+        case 16:
+            return FixedKeyPhysicalRange<16>::buildFromInternalEntries(internal_keys, values);
+        case 24:
+            return FixedKeyPhysicalRange<24>::buildFromInternalEntries(internal_keys, values);
+        case 32:
+            return FixedKeyPhysicalRange<32>::buildFromInternalEntries(internal_keys, values);
+        default:
+            return nullptr;
+    }
+}
+
+}  // namespace ROCKSDB_NAMESPACE
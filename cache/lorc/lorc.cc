@@ -1,14 +1,29 @@
+#include <algorithm>
+#include "cache/cache_reservation_manager.h"
+#include "rocksdb/cache.h"
 #include "rocksdb/lorc.h"
+#include "rocksdb/lorc_budget.h"
+#include "rocksdb/slice_transform.h"
 
 namespace ROCKSDB_NAMESPACE {
 
 LogicalOrderedRangeCache::LogicalOrderedRangeCache(size_t capacity_, LorcLogger::Level logger_level_, PhysicalRangeType physical_range_type_)
     : capacity(capacity_), logger(LorcLogger(logger_level_)), physical_range_type(physical_range_type_),
     ranges_view(LogicalRangesView()), current_size(0), total_range_length(0), range_cache_seq_num(kMinUnCommittedSeq), enable_statistic(false), cache_statistic(CacheStatistic()), 
+    hot_ranges_persist_num(0), budget(nullptr), budget_tenant(false), budget_capacity(0), charged_cache(nullptr), cache_res_mgr(nullptr), effective_capacity(capacity_),
+    effective_capacity_refresh_micros(0), ghost_ratio(0), ghost_size(0), ghost_hit_bytes(0), ghost_generation(0),
+    memory_tuner(nullptr), skip_blob_cache_fill(false), blob_cache_value_sharing(0),
+    blob_cache_max_pinned_ratio(0.5), blob_cache_pins(std::make_shared<BlobCachePins>()), secondary_tier(nullptr),
+    cold_range_compression(kNoCompression), cold_access_frequency(0), defragment_min_physical_ranges(0),
+    scan_prefetch_max_bytes(0), scan_stream_clock(0), scan_prefetch_issued(0), scan_prefetch_hits(0), scan_prefetch_wasted(0),
+    prefix_extractor(nullptr), prefix_soft_quota(0), prefix_hard_quota(0), prefix_quotas_changed(false),
     full_hit_count(0), full_query_count(0), hit_size(0), query_size(0) {
 }
 
 LogicalOrderedRangeCache::~LogicalOrderedRangeCache() {
+    if (budget_tenant) {
+        budget->removeRangeCache(this);
+    }
 }
 
 bool LogicalOrderedRangeCache::enableStatistic() const {
@@ -54,4 +69,391 @@ double LogicalOrderedRangeCache::hitSizeRate() const {
     return (double)hit_size / query_size;
 }
 
+void LogicalOrderedRangeCache::refreshEffectiveCapacity() {
+    // charged_cache and cache_res_mgr are only changed under write lock
+    lockRead();
+    if (!cache_res_mgr) {
+        unlockRead();
+        return;
+    }
+    // Our own reservation is pinned by dummy entries, so the memory pinned by others is
+    // what we can never take. Unpinned entries of others are evicted by growing our reservation.
+    size_t shared_capacity = charged_cache->GetCapacity();
+    size_t usage = charged_cache->GetUsage();
+    size_t pinned_usage = charged_cache->GetPinnedUsage();
+    size_t reserved = cache_res_mgr->GetTotalReservedCacheSize();
+    size_t others_pinned_usage = pinned_usage > reserved ? pinned_usage - reserved : 0;
+    size_t available = shared_capacity > others_pinned_usage ? shared_capacity - others_pinned_usage : 0;
+    // grow beyond capacity only into the free part of the shared cache
+    size_t free_size = shared_capacity > usage ? shared_capacity - usage : 0;
+    size_t target = std::max(capacity, reserved + free_size);
+    size_t new_effective_capacity = std::min(target, available);
+    unlockRead();
+
+    // use atomic write
+    auto* atomic_capacity = reinterpret_cast<std::atomic<size_t>*>(&effective_capacity);
+    atomic_capacity->store(new_effective_capacity, std::memory_order_relaxed);
+    auto* atomic_refresh_micros = reinterpret_cast<std::atomic<uint64_t>*>(&effective_capacity_refresh_micros);
+    atomic_refresh_micros->store(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count()), std::memory_order_relaxed);
+}
+
+void LogicalOrderedRangeCache::maybeRefreshEffectiveCapacity() {
+    static const uint64_t kEffectiveCapacityRefreshIntervalMicros = 1000000;
+    if (!cache_res_mgr) {
+        return;
+    }
+    auto* atomic_refresh_micros = reinterpret_cast<std::atomic<uint64_t>*>(&effective_capacity_refresh_micros);
+    uint64_t last_refresh_micros = atomic_refresh_micros->load(std::memory_order_relaxed);
+    uint64_t now_micros = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+    // only one of the concurrent callers refreshes
+    if (now_micros < last_refresh_micros + kEffectiveCapacityRefreshIntervalMicros ||
+        !atomic_refresh_micros->compare_exchange_strong(last_refresh_micros, now_micros, std::memory_order_relaxed)) {
+        return;
+    }
+    refreshEffectiveCapacity();
+}
+
+void LogicalOrderedRangeCache::setChargedCache(std::shared_ptr<Cache> charged_cache_) {
+    lockWrite();
+    // release the reservation in the previous charged cache
+    cache_res_mgr.reset();
+    charged_cache = charged_cache_;
+    if (charged_cache) {
+        cache_res_mgr = std::make_shared<ConcurrentCacheReservationManager>(
+            std::make_shared<CacheReservationManagerImpl<CacheEntryRole::kRangeCache>>(charged_cache, true /* delayed_decrease */));
+        updateCacheReservation();
+    }
+    unlockWrite();
+    if (charged_cache_) {
+        refreshEffectiveCapacity();
+    }
+}
+
+void LogicalOrderedRangeCache::updateCacheReservation() {
+    if (!cache_res_mgr) {
+        return;
+    }
+    Status s = cache_res_mgr->UpdateCacheReservation(current_size);
+    if (!s.ok()) {
+        // the shared cache is full of pinned entries (strict capacity limit), victim() will shrink the cache
+        // to the effective capacity
+        logger.warn("Failed to reserve " + std::to_string(current_size) + " bytes in the charged cache: " + s.ToString());
+    }
+}
+
+void LogicalOrderedRangeCache::copySettingsTo(LogicalOrderedRangeCache* tenant) const {
+    tenant->logger = logger;
+    tenant->enable_statistic = enable_statistic;
+    tenant->hot_ranges_persist_num = hot_ranges_persist_num;
+    tenant->budget = budget;
+    tenant->budget_tenant = true;
+    tenant->ghost_ratio = ghost_ratio;
+    tenant->skip_blob_cache_fill = skip_blob_cache_fill;
+    tenant->blob_cache_value_sharing = blob_cache_value_sharing;
+    tenant->blob_cache_max_pinned_ratio = blob_cache_max_pinned_ratio;
+    tenant->cold_range_compression = cold_range_compression;
+    tenant->cold_access_frequency = cold_access_frequency;
+    tenant->defragment_min_physical_ranges = defragment_min_physical_ranges;
+    tenant->scan_prefetch_max_bytes = scan_prefetch_max_bytes;
+    tenant->prefix_extractor = prefix_extractor;
+    tenant->prefix_soft_quota = prefix_soft_quota;
+    tenant->prefix_hard_quota = prefix_hard_quota;
+    tenant->prefix_quotas = prefix_quotas;
+}
+
+LogicalOrderedRangeCache::BlobCacheSharingStats LogicalOrderedRangeCache::getBlobCacheSharingStats() const {
+    BlobCacheSharingStats stats;
+    stats.pinned_values = blob_cache_pins->pinned_values.load(std::memory_order_relaxed);
+    stats.pinned_bytes = blob_cache_pins->pinned_bytes.load(std::memory_order_relaxed);
+    stats.shared_values = blob_cache_pins->shared_values.load(std::memory_order_relaxed);
+    stats.refused_values = blob_cache_pins->refused_values.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void LogicalOrderedRangeCache::setGhostRatio(double ghost_ratio_) {
+    lockWrite();
+    this->ghost_ratio = ghost_ratio_;
+    if (ghost_ratio <= 0) {
+        ghost_ranges.clear();
+        ghost_ranges_fifo.clear();
+        ghost_size = 0;
+    }
+    unlockWrite();
+}
+
+void LogicalOrderedRangeCache::putGhostRange(const Slice& start_user_key, const Slice& end_user_key, size_t byte_size) {
+    if (ghost_ratio <= 0 || byte_size == 0) {
+        return;
+    }
+    uint64_t generation = ++ghost_generation;
+    auto res = ghost_ranges.emplace(start_user_key.ToString(), GhostRange{end_user_key.ToString(), byte_size, generation});
+    if (!res.second) {
+        // replace the ghost range with the same start key, its fifo entry becomes stale
+        ghost_size -= res.first->second.byte_size;
+        res.first->second = GhostRange{end_user_key.ToString(), byte_size, generation};
+    }
+    ghost_ranges_fifo.emplace_back(start_user_key.ToString(), generation);
+    ghost_size += byte_size;
+
+    // forget the oldest ghost ranges, and skip the stale fifo entries (of replaced or hit ghost ranges)
+    size_t ghost_capacity = getGhostCapacity();
+    while (!ghost_ranges_fifo.empty() &&
+           (ghost_size > ghost_capacity || ghost_ranges_fifo.size() > 2 * ghost_ranges.size())) {
+        auto& oldest = ghost_ranges_fifo.front();
+        auto it = ghost_ranges.find(oldest.first);
+        if (it != ghost_ranges.end() && it->second.generation == oldest.second) {
+            ghost_size -= it->second.byte_size;
+            ghost_ranges.erase(it);
+        }
+        ghost_ranges_fifo.pop_front();
+    }
+}
+
+void LogicalOrderedRangeCache::checkGhostRange(const Slice& start_user_key, const Slice& end_user_key, size_t byte_size) {
+    if (ghost_ranges.empty()) {
+        return;
+    }
+    // start from the last ghost range starting before start_user_key if it overlaps
+    auto it = ghost_ranges.upper_bound(start_user_key.ToString());
+    if (it != ghost_ranges.begin()) {
+        auto prev = std::prev(it);
+        if (Slice(prev->second.end_user_key) >= start_user_key) {
+            it = prev;
+        }
+    }
+    size_t hit_ghost_size = 0;
+    while (it != ghost_ranges.end() && Slice(it->first) <= end_user_key) {
+        // the fifo entry becomes stale
+        hit_ghost_size += it->second.byte_size;
+        ghost_size -= it->second.byte_size;
+        it = ghost_ranges.erase(it);
+    }
+    if (hit_ghost_size > 0) {
+        // the bytes that would have been hits with a larger cache
+        auto* atomic_bytes = reinterpret_cast<std::atomic<uint64_t>*>(&ghost_hit_bytes);
+        atomic_bytes->fetch_add(std::min(byte_size, hit_ghost_size), std::memory_order_relaxed);
+    }
+}
+
+std::vector<LogicalRange> LogicalOrderedRangeCache::getHotLogicalRanges(size_t max_num) const {
+    lockRead();
+    std::vector<LogicalRange> hot_ranges(ranges_view.getLogicalRanges().begin(), ranges_view.getLogicalRanges().end());
+    unlockRead();
+
+    // never accessed ranges are not worth warming up
+    hot_ranges.erase(std::remove_if(hot_ranges.begin(), hot_ranges.end(),
+                                    [](const LogicalRange& range) {
+                                        return range.accessFrequency() == 0;
+                                    }),
+                     hot_ranges.end());
+    std::stable_sort(hot_ranges.begin(), hot_ranges.end(),
+                     [](const LogicalRange& a, const LogicalRange& b) {
+                         return a.accessFrequency() > b.accessFrequency();
+                     });
+    if (hot_ranges.size() > max_num) {
+        hot_ranges.erase(hot_ranges.begin() + max_num, hot_ranges.end());
+    }
+    return hot_ranges;
+}
+
+uint64_t LogicalOrderedRangeCache::getTotalAccessFrequency() const {
+    uint64_t total = 0;
+    lockRead();
+    for (const auto& range : ranges_view.getLogicalRanges()) {
+        total += range.accessFrequency();
+    }
+    unlockRead();
+    return total;
+}
+
+void LogicalOrderedRangeCache::decayAccessFrequency() {
+    lockWrite();
+    ranges_view.decayAccessFrequency();
+    unlockWrite();
+}
+
+void LogicalOrderedRangeCache::seedAccessFrequency(const Slice& start_user_key, const Slice& end_user_key, uint64_t access_frequency) {
+    lockWrite();
+    ranges_view.seedAccessFrequency(start_user_key, end_user_key, access_frequency);
+    unlockWrite();
+}
+
+void LogicalOrderedRangeCache::setPrefixExtractor(std::shared_ptr<const SliceTransform> prefix_extractor_, size_t soft_quota,
+                                                  size_t hard_quota) {
+    lockWrite();
+    this->prefix_extractor = prefix_extractor_;
+    this->prefix_soft_quota = soft_quota;
+    this->prefix_hard_quota = hard_quota;
+    this->prefix_quotas_changed = true;
+    unlockWrite();
+    std::lock_guard<std::mutex> lock(prefix_counter_mutex);
+    prefix_counters.clear();
+}
+
+void LogicalOrderedRangeCache::setPrefixQuota(const std::string& prefix, size_t soft_quota, size_t hard_quota) {
+    lockWrite();
+    prefix_quotas[prefix] = std::make_pair(soft_quota, hard_quota);
+    this->prefix_quotas_changed = true;
+    unlockWrite();
+}
+
+void LogicalOrderedRangeCache::getPrefixQuota(const std::string& prefix, size_t* soft_quota, size_t* hard_quota) const {
+    auto it = prefix_quotas.find(prefix);
+    if (it != prefix_quotas.end()) {
+        *soft_quota = it->second.first;
+        *hard_quota = it->second.second;
+    } else {
+        *soft_quota = prefix_soft_quota;
+        *hard_quota = prefix_hard_quota;
+    }
+}
+
+bool LogicalOrderedRangeCache::admitPrefix(const Slice& start_user_key) const {
+    if (!prefix_extractor || !prefix_extractor->InDomain(start_user_key)) {
+        return true;
+    }
+    std::string prefix = prefix_extractor->Transform(start_user_key).ToString();
+    size_t soft_quota = 0;
+    size_t hard_quota = 0;
+    getPrefixQuota(prefix, &soft_quota, &hard_quota);
+    return hard_quota == 0 || getPrefixBytes(prefix) < hard_quota;
+}
+
+void LogicalOrderedRangeCache::recordPrefixScan(const Slice& start_user_key, bool full_hit) {
+    // bound the memory of the counters if the prefixes are not tenants (e.g. a wrong extractor)
+    static const size_t kMaxPrefixCounters = 4096;
+
+    if (!prefix_extractor || !prefix_extractor->InDomain(start_user_key)) {
+        return;
+    }
+    std::string prefix = prefix_extractor->Transform(start_user_key).ToString();
+    std::lock_guard<std::mutex> lock(prefix_counter_mutex);
+    auto it = prefix_counters.find(prefix);
+    if (it == prefix_counters.end()) {
+        if (prefix_counters.size() >= kMaxPrefixCounters) {
+            return;
+        }
+        it = prefix_counters.emplace(std::move(prefix), PrefixCounter()).first;
+    }
+    it->second.queries++;
+    if (full_hit) {
+        it->second.full_hits++;
+    }
+}
+
+std::map<std::string, LogicalOrderedRangeCache::PrefixStats> LogicalOrderedRangeCache::getPrefixStats() const {
+    std::map<std::string, PrefixStats> stats;
+    lockRead();
+    if (!prefix_extractor) {
+        unlockRead();
+        return stats;
+    }
+    for (const auto& range : ranges_view.getLogicalRanges()) {
+        if (prefix_extractor->InDomain(range.startUserKey())) {
+            stats.emplace(prefix_extractor->Transform(range.startUserKey()).ToString(), PrefixStats());
+        }
+    }
+    for (const auto& quota : prefix_quotas) {
+        stats.emplace(quota.first, PrefixStats());
+    }
+    {
+        std::lock_guard<std::mutex> lock(prefix_counter_mutex);
+        for (const auto& counter : prefix_counters) {
+            PrefixStats& prefix_stats = stats[counter.first];
+            prefix_stats.queries = counter.second.queries;
+            prefix_stats.full_hits = counter.second.full_hits;
+        }
+    }
+    for (auto& prefix_stats : stats) {
+        prefix_stats.second.bytes = getPrefixBytes(prefix_stats.first);
+        getPrefixQuota(prefix_stats.first, &prefix_stats.second.soft_quota, &prefix_stats.second.hard_quota);
+    }
+    unlockRead();
+    return stats;
+}
+
+size_t LogicalOrderedRangeCache::recordScanPage(const Slice& start_key, const Slice& last_key, size_t len, bool full_hit) {
+    // streams tracked at once (e.g. clients paging through different parts of the key space)
+    static const size_t kMaxScanStreams = 8;
+    // the prefetched length grows up to this many pages
+    static const size_t kMaxPrefetchPages = 64;
+
+    std::lock_guard<std::mutex> lock(scan_stream_mutex);
+    if (scan_prefetch_max_bytes == 0 || len == 0) {
+        return 0;
+    }
+    scan_stream_clock++;
+
+    // the page continues the stream with the largest last key <= start_key, unless a cached logical range starts
+    // in between (the prefetched ranges are concatenated with the range the last page ended in)
+    ScanStream* stream = nullptr;
+    for (auto& candidate : scan_streams) {
+        Slice candidate_key(candidate.last_key);
+        if (candidate_key.compare(start_key) > 0 ||
+            (stream != nullptr && candidate_key.compare(stream->last_key) < 0)) {
+            continue;
+        }
+        auto it = ranges_view.findRange(candidate_key);
+        if (it != ranges_view.getLogicalRanges().end() && it->startUserKey() <= candidate_key) {
+            ++it;
+        }
+        if (it != ranges_view.getLogicalRanges().end() && it->startUserKey() < start_key) {
+            continue;
+        }
+        stream = &candidate;
+    }
+
+    if (stream == nullptr) {
+        // a new stream, replacing the least recently used one
+        if (scan_streams.size() < kMaxScanStreams) {
+            scan_streams.emplace_back();
+            stream = &scan_streams.back();
+        } else {
+            stream = &*std::min_element(scan_streams.begin(), scan_streams.end(),
+                                        [](const ScanStream& a, const ScanStream& b) {
+                                            return a.last_use < b.last_use;
+                                        });
+            if (stream->prefetched_pages > 0) {
+                scan_prefetch_wasted++;
+            }
+        }
+        stream->last_key = last_key.ToString();
+        stream->prefetch_len = 0;
+        stream->prefetched_pages = 0;
+        stream->prefetch_hit = false;
+        stream->last_use = scan_stream_clock;
+        return 0;
+    }
+
+    stream->last_key = last_key.ToString();
+    stream->last_use = scan_stream_clock;
+    if (stream->prefetched_pages > 0) {
+        stream->prefetched_pages--;
+        if (full_hit) {
+            scan_prefetch_hits++;
+            stream->prefetch_hit = true;
+        }
+    }
+    if (stream->prefetched_pages > 1) {
+        return 0;
+    }
+
+    // the prefetched pages run out, prefetch the following ones: twice as many if they were hit, half as many if
+    // the pages got ahead of the prefetches
+    if (stream->prefetch_len == 0) {
+        stream->prefetch_len = len;
+    } else if (stream->prefetch_hit) {
+        stream->prefetch_len = std::min(stream->prefetch_len * 2, len * kMaxPrefetchPages);
+    } else {
+        stream->prefetch_len = std::max(stream->prefetch_len / 2, len);
+    }
+    stream->prefetched_pages = stream->prefetch_len / len;
+    stream->prefetch_hit = false;
+    scan_prefetch_issued++;
+    // from the last key (cached already) to concatenate with the range it is in
+    return stream->prefetch_len + 1;
+}
+
 }  // namespace ROCKSDB_NAMESPACE
@@ -0,0 +1,213 @@
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include "rocksdb/lorc_budget.h"
+
+namespace ROCKSDB_NAMESPACE {
+
+namespace {
+
+uint64_t NowMicros() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+}  // namespace
+
+LorcBudget::LorcBudget(size_t capacity_) : capacity(capacity_), rebalancing(false), last_rebalance_micros(0) {
+}
+
+void LorcBudget::setShare(const std::string& cf_name, size_t min_share, size_t max_share) {
+    std::lock_guard<std::mutex> lock(mutex);
+    shares[cf_name] = std::make_pair(min_share, std::max(min_share, max_share));
+}
+
+void LorcBudget::addRangeCache(const std::string& cf_name, const std::shared_ptr<LogicalOrderedRangeCache>& range_cache,
+                               size_t default_max_share) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tenants.push_back(Tenant{cf_name, range_cache.get(), range_cache, default_max_share, 0});
+    }
+    // give the new tenant its share
+    rebalance();
+}
+
+void LorcBudget::removeRangeCache(const LogicalOrderedRangeCache* range_cache) {
+    std::lock_guard<std::mutex> lock(mutex);
+    tenants.erase(std::remove_if(tenants.begin(), tenants.end(),
+                                 [range_cache](const Tenant& tenant) {
+                                     return tenant.key == range_cache || tenant.range_cache.expired();
+                                 }),
+                  tenants.end());
+}
+
+size_t LorcBudget::getUsage() const {
+    std::vector<std::shared_ptr<LogicalOrderedRangeCache>> range_caches;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& tenant : tenants) {
+            auto range_cache = tenant.range_cache.lock();
+            if (range_cache) {
+                range_caches.push_back(std::move(range_cache));
+            }
+        }
+    }
+    size_t usage = 0;
+    for (const auto& range_cache : range_caches) {
+        usage += range_cache->getCurrentSize();
+    }
+    return usage;
+}
+
+void LorcBudget::refresh() {
+    std::vector<std::pair<const LogicalOrderedRangeCache*, std::shared_ptr<LogicalOrderedRangeCache>>> range_caches;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& tenant : tenants) {
+            auto range_cache = tenant.range_cache.lock();
+            if (range_cache) {
+                range_caches.emplace_back(tenant.key, std::move(range_cache));
+            }
+        }
+    }
+    // visit the logical ranges without holding mutex
+    std::vector<uint64_t> access_frequencies;
+    access_frequencies.reserve(range_caches.size());
+    for (const auto& range_cache : range_caches) {
+        access_frequencies.push_back(range_cache.second->getTotalAccessFrequency());
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < range_caches.size(); i++) {
+            for (auto& tenant : tenants) {
+                if (tenant.key == range_caches[i].first) {
+                    tenant.access_frequency = access_frequencies[i];
+                    break;
+                }
+            }
+        }
+    }
+    rebalance();
+}
+
+void LorcBudget::maybeRebalance() {
+    static const uint64_t kRebalanceIntervalMicros = 1000000;
+    uint64_t now_micros = NowMicros();
+    if (now_micros < last_rebalance_micros.load(std::memory_order_relaxed) + kRebalanceIntervalMicros &&
+        getUsage() <= getCapacity()) {
+        return;
+    }
+    if (rebalancing.load(std::memory_order_acquire)) {
+        // a rebalance is running, maybe the one shrinking the caller
+        return;
+    }
+    rebalance();
+}
+
+void LorcBudget::rebalance() {
+    std::lock_guard<std::mutex> rebalance_lock(rebalance_mutex);
+    rebalancing.store(true, std::memory_order_release);
+    std::vector<std::shared_ptr<LogicalOrderedRangeCache>> range_caches;
+    std::vector<size_t> targets;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<const Tenant*> live_tenants;
+        std::vector<size_t> sizes;
+        for (const auto& tenant : tenants) {
+            auto range_cache = tenant.range_cache.lock();
+            if (range_cache) {
+                live_tenants.push_back(&tenant);
+                sizes.push_back(range_cache->getCurrentSize());
+                range_caches.push_back(std::move(range_cache));
+            }
+        }
+        targets = computeTargets(live_tenants, sizes);
+    }
+
+    for (size_t i = 0; i < range_caches.size(); i++) {
+        // use atomic write
+        auto* atomic_budget_capacity = reinterpret_cast<std::atomic<size_t>*>(&range_caches[i]->budget_capacity);
+        atomic_budget_capacity->store(targets[i], std::memory_order_relaxed);
+    }
+    // shrink the tenants that lost capacity (their tryVictim() skips maybeRebalance() while rebalancing)
+    for (size_t i = 0; i < range_caches.size(); i++) {
+        if (range_caches[i]->getCurrentSize() > targets[i]) {
+            range_caches[i]->tryVictim();
+        }
+    }
+    last_rebalance_micros.store(NowMicros(), std::memory_order_relaxed);
+    rebalancing.store(false, std::memory_order_release);
+}
+
+std::vector<size_t> LorcBudget::computeTargets(const std::vector<const Tenant*>& live_tenants,
+                                               const std::vector<size_t>& sizes) const {
+    // an accessed tenant may grow by 1/8 of its size (at least this much) per rebalance at the expense of colder ones
+    static const size_t kMinGrowthBytes = 1 << 20;
+
+    size_t num = live_tenants.size();
+    std::vector<size_t> targets(num, 0);
+    std::vector<size_t> max_shares(num, 0);
+    size_t remaining = getCapacity();
+
+    // minimum shares first, in the order of registration
+    for (size_t i = 0; i < num; i++) {
+        size_t min_share = 0;
+        max_shares[i] = live_tenants[i]->default_max_share;
+        auto it = shares.find(live_tenants[i]->cf_name);
+        if (it != shares.end()) {
+            min_share = it->second.first;
+            max_shares[i] = it->second.second;
+        }
+        targets[i] = std::min(min_share, remaining);
+        remaining -= targets[i];
+    }
+
+    // then the hottest tenants (access frequency per byte cached) keep what they cache, and grow if accessed
+    std::vector<size_t> order(num);
+    std::iota(order.begin(), order.end(), 0);
+    std::vector<double> densities(num);
+    for (size_t i = 0; i < num; i++) {
+        densities[i] = static_cast<double>(live_tenants[i]->access_frequency) / static_cast<double>(std::max<size_t>(sizes[i], 1));
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&densities](size_t a, size_t b) {
+                         return densities[a] > densities[b];
+                     });
+    for (size_t i : order) {
+        size_t want = sizes[i];
+        if (live_tenants[i]->access_frequency > 0) {
+            want += std::max(sizes[i] / 8, kMinGrowthBytes);
+        }
+        want = std::min(want, max_shares[i]);
+        if (want > targets[i]) {
+            size_t grant = std::min(want - targets[i], remaining);
+            targets[i] += grant;
+            remaining -= grant;
+        }
+    }
+
+    // the free part is shared evenly (e.g. by new tenants), up to the maximum shares
+    while (remaining > 0) {
+        size_t growable = 0;
+        for (size_t i = 0; i < num; i++) {
+            if (targets[i] < max_shares[i]) {
+                growable++;
+            }
+        }
+        if (growable == 0) {
+            break;
+        }
+        size_t grant_each = std::max<size_t>(remaining / growable, 1);
+        for (size_t i : order) {
+            if (remaining == 0) {
+                break;
+            }
+            size_t grant = std::min({grant_each, max_shares[i] - std::min(targets[i], max_shares[i]), remaining});
+            targets[i] += grant;
+            remaining -= grant;
+        }
+    }
+    return targets;
+}
+
+}  // namespace ROCKSDB_NAMESPACE
@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <chrono>
+#include "rocksdb/lorc_memory_tuner.h"
+#include "util/hash.h"
+
+namespace ROCKSDB_NAMESPACE {
+
+GhostCache::GhostCache(std::shared_ptr<Cache> target, double ghost_ratio_)
+    : CacheWrapper(std::move(target)), ghost_ratio(ghost_ratio_), ghost_hit_bytes(0) {
+}
+
+Status GhostCache::Insert(const Slice& key, ObjectPtr value, const CacheItemHelper* helper, size_t charge,
+                          Handle** handle, Priority priority, const Slice& compressed_value, CompressionType type) {
+    if (ghost_ratio > 0) {
+        uint64_t key_hash = GetSliceNPHash64(key);
+        uint64_t window = (GetCapacity() + getGhostCapacity()) / kNumShards;
+        GhostShard& shard = shards[key_hash % kNumShards];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.inserted_bytes += charge;
+        shard.entries[key_hash] = GhostEntry{shard.inserted_bytes, charge};
+        shard.fifo.emplace_back(key_hash, shard.inserted_bytes);
+
+        // forget the keys out of the ghost window, and the stale fifo entries of re-inserted keys
+        while (!shard.fifo.empty() &&
+               (shard.fifo.front().second + window < shard.inserted_bytes || shard.fifo.size() > 2 * shard.entries.size())) {
+            auto it = shard.entries.find(shard.fifo.front().first);
+            if (it != shard.entries.end() && it->second.inserted_bytes == shard.fifo.front().second) {
+                shard.entries.erase(it);
+            }
+            shard.fifo.pop_front();
+        }
+    }
+    return CacheWrapper::Insert(key, value, helper, charge, handle, priority, compressed_value, type);
+}
+
+Cache::Handle* GhostCache::Lookup(const Slice& key, const CacheItemHelper* helper, CreateContext* create_context,
+                                  Priority priority, Statistics* stats) {
+    Handle* handle = CacheWrapper::Lookup(key, helper, create_context, priority, stats);
+    if (handle == nullptr && ghost_ratio > 0) {
+        uint64_t key_hash = GetSliceNPHash64(key);
+        uint64_t shard_capacity = GetCapacity() / kNumShards;
+        GhostShard& shard = shards[key_hash % kNumShards];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key_hash);
+        // evicted (approximately, as if the cache were FIFO) but within the ghost window
+        if (it != shard.entries.end() && it->second.inserted_bytes + shard_capacity < shard.inserted_bytes) {
+            ghost_hit_bytes.fetch_add(it->second.charge, std::memory_order_relaxed);
+            // count once until it is inserted again
+            shard.entries.erase(it);
+        }
+    }
+    return handle;
+}
+
+LorcMemoryTuner::LorcMemoryTuner(std::shared_ptr<LogicalOrderedRangeCache> range_cache_, std::shared_ptr<GhostCache> blob_cache_,
+                                 std::shared_ptr<GhostCache> block_cache_, const LorcMemoryTunerOptions& options_)
+    : range_cache(range_cache_), blob_cache(blob_cache_), block_cache(block_cache_), options(options_),
+      total_budget(options_.total_budget), last_tune_micros(0) {
+    if (range_cache_) {
+        if (range_cache_->getGhostRatio() <= 0) {
+            double ghost_ratio = 0.1;
+            if (blob_cache_) {
+                ghost_ratio = static_cast<double>(blob_cache_->getGhostCapacity()) / std::max<size_t>(blob_cache_->GetCapacity(), 1);
+            } else if (block_cache_) {
+                ghost_ratio = static_cast<double>(block_cache_->getGhostCapacity()) / std::max<size_t>(block_cache_->GetCapacity(), 1);
+            }
+            range_cache_->setGhostRatio(ghost_ratio);
+        }
+        std::weak_ptr<LogicalOrderedRangeCache> weak_range_cache = range_cache_;
+        addCache("range cache",
+                 [weak_range_cache]() { auto rc = weak_range_cache.lock(); return rc ? rc->getCapacity() : 0; },
+                 [weak_range_cache](size_t capacity) {
+                     auto rc = weak_range_cache.lock();
+                     if (rc) {
+                         rc->setCapacity(capacity);
+                         rc->tryVictim();
+                     }
+                 },
+                 [weak_range_cache]() { auto rc = weak_range_cache.lock(); return rc ? rc->getGhostHitBytes() : 0; },
+                 [weak_range_cache]() { auto rc = weak_range_cache.lock(); return rc ? rc->getGhostCapacity() : 0; });
+    }
+    if (blob_cache_) {
+        GhostCache* cache = blob_cache_.get();
+        addCache("blob cache", [cache]() { return cache->GetCapacity(); }, [cache](size_t capacity) { cache->SetCapacity(capacity); },
+                 [cache]() { return cache->getGhostHitBytes(); }, [cache]() { return cache->getGhostCapacity(); });
+    }
+    if (block_cache_) {
+        GhostCache* cache = block_cache_.get();
+        addCache("block cache", [cache]() { return cache->GetCapacity(); }, [cache](size_t capacity) { cache->SetCapacity(capacity); },
+                 [cache]() { return cache->getGhostHitBytes(); }, [cache]() { return cache->getGhostCapacity(); });
+    }
+
+    // scale the capacities to the total budget
+    size_t total_capacity = 0;
+    for (auto& cache : tuned_caches) {
+        total_capacity += cache.get_capacity();
+    }
+    if (total_budget == 0) {
+        total_budget = total_capacity;
+    } else if (total_capacity > 0 && total_capacity != total_budget) {
+        double scale = static_cast<double>(total_budget) / static_cast<double>(total_capacity);
+        for (auto& cache : tuned_caches) {
+            cache.set_capacity(static_cast<size_t>(static_cast<double>(cache.get_capacity()) * scale));
+        }
+    }
+}
+
+void LorcMemoryTuner::addCache(const std::string& name, std::function<size_t()> get_capacity, std::function<void(size_t)> set_capacity,
+                               std::function<uint64_t()> get_ghost_hit_bytes, std::function<size_t()> get_ghost_capacity) {
+    uint64_t ghost_hit_bytes = get_ghost_hit_bytes();
+    tuned_caches.push_back(TunedCache{name, std::move(get_capacity), std::move(set_capacity), std::move(get_ghost_hit_bytes),
+                                      std::move(get_ghost_capacity), ghost_hit_bytes});
+}
+
+bool LorcMemoryTuner::tune() {
+    std::lock_guard<std::mutex> lock(tune_mutex);
+    uint64_t now_micros = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+    if (last_tune_micros != 0 && now_micros < last_tune_micros + options.min_tune_interval_micros) {
+        return false;
+    }
+    last_tune_micros = now_micros;
+    if (tuned_caches.size() < 2 || range_cache.expired()) {
+        return false;
+    }
+
+    // marginal benefit: ghost hit bytes per ghost byte since the last tuning
+    size_t max_index = 0;
+    size_t min_index = 0;
+    std::vector<double> benefits(tuned_caches.size(), 0);
+    for (size_t i = 0; i < tuned_caches.size(); i++) {
+        auto& cache = tuned_caches[i];
+        uint64_t ghost_hit_bytes = cache.get_ghost_hit_bytes();
+        size_t ghost_capacity = cache.get_ghost_capacity();
+        benefits[i] = ghost_capacity == 0 ? 0 :
+            static_cast<double>(ghost_hit_bytes - cache.last_ghost_hit_bytes) / static_cast<double>(ghost_capacity);
+        cache.last_ghost_hit_bytes = ghost_hit_bytes;
+        if (benefits[i] > benefits[max_index]) {
+            max_index = i;
+        }
+        if (benefits[i] < benefits[min_index]) {
+            min_index = i;
+        }
+    }
+    if (max_index == min_index || benefits[max_index] <= benefits[min_index] * (1 + options.min_benefit_gap_ratio)) {
+        return false;
+    }
+
+    size_t step = static_cast<size_t>(static_cast<double>(total_budget) * options.step_ratio);
+    size_t min_share = static_cast<size_t>(static_cast<double>(total_budget) * options.min_share_ratio);
+    size_t from_capacity = tuned_caches[min_index].get_capacity();
+    if (from_capacity <= min_share) {
+        return false;
+    }
+    step = std::min(step, from_capacity - min_share);
+    if (step == 0) {
+        return false;
+    }
+    // shrink first to stay within the budget
+    tuned_caches[min_index].set_capacity(from_capacity - step);
+    tuned_caches[max_index].set_capacity(tuned_caches[max_index].get_capacity() + step);
+
+    auto rc = range_cache.lock();
+    if (rc) {
+        rc->getLogger().info("LorcMemoryTuner: move " + std::to_string(step) + " bytes from " + tuned_caches[min_index].name +
+                             " to " + tuned_caches[max_index].name);
+    }
+    return true;
+}
+
+}  // namespace ROCKSDB_NAMESPACE
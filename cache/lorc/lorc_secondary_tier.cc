@@ -0,0 +1,419 @@
+#include <algorithm>
+#include <cinttypes>
+#include "rocksdb/env.h"
+#include "rocksdb/lorc_secondary_tier.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+
+namespace ROCKSDB_NAMESPACE {
+
+static const char* kSegmentFilePrefix = "lorc-tier-";
+static const char* kSegmentFileSuffix = ".seg";
+
+namespace {
+
+// Fails if a value of a compressed range can not be decompressed
+Status EncodeRangeRecord(const std::vector<const PhysicalRange*>& physical_ranges, std::string* record) {
+    PutFixed32(record, 0); // placeholder of crc
+    uint64_t num_entries = 0;
+    for (auto physical_range : physical_ranges) {
+        num_entries += physical_range->length();
+    }
+    PutVarint64(record, num_entries);
+    PhysicalRangeKeyBuffer key_buffer;
+    PhysicalRangeValueBuffer value_buffer;
+    for (auto physical_range : physical_ranges) {
+        for (size_t i = 0; i < physical_range->length(); i++) {
+            PutLengthPrefixedSlice(record, physical_range->readInternalKeyAt(i, &key_buffer));
+            PutLengthPrefixedSlice(record, physical_range->readValueAt(i, &value_buffer));
+            if (value_buffer.corrupted) {
+                return Status::Corruption("Failed to decompress a value of an evicted range");
+            }
+        }
+    }
+    EncodeFixed32(&(*record)[0], crc32c::Mask(crc32c::Value(record->data() + 4, record->size() - 4)));
+    return Status::OK();
+}
+
+}  // namespace
+
+LorcSecondaryTier::LorcSecondaryTier(Env* env_, const std::string& dir_, size_t capacity_, size_t segment_size_)
+    : env(env_), dir(dir_), capacity(capacity_), segment_size(std::min(segment_size_, capacity_)), active_segment(0),
+      usage(0), pending_bytes(0), next_pending_order(0) {
+    Status s = env->CreateDirIfMissing(dir);
+    // the tier is not persistent, drop the segments of the last run
+    std::vector<std::string> children;
+    if (s.ok()) {
+        s = env->GetChildren(dir, &children);
+    }
+    for (const auto& child : children) {
+        if (child.rfind(kSegmentFilePrefix, 0) == 0) {
+            env->DeleteFile(dir + "/" + child).PermitUncheckedError();
+        }
+    }
+    if (s.ok()) {
+        std::lock_guard<std::mutex> io_lock(io_mutex);
+        s = rollSegment();
+    }
+    s.PermitUncheckedError();
+}
+
+LorcSecondaryTier::~LorcSecondaryTier() {
+    std::lock_guard<std::mutex> io_lock(io_mutex);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (active_writer) {
+        active_writer->Close().PermitUncheckedError();
+        active_writer.reset();
+    }
+    segment_readers.clear();
+    for (auto& segment : segment_sizes) {
+        env->DeleteFile(segmentFileName(segment.first)).PermitUncheckedError();
+    }
+}
+
+std::string LorcSecondaryTier::segmentFileName(uint64_t segment) const {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%06" PRIu64, segment);
+    return dir + "/" + kSegmentFilePrefix + buf + kSegmentFileSuffix;
+}
+
+Status LorcSecondaryTier::rollSegment() {
+    if (active_writer) {
+        Status s = active_writer->Close();
+        active_writer.reset();
+        if (!s.ok()) {
+            return s;
+        }
+    }
+    active_segment++;
+    Status s = env->NewWritableFile(segmentFileName(active_segment), &active_writer, EnvOptions());
+    if (!s.ok()) {
+        active_writer.reset();
+        return s;
+    }
+
+    // drop the oldest segments (and the ranges in them) to make room for the new one
+    std::vector<uint64_t> dropped_segments;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        segment_sizes[active_segment] = 0;
+        while (segment_sizes.size() > 1 && usage + segment_size > capacity) {
+            uint64_t oldest = segment_sizes.begin()->first;
+            usage -= segment_sizes.begin()->second;
+            segment_sizes.erase(segment_sizes.begin());
+            for (auto it = spilled_ranges.begin(); it != spilled_ranges.end();) {
+                if (it->second.segment == oldest) {
+                    it = eraseRange(it);
+                } else {
+                    ++it;
+                }
+            }
+            dropped_segments.push_back(oldest);
+        }
+    }
+    for (uint64_t segment : dropped_segments) {
+        segment_readers.erase(segment);
+        env->DeleteFile(segmentFileName(segment)).PermitUncheckedError();
+    }
+    return Status::OK();
+}
+
+Status LorcSecondaryTier::appendRecord(const std::string& record, uint64_t* segment, uint64_t* offset) {
+    if (record.size() > segment_size) {
+        return Status::NoSpace("Range is larger than a segment of the secondary tier");
+    }
+    size_t active_size = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = segment_sizes.find(active_segment);
+        active_size = it != segment_sizes.end() ? it->second : 0;
+    }
+    Status s;
+    if (active_writer && active_size + record.size() > segment_size) {
+        s = rollSegment();
+    }
+    if (s.ok() && !active_writer) {
+        s = Status::IOError("No active segment in the secondary tier");
+    }
+    if (s.ok()) {
+        s = active_writer->Append(record);
+    }
+    if (s.ok()) {
+        // make it readable by the segment reader
+        s = active_writer->Flush();
+    }
+    if (!s.ok()) {
+        return s;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    *segment = active_segment;
+    *offset = segment_sizes[active_segment];
+    segment_sizes[active_segment] += record.size();
+    usage += record.size();
+    return Status::OK();
+}
+
+Status LorcSecondaryTier::spill(const Slice& start_user_key, const Slice& end_user_key, const std::vector<const PhysicalRange*>& physical_ranges) {
+    std::string record;
+    Status s = EncodeRangeRecord(physical_ranges, &record);
+    if (!s.ok()) {
+        return s;
+    }
+
+    std::lock_guard<std::mutex> io_lock(io_mutex);
+    uint64_t segment = 0;
+    uint64_t offset = 0;
+    s = appendRecord(record, &segment, &offset);
+    if (!s.ok()) {
+        return s;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    // replace the stale spilled ranges overlapping the new one
+    dropOverlapping(start_user_key, end_user_key);
+    spilled_ranges[start_user_key.ToString()] = SpilledRange{end_user_key.ToString(), segment, offset, record.size(), nullptr};
+    return Status::OK();
+}
+
+void LorcSecondaryTier::enqueueSpill(const Slice& start_user_key, const Slice& end_user_key,
+                                     std::vector<std::unique_ptr<PhysicalRange>>&& physical_ranges) {
+    auto pending = std::make_shared<PendingSpill>();
+    pending->physical_ranges = std::move(physical_ranges);
+    pending->byte_size = 0;
+    for (const auto& physical_range : pending->physical_ranges) {
+        pending->byte_size += physical_range->byteSize();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    // replace the stale spilled ranges overlapping the new one
+    dropOverlapping(start_user_key, end_user_key);
+    pending->order = next_pending_order++;
+    pending_order[pending->order] = start_user_key.ToString();
+    pending_bytes += pending->byte_size;
+    spilled_ranges[start_user_key.ToString()] = SpilledRange{end_user_key.ToString(), 0, 0, 0, std::move(pending)};
+    // the queue holds at most a segment, the oldest ranges are dropped (as if the spill failed)
+    while (pending_bytes > segment_size && !pending_order.empty()) {
+        eraseRange(spilled_ranges.find(pending_order.begin()->second));
+    }
+}
+
+Status LorcSecondaryTier::drainPendingSpills() {
+    // one drain (or spill) at a time, in order of eviction
+    std::lock_guard<std::mutex> io_lock(io_mutex);
+    Status result;
+    while (true) {
+        std::string start_user_key;
+        std::shared_ptr<PendingSpill> pending;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (pending_order.empty()) {
+                break;
+            }
+            start_user_key = pending_order.begin()->second;
+            pending = spilled_ranges.at(start_user_key).pending;
+        }
+        // the physical ranges are kept by pending even if the range is loaded or dropped meanwhile
+        std::vector<const PhysicalRange*> physical_ranges;
+        for (const auto& physical_range : pending->physical_ranges) {
+            physical_ranges.push_back(physical_range.get());
+        }
+        std::string record;
+        Status s = EncodeRangeRecord(physical_ranges, &record);
+        uint64_t segment = 0;
+        uint64_t offset = 0;
+        if (s.ok()) {
+            s = appendRecord(record, &segment, &offset);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = spilled_ranges.find(start_user_key);
+        if (it == spilled_ranges.end() || it->second.pending != pending) {
+            // loaded or dropped meanwhile, the space of the record is reclaimed when its segment is dropped
+            continue;
+        }
+        if (!s.ok()) {
+            // dropped, as if it was not spilled
+            eraseRange(it);
+            result = s;
+            continue;
+        }
+        pending_bytes -= pending->byte_size;
+        pending_order.erase(pending->order);
+        it->second.segment = segment;
+        it->second.offset = offset;
+        it->second.size = record.size();
+        it->second.pending.reset();
+    }
+    return result;
+}
+
+LorcSecondaryTier::SpilledRangeMap::const_iterator LorcSecondaryTier::firstOverlapping(const Slice& start_user_key) const {
+    auto it = spilled_ranges.upper_bound(start_user_key.ToString());
+    if (it != spilled_ranges.begin() && Slice(std::prev(it)->second.end_user_key) >= start_user_key) {
+        --it;
+    }
+    return it;
+}
+
+LorcSecondaryTier::SpilledRangeMap::iterator LorcSecondaryTier::eraseRange(SpilledRangeMap::const_iterator it) {
+    if (it->second.pending) {
+        pending_bytes -= it->second.pending->byte_size;
+        pending_order.erase(it->second.pending->order);
+    }
+    return spilled_ranges.erase(it);
+}
+
+void LorcSecondaryTier::dropOverlapping(const Slice& start_user_key, const Slice& end_user_key) {
+    // the space of the spilled ranges is reclaimed when their segments are dropped
+    for (auto it = firstOverlapping(start_user_key); it != spilled_ranges.end() && Slice(it->first) <= end_user_key;) {
+        it = eraseRange(it);
+    }
+    for (auto& loading_range : loading_ranges) {
+        if (Slice(loading_range.first) <= end_user_key && Slice(loading_range.second.first) >= start_user_key) {
+            loading_range.second.second = true;
+        }
+    }
+}
+
+bool LorcSecondaryTier::mayOverlap(const Slice& start_user_key, const Slice& end_user_key) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (spilled_ranges.empty()) {
+        return false;
+    }
+    auto it = firstOverlapping(start_user_key);
+    return it != spilled_ranges.end() && (end_user_key.empty() || Slice(it->first) <= end_user_key);
+}
+
+std::vector<std::pair<std::string, std::string>> LorcSecondaryTier::getOverlappingRanges(const Slice& start_user_key, const Slice& end_user_key,
+                                                                                         size_t max_num) const {
+    std::vector<std::pair<std::string, std::string>> ranges;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = firstOverlapping(start_user_key); it != spilled_ranges.end() && ranges.size() < max_num; ++it) {
+        if (!end_user_key.empty() && Slice(it->first) > end_user_key) {
+            break;
+        }
+        ranges.emplace_back(it->first, it->second.end_user_key);
+    }
+    return ranges;
+}
+
+Status LorcSecondaryTier::load(const Slice& start_user_key, std::vector<std::string>* internal_keys, std::vector<std::string>* values) {
+    SpilledRange spilled_range;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = spilled_ranges.find(start_user_key.ToString());
+        if (it == spilled_ranges.end()) {
+            return Status::NotFound("Range not in the secondary tier");
+        }
+        spilled_range = it->second;
+        eraseRange(it);
+        loading_ranges[start_user_key.ToString()] = std::make_pair(spilled_range.end_user_key, false);
+    }
+
+    Status s;
+    if (spilled_range.pending) {
+        // not written yet, no I/O
+        PhysicalRangeKeyBuffer key_buffer;
+        PhysicalRangeValueBuffer value_buffer;
+        for (const auto& physical_range : spilled_range.pending->physical_ranges) {
+            for (size_t i = 0; i < physical_range->length(); i++) {
+                internal_keys->emplace_back(physical_range->readInternalKeyAt(i, &key_buffer).ToString());
+                values->emplace_back(physical_range->readValueAt(i, &value_buffer).ToString());
+                if (value_buffer.corrupted) {
+                    s = Status::Corruption("Failed to decompress a value of an evicted range");
+                    break;
+                }
+            }
+            if (!s.ok()) {
+                break;
+            }
+        }
+    } else {
+        std::lock_guard<std::mutex> io_lock(io_mutex);
+        s = readRecord(spilled_range, internal_keys, values);
+    }
+    if (!s.ok()) {
+        std::lock_guard<std::mutex> lock(mutex);
+        loading_ranges.erase(start_user_key.ToString());
+    }
+    return s;
+}
+
+Status LorcSecondaryTier::readRecord(const SpilledRange& spilled_range, std::vector<std::string>* internal_keys,
+                                     std::vector<std::string>* values) {
+    auto& segment_reader = segment_readers[spilled_range.segment];
+    if (!segment_reader) {
+        // fails if the segment has been dropped since the range was found
+        Status s = env->NewRandomAccessFile(segmentFileName(spilled_range.segment), &segment_reader, EnvOptions());
+        if (!s.ok()) {
+            segment_readers.erase(spilled_range.segment);
+            return s;
+        }
+    }
+    // one sequential read for the whole range, with io_mutex held so that the segment is not dropped meanwhile
+    std::string scratch;
+    scratch.resize(spilled_range.size);
+    Slice record;
+    Status s = segment_reader->Read(spilled_range.offset, spilled_range.size, &record, &scratch[0]);
+    if (!s.ok()) {
+        return s;
+    }
+    if (record.size() != spilled_range.size ||
+        crc32c::Unmask(DecodeFixed32(record.data())) != crc32c::Value(record.data() + 4, record.size() - 4)) {
+        return Status::Corruption("Bad range record in the secondary tier");
+    }
+    record.remove_prefix(4);
+    uint64_t num_entries = 0;
+    if (!GetVarint64(&record, &num_entries)) {
+        return Status::Corruption("Bad range record in the secondary tier");
+    }
+    internal_keys->reserve(num_entries);
+    values->reserve(num_entries);
+    for (uint64_t i = 0; i < num_entries; i++) {
+        Slice internal_key;
+        Slice value;
+        if (!GetLengthPrefixedSlice(&record, &internal_key) || !GetLengthPrefixedSlice(&record, &value)) {
+            internal_keys->clear();
+            values->clear();
+            return Status::Corruption("Bad range entry in the secondary tier");
+        }
+        internal_keys->emplace_back(internal_key.data(), internal_key.size());
+        values->emplace_back(value.data(), value.size());
+    }
+    return Status::OK();
+}
+
+bool LorcSecondaryTier::finishLoad(const Slice& start_user_key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = loading_ranges.find(start_user_key.ToString());
+    if (it == loading_ranges.end()) {
+        return false;
+    }
+    bool stale = it->second.second;
+    loading_ranges.erase(it);
+    return !stale;
+}
+
+void LorcSecondaryTier::invalidate(const Slice& start_user_key, const Slice& end_user_key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (spilled_ranges.empty() && loading_ranges.empty()) {
+        return;
+    }
+    dropOverlapping(start_user_key, end_user_key);
+}
+
+size_t LorcSecondaryTier::getUsage() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return usage;
+}
+
+size_t LorcSecondaryTier::getSpilledRangeNum() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return spilled_ranges.size();
+}
+
+size_t LorcSecondaryTier::getPendingSpillNum() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pending_order.size();
+}
+
+}  // namespace ROCKSDB_NAMESPACE
@@ -0,0 +1,416 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include "rocksdb/physical_range_index.h"
+
+namespace ROCKSDB_NAMESPACE {
+
+namespace {
+
+// Big endian 8 bytes of key after offset (zero padded), so that heads compare like the keys
+inline uint64_t keyHead(const Slice& key, size_t offset) {
+    uint64_t head = 0;
+    size_t n = key.size() > offset ? std::min(key.size() - offset, sizeof(uint64_t)) : 0;
+    for (size_t i = 0; i < n; i++) {
+        head |= static_cast<uint64_t>(static_cast<unsigned char>(key[offset + i])) << (56 - 8 * i);
+    }
+    return head;
+}
+
+inline size_t commonPrefixSize(const Slice& a, const Slice& b) {
+    size_t n = std::min(a.size(), b.size());
+    size_t i = 0;
+    while (i < n && a[i] == b[i]) {
+        i++;
+    }
+    return i;
+}
+
+}  // namespace
+
+size_t PhysicalRangeIndex::Node::countLess(const Slice& key, bool or_equal) const {
+    if (count == 0) {
+        return 0;
+    }
+    // keys not starting with the prefix are before or after all entries
+    size_t prefix_size = prefix.size();
+    int c = memcmp(key.data(), prefix.data(), std::min(key.size(), prefix_size));
+    if (c == 0 && key.size() < prefix_size) {
+        c = -1;
+    }
+    if (c < 0) {
+        return 0;
+    } else if (c > 0) {
+        return count;
+    }
+
+    uint64_t head = keyHead(key, prefix_size);
+    size_t left = 0;
+    size_t len = count;
+    while (len > 0) {
+        size_t half = len / 2;
+        if (heads[left + half] < head) {
+            left += half + 1;
+            len -= half + 1;
+        } else {
+            len = half;
+        }
+    }
+    size_t right = left;
+    while (right < count && heads[right] == head) {
+        right++;
+    }
+    // ties of heads are broken by the full keys
+    while (left < right) {
+        size_t mid = left + (right - left) / 2;
+        int r = firsts[mid]->startUserKey().compare(key);
+        if (r < 0 || (or_equal && r == 0)) {
+            left = mid + 1;
+        } else {
+            right = mid;
+        }
+    }
+    return left;
+}
+
+PhysicalRangeStats PhysicalRangeIndex::Node::total() const {
+    PhysicalRangeStats result;
+    for (size_t i = 0; i < count; i++) {
+        result += stats[i];
+    }
+    return result;
+}
+
+void PhysicalRangeIndex::Node::insertKey(size_t pos, const PhysicalRange* first, const PhysicalRangeStats& entry_stats) {
+    assert(count < kFanout && pos <= count);
+    std::copy_backward(heads + pos, heads + count, heads + count + 1);
+    std::copy_backward(firsts + pos, firsts + count, firsts + count + 1);
+    std::copy_backward(stats + pos, stats + count, stats + count + 1);
+    if (count == 0) {
+        prefix = first->startUserKey().ToString();
+    }
+    count++;
+    stats[pos] = entry_stats;
+    setKey(pos, first);
+}
+
+void PhysicalRangeIndex::Node::removeKey(size_t pos) {
+    assert(pos < count);
+    std::copy(heads + pos + 1, heads + count, heads + pos);
+    std::copy(firsts + pos + 1, firsts + count, firsts + pos);
+    std::copy(stats + pos + 1, stats + count, stats + pos);
+    count--;
+    // the prefix is still common to the rest
+}
+
+void PhysicalRangeIndex::Node::setKey(size_t pos, const PhysicalRange* first) {
+    firsts[pos] = first;
+    Slice key = first->startUserKey();
+    if (!key.starts_with(prefix)) {
+        // shrink the prefix and rebuild the heads
+        prefix.resize(commonPrefixSize(key, prefix));
+        for (size_t i = 0; i < count; i++) {
+            heads[i] = keyHead(firsts[i]->startUserKey(), prefix.size());
+        }
+        return;
+    }
+    heads[pos] = keyHead(key, prefix.size());
+}
+
+size_t PhysicalRangeIndex::InnerNode::indexOf(const Node* child) const {
+    for (size_t i = 0; i < count; i++) {
+        if (children[i].get() == child) {
+            return i;
+        }
+    }
+    assert(false);
+    return count;
+}
+
+PhysicalRangeIndex::PhysicalRangeIndex() : root(new LeafNode()), range_num(0) {}
+
+PhysicalRangeIndex::LeafNode* PhysicalRangeIndex::findLeaf(const Slice& key, bool or_equal) const {
+    Node* node = root.get();
+    while (!node->leaf) {
+        auto inner = static_cast<InnerNode*>(node);
+        // the last child whose first key < key (or <= key)
+        size_t n = inner->countLess(key, or_equal);
+        node = inner->children[n == 0 ? 0 : n - 1].get();
+    }
+    return static_cast<LeafNode*>(node);
+}
+
+PhysicalRangeIndex::LeafNode* PhysicalRangeIndex::firstLeaf() const {
+    Node* node = root.get();
+    while (!node->leaf) {
+        node = static_cast<InnerNode*>(node)->children[0].get();
+    }
+    return static_cast<LeafNode*>(node);
+}
+
+PhysicalRangeIndex::LeafNode* PhysicalRangeIndex::lastLeaf() const {
+    Node* node = root.get();
+    while (!node->leaf) {
+        node = static_cast<InnerNode*>(node)->children[node->count - 1].get();
+    }
+    return static_cast<LeafNode*>(node);
+}
+
+PhysicalRangeIndex::iterator PhysicalRangeIndex::makeIterator(LeafNode* leaf, size_t pos) const {
+    if (pos < leaf->count) {
+        return iterator(this, leaf, pos);
+    }
+    // leaves other than an empty root are never empty
+    return iterator(this, leaf->next, 0);
+}
+
+PhysicalRangeIndex::iterator PhysicalRangeIndex::begin() const {
+    return makeIterator(firstLeaf(), 0);
+}
+
+PhysicalRangeIndex::iterator PhysicalRangeIndex::lower_bound(const Slice& key) const {
+    LeafNode* leaf = findLeaf(key, false);
+    return makeIterator(leaf, leaf->countLess(key, false));
+}
+
+PhysicalRangeIndex::iterator PhysicalRangeIndex::upper_bound(const Slice& key) const {
+    LeafNode* leaf = findLeaf(key, true);
+    return makeIterator(leaf, leaf->countLess(key, true));
+}
+
+PhysicalRangeIndex::iterator PhysicalRangeIndex::find(const Slice& key) const {
+    iterator it = lower_bound(key);
+    if (it != end() && (*it)->startUserKey() == key) {
+        return it;
+    }
+    return end();
+}
+
+PhysicalRangeStats PhysicalRangeIndex::statsBefore(const Slice& key, bool or_equal) const {
+    PhysicalRangeStats result;
+    const Node* node = root.get();
+    while (true) {
+        size_t n = node->countLess(key, or_equal);
+        if (node->leaf) {
+            for (size_t i = 0; i < n; i++) {
+                result += node->stats[i];
+            }
+            return result;
+        }
+        // the subtrees before the child holding the key are all before the key
+        size_t child = n == 0 ? 0 : n - 1;
+        for (size_t i = 0; i < child; i++) {
+            result += node->stats[i];
+        }
+        node = static_cast<const InnerNode*>(node)->children[child].get();
+    }
+}
+
+PhysicalRangeIndex::iterator PhysicalRangeIndex::insert(std::unique_ptr<PhysicalRange> range) {
+    Slice key = range->startUserKey();
+    LeafNode* leaf = findLeaf(key, true);
+    size_t pos = leaf->countLess(key, true);
+    assert(pos == 0 || leaf->firsts[pos - 1]->startUserKey() != key);
+
+    if (leaf->count == kFanout) {
+        LeafNode* right = splitLeaf(leaf);
+        if (pos > leaf->count) {
+            pos -= leaf->count;
+            leaf = right;
+        }
+    }
+    std::move_backward(leaf->ranges + pos, leaf->ranges + leaf->count, leaf->ranges + leaf->count + 1);
+    leaf->ranges[pos] = std::move(range);
+    PhysicalRangeStats range_stats(*leaf->ranges[pos]);
+    leaf->insertKey(pos, leaf->ranges[pos].get(), range_stats);
+    if (pos == 0) {
+        propagateFirst(leaf);
+    }
+    propagateStats(leaf, PhysicalRangeStats(), range_stats);
+    range_num++;
+    return iterator(this, leaf, pos);
+}
+
+PhysicalRangeIndex::iterator PhysicalRangeIndex::erase(iterator it, std::unique_ptr<PhysicalRange>* erased) {
+    LeafNode* leaf = it.leaf;
+    size_t pos = it.pos;
+    assert(leaf != nullptr && pos < leaf->count);
+    LeafNode* next_leaf = leaf->next;
+
+    propagateStats(leaf, leaf->stats[pos], PhysicalRangeStats());
+    if (erased) {
+        *erased = std::move(leaf->ranges[pos]);
+    }
+    std::move(leaf->ranges + pos + 1, leaf->ranges + leaf->count, leaf->ranges + pos);
+    leaf->ranges[leaf->count - 1].reset();
+    leaf->removeKey(pos);
+    range_num--;
+
+    if (leaf->count == 0 && leaf != root.get()) {
+        if (leaf->prev) {
+            leaf->prev->next = leaf->next;
+        }
+        if (leaf->next) {
+            leaf->next->prev = leaf->prev;
+        }
+        removeChild(leaf);
+        return iterator(this, next_leaf, 0);
+    }
+    if (pos == 0 && leaf->count > 0) {
+        propagateFirst(leaf);
+    }
+    return makeIterator(leaf, pos);
+}
+
+PhysicalRangeIndex::iterator PhysicalRangeIndex::replace(iterator it, std::unique_ptr<PhysicalRange> range) {
+    assert(it.leaf != nullptr && range->startUserKey() == (*it)->startUserKey());
+    LeafNode* leaf = it.leaf;
+    leaf->ranges[it.pos] = std::move(range);
+    // same key, only the range to break ties is changed
+    leaf->setKey(it.pos, leaf->ranges[it.pos].get());
+    if (it.pos == 0) {
+        propagateFirst(leaf);
+    }
+    refresh(it);
+    return it;
+}
+
+void PhysicalRangeIndex::refresh(iterator it) {
+    assert(it.leaf != nullptr);
+    LeafNode* leaf = it.leaf;
+    PhysicalRangeStats old_stats = leaf->stats[it.pos];
+    leaf->stats[it.pos] = PhysicalRangeStats(*leaf->ranges[it.pos]);
+    propagateStats(leaf, old_stats, leaf->stats[it.pos]);
+}
+
+void PhysicalRangeIndex::clear() {
+    root.reset(new LeafNode());
+    range_num = 0;
+}
+
+PhysicalRangeIndex::LeafNode* PhysicalRangeIndex::splitLeaf(LeafNode* leaf) {
+    size_t half = leaf->count / 2;
+    std::unique_ptr<LeafNode> right(new LeafNode());
+    // a subset of the entries shares the prefix
+    right->prefix = leaf->prefix;
+    right->count = leaf->count - half;
+    std::move(leaf->ranges + half, leaf->ranges + leaf->count, right->ranges);
+    std::copy(leaf->heads + half, leaf->heads + leaf->count, right->heads);
+    std::copy(leaf->firsts + half, leaf->firsts + leaf->count, right->firsts);
+    std::copy(leaf->stats + half, leaf->stats + leaf->count, right->stats);
+    leaf->count = half;
+
+    right->prev = leaf;
+    right->next = leaf->next;
+    if (leaf->next) {
+        leaf->next->prev = right.get();
+    }
+    leaf->next = right.get();
+
+    LeafNode* result = right.get();
+    insertChild(leaf, std::move(right));
+    return result;
+}
+
+PhysicalRangeIndex::InnerNode* PhysicalRangeIndex::splitInner(InnerNode* node) {
+    size_t half = node->count / 2;
+    std::unique_ptr<InnerNode> right(new InnerNode());
+    right->prefix = node->prefix;
+    right->count = node->count - half;
+    std::move(node->children + half, node->children + node->count, right->children);
+    std::copy(node->heads + half, node->heads + node->count, right->heads);
+    std::copy(node->firsts + half, node->firsts + node->count, right->firsts);
+    std::copy(node->stats + half, node->stats + node->count, right->stats);
+    node->count = half;
+    for (size_t i = 0; i < right->count; i++) {
+        right->children[i]->parent = right.get();
+    }
+
+    InnerNode* result = right.get();
+    insertChild(node, std::move(right));
+    return result;
+}
+
+void PhysicalRangeIndex::insertChild(Node* left, std::unique_ptr<Node> right) {
+    if (left == root.get()) {
+        // grow a new root
+        std::unique_ptr<InnerNode> new_root(new InnerNode());
+        const PhysicalRange* left_first = left->firsts[0];
+        const PhysicalRange* right_first = right->firsts[0];
+        left->parent = new_root.get();
+        right->parent = new_root.get();
+        new_root->children[0] = std::move(root);
+        new_root->children[1] = std::move(right);
+        new_root->insertKey(0, left_first, left->total());
+        new_root->insertKey(1, right_first, new_root->children[1]->total());
+        root = std::move(new_root);
+        return;
+    }
+
+    InnerNode* parent = left->parent;
+    if (parent->count == kFanout) {
+        splitInner(parent);
+        // left may have moved to the new sibling
+        parent = left->parent;
+    }
+    size_t pos = parent->indexOf(left) + 1;
+    const PhysicalRange* right_first = right->firsts[0];
+    PhysicalRangeStats right_stats = right->total();
+    right->parent = parent;
+    std::move_backward(parent->children + pos, parent->children + parent->count, parent->children + parent->count + 1);
+    parent->children[pos] = std::move(right);
+    // the entries moved from left to right, the total of the parent is unchanged
+    parent->stats[pos - 1] -= right_stats;
+    parent->insertKey(pos, right_first, right_stats);
+}
+
+void PhysicalRangeIndex::removeChild(Node* node) {
+    assert(node != root.get() && node->count == 0);
+    InnerNode* parent = node->parent;
+    size_t pos = parent->indexOf(node);
+    std::move(parent->children + pos + 1, parent->children + parent->count, parent->children + pos);
+    parent->children[parent->count - 1].reset(); // node is freed here
+    parent->removeKey(pos);
+
+    if (parent->count == 0 && parent != root.get()) {
+        removeChild(parent);
+        return;
+    }
+    if (pos == 0 && parent->count > 0) {
+        propagateFirst(parent);
+    }
+    // shrink the tree while the root has a single child
+    while (!root->leaf && root->count <= 1) {
+        if (root->count == 0) {
+            root.reset(new LeafNode());
+        } else {
+            std::unique_ptr<Node> child = std::move(static_cast<InnerNode*>(root.get())->children[0]);
+            child->parent = nullptr;
+            root = std::move(child);
+        }
+    }
+}
+
+void PhysicalRangeIndex::propagateStats(Node* node, const PhysicalRangeStats& old_stats, const PhysicalRangeStats& new_stats) {
+    while (node->parent) {
+        InnerNode* parent = node->parent;
+        PhysicalRangeStats& entry_stats = parent->stats[parent->indexOf(node)];
+        entry_stats -= old_stats;
+        entry_stats += new_stats;
+        node = parent;
+    }
+}
+
+void PhysicalRangeIndex::propagateFirst(Node* node) {
+    while (node->parent) {
+        InnerNode* parent = node->parent;
+        size_t pos = parent->indexOf(node);
+        parent->setKey(pos, node->firsts[0]);
+        if (pos != 0) {
+            break;
+        }
+        node = parent;
+    }
+}
+
+}  // namespace ROCKSDB_NAMESPACE
@@ -0,0 +1,280 @@
+//  Copyright (c) 2011-present, Facebook, Inc.  All rights reserved.
+//  This source code is licensed under both the GPLv2 (found in the
+//  COPYING file in the root directory) and Apache 2.0 License
+//  (found in the LICENSE.Apache file in the root directory).
+
+#include "rocksdb/physical_range_index.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "port/stack_trace.h"
+#include "rocksdb/vec_physical_range.h"
+#include "test_util/testharness.h"
+#include "util/random.h"
+
+namespace ROCKSDB_NAMESPACE {
+
+class PhysicalRangeIndexTest : public testing::Test {
+ public:
+  PhysicalRangeIndexTest() : rnd_(301) {}
+
+  // A range starting at start_key of 1 to 3 entries, some of them deletions,
+  // with values of random sizes (so the stats differ by range)
+  std::unique_ptr<PhysicalRange> NewRange(const std::string& start_key) {
+    std::vector<std::string> internal_keys;
+    std::vector<std::string> values;
+    size_t len = 1 + rnd_.Uniform(3);
+    for (size_t i = 0; i < len; i++) {
+      std::string user_key = start_key + std::string(i, '\x01');
+      ValueType type = rnd_.OneIn(4) ? kTypeDeletion : kTypeValue;
+      internal_keys.push_back(
+          InternalKey(user_key, 100, type).Encode().ToString());
+      values.push_back(type == kTypeValue ? rnd_.RandomString(rnd_.Uniform(64))
+                                          : std::string());
+    }
+    std::vector<Slice> key_slices(internal_keys.begin(), internal_keys.end());
+    std::vector<Slice> value_slices(values.begin(), values.end());
+    return VecPhysicalRange::buildFromInternalEntries(key_slices,
+                                                      value_slices);
+  }
+
+  // Keys sharing long prefixes, equal 8 byte heads after them, keys which are
+  // prefixes of each other (equal heads once padded) and 0x00 / 0xff bytes
+  std::string NewKey() {
+    static const std::string kLongPrefix(40, 'p');
+    switch (rnd_.Uniform(5)) {
+      case 0:
+        return kLongPrefix + rnd_.RandomString(1 + rnd_.Uniform(12));
+      case 1:
+        return kLongPrefix + "headhead" + rnd_.RandomString(rnd_.Uniform(4));
+      case 2:
+        return "short" + std::string(rnd_.Uniform(10), '\0');
+      case 3:
+        return std::string(1 + rnd_.Uniform(10), '\xff') +
+               rnd_.RandomString(rnd_.Uniform(3));
+      default:
+        return rnd_.RandomString(1 + rnd_.Uniform(20));
+    }
+  }
+
+  std::unique_ptr<PhysicalRange> Insert(const std::string& start_key) {
+    std::unique_ptr<PhysicalRange> range = NewRange(start_key);
+    oracle_[start_key] = PhysicalRangeStats(*range);
+    return range;
+  }
+
+  static void AssertStatsEq(const PhysicalRangeStats& expected,
+                            const PhysicalRangeStats& actual) {
+    ASSERT_EQ(expected.length, actual.length);
+    ASSERT_EQ(expected.delete_length, actual.delete_length);
+    ASSERT_EQ(expected.byte_size, actual.byte_size);
+  }
+
+  // The start key of the range of it, or "<end>"
+  std::string KeyOf(PhysicalRangeIndex::iterator it) const {
+    return it == index_.end() ? "<end>" : (*it)->startUserKey().ToString();
+  }
+
+  std::string OracleKeyOf(
+      std::map<std::string, PhysicalRangeStats>::const_iterator it) const {
+    return it == oracle_.end() ? "<end>" : it->first;
+  }
+
+  // Check the iteration in both directions, the lookups of the probes and of
+  // the keys around the cached ones, and the stats, against the oracle
+  void Verify(const std::vector<std::string>& probes) {
+    ASSERT_EQ(oracle_.size(), index_.size());
+    ASSERT_EQ(oracle_.empty(), index_.empty());
+    auto it = index_.begin();
+    for (const auto& entry : oracle_) {
+      ASSERT_TRUE(it != index_.end());
+      ASSERT_EQ(entry.first, (*it)->startUserKey().ToString());
+      ++it;
+    }
+    ASSERT_TRUE(it == index_.end());
+    for (auto rit = oracle_.rbegin(); rit != oracle_.rend(); ++rit) {
+      --it;
+      ASSERT_EQ(rit->first, (*it)->startUserKey().ToString());
+    }
+    ASSERT_TRUE(it == index_.begin());
+    // the stats of the ranges before each of them in the oracle
+    std::vector<std::string> oracle_keys;
+    std::vector<PhysicalRangeStats> oracle_stats_before(1);
+    for (const auto& entry : oracle_) {
+      oracle_keys.push_back(entry.first);
+      oracle_stats_before.push_back(oracle_stats_before.back());
+      oracle_stats_before.back() += entry.second;
+    }
+    AssertStatsEq(oracle_stats_before.back(), index_.totalStats());
+
+    std::vector<std::string> keys = probes;
+    for (const auto& entry : oracle_) {
+      keys.push_back(entry.first);
+      keys.push_back(entry.first + std::string(1, '\0'));
+      if (!entry.first.empty()) {
+        keys.push_back(entry.first.substr(0, entry.first.size() - 1));
+      }
+    }
+    for (const auto& key : keys) {
+      ASSERT_EQ(OracleKeyOf(oracle_.lower_bound(key)),
+                KeyOf(index_.lower_bound(key)));
+      ASSERT_EQ(OracleKeyOf(oracle_.upper_bound(key)),
+                KeyOf(index_.upper_bound(key)));
+      ASSERT_EQ(OracleKeyOf(oracle_.find(key)), KeyOf(index_.find(key)));
+      size_t less = std::lower_bound(oracle_keys.begin(), oracle_keys.end(),
+                                     key) -
+                    oracle_keys.begin();
+      size_t less_or_equal = std::upper_bound(oracle_keys.begin(),
+                                              oracle_keys.end(), key) -
+                             oracle_keys.begin();
+      AssertStatsEq(oracle_stats_before[less], index_.statsBefore(key, false));
+      AssertStatsEq(oracle_stats_before[less_or_equal],
+                    index_.statsBefore(key, true));
+    }
+  }
+
+  std::vector<std::string> NewProbes(size_t num) {
+    std::vector<std::string> probes;
+    for (size_t i = 0; i < num; i++) {
+      probes.push_back(NewKey());
+    }
+    return probes;
+  }
+
+  Random rnd_;
+  PhysicalRangeIndex index_;
+  std::map<std::string, PhysicalRangeStats> oracle_;
+};
+
+TEST_F(PhysicalRangeIndexTest, LookupsWithSharedPrefixesAndEqualHeads) {
+  Verify(NewProbes(10));
+  // enough ranges for several levels of nodes of 32 entries
+  for (int batch = 0; batch < 8; batch++) {
+    for (int i = 0; i < 500; i++) {
+      std::string key = NewKey();
+      if (oracle_.count(key) > 0) {
+        continue;
+      }
+      auto it = index_.insert(Insert(key));
+      ASSERT_EQ(key, KeyOf(it));
+    }
+    Verify(NewProbes(100));
+  }
+}
+
+TEST_F(PhysicalRangeIndexTest, SplitsOfSequentialInserts) {
+  // ascending and descending inserts split the last and the first nodes
+  std::string prefix(30, 'k');
+  for (int i = 0; i < 2000; i++) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%08d", i);
+    index_.insert(Insert(prefix + buf));
+    snprintf(buf, sizeof(buf), "%08d", 9999 - i);
+    index_.insert(Insert(prefix + "~" + buf));
+  }
+  Verify(NewProbes(100));
+}
+
+TEST_F(PhysicalRangeIndexTest, EraseRemovesEmptyNodes) {
+  for (int i = 0; i < 3000; i++) {
+    std::string key = NewKey();
+    if (oracle_.count(key) == 0) {
+      index_.insert(Insert(key));
+    }
+  }
+  Verify(NewProbes(50));
+
+  // erase a run of adjacent ranges (emptying whole leaves) through the
+  // returned iterators
+  auto it = index_.lower_bound(oracle_.begin()->first);
+  std::advance(it, 100);
+  for (int i = 0; i < 500 && it != index_.end(); i++) {
+    std::string key = (*it)->startUserKey().ToString();
+    std::unique_ptr<PhysicalRange> erased;
+    it = index_.erase(it, &erased);
+    ASSERT_TRUE(erased != nullptr);
+    ASSERT_EQ(key, erased->startUserKey().ToString());
+    auto oracle_it = oracle_.erase(oracle_.find(key));
+    ASSERT_EQ(OracleKeyOf(oracle_it), KeyOf(it));
+  }
+  Verify(NewProbes(50));
+
+  // erase the others in random order
+  while (!oracle_.empty()) {
+    auto oracle_it = oracle_.begin();
+    std::advance(oracle_it, rnd_.Uniform(static_cast<int>(oracle_.size())));
+    it = index_.find(oracle_it->first);
+    ASSERT_TRUE(it != index_.end());
+    it = index_.erase(it);
+    oracle_it = oracle_.erase(oracle_it);
+    ASSERT_EQ(OracleKeyOf(oracle_it), KeyOf(it));
+    if (oracle_.size() % 500 == 0) {
+      Verify(NewProbes(20));
+    }
+  }
+  ASSERT_TRUE(index_.empty());
+  ASSERT_TRUE(index_.begin() == index_.end());
+  AssertStatsEq(PhysicalRangeStats(), index_.totalStats());
+
+  // the emptied index is used again
+  for (int i = 0; i < 200; i++) {
+    std::string key = NewKey();
+    if (oracle_.count(key) == 0) {
+      index_.insert(Insert(key));
+    }
+  }
+  Verify(NewProbes(20));
+}
+
+TEST_F(PhysicalRangeIndexTest, ReplaceAndRefreshKeepStats) {
+  for (int i = 0; i < 1000; i++) {
+    std::string key = NewKey();
+    if (oracle_.count(key) == 0) {
+      index_.insert(Insert(key));
+    }
+  }
+  for (auto& entry : oracle_) {
+    if (!rnd_.OneIn(3)) {
+      continue;
+    }
+    auto it = index_.find(entry.first);
+    ASSERT_TRUE(it != index_.end());
+    std::unique_ptr<PhysicalRange> range = NewRange(entry.first);
+    const PhysicalRange* new_range = range.get();
+    entry.second = PhysicalRangeStats(*range);
+    it = index_.replace(it, std::move(range));
+    ASSERT_EQ(new_range, it->get());
+  }
+  Verify(NewProbes(50));
+
+  // ranges updated in place (growing by an entry) and refreshed
+  for (auto& entry : oracle_) {
+    if (!rnd_.OneIn(3)) {
+      continue;
+    }
+    auto it = index_.find(entry.first);
+    ASSERT_TRUE(it != index_.end());
+    std::string internal_key =
+        InternalKey((*it)->endUserKey().ToString() + "+", 200, kTypeValue)
+            .Encode()
+            .ToString();
+    ASSERT_EQ(PhysicalRangeUpdateResult::INSERTED,
+              (*it)->update(internal_key, "value"));
+    index_.refresh(it);
+    entry.second = PhysicalRangeStats(**it);
+  }
+  Verify(NewProbes(50));
+}
+
+}  // namespace ROCKSDB_NAMESPACE
+
+int main(int argc, char** argv) {
+  ROCKSDB_NAMESPACE::port::InstallStackTraceHandler();
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
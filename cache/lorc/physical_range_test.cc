@@ -0,0 +1,346 @@
+//  Copyright (c) 2011-present, Facebook, Inc.  All rights reserved.
+//  This source code is licensed under both the GPLv2 (found in the
+//  COPYING file in the root directory) and Apache 2.0 License
+//  (found in the LICENSE.Apache file in the root directory).
+
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "port/stack_trace.h"
+#include "rocksdb/compressed_physical_range.h"
+#include "rocksdb/continuous_physical_range.h"
+#include "rocksdb/fixed_key_physical_range.h"
+#include "rocksdb/rbtree_lorc.h"
+#include "rocksdb/vec_physical_range.h"
+#include "test_util/testharness.h"
+#include "util/compression.h"
+#include "util/random.h"
+
+namespace ROCKSDB_NAMESPACE {
+
+enum class TestRangeType { kContinuous, kVec, kFixedKey, kCompressed };
+
+// Builds a physical range of each type, applies random inserts, overwrites
+// and deletions to it and to a std::map model, and reads all keys (with their
+// trailers) and values back
+class PhysicalRangeTest : public testing::TestWithParam<TestRangeType> {
+ public:
+  struct Entry {
+    std::string internal_key;
+    std::string value;
+  };
+
+  PhysicalRangeTest() : rnd_(301), compression_type_(kNoCompression) {
+    for (CompressionType type : {kSnappyCompression, kLZ4Compression,
+                                 kZlibCompression, kZSTD}) {
+      if (CompressionTypeSupported(type)) {
+        compression_type_ = type;
+        break;
+      }
+    }
+  }
+
+  // 16 byte user keys, as a FixedKeyPhysicalRange of 16 bytes holds them
+  static std::string Key(uint64_t id) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "key%013llu",
+             static_cast<unsigned long long>(id));
+    return buf;
+  }
+
+  // Values of runs of one char (so a compressed range saves), of 0 to 2000
+  // bytes so the values of a ContinuousPhysicalRange grow out of place
+  std::string NewValue() {
+    std::string value;
+    size_t len = rnd_.Uniform(4) == 0 ? rnd_.Uniform(2000) : rnd_.Uniform(100);
+    while (value.size() < len) {
+      value.append(1 + rnd_.Uniform(20),
+                   static_cast<char>('a' + rnd_.Uniform(26)));
+    }
+    value.resize(len);
+    return value;
+  }
+
+  void Build(size_t num, uint64_t id_step) {
+    for (size_t i = 0; i < num; i++) {
+      std::string user_key = Key((i + 1) * id_step);
+      // most entries share the sequence number and type of the range
+      SequenceNumber seq = rnd_.OneIn(10) ? 1 + rnd_.Uniform(9) : 10;
+      ValueType type = rnd_.OneIn(10) ? kTypeDeletion : kTypeRangeCacheValue;
+      model_[user_key] = Entry{
+          InternalKey(user_key, seq, type).Encode().ToString(),
+          type == kTypeDeletion ? std::string() : NewValue()};
+    }
+    std::vector<Slice> internal_keys;
+    std::vector<Slice> values;
+    for (const auto& entry : model_) {
+      internal_keys.emplace_back(entry.second.internal_key);
+      values.emplace_back(entry.second.value);
+    }
+    switch (GetParam()) {
+      case TestRangeType::kContinuous:
+        range_ = ContinuousPhysicalRange::buildFromInternalEntries(
+            internal_keys, values);
+        break;
+      case TestRangeType::kVec:
+        range_ = VecPhysicalRange::buildFromInternalEntries(internal_keys,
+                                                            values);
+        break;
+      case TestRangeType::kFixedKey:
+        range_ = buildFixedKeyPhysicalRangeFromInternalEntries(internal_keys,
+                                                               values);
+        break;
+      case TestRangeType::kCompressed: {
+        std::unique_ptr<VecPhysicalRange> hot_range =
+            VecPhysicalRange::buildFromInternalEntries(internal_keys, values);
+        range_ = CompressedPhysicalRange::buildFromPhysicalRange(
+            *hot_range, compression_type_, 4096 /* block_size */);
+        break;
+      }
+    }
+    ASSERT_TRUE(range_ != nullptr);
+    Verify();
+  }
+
+  // Insert, overwrite or delete user_key in the range and in the model
+  void Update(const std::string& user_key, bool deletion) {
+    seq_++;
+    std::string value = deletion ? std::string() : NewValue();
+    std::string internal_key =
+        InternalKey(user_key, seq_, deletion ? kTypeDeletion : kTypeValue)
+            .Encode()
+            .ToString();
+    PhysicalRangeUpdateResult expected =
+        model_.count(user_key) > 0 ? PhysicalRangeUpdateResult::UPDATED
+                                   : PhysicalRangeUpdateResult::INSERTED;
+    ASSERT_EQ(expected, range_->update(internal_key, value));
+    // values are kept as kTypeRangeCacheValue by the range cache
+    model_[user_key] = Entry{
+        InternalKey(user_key, seq_,
+                    deletion ? kTypeDeletion : kTypeRangeCacheValue)
+            .Encode()
+            .ToString(),
+        value};
+  }
+
+  void VerifyEntry(size_t index, const Entry& entry,
+                   PhysicalRangeKeyBuffer* key_buffer,
+                   PhysicalRangeValueBuffer* value_buffer) {
+    ASSERT_EQ(entry.internal_key,
+              range_->readInternalKeyAt(index, key_buffer).ToString());
+    Slice user_key = ExtractUserKey(entry.internal_key);
+    ASSERT_EQ(user_key, range_->readUserKeyAt(index, key_buffer));
+    ASSERT_EQ(entry.value, range_->readValueAt(index, value_buffer).ToString());
+    ASSERT_FALSE(value_buffer->corrupted);
+    ASSERT_EQ(entry.value, range_->valueAt(index).ToString());
+    ASSERT_EQ(static_cast<int>(index), range_->find(user_key));
+  }
+
+  void Verify() {
+    ASSERT_EQ(model_.size(), range_->length());
+    size_t delete_length = 0;
+    size_t byte_size = 0;
+    for (const auto& entry : model_) {
+      if (ExtractValueType(entry.second.internal_key) == kTypeDeletion) {
+        delete_length++;
+      }
+      byte_size += entry.second.internal_key.size() + entry.second.value.size();
+    }
+    ASSERT_EQ(delete_length, range_->deleteLength());
+    if (GetParam() == TestRangeType::kVec ||
+        GetParam() == TestRangeType::kFixedKey) {
+      // the keys and values are stored plainly
+      ASSERT_EQ(byte_size, range_->byteSize());
+    }
+    ASSERT_EQ(model_.begin()->first, range_->startUserKey().ToString());
+    ASSERT_EQ(model_.rbegin()->first, range_->endUserKey().ToString());
+    ASSERT_EQ(model_.rbegin()->second.internal_key,
+              range_->endInternalKey().ToString());
+
+    // in order, as the iterators read
+    std::vector<const Entry*> entries;
+    PhysicalRangeKeyBuffer key_buffer;
+    PhysicalRangeValueBuffer value_buffer;
+    size_t index = 0;
+    for (const auto& entry : model_) {
+      VerifyEntry(index++, entry.second, &key_buffer, &value_buffer);
+      entries.push_back(&entry.second);
+    }
+    // out of order (the keys are decoded from their restart points again)
+    for (int i = 0; i < 200; i++) {
+      index = rnd_.Uniform(static_cast<int>(entries.size()));
+      VerifyEntry(index, *entries[index], &key_buffer, &value_buffer);
+    }
+    // a key before the range is found at its start, none after its end
+    ASSERT_EQ(0, range_->find(Key(0)));
+    ASSERT_EQ(-1, range_->find(model_.rbegin()->first + "~"));
+  }
+
+  bool IsCompressed() const {
+    return GetParam() == TestRangeType::kCompressed;
+  }
+
+  Random rnd_;
+  CompressionType compression_type_;
+  SequenceNumber seq_ = 100;
+  std::map<std::string, Entry> model_;
+  std::unique_ptr<PhysicalRange> range_;
+};
+
+TEST_P(PhysicalRangeTest, RandomUpdatesRoundTrip) {
+  if (IsCompressed() && compression_type_ == kNoCompression) {
+    ROCKSDB_GTEST_BYPASS("no compression supported");
+    return;
+  }
+  // a compressed range is compressed again on every update
+  const int kOps = IsCompressed() ? 200 : 2000;
+  Build(500, 1000);
+  for (int i = 0; i < kOps; i++) {
+    if (rnd_.OneIn(2) && !model_.empty()) {
+      // an overwrite (or deletion) of a cached key
+      auto it = model_.lower_bound(Key(rnd_.Uniform(600 * 1000)));
+      if (it == model_.end()) {
+        it = model_.begin();
+      }
+      Update(it->first, rnd_.OneIn(4));
+      continue;
+    }
+    // an insertion before, in or after the range
+    Update(Key(rnd_.Uniform(502 * 1000)), rnd_.OneIn(4));
+    if (i % 500 == 0) {
+      Verify();
+    }
+  }
+  Verify();
+}
+
+TEST_P(PhysicalRangeTest, RestartIntervalsGrowAndSplit) {
+  if (IsCompressed() && compression_type_ == kNoCompression) {
+    ROCKSDB_GTEST_BYPASS("no compression supported");
+    return;
+  }
+  Build(200, 1000);
+  // far more than 32 keys inserted between two adjacent keys, in ascending
+  // and in descending order
+  for (uint64_t i = 1; i <= 100; i++) {
+    Update(Key(50 * 1000 + i), false);
+    Update(Key(100 * 1000 + 999 - i), rnd_.OneIn(5));
+  }
+  Verify();
+  // and overwritten (the trailers differ from the one of the range)
+  for (uint64_t i = 1; i <= 100; i += 3) {
+    Update(Key(50 * 1000 + i), rnd_.OneIn(2));
+  }
+  Verify();
+}
+
+TEST_P(PhysicalRangeTest, ChunksSplitAtHeadAndTail) {
+  if (IsCompressed() && compression_type_ == kNoCompression) {
+    ROCKSDB_GTEST_BYPASS("no compression supported");
+    return;
+  }
+  // past the 512 entries (or 64KB) a chunk of a range is split at, before the
+  // start key and after the end key
+  const uint64_t kInserts = IsCompressed() ? 50 : 1200;
+  Build(100, 1000 * 1000);
+  for (uint64_t i = 1; i <= kInserts; i++) {
+    Update(Key(1000 * 1000 - i), rnd_.OneIn(8));
+    Update(Key(100 * 1000 * 1000 + i), rnd_.OneIn(8));
+  }
+  Verify();
+  // overwrites of the new chunks
+  for (uint64_t i = 1; i <= kInserts; i += 7) {
+    Update(Key(1000 * 1000 - i), false);
+    Update(Key(100 * 1000 * 1000 + i), false);
+  }
+  Verify();
+}
+
+INSTANTIATE_TEST_CASE_P(PhysicalRangeTest, PhysicalRangeTest,
+                        ::testing::Values(TestRangeType::kContinuous,
+                                          TestRangeType::kVec,
+                                          TestRangeType::kFixedKey,
+                                          TestRangeType::kCompressed));
+
+TEST(FixedKeyPhysicalRangeTest, OtherKeySizesFallBackToVec) {
+  std::vector<std::string> keys;
+  std::vector<std::string> values;
+  for (int i = 0; i < 100; i++) {
+    keys.push_back(PhysicalRangeTest::Key(i * 10));
+    values.push_back("value" + std::to_string(i));
+  }
+
+  // keys of other or unsupported sizes are not built in fixed key ranges
+  std::vector<Slice> internal_keys;
+  std::vector<std::string> internal_key_strs;
+  for (const auto& key : keys) {
+    internal_key_strs.push_back(
+        InternalKey(key, 10, kTypeRangeCacheValue).Encode().ToString());
+  }
+  internal_keys.assign(internal_key_strs.begin(), internal_key_strs.end());
+  std::vector<Slice> value_slices(values.begin(), values.end());
+  std::unique_ptr<PhysicalRange> range =
+      buildFixedKeyPhysicalRangeFromInternalEntries(internal_keys,
+                                                    value_slices);
+  ASSERT_TRUE(range != nullptr);
+  std::string odd_key =
+      InternalKey(keys[50] + "x", 20, kTypeValue).Encode().ToString();
+  ASSERT_EQ(PhysicalRangeUpdateResult::UNABLE_TO_INSERT,
+            range->update(odd_key, "odd"));
+  ASSERT_EQ(keys.size(), range->length());
+  std::string odd_internal_key = InternalKey(keys[50] + "x", 10,
+                                             kTypeRangeCacheValue)
+                                     .Encode()
+                                     .ToString();
+  internal_keys[50] = odd_internal_key;
+  ASSERT_TRUE(buildFixedKeyPhysicalRangeFromInternalEntries(
+                  internal_keys, value_slices) == nullptr);
+
+  // the range cache rebuilds the range as a VecPhysicalRange to insert it
+  RBTreeLogicalOrderedRangeCache range_cache(size_t{1} << 20,
+                                             LorcLogger::Level::DISABLE,
+                                             PhysicalRangeType::FIXED_KEY);
+  ReferringRange ref_range(true, 10);
+  for (size_t i = 0; i < keys.size(); i++) {
+    ref_range.emplace(keys[i], values[i]);
+  }
+  range_cache.putGapPhysicalRange(std::move(ref_range), false, false, false,
+                                  "", "");
+  range_cache.lockWrite();
+  ASSERT_TRUE(range_cache.updateEntry(odd_key, "odd"));
+  ASSERT_TRUE(range_cache.updateEntry(
+      InternalKey(keys[10], 30, kTypeValue).Encode().ToString(), "new"));
+  range_cache.unlockWrite();
+
+  range_cache.lockRead();
+  for (size_t i = 0; i < keys.size(); i++) {
+    bool found = false;
+    std::string value;
+    ASSERT_TRUE(range_cache.lookupEntry(keys[i], nullptr, &value, &found));
+    ASSERT_TRUE(found);
+    ASSERT_EQ(i == 10 ? "new" : values[i], value);
+  }
+  bool found = false;
+  std::string internal_key;
+  std::string value;
+  ASSERT_TRUE(
+      range_cache.lookupEntry(keys[50] + "x", &internal_key, &value, &found));
+  ASSERT_TRUE(found);
+  ASSERT_EQ("odd", value);
+  ParsedInternalKey parsed_key;
+  ASSERT_OK(ParseInternalKey(internal_key, &parsed_key, false));
+  ASSERT_EQ(20u, parsed_key.sequence);
+  range_cache.unlockRead();
+}
+
+}  // namespace ROCKSDB_NAMESPACE
+
+int main(int argc, char** argv) {
+  ROCKSDB_NAMESPACE::port::InstallStackTraceHandler();
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
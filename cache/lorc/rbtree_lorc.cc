@@ -3,7 +3,12 @@
 #include <iomanip>
 #include <algorithm>
 #include <climits>
+#include <cstdint>
 #include <shared_mutex>
+#include "rocksdb/compressed_physical_range.h"
+#include "rocksdb/fixed_key_physical_range.h"
+#include "rocksdb/lorc_budget.h"
+#include "rocksdb/lorc_secondary_tier.h"
 #include "rocksdb/rbtree_lorc.h"
 #include "rocksdb/rbtree_lorc_iter.h"
 #include "memory/arena.h"
@@ -11,7 +16,7 @@
 namespace ROCKSDB_NAMESPACE {
 
 RBTreeLogicalOrderedRangeCache::RBTreeLogicalOrderedRangeCache(size_t capacity_, LorcLogger::Level logger_level_, PhysicalRangeType physical_range_type_)
-    : LogicalOrderedRangeCache(capacity_, logger_level_, physical_range_type_), cache_timestamp(0) {
+    : LogicalOrderedRangeCache(capacity_, logger_level_, physical_range_type_), cache_timestamp(0), compressed_physical_range_num(0) {
 }
 
 RBTreeLogicalOrderedRangeCache::~RBTreeLogicalOrderedRangeCache() {
@@ -22,6 +27,17 @@ RBTreeLogicalOrderedRangeCache::~RBTreeLogicalOrderedRangeCache() {
     unlockWrite();
 }
 
+std::shared_ptr<LogicalOrderedRangeCache> RBTreeLogicalOrderedRangeCache::newTenant(const std::string& cf_name) const {
+    if (!this->budget) {
+        return nullptr;
+    }
+    auto tenant = std::make_shared<RBTreeLogicalOrderedRangeCache>(this->capacity, LorcLogger::Level::DISABLE,
+                                                                   this->physical_range_type);
+    this->copySettingsTo(tenant.get());
+    this->budget->addRangeCache(cf_name, tenant, this->capacity);
+    return tenant;
+}
+
 void RBTreeLogicalOrderedRangeCache::putGapPhysicalRange(ReferringRange&& newRefRange, bool leftConcat, bool rightConcat, bool emptyConcat, std::string emptyConcatLeftKey, std::string emptyConcatRightKey) {
     lockWrite();
     std::chrono::high_resolution_clock::time_point start_time;
@@ -29,8 +45,15 @@ void RBTreeLogicalOrderedRangeCache::putGapPhysicalRange(ReferringRange&& newRef
     std::unique_ptr<PhysicalRange> newRange;
     if (LogicalOrderedRangeCache::getPhysicalRangeType() == PhysicalRangeType::CONTINUOUS) {
         newRange = ContinuousPhysicalRange::buildFromReferringRange(newRefRange);
-    } else if (LogicalOrderedRangeCache::getPhysicalRangeType() == PhysicalRangeType::VEC) {
+    } else if (LogicalOrderedRangeCache::getPhysicalRangeType() == PhysicalRangeType::VEC ||
+               LogicalOrderedRangeCache::getPhysicalRangeType() == PhysicalRangeType::BLOB_INDEX) {
         newRange = VecPhysicalRange::buildFromReferringRange(newRefRange);
+    } else if (LogicalOrderedRangeCache::getPhysicalRangeType() == PhysicalRangeType::FIXED_KEY) {
+        newRange = buildFixedKeyPhysicalRangeFromReferringRange(newRefRange);
+        if (!newRange) {
+            // keys of unsupported or mixed sizes
+            newRange = VecPhysicalRange::buildFromReferringRange(newRefRange);
+        }
     } else {
         logger.error("Unsupported PhysicalRangeType for RBTreeLogicalOrderedRangeCache");
         unlockWrite();
@@ -47,11 +70,20 @@ void RBTreeLogicalOrderedRangeCache::putGapPhysicalRange(ReferringRange&& newRef
         // Update the logical ranges view
         ranges_view.putLogicalRange(LogicalRange(newRange->startUserKey().ToString(), newRange->endUserKey().ToString(), newRange->length(), true, true, true), leftConcat, rightConcat);
 
+        // The range may have been evicted recently (a hit with a larger cache)
+        this->checkGhostRange(newRange->startUserKey(), newRange->endUserKey(), newRange->byteSize());
+        // The spilled copy (if any) is older than the scanned one
+        if (this->secondary_tier) {
+            this->secondary_tier->invalidate(newRange->startUserKey(), newRange->endUserKey());
+        }
+
         // Put into physical ranges directly since no overlapping
         physical_range_length_map.emplace(newRange->length(), newRange->startUserKey().ToString());
         this->current_size += newRange->byteSize();
         this->total_range_length += newRange->length();
-        ordered_physical_ranges.emplace(std::move(newRange));
+        auto inserted = ordered_physical_ranges.insert(std::move(newRange));
+        this->updateCacheReservation();
+        this->checkPrefixQuotas((*inserted)->startUserKey());
     } else {
         // empty actual range only for concat adjacent ranges
         assert(leftConcat && rightConcat && !emptyConcatLeftKey.empty() && !emptyConcatRightKey.empty());
@@ -88,17 +120,13 @@ bool RBTreeLogicalOrderedRangeCache::updateEntry(const Slice& internal_key, cons
     Slice user_key = Slice(internal_key.data(), internal_key.size() - PhysicalRange::internal_key_extra_bytes);
 
     // Find the logical range that may contain the user key
-    auto logical_ranges = ranges_view.getLogicalRanges();
-    auto find_first_range = [&logical_ranges](const Slice& key) {
-        auto it = std::lower_bound(logical_ranges.begin(), logical_ranges.end(), key,
-            [](const LogicalRange& range, const Slice& key_) {
-                return range.endUserKey() < key_;
-            });
-        return it;
-    };
-    auto range_it = find_first_range(user_key);
-    if (range_it == logical_ranges.end() || range_it->startUserKey() > user_key) {
+    auto range_it = ranges_view.findRange(user_key);
+    if (range_it == ranges_view.getLogicalRanges().end() || range_it->startUserKey() > user_key) {
         // The user key is not in any logical range, no need to update!
+        // But a spilled range containing it is stale now
+        if (this->secondary_tier) {
+            this->secondary_tier->invalidate(user_key, user_key);
+        }
         return false;
     }
     Slice logical_range_start_key = range_it->startUserKey();
@@ -127,18 +155,35 @@ bool RBTreeLogicalOrderedRangeCache::updateEntry(const Slice& internal_key, cons
     }
     // `(*it)->endUserKey() < user_key && (*it)->endUserKey() != logical_range_end_key` is possible (tail insertion in a middle physical range)
 
+    if ((*it)->isCompressed()) {
+        // A cold range being written is decompressed back to a hot one
+        it = this->decompressPhysicalRange(it);
+        if (it == ordered_physical_ranges.end()) {
+            // the cached entries would be stale without the update
+            logger.error("Failed to decompress the physical range to update user key " + user_key.ToString());
+            this->invalidateLogicalRange(user_key);
+            return false;
+        }
+    }
+
     ParsedInternalKey parsed_internal_key;
     Status s = ParseInternalKey(internal_key, &parsed_internal_key, false);
     SequenceNumber key_seq_num = parsed_internal_key.sequence;
 
     // update in physical range
+    size_t old_byte_size = (*it)->byteSize();
     PhysicalRangeUpdateResult updateResult = (*it)->update(internal_key, value);
+    if (updateResult == PhysicalRangeUpdateResult::UNABLE_TO_INSERT && !(*it)->isCompressed()) {
+        // e.g. a key of another size in a FixedKeyPhysicalRange, retry in a general range
+        it = this->generalizePhysicalRange(it);
+        old_byte_size = (*it)->byteSize();
+        updateResult = (*it)->update(internal_key, value);
+    }
+    // keep the stats of the index (length, deletions and bytes) in sync
+    ordered_physical_ranges.refresh(it);
 
     if (updateResult == PhysicalRangeUpdateResult::UNABLE_TO_INSERT) {
         logger.error("Failed to update entry (user key = " + parsed_internal_key.user_key.ToString() + ") in PhysicalRange: " + (*it)->toString());
-        if (LogicalOrderedRangeCache::getPhysicalRangeType() == PhysicalRangeType::CONTINUOUS) {
-            logger.error("Random insertion in continuous physical range is not supported yet");
-        }
         return false;
     } else if (updateResult == PhysicalRangeUpdateResult::ERROR) {
         logger.error("Error updating entry (user key = " + parsed_internal_key.user_key.ToString() + ") in PhysicalRange: " + (*it)->toString());
@@ -147,19 +192,20 @@ bool RBTreeLogicalOrderedRangeCache::updateEntry(const Slice& internal_key, cons
         logger.error("Key " + parsed_internal_key.user_key.ToString() + " is out of range in PhysicalRange: " + (*it)->toString());
         return false;
     } else if (updateResult == PhysicalRangeUpdateResult::UPDATED) {
-        // normally updated
-        // Note: not re-calculate byte size of the PhysicalRange after update (even for VecPhysicalRange)
-        // TODO(jr): neccessary to re-calculate the byte size of the PhysicalRange?
+        // normally updated, the value size may change
+        this->current_size = this->current_size - old_byte_size + (*it)->byteSize();
+        this->updateCacheReservation();
     } else if (updateResult == PhysicalRangeUpdateResult::INSERTED) {
         // update the outer logical range length
-        range_it->setLength(range_it->length() + 1);
+        ranges_view.setRangeLength(range_it, range_it->length() + 1);
         
         // update lorc info
         this->total_range_length += 1;
-        this->current_size += (internal_key.size() + value.size());
-        while (this->current_size > this->capacity) {
-            this->victim();
+        this->current_size = this->current_size - old_byte_size + (*it)->byteSize();
+        this->checkPrefixQuotas((*it)->startUserKey());
+        while (this->current_size > this->getEffectiveCapacity() && this->victim()) {
         }
+        this->updateCacheReservation();
     }
 
     assert(updateResult == PhysicalRangeUpdateResult::UPDATED || updateResult == PhysicalRangeUpdateResult::INSERTED);
@@ -168,7 +214,7 @@ bool RBTreeLogicalOrderedRangeCache::updateEntry(const Slice& internal_key, cons
     return true;
 }
 
-bool RBTreeLogicalOrderedRangeCache::Get(const Slice& internal_key, std::string* value, Status* s) const {
+bool RBTreeLogicalOrderedRangeCache::Get(const Slice& internal_key, std::string* value, Status* s, bool* is_blob_index) const {
     lockRead();
     assert(s);
     
@@ -227,7 +273,8 @@ bool RBTreeLogicalOrderedRangeCache::Get(const Slice& internal_key, std::string*
     }
     
     // Check if the found key exactly matches our target key
-    if ((*it)->userKeyAt(index) != user_key) {
+    PhysicalRangeKeyBuffer key_buffer;
+    if ((*it)->readUserKeyAt(index, &key_buffer) != user_key) {
         *s = Status::OK();
         unlockRead();
         return false;
@@ -235,37 +282,123 @@ bool RBTreeLogicalOrderedRangeCache::Get(const Slice& internal_key, std::string*
     
     // Key found, retrieve the value
     if (value) {
-        *value = (*it)->valueAt(index).ToString();
+        PhysicalRangeValueBuffer value_buffer;
+        *value = (*it)->readValueAt(index, &value_buffer).ToString();
+        if (value_buffer.corrupted) {
+            // read from the LSM, the range is dropped by tryVictim()
+            this->reportCorruptedRange((*it)->startUserKey());
+            value->clear();
+            *s = Status::OK();
+            unlockRead();
+            return false;
+        }
+    }
+    if (is_blob_index) {
+        *is_blob_index = ExtractValueType((*it)->readInternalKeyAt(index, &key_buffer)) == kTypeBlobIndex;
     }
     *s = Status::OK();
     unlockRead();
     return true;
 }
 
+bool RBTreeLogicalOrderedRangeCache::lookupEntry(const Slice& user_key, std::string* internal_key, std::string* value, bool* found) const {
+    // lookup is done with outside lock
+    assert(found);
+    *found = false;
+    auto range_it = ranges_view.findRange(user_key);
+    if (range_it == ranges_view.getLogicalRanges().end() || range_it->startUserKey() > user_key) {
+        return false;
+    }
+
+    // Find the physical range that may contain the key
+    auto it = ordered_physical_ranges.upper_bound(user_key);
+    if (it != ordered_physical_ranges.begin()) {
+        it--;
+    }
+    if (it == ordered_physical_ranges.end() || (*it)->startUserKey() > user_key || (*it)->endUserKey() < user_key) {
+        return true;
+    }
+    int index = (*it)->find(user_key);
+    PhysicalRangeKeyBuffer key_buffer;
+    if (index < 0 || (size_t)index >= (*it)->length() || (*it)->readUserKeyAt(index, &key_buffer) != user_key) {
+        return true;
+    }
+
+    if (value) {
+        PhysicalRangeValueBuffer value_buffer;
+        *value = (*it)->readValueAt(index, &value_buffer).ToString();
+        if (value_buffer.corrupted) {
+            // as if not in any logical range, the range is dropped by tryVictim()
+            this->reportCorruptedRange((*it)->startUserKey());
+            value->clear();
+            return false;
+        }
+    }
+    *found = true;
+    if (internal_key) {
+        *internal_key = (*it)->readInternalKeyAt(index, &key_buffer).ToString();
+    }
+    return true;
+}
+
+bool RBTreeLogicalOrderedRangeCache::invalidateLogicalRange(const Slice& user_key) {
+    // invalidation is done with outside write lock
+    if (this->secondary_tier) {
+        this->secondary_tier->invalidate(user_key, user_key);
+    }
+    auto range_it = ranges_view.findRange(user_key);
+    if (range_it == ranges_view.getLogicalRanges().end() || range_it->startUserKey() > user_key) {
+        return false;
+    }
+    logger.info("Invalidate logical range: " + range_it->toString());
+    bool invalidated = this->evictLogicalRange(range_it->startUserKey(), range_it->endUserKey(), range_it->length(), true);
+    this->updateCacheReservation();
+    return invalidated;
+}
+
 void RBTreeLogicalOrderedRangeCache::tryVictim() {    
+    this->maybeRefreshEffectiveCapacity();
+    if (this->budget_tenant) {
+        // follow the share of the budget, which may shrink the other tenants
+        this->budget->maybeRebalance();
+    }
+    this->dropCorruptedRanges();
     lockRead();
     // If no ranges exist, nothing to evict
-    if (physical_range_length_map.empty() || ordered_physical_ranges.empty() || this->current_size <= this->capacity) {
-        unlockRead();
-        return;
+    bool need_victim = !(physical_range_length_map.empty() || ordered_physical_ranges.empty() ||
+                         (this->current_size <= this->getEffectiveCapacity() && prefixes_over_hard_quota.empty() &&
+                          !this->prefix_quotas_changed));
+    unlockRead();
+
+    if (need_victim) {
+        // upgrade to unique lock for real victim
+        lockWrite();
+        if (this->prefix_quotas_changed) {
+            this->refreshPrefixesOverQuotas();
+        }
+        this->enforcePrefixHardQuotas();
+        while (this->current_size > this->getEffectiveCapacity() && this->victim()) {
+        }
+        this->updateCacheReservation();
+        unlockWrite();
     }
 
-    // upgrade to unique lock for real victim
-    unlockRead();
-    lockWrite();
-    while (this->current_size > this->capacity) {
-        this->victim();
+    // spill the ranges evicted here (or by flushes) without the lock
+    if (this->secondary_tier) {
+        Status s = this->secondary_tier->drainPendingSpills();
+        if (!s.ok()) {
+            logger.warn("Failed to spill ranges to the secondary tier: " + s.ToString());
+        }
     }
-    unlockWrite();
 }
 
-void RBTreeLogicalOrderedRangeCache::victim() {    
+bool RBTreeLogicalOrderedRangeCache::victim() {    
     // Evict the shortest PhysicalRange to minimize impact
-    if (this->current_size <= this->capacity) {
-        return;
+    if (this->current_size <= this->getEffectiveCapacity()) {
+        return false;
     }
     if (physical_range_length_map.empty() || ordered_physical_ranges.empty()) {
-        return;
+        return false;
     }
     
     // victimRangeStartKey is the start key of range whose len is the smallest
@@ -273,21 +406,40 @@ void RBTreeLogicalOrderedRangeCache::victim() {
     Slice victimRangeStartKey;
     Slice victimRangeEndKey;
     size_t min_len = 0;
-    for (auto& range : ranges_view.getLogicalRanges()) {
-        if (range.length() < min_len || min_len == 0) {
-            min_len = range.length();
-            victimRangeStartKey = range.startUserKey();
-            victimRangeEndKey = range.endUserKey();
+    // the prefixes above their soft quotas go first
+    if (!this->selectPrefixVictim(&victimRangeStartKey, &victimRangeEndKey, &min_len)) {
+        for (auto& range : ranges_view.getLogicalRanges()) {
+            if (range.length() < min_len || min_len == 0) {
+                min_len = range.length();
+                victimRangeStartKey = range.startUserKey();
+                victimRangeEndKey = range.endUserKey();
+            }
         }
     }
+    return this->evictLogicalRange(victimRangeStartKey, victimRangeEndKey, min_len);
+}
+
+bool RBTreeLogicalOrderedRangeCache::evictLogicalRange(const Slice& start_user_key, const Slice& end_user_key, size_t len, bool invalidate) {
+    // the keys are owned by the logical range, which is removed at last
+    Slice victimRangeStartKey = start_user_key;
+    Slice victimRangeEndKey = end_user_key;
+    size_t min_len = len;
 
     // If multiple ranges exist, remove the victim
     // If only one PhysicalRange remains, do nothing
-    if (ordered_physical_ranges.size() > 1 || this->capacity <= 0) {
+    if (ordered_physical_ranges.size() > 1 || this->getEffectiveCapacity() == 0 || invalidate) {
+        // The evicted range is detached and queued to be spilled to the secondary tier without the lock
+        const bool spill = this->secondary_tier && min_len > 0 && !invalidate;
+        std::vector<std::unique_ptr<PhysicalRange>> spilled_physical_ranges;
+        size_t victim_byte_size = 0;
         for (auto it = ordered_physical_ranges.begin(); it != ordered_physical_ranges.end();) {
             if ((*it)->startUserKey() >= victimRangeStartKey && 
                 (*it)->endUserKey() <= victimRangeEndKey) {
                 logger.debug("Victim: " + (*it)->toString());
+                victim_byte_size += (*it)->byteSize();
+                if ((*it)->isCompressed()) {
+                    this->compressed_physical_range_num--;
+                }
                 this->current_size -= (*it)->byteSize();
                 this->total_range_length -= (*it)->length();
                 
@@ -301,19 +453,503 @@ void RBTreeLogicalOrderedRangeCache::victim() {
                 }
                 
                 // Erase from ordered_physical_ranges and move to next iterator
-                it = ordered_physical_ranges.erase(it);
+                if (spill) {
+                    spilled_physical_ranges.emplace_back();
+                    it = ordered_physical_ranges.erase(it, &spilled_physical_ranges.back());
+                } else {
+                    it = ordered_physical_ranges.erase(it);
+                }
             } else {
                 ++it;
             }
         }
+        if (spill) {
+            this->secondary_tier->enqueueSpill(victimRangeStartKey, victimRangeEndKey, std::move(spilled_physical_ranges));
+        }
+        // Remember the evicted range to measure the benefit of a larger cache
+        if (!invalidate) {
+            this->putGhostRange(victimRangeStartKey, victimRangeEndKey, victim_byte_size);
+        }
         // Remove the logical range from ranges_view
         ranges_view.removeRange(victimRangeStartKey);
+        return true;
     } else {
         auto it = ordered_physical_ranges.find(victimRangeStartKey);
         assert(it != ordered_physical_ranges.end() && (*it)->startUserKey() == victimRangeStartKey);
         // Do nothing
         logger.info("Not victim the last range: " + (*it)->toString());
+        return false;
+    }
+}
+
+size_t RBTreeLogicalOrderedRangeCache::getPrefixBytes(const Slice& prefix) const {
+    // the keys starting with prefix are in [prefix, successor of prefix)
+    std::string successor = prefix.ToString();
+    while (!successor.empty() && static_cast<unsigned char>(successor.back()) == 0xff) {
+        successor.pop_back();
+    }
+    size_t before = ordered_physical_ranges.statsBefore(prefix, false).byte_size;
+    if (successor.empty()) {
+        return ordered_physical_ranges.totalStats().byte_size - before;
+    }
+    successor.back() = static_cast<char>(static_cast<unsigned char>(successor.back()) + 1);
+    return ordered_physical_ranges.statsBefore(successor, false).byte_size - before;
+}
+
+bool RBTreeLogicalOrderedRangeCache::selectPrefixVictim(Slice* start_user_key, Slice* end_user_key, size_t* len) {
+    if (!this->prefix_extractor || prefixes_over_soft_quota.empty()) {
+        return false;
+    }
+    double max_overuse = 1;
+    const std::string* victim_prefix = nullptr;
+    for (auto it = prefixes_over_soft_quota.begin(); it != prefixes_over_soft_quota.end();) {
+        size_t soft_quota = 0;
+        size_t hard_quota = 0;
+        this->getPrefixQuota(*it, &soft_quota, &hard_quota);
+        size_t prefix_bytes = this->getPrefixBytes(*it);
+        if (soft_quota == 0 || prefix_bytes <= soft_quota) {
+            // shrunk by evictions (the bytes of a prefix only grow by checkPrefixQuotas())
+            it = prefixes_over_soft_quota.erase(it);
+            continue;
+        }
+        double overuse = static_cast<double>(prefix_bytes) / static_cast<double>(soft_quota);
+        if (overuse > max_overuse) {
+            max_overuse = overuse;
+            victim_prefix = &*it;
+        }
+        ++it;
+    }
+    if (victim_prefix == nullptr) {
+        return false;
+    }
+    // the logical ranges of a prefix are adjacent
+    bool found = false;
+    for (auto it = ranges_view.getLogicalRanges().lower_bound(Slice(*victim_prefix));
+         it != ranges_view.getLogicalRanges().end() && it->startUserKey().starts_with(*victim_prefix); ++it) {
+        if (!found || it->length() < *len) {
+            *start_user_key = it->startUserKey();
+            *end_user_key = it->endUserKey();
+            *len = it->length();
+            found = true;
+        }
+    }
+    return found;
+}
+
+void RBTreeLogicalOrderedRangeCache::checkPrefixQuotas(const Slice& start_user_key) {
+    if (!this->prefix_extractor || !this->prefix_extractor->InDomain(start_user_key)) {
+        return;
+    }
+    std::string prefix = this->prefix_extractor->Transform(start_user_key).ToString();
+    size_t soft_quota = 0;
+    size_t hard_quota = 0;
+    this->getPrefixQuota(prefix, &soft_quota, &hard_quota);
+    if (soft_quota == 0 && hard_quota == 0) {
+        return;
+    }
+    size_t prefix_bytes = this->getPrefixBytes(prefix);
+    if (soft_quota > 0 && prefix_bytes > soft_quota) {
+        prefixes_over_soft_quota.insert(prefix);
+    }
+    if (hard_quota > 0 && prefix_bytes > hard_quota &&
+        std::find(prefixes_over_hard_quota.begin(), prefixes_over_hard_quota.end(), prefix) == prefixes_over_hard_quota.end()) {
+        prefixes_over_hard_quota.push_back(std::move(prefix));
+    }
+}
+
+void RBTreeLogicalOrderedRangeCache::refreshPrefixesOverQuotas() {
+    prefixes_over_soft_quota.clear();
+    prefixes_over_hard_quota.clear();
+    this->prefix_quotas_changed = false;
+    if (!this->prefix_extractor) {
+        return;
+    }
+    // once per prefix, its logical ranges are adjacent
+    std::string prefix;
+    bool has_prefix = false;
+    for (auto& range : ranges_view.getLogicalRanges()) {
+        if (!this->prefix_extractor->InDomain(range.startUserKey())) {
+            continue;
+        }
+        Slice range_prefix = this->prefix_extractor->Transform(range.startUserKey());
+        if (has_prefix && range_prefix == Slice(prefix)) {
+            continue;
+        }
+        has_prefix = true;
+        prefix = range_prefix.ToString();
+        this->checkPrefixQuotas(range.startUserKey());
+    }
+}
+
+void RBTreeLogicalOrderedRangeCache::enforcePrefixHardQuotas() {
+    for (const auto& prefix : prefixes_over_hard_quota) {
+        size_t soft_quota = 0;
+        size_t hard_quota = 0;
+        this->getPrefixQuota(prefix, &soft_quota, &hard_quota);
+        while (hard_quota > 0 && this->getPrefixBytes(prefix) > hard_quota) {
+            // the shortest logical range starting with the prefix
+            const LogicalRange* victim_range = nullptr;
+            for (auto it = ranges_view.getLogicalRanges().lower_bound(Slice(prefix));
+                 it != ranges_view.getLogicalRanges().end() && it->startUserKey().starts_with(prefix); ++it) {
+                if (victim_range == nullptr || it->length() < victim_range->length()) {
+                    victim_range = &*it;
+                }
+            }
+            if (victim_range == nullptr ||
+                !this->evictLogicalRange(victim_range->startUserKey(), victim_range->endUserKey(), victim_range->length())) {
+                break;
+            }
+        }
+    }
+    prefixes_over_hard_quota.clear();
+}
+
+bool RBTreeLogicalOrderedRangeCache::promoteSpilledRanges(const Slice& start_key, const Slice& end_key) {
+    if (!this->secondary_tier || !this->secondary_tier->mayOverlap(start_key, end_key)) {
+        return false;
+    }
+
+    // without an end key, only the range the scan starts in is promoted
+    auto spilled_ranges = this->secondary_tier->getOverlappingRanges(start_key, end_key, end_key.empty() ? 1 : SIZE_MAX);
+    const auto& logical_ranges = ranges_view.getLogicalRanges();
+    auto isCached = [&](const Slice& spilled_start, const Slice& spilled_end) {
+        auto range_it = ranges_view.findRange(spilled_start);
+        return range_it != logical_ranges.end() && range_it->startUserKey() <= spilled_end;
+    };
+
+    // load the ranges without the lock (I/O), they are checked again under the write lock
+    struct LoadedRange {
+        std::string start_user_key;
+        std::string end_user_key;
+        std::vector<std::string> internal_keys;
+        std::vector<std::string> values;
+    };
+    std::vector<LoadedRange> loaded_ranges;
+    for (const auto& spilled_range : spilled_ranges) {
+        Slice spilled_start(spilled_range.first);
+        Slice spilled_end(spilled_range.second);
+        lockRead();
+        bool cached = isCached(spilled_start, spilled_end);
+        unlockRead();
+        if (cached) {
+            // (partly) cached again since it was spilled, the cached one is newer
+            this->secondary_tier->invalidate(spilled_start, spilled_end);
+            continue;
+        }
+        LoadedRange loaded_range{spilled_range.first, spilled_range.second, {}, {}};
+        Status s = this->secondary_tier->load(spilled_start, &loaded_range.internal_keys, &loaded_range.values);
+        if (!s.ok()) {
+            logger.warn("Failed to load range [" + spilled_range.first + ", " + spilled_range.second +
+                        "] from the secondary tier: " + s.ToString());
+            continue;
+        }
+        loaded_ranges.push_back(std::move(loaded_range));
+    }
+    if (loaded_ranges.empty()) {
+        return false;
+    }
+
+    lockWrite();
+    bool promoted = false;
+    for (const auto& loaded_range : loaded_ranges) {
+        Slice spilled_start(loaded_range.start_user_key);
+        Slice spilled_end(loaded_range.end_user_key);
+        if (!this->secondary_tier->finishLoad(spilled_start) || loaded_range.internal_keys.empty()) {
+            // updated (e.g. by a flush) since it was loaded
+            continue;
+        }
+        if (isCached(spilled_start, spilled_end)) {
+            // cached by a scan since it was loaded, the cached one is newer
+            continue;
+        }
+        std::vector<Slice> internal_key_slices(loaded_range.internal_keys.begin(), loaded_range.internal_keys.end());
+        std::vector<Slice> value_slices(loaded_range.values.begin(), loaded_range.values.end());
+        std::unique_ptr<PhysicalRange> newRange = this->buildPhysicalRangeFromInternalEntries(internal_key_slices, value_slices);
+
+        // the logical range keeps the boundaries of the evicted one, which may be wider than its entries
+        ranges_view.putLogicalRange(LogicalRange(loaded_range.start_user_key, loaded_range.end_user_key, newRange->length(), true, true, true), false, false);
+        physical_range_length_map.emplace(newRange->length(), newRange->startUserKey().ToString());
+        this->current_size += newRange->byteSize();
+        this->total_range_length += newRange->length();
+        auto inserted = ordered_physical_ranges.insert(std::move(newRange));
+        this->checkPrefixQuotas((*inserted)->startUserKey());
+        promoted = true;
+    }
+    if (promoted) {
+        this->updateCacheReservation();
+    }
+    unlockWrite();
+
+    if (promoted) {
+        this->tryVictim();
+    }
+    return promoted;
+}
+
+std::unique_ptr<PhysicalRange> RBTreeLogicalOrderedRangeCache::buildPhysicalRangeFromInternalEntries(const std::vector<Slice>& internal_keys,
+                                                                                                    const std::vector<Slice>& values) const {
+    if (LogicalOrderedRangeCache::getPhysicalRangeType() == PhysicalRangeType::CONTINUOUS) {
+        return ContinuousPhysicalRange::buildFromInternalEntries(internal_keys, values);
+    } else if (LogicalOrderedRangeCache::getPhysicalRangeType() == PhysicalRangeType::FIXED_KEY) {
+        std::unique_ptr<PhysicalRange> newRange = buildFixedKeyPhysicalRangeFromInternalEntries(internal_keys, values);
+        if (newRange) {
+            return newRange;
+        }
     }
+    return VecPhysicalRange::buildFromInternalEntries(internal_keys, values);
+}
+
+PhysicalRangeIndex::iterator RBTreeLogicalOrderedRangeCache::replacePhysicalRange(
+    PhysicalRangeIndex::iterator it, std::unique_ptr<PhysicalRange> newRange) {
+    assert(newRange->startUserKey() == (*it)->startUserKey() && newRange->length() == (*it)->length());
+    this->current_size = this->current_size - (*it)->byteSize() + newRange->byteSize();
+    if ((*it)->isCompressed()) {
+        this->compressed_physical_range_num--;
+    }
+    if (newRange->isCompressed()) {
+        this->compressed_physical_range_num++;
+    }
+    // same start key, so the range is replaced in place (and physical_range_length_map is unchanged)
+    return ordered_physical_ranges.replace(it, std::move(newRange));
+}
+
+PhysicalRangeIndex::iterator RBTreeLogicalOrderedRangeCache::decompressPhysicalRange(PhysicalRangeIndex::iterator it) {
+    auto compressedRange = static_cast<const CompressedPhysicalRange*>(it->get());
+    std::vector<Slice> internal_keys;
+    std::vector<Slice> values;
+    std::string raw_values;
+    if (!compressedRange->getEntries(&internal_keys, &values, &raw_values)) {
+        return ordered_physical_ranges.end();
+    }
+    return this->replacePhysicalRange(it, this->buildPhysicalRangeFromInternalEntries(internal_keys, values));
+}
+
+PhysicalRangeIndex::iterator RBTreeLogicalOrderedRangeCache::generalizePhysicalRange(PhysicalRangeIndex::iterator it) {
+    // copy the entries since the slices refer to the range being replaced
+    std::vector<std::string> internal_key_strs;
+    std::vector<std::string> value_strs;
+    internal_key_strs.reserve((*it)->length());
+    value_strs.reserve((*it)->length());
+    PhysicalRangeKeyBuffer key_buffer;
+    for (size_t i = 0; i < (*it)->length(); i++) {
+        internal_key_strs.emplace_back((*it)->readInternalKeyAt(i, &key_buffer).ToString());
+        value_strs.emplace_back((*it)->valueAt(i).ToString());
+    }
+    std::vector<Slice> internal_keys(internal_key_strs.begin(), internal_key_strs.end());
+    std::vector<Slice> values(value_strs.begin(), value_strs.end());
+    return this->replacePhysicalRange(it, VecPhysicalRange::buildFromInternalEntries(internal_keys, values));
+}
+
+size_t RBTreeLogicalOrderedRangeCache::compressColdRanges(size_t max_bytes) {
+    lockWrite();
+    bool enabled = this->cold_range_compression != kNoCompression;
+    const auto& logical_ranges = ranges_view.getLogicalRanges();
+    if ((!enabled && this->compressed_physical_range_num == 0) || logical_ranges.empty()) {
+        unlockWrite();
+        return 0;
+    }
+
+    // continue from where the last call stopped, so that every range is visited in turn
+    auto range_it = logical_ranges.lower_bound(Slice(this->cold_range_compression_cursor));
+    size_t processed_bytes = 0;
+    size_t processed_num = 0;
+    for (size_t visited = 0; visited < logical_ranges.size() && processed_bytes < max_bytes; visited++, ++range_it) {
+        if (range_it == logical_ranges.end()) {
+            range_it = logical_ranges.begin();
+        }
+        bool cold = enabled && range_it->accessFrequency() <= this->cold_access_frequency;
+        for (auto it = ordered_physical_ranges.lower_bound(range_it->startUserKey());
+             it != ordered_physical_ranges.end() && (*it)->endUserKey() <= range_it->endUserKey(); ++it) {
+            if (cold && !(*it)->isCompressed()) {
+                processed_bytes += (*it)->byteSize();
+                auto compressedRange = CompressedPhysicalRange::buildFromPhysicalRange(**it, this->cold_range_compression);
+                if (compressedRange) {
+                    it = this->replacePhysicalRange(it, std::move(compressedRange));
+                    processed_num++;
+                }
+            } else if (!cold && (*it)->isCompressed()) {
+                auto newIt = this->decompressPhysicalRange(it);
+                if (newIt == ordered_physical_ranges.end()) {
+                    logger.error("Failed to decompress physical range: " + (*it)->toString());
+                    this->reportCorruptedRange((*it)->startUserKey());
+                    continue;
+                }
+                it = newIt;
+                processed_bytes += (*it)->byteSize();
+                processed_num++;
+            }
+        }
+    }
+    this->cold_range_compression_cursor = range_it == logical_ranges.end() ? std::string() : range_it->startUserKey().ToString();
+    if (processed_num > 0) {
+        this->updateCacheReservation();
+        logger.info("(De)compressed " + std::to_string(processed_num) + " physical ranges, compressed physical range num = " +
+                    std::to_string(this->compressed_physical_range_num));
+    }
+    unlockWrite();
+    return processed_num;
+}
+
+size_t RBTreeLogicalOrderedRangeCache::defragmentRanges(size_t max_bytes) {
+    lockWrite();
+    const auto& logical_ranges = ranges_view.getLogicalRanges();
+    if (this->defragment_min_physical_ranges == 0 || logical_ranges.empty()) {
+        unlockWrite();
+        return 0;
+    }
+
+    // continue from where the last call stopped, so that every range is visited in turn
+    auto range_it = logical_ranges.lower_bound(Slice(this->defragment_cursor));
+    size_t processed_bytes = 0;
+    size_t merged_num = 0;
+    size_t purged_num = 0;
+    bool stopped_in_range = false;
+    for (size_t visited = 0; visited < logical_ranges.size() && processed_bytes < max_bytes; visited++, ++range_it) {
+        if (range_it == logical_ranges.end()) {
+            range_it = logical_ranges.begin();
+        }
+        auto first = ordered_physical_ranges.lower_bound(range_it->startUserKey());
+        size_t fragment_num = 0;
+        for (auto it = first; it != ordered_physical_ranges.end() && (*it)->endUserKey() <= range_it->endUserKey() &&
+             fragment_num < this->defragment_min_physical_ranges; ++it) {
+            fragment_num++;
+        }
+        if (fragment_num < this->defragment_min_physical_ranges) {
+            continue;
+        }
+
+        // merge the uncompressed (hot) physical ranges in runs within the budget
+        auto it = first;
+        while (it != ordered_physical_ranges.end() && (*it)->endUserKey() <= range_it->endUserKey()) {
+            if ((*it)->isCompressed()) {
+                ++it;
+                continue;
+            }
+            auto run_end = it;
+            size_t run_num = 0;
+            size_t run_bytes = 0;
+            while (run_end != ordered_physical_ranges.end() && (*run_end)->endUserKey() <= range_it->endUserKey() &&
+                   !(*run_end)->isCompressed() && (run_num < 2 || processed_bytes + run_bytes + (*run_end)->byteSize() <= max_bytes)) {
+                run_bytes += (*run_end)->byteSize();
+                run_num++;
+                ++run_end;
+            }
+            if (run_num < 2) {
+                it = run_end;
+                continue;
+            }
+            // iterators of the index are invalidated by the merge, continue after the merged range by its key
+            std::string run_start_key = (*it)->startUserKey().ToString();
+            size_t purged = this->mergePhysicalRanges(it, run_num);
+            if (purged > 0) {
+                ranges_view.setRangeLength(range_it, range_it->length() > purged ? range_it->length() - purged : 0);
+            }
+            processed_bytes += run_bytes;
+            merged_num += run_num - 1;
+            purged_num += purged;
+            it = ordered_physical_ranges.upper_bound(run_start_key);
+            if (processed_bytes >= max_bytes) {
+                // the rest of the logical range is merged by the next call
+                stopped_in_range = it != ordered_physical_ranges.end() && (*it)->endUserKey() <= range_it->endUserKey();
+                break;
+            }
+        }
+        if (stopped_in_range) {
+            break;
+        }
+    }
+    if (stopped_in_range) {
+        this->defragment_cursor = range_it->startUserKey().ToString();
+    } else {
+        this->defragment_cursor = range_it == logical_ranges.end() ? std::string() : range_it->startUserKey().ToString();
+    }
+    if (merged_num > 0) {
+        this->updateCacheReservation();
+        logger.info("Merged away " + std::to_string(merged_num) + " physical ranges, purged " + std::to_string(purged_num) +
+                    " deletion entries, physical range num = " + std::to_string(ordered_physical_ranges.size()));
+    }
+    unlockWrite();
+    return merged_num;
+}
+
+size_t RBTreeLogicalOrderedRangeCache::mergePhysicalRanges(PhysicalRangeIndex::iterator first, size_t num) {
+    // copy the entries since the slices refer to the ranges being replaced
+    std::vector<std::string> internal_key_strs;
+    std::vector<std::string> value_strs;
+    size_t total_length = 0;
+    auto it = first;
+    for (size_t i = 0; i < num; i++, ++it) {
+        total_length += (*it)->length();
+    }
+    internal_key_strs.reserve(total_length);
+    value_strs.reserve(total_length);
+
+    size_t purged = 0;
+    size_t old_byte_size = 0;
+    size_t index = 0;
+    PhysicalRangeKeyBuffer key_buffer;
+    it = first;
+    for (size_t i = 0; i < num; i++) {
+        for (size_t j = 0; j < (*it)->length(); j++, index++) {
+            Slice internal_key = (*it)->readInternalKeyAt(j, &key_buffer);
+            ValueType type = ExtractValueType(internal_key);
+            bool is_delete_entry = (type == kTypeDeletion || type == kTypeSingleDeletion || type == kTypeDeletionWithTimestamp);
+            // the bounds of the physical ranges are kept for the lookups of updateEntry
+            if (is_delete_entry && index != 0 && index != total_length - 1) {
+                purged++;
+                continue;
+            }
+            internal_key_strs.emplace_back(internal_key.data(), internal_key.size());
+            Slice value = (*it)->valueAt(j);
+            value_strs.emplace_back(value.data(), value.size());
+        }
+        old_byte_size += (*it)->byteSize();
+        this->eraseFromLengthMap(**it);
+        it = ordered_physical_ranges.erase(it);
+    }
+
+    std::vector<Slice> internal_keys(internal_key_strs.begin(), internal_key_strs.end());
+    std::vector<Slice> values(value_strs.begin(), value_strs.end());
+    std::unique_ptr<PhysicalRange> newRange = this->buildPhysicalRangeFromInternalEntries(internal_keys, values);
+    this->current_size = this->current_size - old_byte_size + newRange->byteSize();
+    this->total_range_length -= purged;
+    physical_range_length_map.emplace(newRange->length(), newRange->startUserKey().ToString());
+    ordered_physical_ranges.insert(std::move(newRange));
+    return purged;
+}
+
+void RBTreeLogicalOrderedRangeCache::eraseFromLengthMap(const PhysicalRange& range) {
+    auto length_range = physical_range_length_map.equal_range(range.length());
+    for (auto mapIt = length_range.first; mapIt != length_range.second; ++mapIt) {
+        if (mapIt->second == range.startUserKey().ToString()) {
+            physical_range_length_map.erase(mapIt);
+            break;
+        }
+    }
+}
+
+void RBTreeLogicalOrderedRangeCache::reportCorruptedRange(const Slice& start_user_key) const {
+    std::lock_guard<std::mutex> lock(corrupted_ranges_mutex);
+    corrupted_range_keys.emplace_back(start_user_key.data(), start_user_key.size());
+}
+
+void RBTreeLogicalOrderedRangeCache::dropCorruptedRanges() {
+    std::vector<std::string> start_user_keys;
+    {
+        std::lock_guard<std::mutex> lock(corrupted_ranges_mutex);
+        start_user_keys.swap(corrupted_range_keys);
+    }
+    if (start_user_keys.empty()) {
+        return;
+    }
+    lockWrite();
+    for (const auto& start_user_key : start_user_keys) {
+        // the range may have been evicted (or dropped by another report) meanwhile
+        if (this->invalidateLogicalRange(start_user_key)) {
+            logger.error("Dropped the logical range of a corrupted physical range starting at " + start_user_key);
+        }
+    }
+    unlockWrite();
 }
 
 void RBTreeLogicalOrderedRangeCache::pinRange(std::string startKey) {
@@ -350,7 +986,7 @@ void RBTreeLogicalOrderedRangeCache::printAllLogicalRanges() const {
         return;
     }
     logger.debug("All logical ranges in RBTreeLogicalOrderedRangeCache:");
-    auto logical_ranges = this->ranges_view.getLogicalRanges();
+    const auto& logical_ranges = this->ranges_view.getLogicalRanges();
     size_t total_len = 0;
     for (auto it = logical_ranges.begin(); it != logical_ranges.end(); ++it) {
         logger.debug("LogicalRange: " + it->toString());
@@ -374,10 +1010,11 @@ void RBTreeLogicalOrderedRangeCache::printAllRangesWithKeys() const {
     logger.debug("----------------------------------------\n");
 
     logger.debug("All keys in RBTreeLogicalOrderedRangeCache:");
+    PhysicalRangeKeyBuffer key_buffer;
     for (const auto& range : ordered_physical_ranges) {
         for (size_t i = 0; i < range->length(); ++i) {
             ParsedInternalKey parsed_key;
-            Status s = ParseInternalKey(range->internalKeyAt(i), &parsed_key, false);
+            Status s = ParseInternalKey(range->readInternalKeyAt(i, &key_buffer), &parsed_key, false);
             logger.debug("User Key: " + parsed_key.user_key.ToString() + ", Seq = " + std::to_string(parsed_key.sequence) +
                          ", Type = " + std::to_string(static_cast<unsigned char>(parsed_key.type)));
         }
@@ -417,15 +1054,7 @@ std::vector<LogicalRange> RBTreeLogicalOrderedRangeCache::divideLogicalRange(con
     bool has_end_key_limit = !end_key.empty();
     bool terminated = false;
 
-    auto find_first_range = [&logical_ranges](const Slice& key) {
-        auto it = std::lower_bound(logical_ranges.begin(), logical_ranges.end(), key,
-            [](const LogicalRange& range, const Slice& key_) {
-                return range.endUserKey() < key_;
-            });
-        return it;
-    };
-
-    auto range_it = find_first_range(current_key);
+    auto range_it = ranges_view.findRange(current_key);
 
     int num = 0;
     // Iterate through all logical ranges to find overlapping parts with the query range
@@ -477,6 +1106,7 @@ std::vector<LogicalRange> RBTreeLogicalOrderedRangeCache::divideLogicalRange(con
                 size_t remaining_length = len - total_length_in_range_cache;
                 size_t range_len = this->downwardEstimateLengthInRangeCache(overlap_start, overlap_end, remaining_length);
                 result.emplace_back(overlap_start.ToString(), overlap_end.ToString(), range_len, true, true, true);
+                range.recordAccess();
                 total_length_in_range_cache += range_len;
                 current_key = overlap_end;
             }
@@ -505,62 +1135,65 @@ std::vector<LogicalRange> RBTreeLogicalOrderedRangeCache::divideLogicalRange(con
     return result;
 }
 
-size_t RBTreeLogicalOrderedRangeCache::downwardEstimateLengthInRangeCache(const Slice& start_key, const Slice& end_key, size_t remaining_length) const {
+PhysicalRangeStats RBTreeLogicalOrderedRangeCache::statsInRangeCache(const Slice& start_key, const Slice& end_key) const {
     assert(!start_key.empty() && !end_key.empty() && start_key <= end_key);
-    
-    size_t total_length = 0;
-    
-    // Find the range that contains or comes after start_key
-    auto start_it = ordered_physical_ranges.upper_bound(start_key);
-    if (start_it != ordered_physical_ranges.begin()) {
-        --start_it;
-        // assert((*start_it)->endUserKey() >= start_key);
-        if ((*start_it)->endUserKey() < start_key) {
-            return 0; // not in any physical range
-        }
-    }
-    
-    // Find the range that contains or comes after end_key
-    auto end_it = ordered_physical_ranges.upper_bound(end_key);
-    if (end_it != ordered_physical_ranges.begin()) {
-        --end_it;
-        // assert((*end_it)->endUserKey() >= end_key);
-    }
 
-    assert(start_it != ordered_physical_ranges.end() && end_it != ordered_physical_ranges.end() && std::distance(start_it, end_it) >= 0);
-    
-    // Iterate from start_it to calculate total length
-    for (auto it = start_it; it != ordered_physical_ranges.end(); ++it) {
+    // Stats of the part of a range in [start_key, end_key], its deletions (and bytes) are not known by position
+    auto partial_stats = [&start_key, &end_key](const PhysicalRange& range) {
+        PhysicalRangeStats stats;
         int start_index = 0;
-        int end_index = (*it)->length() - 1;
-        if ((*it)->startUserKey() < start_key && (*it)->endUserKey() >= start_key) {
-            start_index = (*it)->find(start_key);
-            assert(start_index >= 0);
+        int end_index = static_cast<int>(range.length());
+        if (range.startUserKey() < start_key) {
+            start_index = range.find(start_key);
+            if (start_index < 0) {
+                return stats;
+            }
         }
-
-        if ((*it)->startUserKey() < end_key && (*it)->endUserKey() >= end_key) {
-            end_index = (*it)->find(end_key);
-            assert(end_index >= 0);
-            if ((*it)->userKeyAt(end_index) != end_key) {
-                end_index -= 1;
+        if (range.endUserKey() > end_key) {
+            int index = range.find(end_key);
+            if (index >= 0) {
+                PhysicalRangeKeyBuffer key_buffer;
+                end_index = range.readUserKeyAt(index, &key_buffer) == end_key ? index + 1 : index;
             }
         }
+        if (end_index <= start_index) {
+            return stats;
+        }
+        stats.length = end_index - start_index;
+        stats.delete_length = std::min(stats.length, range.deleteLength());
+        stats.byte_size = range.byteSize() / range.length() * stats.length;
+        return stats;
+    };
 
-        assert(start_index <= end_index);
-        // minus delete length to downward estimate
-        int range_length = std::max(end_index - start_index + 1 - (int)(*it)->deleteLength(), 0);
-        total_length += (end_index - start_index + 1);
-
-        if (it == end_it) {
-            break;
+    PhysicalRangeStats result;
+    // The range containing start_key
+    auto start_it = ordered_physical_ranges.upper_bound(start_key);
+    if (start_it != ordered_physical_ranges.begin()) {
+        const PhysicalRange& first_range = **std::prev(start_it);
+        if (first_range.endUserKey() >= start_key) {
+            result += partial_stats(first_range);
         }
-        if (total_length >= remaining_length) {
-            // If we have reached the remaining length, stop traversing
-            break;
+    }
+
+    // The ranges starting in (start_key, end_key], all but the last one are fully covered
+    auto end_it = ordered_physical_ranges.upper_bound(end_key);
+    if (start_it != end_it) {
+        PhysicalRangeStats stats = ordered_physical_ranges.statsBefore(end_key, true);
+        stats -= ordered_physical_ranges.statsBefore(start_key, true);
+        const PhysicalRange& last_range = **std::prev(end_it);
+        if (last_range.endUserKey() > end_key) {
+            stats -= PhysicalRangeStats(last_range);
+            stats += partial_stats(last_range);
         }
+        result += stats;
     }
+    return result;
+}
 
-    return std::min(total_length, remaining_length);
+size_t RBTreeLogicalOrderedRangeCache::downwardEstimateLengthInRangeCache(const Slice& start_key, const Slice& end_key, size_t remaining_length) const {
+    // exact for fully covered ranges, all deletions of a partly covered range are assumed to be in the part
+    PhysicalRangeStats stats = this->statsInRangeCache(start_key, end_key);
+    return std::min(stats.length - stats.delete_length, remaining_length);
 }
 
 }  // namespace ROCKSDB_NAMESPACE
@@ -141,7 +141,7 @@ Slice RBTreeLogicalOrderedRangeCacheIterator::key() const {
     if (!valid) {
         return empty_string;
     }
-    return (*current_range)->internalKeyAt(current_index);
+    return (*current_range)->readInternalKeyAt(current_index, &key_buffer);
 }
 
 Slice RBTreeLogicalOrderedRangeCacheIterator::userKey() const {
@@ -149,7 +149,7 @@ Slice RBTreeLogicalOrderedRangeCacheIterator::userKey() const {
     if (!valid) {
         return empty_string;
     }
-    return (*current_range)->userKeyAt(current_index);
+    return (*current_range)->readUserKeyAt(current_index, &key_buffer);
 }
 
 Slice RBTreeLogicalOrderedRangeCacheIterator::value() const {
@@ -157,7 +157,13 @@ Slice RBTreeLogicalOrderedRangeCacheIterator::value() const {
     if (!valid) {
         return empty_string;
     }
-    return (*current_range)->valueAt(current_index);
+    Slice value = (*current_range)->readValueAt(current_index, &value_buffer);
+    if (value_buffer.corrupted) {
+        // the range is dropped by the cache, the scan fails (read from the LSM when retried)
+        cache->reportCorruptedRange((*current_range)->startUserKey());
+        iter_status = Status::Corruption("Failed to decompress a value of the range cache");
+    }
+    return value;
 }
 
 Status RBTreeLogicalOrderedRangeCacheIterator::status() const {
@@ -57,6 +57,8 @@ ReferringRange::ReferringRange(const ReferringRange& other) {
         this->slice_data = std::make_shared<SliceRangeData>();
         this->slice_data->slice_keys = other.slice_data->slice_keys;
         this->slice_data->slice_values = other.slice_data->slice_values;
+        this->slice_data->blob_index_flags = other.slice_data->blob_index_flags;
+        this->slice_data->shared_values = other.slice_data->shared_values;
     }
 }
 
@@ -86,6 +88,8 @@ ReferringRange& ReferringRange::operator=(const ReferringRange& other) {
             this->slice_data = std::make_shared<SliceRangeData>();
             this->slice_data->slice_keys = other.slice_data->slice_keys;
             this->slice_data->slice_values = other.slice_data->slice_values;
+        this->slice_data->blob_index_flags = other.slice_data->blob_index_flags;
+        this->slice_data->shared_values = other.slice_data->shared_values;
         } else {
             this->slice_data.reset();
         }
@@ -136,6 +140,17 @@ Slice ReferringRange::valueAt(size_t index) const {
     return Slice(slice_data->slice_values[index]);
 }
 
+bool ReferringRange::isBlobIndexAt(size_t index) const {
+    assert(valid && range_length > index);
+    return index < slice_data->blob_index_flags.size() && slice_data->blob_index_flags[index];
+}
+
+const std::shared_ptr<SharedRangeValue>& ReferringRange::sharedValueAt(size_t index) const {
+    static const std::shared_ptr<SharedRangeValue> kNotShared;
+    assert(valid && range_length > index);
+    return index < slice_data->shared_values.size() ? slice_data->shared_values[index] : kNotShared;
+}
+
 size_t ReferringRange::length() const {
     return range_length;
 }   
@@ -198,9 +213,31 @@ void ReferringRange::emplace(const Slice& key, const Slice& value) {
     assert(valid);
     slice_data->slice_keys.emplace_back(key);
     slice_data->slice_values.emplace_back(value);
+    if (!slice_data->blob_index_flags.empty()) {
+        slice_data->blob_index_flags.push_back(false);
+    }
+    if (!slice_data->shared_values.empty()) {
+        slice_data->shared_values.emplace_back();
+    }
     range_length++;
     keys_byte_size += key.size() + 8; // key size virtually expanded to internal key size (user key size + 8)
     values_byte_size += value.size();
 }
 
+void ReferringRange::emplaceBlobIndex(const Slice& key, const Slice& blob_index) {
+    assert(valid);
+    emplace(key, blob_index);
+    slice_data->blob_index_flags.resize(range_length, false);
+    slice_data->blob_index_flags.back() = true;
+}
+
+void ReferringRange::emplaceShared(const Slice& key, std::shared_ptr<SharedRangeValue> value) {
+    assert(valid && value);
+    emplace(key, value->value());
+    // the value bytes are charged by the holder of the reference
+    values_byte_size = values_byte_size - value->value().size() + SharedRangeValue::reference_bytes;
+    slice_data->shared_values.resize(range_length);
+    slice_data->shared_values.back() = std::move(value);
+}
+
 }  // namespace ROCKSDB_NAMESPACE
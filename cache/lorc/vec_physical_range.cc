@@ -6,11 +6,107 @@
 #include <queue>
 #include <functional>
 #include <atomic>
+#include <iterator>
 #include "db/dbformat.h"
 #include "rocksdb/vec_physical_range.h"
+#include "util/math.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#elif defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
 
 namespace ROCKSDB_NAMESPACE {
 
+// Heads left after the binary search, compared at once
+static const size_t kHeadScanWidth = 8;
+
+// The 8 bytes of the user key after offset as a big-endian integer (padded with zeros), the order of the heads of
+// keys sharing the first offset bytes is consistent with the order of the keys
+static uint64_t keyHead(const Slice& user_key, size_t offset) {
+    uint64_t head = 0;
+    size_t head_size = user_key.size() > offset ? std::min<size_t>(8, user_key.size() - offset) : 0;
+    for (size_t i = 0; i < head_size; i++) {
+        head |= static_cast<uint64_t>(static_cast<unsigned char>(user_key[offset + i])) << (56 - 8 * i);
+    }
+    return head;
+}
+
+// Index of the first head >= target in the sorted heads[0, n)
+static size_t lowerBoundHead(const uint64_t* heads, size_t n, uint64_t target) {
+    const uint64_t* first = heads;
+    while (n > kHeadScanWidth) {
+        size_t half = n / 2;
+        first += first[half - 1] < target ? half : 0;
+        n -= half;
+    }
+
+    // count the heads < target in the last window
+    size_t count = 0;
+    size_t i = 0;
+#if defined(__AVX2__)
+    // there is no unsigned 64-bit compare, flip the sign bits for the signed one
+    const __m256i sign = _mm256_set1_epi64x(static_cast<long long>(1ULL << 63));
+    const __m256i target_vec = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<long long>(target)), sign);
+    for (; i + 4 <= n; i += 4) {
+        __m256i heads_vec = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(first + i)), sign);
+        count += BitsSetToOne(static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(target_vec, heads_vec)))));
+    }
+#elif defined(__SSE4_2__)
+    const __m128i sign = _mm_set1_epi64x(static_cast<long long>(1ULL << 63));
+    const __m128i target_vec = _mm_xor_si128(_mm_set1_epi64x(static_cast<long long>(target)), sign);
+    for (; i + 2 <= n; i += 2) {
+        __m128i heads_vec = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(first + i)), sign);
+        count += BitsSetToOne(static_cast<unsigned>(_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(target_vec, heads_vec)))));
+    }
+#endif
+    for (; i < n; i++) {
+        count += first[i] < target ? 1 : 0;
+    }
+    return (first - heads) + count;
+}
+
+// Narrow the search of key among n sorted keys sharing prefix to [*lo, *hi): the keys before *lo are < key,
+// the keys from *hi are > key, and the keys between have the same head as key
+static void searchHeads(const uint64_t* heads, size_t n, const Slice& prefix, const Slice& key, size_t* lo, size_t* hi) {
+    int cmp = memcmp(key.data(), prefix.data(), std::min(key.size(), prefix.size()));
+    if (cmp < 0 || (cmp == 0 && key.size() < prefix.size())) {
+        *lo = *hi = 0;
+        return;
+    } else if (cmp > 0) {
+        *lo = *hi = n;
+        return;
+    }
+    uint64_t target = keyHead(key, prefix.size());
+    *lo = lowerBoundHead(heads, n, target);
+    *hi = target == UINT64_MAX ? n : *lo + lowerBoundHead(heads + *lo, n - *lo, target + 1);
+}
+
+void VecPhysicalRange::Chunk::rebuildKeyHeads() {
+    shared_prefix_size = size() > 0 ? userKeyAt(0).difference_offset(userKeyAt(size() - 1)) : 0;
+    key_heads.resize(size());
+    for (size_t i = 0; i < size(); i++) {
+        key_heads[i] = keyHead(userKeyAt(i), shared_prefix_size);
+    }
+}
+
+size_t VecPhysicalRange::Chunk::lowerBound(const Slice& key) const {
+    size_t left = 0;
+    size_t right = 0;
+    searchHeads(key_heads.data(), size(), Slice(internal_keys[0].data(), shared_prefix_size), key, &left, &right);
+    // break the ties of the heads with the full keys
+    while (left < right) {
+        size_t mid = left + (right - left) / 2;
+        if (userKeyAt(mid).compare(key) < 0) {
+            left = mid + 1;
+        } else {
+            right = mid;
+        }
+    }
+    return left;
+}
+
 std::string VecPhysicalRange::toString() const {
     std::shared_lock<std::shared_mutex> lock(physical_range_mutex_);
     std::string str = "< " + ToStringPlain(this->startUserKey().ToString()) + " -> " + ToStringPlain(this->endUserKey().ToString()) + " >"
@@ -24,10 +120,6 @@ VecPhysicalRange::VecPhysicalRange(bool valid_) {
     this->range_length = 0;
     this->byte_size = 0;
     this->timestamp = 0;
-    this->start_user_key_slice = Slice();
-    if (valid) {
-        data = std::make_shared<RangeData>();
-    }
 }
 
 // TODO(jr): find out is it necessary to deconstruct VecPhysicalRange asynchronously
@@ -37,55 +129,11 @@ VecPhysicalRange::~VecPhysicalRange() {
 
 VecPhysicalRange::VecPhysicalRange(const VecPhysicalRange& other) : PhysicalRange(other.valid) {
     // assert(false); // (it should not be called in RBTreeVecPhysicalRangeCache)
-    this->valid = other.valid;
-    this->range_length = other.range_length;
-    this->byte_size = other.byte_size;
-    this->timestamp = other.timestamp;
-    this->start_user_key_slice = other.start_user_key_slice;
-
-    if (other.valid && other.data) {
-        this->data = std::make_shared<RangeData>();
-        this->data->internal_keys = other.data->internal_keys;
-        this->data->values = other.data->values;
-        for (size_t i = 0; i < this->range_length; i++) {
-            this->data->internal_key_slices.emplace_back(this->data->internal_keys[i].data(), this->data->internal_keys[i].size() - internal_key_extra_bytes);
-            this->data->user_key_slices.emplace_back(this->data->internal_keys[i].data(), this->data->internal_keys[i].size() - internal_key_extra_bytes);
-            this->data->value_slices.emplace_back(this->data->values[i]);
-        }
-    }
+    *this = other;
 }
 
 VecPhysicalRange::VecPhysicalRange(VecPhysicalRange&& other) noexcept : PhysicalRange(other.valid) {
-    this->data = std::move(other.data);
-    this->valid = other.valid;
-    this->range_length = other.range_length;
-    this->byte_size = other.byte_size;
-    this->timestamp = other.timestamp;
-    this->start_user_key_slice = other.start_user_key_slice;
-
-    other.valid = false;
-    other.range_length = 0;
-    other.timestamp = 0;
-    other.start_user_key_slice = Slice();
-}
-
-VecPhysicalRange::VecPhysicalRange(std::shared_ptr<RangeData> data_, size_t range_length_) {
-    this->data = data_;
-    this->valid = true;
-    this->range_length = range_length_;
-    // TODO(jr): avoid calculating byte_size in the constructor
-    this->byte_size = 0;
-    for (size_t i = 0; i < range_length_; i++) {
-        this->byte_size += data_->internal_keys[i].size();
-        this->byte_size += data_->values[i].size();
-    }
-    this->timestamp = 0;
-
-    if (range_length_ > 0) {
-        this->start_user_key_slice = Slice(data_->internal_keys[0].data(), data_->internal_keys[0].size() - internal_key_extra_bytes);
-    } else {
-        this->start_user_key_slice = Slice();
-    }
+    *this = std::move(other);
 }
 
 VecPhysicalRange& VecPhysicalRange::operator=(const VecPhysicalRange& other) {
@@ -95,20 +143,19 @@ VecPhysicalRange& VecPhysicalRange::operator=(const VecPhysicalRange& other) {
         this->valid = other.valid;
         this->range_length = other.range_length;
         this->byte_size = other.byte_size;
+        this->delete_length = other.delete_length;
         this->timestamp = other.timestamp;
-        this->start_user_key_slice = other.start_user_key_slice;
-
-        if (other.valid && other.data) {
-            this->data = std::make_shared<RangeData>();
-            this->data->internal_keys = other.data->internal_keys;
-            this->data->values = other.data->values;
-            for (size_t i = 0; i < this->range_length; i++) {
-                this->data->internal_key_slices.emplace_back(this->data->internal_keys[i].data(), this->data->internal_keys[i].size() - internal_key_extra_bytes);
-                this->data->user_key_slices.emplace_back(this->data->internal_keys[i].data(), this->data->internal_keys[i].size() - internal_key_extra_bytes);
-                this->data->value_slices.emplace_back(this->data->values[i]);
+        this->start_user_key = other.start_user_key;
+
+        // deep copy of the chunks
+        this->data = std::make_shared<RangeData>();
+        if (other.data) {
+            for (const auto& chunk : other.data->chunks) {
+                this->data->chunks.emplace_back(new Chunk(*chunk));
             }
-        } else {
-            this->data.reset();
+            this->data->chunk_first_index = other.data->chunk_first_index;
+            this->data->chunk_heads = other.data->chunk_heads;
+            this->data->chunk_shared_prefix_size = other.data->chunk_shared_prefix_size;
         }
     }
     return *this;
@@ -116,95 +163,145 @@ VecPhysicalRange& VecPhysicalRange::operator=(const VecPhysicalRange& other) {
 
 VecPhysicalRange& VecPhysicalRange::operator=(VecPhysicalRange&& other) noexcept {
     if (this != &other) {
-        // Clean up current object's resources
-        this->data.reset();
-
         // Move resources from other
         this->data = std::move(other.data);
         this->valid = other.valid;
         this->range_length = other.range_length;
         this->byte_size = other.byte_size;
+        this->delete_length = other.delete_length;
         this->timestamp = other.timestamp;
-        this->start_user_key_slice = other.start_user_key_slice;
+        this->start_user_key = std::move(other.start_user_key);
 
         // Reset other object's state
         other.valid = false;
         other.range_length = 0;
+        other.byte_size = 0;
+        other.delete_length = 0;
         other.timestamp = 0;
-        other.start_user_key_slice = Slice();
+        other.start_user_key.clear();
     }
     return *this;
 }
 
 std::unique_ptr<VecPhysicalRange> VecPhysicalRange::buildFromReferringRange(const ReferringRange& refRange) {
     auto newRange = std::make_unique<VecPhysicalRange>(true);
-    newRange->reserve(refRange.length());
-
+    std::string internal_key_str;
     for (size_t i = 0; i < refRange.length(); i++) {
-        Slice user_key = refRange.keyAt(i);
-        std::string internal_key_str = InternalKey(user_key, refRange.getSeqNum(), kTypeRangeCacheValue).Encode().ToString();
-        Slice value = refRange.valueAt(i);
-        newRange->emplaceInternal(Slice(internal_key_str), value);
+        internal_key_str.clear();
+        AppendInternalKey(&internal_key_str, ParsedInternalKey(refRange.keyAt(i), refRange.getSeqNum(), refRange.isBlobIndexAt(i) ? kTypeBlobIndex : kTypeRangeCacheValue));
+        newRange->emplaceInternal(Slice(internal_key_str), refRange.valueAt(i), refRange.sharedValueAt(i));
     }
+    newRange->finishBuilding();
+    return newRange;
+}
 
-    if (newRange->range_length > 0) {
-        newRange->start_user_key_slice = newRange->data->user_key_slices[0];
+std::unique_ptr<VecPhysicalRange> VecPhysicalRange::buildFromInternalEntries(const std::vector<Slice>& internal_keys, const std::vector<Slice>& values) {
+    assert(internal_keys.size() == values.size());
+    auto newRange = std::make_unique<VecPhysicalRange>(true);
+    for (size_t i = 0; i < internal_keys.size(); i++) {
+        newRange->emplaceInternal(internal_keys[i], values[i]);
+        ValueType type = ExtractValueType(internal_keys[i]);
+        if (type == kTypeDeletion || type == kTypeSingleDeletion || type == kTypeDeletionWithTimestamp) {
+            newRange->delete_length++;
+        }
     }
-
+    newRange->finishBuilding();
     return newRange;
 }
 
-const Slice& VecPhysicalRange::startUserKey() const {
+size_t VecPhysicalRange::chunkOf(size_t index) const {
+    const auto& chunk_first_index = data->chunk_first_index;
+    auto it = std::upper_bound(chunk_first_index.begin(), chunk_first_index.end(), index);
+    assert(it != chunk_first_index.begin());
+    return std::distance(chunk_first_index.begin(), it) - 1;
+}
+
+void VecPhysicalRange::splitChunk(size_t chunk) const {
+    auto& chunks = data->chunks;
+    Chunk& old_chunk = *chunks[chunk];
+    size_t half = old_chunk.size() / 2;
+    std::unique_ptr<Chunk> right(new Chunk());
+    right->internal_keys.reserve(kChunkMaxEntries);
+    right->values.reserve(kChunkMaxEntries);
+    std::move(old_chunk.internal_keys.begin() + half, old_chunk.internal_keys.end(), std::back_inserter(right->internal_keys));
+    std::move(old_chunk.values.begin() + half, old_chunk.values.end(), std::back_inserter(right->values));
+    if (old_chunk.shared_values.size() > half) {
+        std::move(old_chunk.shared_values.begin() + half, old_chunk.shared_values.end(), std::back_inserter(right->shared_values));
+        old_chunk.shared_values.resize(half);
+    }
+    old_chunk.internal_keys.resize(half);
+    old_chunk.values.resize(half);
+    old_chunk.rebuildKeyHeads();
+    right->rebuildKeyHeads();
+
+    size_t right_first_index = data->chunk_first_index[chunk] + half;
+    uint64_t right_head = keyHead(right->userKeyAt(0), data->chunk_shared_prefix_size);
+    chunks.insert(chunks.begin() + chunk + 1, std::move(right));
+    data->chunk_first_index.insert(data->chunk_first_index.begin() + chunk + 1, right_first_index);
+    data->chunk_heads.insert(data->chunk_heads.begin() + chunk + 1, right_head);
+}
+
+void VecPhysicalRange::rebuildChunkHeads() const {
+    const auto& chunks = data->chunks;
+    data->chunk_shared_prefix_size = Slice(start_user_key).difference_offset(chunks.back()->userKeyAt(chunks.back()->size() - 1));
+    data->chunk_heads.resize(chunks.size());
+    for (size_t i = 0; i < chunks.size(); i++) {
+        data->chunk_heads[i] = keyHead(chunks[i]->userKeyAt(0), data->chunk_shared_prefix_size);
+    }
+}
+
+Slice VecPhysicalRange::startUserKey() const {
     // Optimization: dont add read lock for startUserKey since it never changes after initialization
     // std::shared_lock<std::shared_mutex> lock(physical_range_mutex_);
-    // assert(valid && range_length > 0 && data->internal_keys.size() > 0 && data->internal_keys[0].size() > internal_key_extra_bytes);
-    return this->start_user_key_slice;
+    assert(valid && range_length > 0);
+    return Slice(this->start_user_key);
 }
 
-const Slice& VecPhysicalRange::endUserKey() const {
+Slice VecPhysicalRange::endUserKey() const {
     std::shared_lock<std::shared_mutex> lock(physical_range_mutex_);
-    assert(valid && range_length > 0 && data->internal_keys.size() > 0 && data->internal_keys[range_length - 1].size() > internal_key_extra_bytes);
-    // return Slice(data->internal_keys[range_length - 1].data(), data->internal_keys[range_length - 1].size() - internal_key_extra_bytes);
-    return this->data->user_key_slices[range_length - 1];
-}  
+    assert(valid && range_length > 0);
+    const std::string& internal_key = data->chunks.back()->internal_keys.back();
+    assert(internal_key.size() > internal_key_extra_bytes);
+    return Slice(internal_key.data(), internal_key.size() - internal_key_extra_bytes);
+}
 
-const Slice& VecPhysicalRange::startInternalKey() const {
+Slice VecPhysicalRange::startInternalKey() const {
     std::shared_lock<std::shared_mutex> lock(physical_range_mutex_);
-    assert(valid && range_length > 0 && data->internal_keys.size() > 0);
-    // return Slice(data->internal_keys[0]);
-    return this->data->internal_key_slices[0];
+    assert(valid && range_length > 0);
+    return Slice(data->chunks.front()->internal_keys.front());
 }
 
-const Slice& VecPhysicalRange::endInternalKey() const {
+Slice VecPhysicalRange::endInternalKey() const {
     std::shared_lock<std::shared_mutex> lock(physical_range_mutex_);
-    assert(valid && range_length > 0 && data->internal_keys.size() > 0);
-    // return Slice(data->internal_keys[range_length - 1]);
-    return this->data->internal_key_slices[range_length - 1];
-}   
+    assert(valid && range_length > 0);
+    return Slice(data->chunks.back()->internal_keys.back());
+}
 
-const Slice& VecPhysicalRange::internalKeyAt(size_t index) const {
+Slice VecPhysicalRange::internalKeyAt(size_t index) const {
     std::shared_lock<std::shared_mutex> lock(physical_range_mutex_);
     assert(valid && range_length > index);
-    // return Slice(data->internal_keys[index]);
-    return this->data->internal_key_slices[index];
+    size_t chunk = chunkOf(index);
+    return Slice(data->chunks[chunk]->internal_keys[index - data->chunk_first_index[chunk]]);
 }
 
-const Slice& VecPhysicalRange::userKeyAt(size_t index) const {
+Slice VecPhysicalRange::userKeyAt(size_t index) const {
     std::shared_lock<std::shared_mutex> lock(physical_range_mutex_);
     return userKeyAtInternal(index);
 }
 
-const Slice& VecPhysicalRange::userKeyAtInternal(size_t index) const {
-    assert(valid && range_length > index && data->internal_keys[index].size() > internal_key_extra_bytes);
-    // return Slice(data->internal_keys[index].data(), data->internal_keys[index].size() - internal_key_extra_bytes);
-    return this->data->user_key_slices[index];
+Slice VecPhysicalRange::userKeyAtInternal(size_t index) const {
+    assert(valid && range_length > index);
+    size_t chunk = chunkOf(index);
+    const std::string& internal_key = data->chunks[chunk]->internal_keys[index - data->chunk_first_index[chunk]];
+    assert(internal_key.size() > internal_key_extra_bytes);
+    return Slice(internal_key.data(), internal_key.size() - internal_key_extra_bytes);
 }
 
-const Slice& VecPhysicalRange::valueAt(size_t index) const {
+Slice VecPhysicalRange::valueAt(size_t index) const {
     std::shared_lock<std::shared_mutex> lock(physical_range_mutex_);
     assert(valid && range_length > index);
-    // return Slice(data->values[index]);
-    return this->data->value_slices[index];
+    size_t chunk = chunkOf(index);
+    return data->chunks[chunk]->valueAt(index - data->chunk_first_index[chunk]);
 }
 
 PhysicalRangeUpdateResult VecPhysicalRange::update(const Slice& internal_key, const Slice& value) const {
@@ -227,6 +324,9 @@ PhysicalRangeUpdateResult VecPhysicalRange::update(const Slice& internal_key, co
     if (is_delete_entry) {
         // reserve deletion types for range cache
         type_in_range_cache = parsed_internal_key.type; 
+    } else if (parsed_internal_key.type == kTypeBlobIndex) {
+        // the value is a blob reference (BLOB_INDEX range cache)
+        type_in_range_cache = kTypeBlobIndex;
     } else {
         // parsed_internal_key.type should be kTypeValue here
         // TODO(jr): is there any other type that should be considered in range cache?
@@ -236,41 +336,78 @@ PhysicalRangeUpdateResult VecPhysicalRange::update(const Slice& internal_key, co
 
     // dont use internal_key for comparison (the last bit may be kTypeValue in Range Cache and kTypeBlobIndex in LSM)
     if (index >= 0 && userKeyAtInternal(index) == user_key) {
-        data->internal_keys[index] = new_internal_key_str;
+        size_t chunk_index = chunkOf(index);
+        Chunk& chunk = *data->chunks[chunk_index];
+        size_t local_index = index - data->chunk_first_index[chunk_index];
+        ValueType old_type = ExtractValueType(chunk.internal_keys[local_index]);
+        bool was_delete_entry = (old_type == kTypeDeletion || old_type == kTypeSingleDeletion || old_type == kTypeDeletionWithTimestamp);
+        chunk.internal_keys[local_index] = new_internal_key_str;
         // update the value
-        data->values[index] = value.ToString();
-
-        if (is_delete_entry) {
-            delete_length++;
+        byte_size = byte_size - chunk.valueBytes(local_index) + value.size();
+        chunk.values[local_index].assign(value.data(), value.size());
+        if (local_index < chunk.shared_values.size()) {
+            chunk.shared_values[local_index].reset();
         }
+
+        // an overwritten deletion is not counted any more
+        delete_length = delete_length - (was_delete_entry ? 1 : 0) + (is_delete_entry ? 1 : 0);
         return PhysicalRangeUpdateResult::UPDATED;
     } else if (index == -1 || userKeyAtInternal(index) != user_key) {
         assert(index == -1 || userKeyAtInternal(index) > user_key);
+        size_t chunk_index;
+        size_t local_index;
         if (index == -1) {
-            index = range_length; // tail insertion
+            // tail insertion
+            chunk_index = data->chunks.size() - 1;
+            local_index = data->chunks.back()->size();
+        } else {
+            chunk_index = chunkOf(index);
+            local_index = index - data->chunk_first_index[chunk_index];
+            if (local_index == 0 && chunk_index > 0) {
+                // append to the previous chunk rather than shifting all entries of this one
+                chunk_index--;
+                local_index = data->chunks[chunk_index]->size();
+            }
+        }
+
+        // random insert in vec physical range, only the entries of one chunk are shifted
+        Chunk& chunk = *data->chunks[chunk_index];
+        // the heads are rebuilt if a new first or last key does not share the prefix of the keys
+        bool in_chunk_prefix = user_key.starts_with(Slice(chunk.internal_keys[0].data(), chunk.shared_prefix_size));
+        bool in_range_prefix = user_key.starts_with(Slice(start_user_key.data(), data->chunk_shared_prefix_size));
+        chunk.internal_keys.insert(chunk.internal_keys.begin() + local_index, std::move(new_internal_key_str));
+        chunk.values.insert(chunk.values.begin() + local_index, value.ToString());
+        if (local_index < chunk.shared_values.size()) {
+            chunk.shared_values.insert(chunk.shared_values.begin() + local_index, nullptr);
+        }
+        if (in_chunk_prefix) {
+            chunk.key_heads.insert(chunk.key_heads.begin() + local_index, keyHead(user_key, chunk.shared_prefix_size));
+        } else {
+            chunk.rebuildKeyHeads();
+        }
+        if (chunk_index == 0 && local_index == 0) {
+            // insertion before the start key
+            start_user_key = user_key.ToString();
+            rebuildChunkHeads();
+        } else if (!in_range_prefix) {
+            rebuildChunkHeads();
+        }
+        for (size_t i = chunk_index + 1; i < data->chunk_first_index.size(); i++) {
+            data->chunk_first_index[i]++;
+        }
+        if (chunk.size() > kChunkMaxEntries) {
+            splitChunk(chunk_index);
         }
 
-        // random insert in vec physical range
-        data->internal_keys.insert(data->internal_keys.begin() + index, new_internal_key_str);
-        data->values.insert(data->values.begin() + index, value.ToString());
-        
-        // Insert corresponding slices at the same position
-        data->internal_key_slices.insert(data->internal_key_slices.begin() + index, 
-            Slice(data->internal_keys[index].data(), data->internal_keys[index].size()));
-        data->user_key_slices.insert(data->user_key_slices.begin() + index,
-            Slice(data->internal_keys[index].data(), data->internal_keys[index].size() - internal_key_extra_bytes));
-        data->value_slices.insert(data->value_slices.begin() + index,
-            Slice(data->values[index].data(), data->values[index].size()));
-        
         range_length++;
-        byte_size += new_internal_key_str.size() + value.size();
+        byte_size += internal_key.size() + value.size();
         if (is_delete_entry) {
             delete_length++;
         }
-        
+
         return PhysicalRangeUpdateResult::INSERTED;
     }
-    
+
     return PhysicalRangeUpdateResult::ERROR;
 }
 
@@ -286,49 +423,68 @@ int VecPhysicalRange::findInternal(const Slice& key) const {
         return -1;
     }
 
-    int left = 0;
-    int right = range_length - 1;
-
-    while (left <= right) {
-        int mid = left + (right - left) / 2;
-        Slice mid_user_key = userKeyAtInternal(mid);
-        if (mid_user_key == key) {
-            return mid;
-        } else if (mid_user_key < key) {
+    // the last chunk whose first key <= key, then the first key >= key in it
+    const auto& chunks = data->chunks;
+    size_t left = 0;
+    size_t right = 0;
+    searchHeads(data->chunk_heads.data(), chunks.size(), Slice(start_user_key.data(), data->chunk_shared_prefix_size), key, &left, &right);
+    while (left < right) {
+        size_t mid = left + (right - left) / 2;
+        if (chunks[mid]->userKeyAt(0).compare(key) <= 0) {
             left = mid + 1;
         } else {
-            right = mid - 1;
+            right = mid;
         }
     }
+    size_t chunk = left == 0 ? 0 : left - 1;
+    size_t local_index = chunks[chunk]->lowerBound(key);
 
-    if ((size_t)left >= range_length) {
+    // the first key of the next chunk if all keys in the chunk are smaller
+    size_t index = data->chunk_first_index[chunk] + local_index;
+    if (index >= range_length) {
         return -1;
     }
-    return left;
+    return static_cast<int>(index);
 }
 
 void VecPhysicalRange::reserve(size_t len) {
-    std::unique_lock<std::shared_mutex> lock(physical_range_mutex_);
-    assert(valid);
-    data->internal_keys.reserve(len);
-    data->values.reserve(len);
-    data->internal_key_slices.reserve(len);
-    data->user_key_slices.reserve(len);
-    data->value_slices.reserve(len);
+    // chunks grow on demand
+}
+
+void VecPhysicalRange::finishBuilding() {
+    if (range_length == 0) {
+        return;
+    }
+    for (auto& chunk : data->chunks) {
+        chunk->rebuildKeyHeads();
+    }
+    rebuildChunkHeads();
 }
 
-void VecPhysicalRange::emplaceInternal(const Slice& internal_key, const Slice& value) {
+void VecPhysicalRange::emplaceInternal(const Slice& internal_key, const Slice& value, std::shared_ptr<SharedRangeValue> shared_value) {
     assert(valid);
+    auto& chunks = data->chunks;
+    if (chunks.empty() || chunks.back()->size() >= kChunkTargetEntries) {
+        chunks.emplace_back(new Chunk());
+        chunks.back()->internal_keys.reserve(kChunkMaxEntries);
+        chunks.back()->values.reserve(kChunkMaxEntries);
+        data->chunk_first_index.push_back(range_length);
+    }
+    chunks.back()->internal_keys.emplace_back(internal_key.data(), internal_key.size());
+    Chunk& chunk = *chunks.back();
+    if (shared_value) {
+        chunk.values.emplace_back();
+        chunk.shared_values.resize(chunk.size() - 1);
+        chunk.shared_values.push_back(std::move(shared_value));
+        byte_size += internal_key.size() + SharedRangeValue::reference_bytes;
+    } else {
+        chunk.values.emplace_back(value.data(), value.size());
+        byte_size += internal_key.size() + value.size();
+    }
     range_length++;
-    byte_size += internal_key.size() + value.size();
-    data->internal_keys.emplace_back(internal_key.data(), internal_key.size());
-    data->values.emplace_back(value.data(), value.size());
-    data->internal_key_slices.emplace_back(data->internal_keys.back().data(), data->internal_keys.back().size());
-    data->user_key_slices.emplace_back(data->internal_keys.back().data(), data->internal_keys.back().size() - internal_key_extra_bytes);
-    data->value_slices.emplace_back(data->values.back().data(), data->values.back().size());
 
     if (range_length == 1) {
-        start_user_key_slice = data->user_key_slices[0];
+        start_user_key.assign(internal_key.data(), internal_key.size() - internal_key_extra_bytes);
     }
 }
 
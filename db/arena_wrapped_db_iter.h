@@ -91,6 +91,7 @@ class ArenaWrappedDBIter : public Iterator {
   Status status() const override { return db_iter_->status(); }
   Slice timestamp() const override { return db_iter_->timestamp(); }
   bool IsBlob() const { return db_iter_->IsBlob(); }
+  Slice lazy_blob_index() const { return db_iter_->lazy_blob_index(); }
 
   Status GetProperty(std::string prop_name, std::string* prop) override;
 
@@ -71,6 +71,16 @@ Status BlobSource::GetBlobFromCache(
   return Status::NotFound("Blob not found in cache");
 }
 
+Cache::Handle* BlobSource::LookupCachedBlob(uint64_t file_number,
+                                            uint64_t offset) const {
+  if (!blob_cache_) {
+    return nullptr;
+  }
+
+  const CacheKey cache_key = GetCacheKey(file_number, 0 /* file_size */, offset);
+  return blob_cache_.get()->Lookup(cache_key.AsSlice());
+}
+
 Status BlobSource::PutBlobIntoCache(
     const Slice& cache_key, std::unique_ptr<BlobContents>* blob,
     CacheHandleGuard<BlobContents>* cached_blob) const {
@@ -223,7 +233,8 @@ Status BlobSource::GetBlob(const ReadOptions& read_options,
     }
 
     MemoryAllocator* const allocator =
-        (blob_cache_ && read_options.fill_cache)
+        (blob_cache_ && read_options.fill_cache &&
+         read_options.fill_blob_cache)
             ? blob_cache_.get()->memory_allocator()
             : nullptr;
 
@@ -239,7 +250,8 @@ Status BlobSource::GetBlob(const ReadOptions& read_options,
     }
   }
 
-  if (blob_cache_ && read_options.fill_cache) {
+  if (blob_cache_ && read_options.fill_cache &&
+      read_options.fill_blob_cache) {
     // If filling cache is allowed and a cache is configured, try to put the
     // blob to the cache.
     Slice key = cache_key.AsSlice();
@@ -390,14 +402,16 @@ void BlobSource::MultiGetBlobFromOneFile(const ReadOptions& read_options,
     assert(blob_file_reader.GetValue());
 
     MemoryAllocator* const allocator =
-        (blob_cache_ && read_options.fill_cache)
+        (blob_cache_ && read_options.fill_cache &&
+         read_options.fill_blob_cache)
             ? blob_cache_.get()->memory_allocator()
             : nullptr;
 
     blob_file_reader.GetValue()->MultiGetBlob(read_options, allocator,
                                               _blob_reqs, &_bytes_read);
 
-    if (blob_cache_ && read_options.fill_cache) {
+    if (blob_cache_ && read_options.fill_cache &&
+        read_options.fill_blob_cache) {
       // If filling cache is allowed and a cache is configured, try to put
       // the blob(s) to the cache.
       for (auto& [req, blob_contents] : _blob_reqs) {
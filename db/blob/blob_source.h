@@ -107,6 +107,12 @@ class BlobSource {
 
   inline Cache* GetBlobCache() const { return blob_cache_.get(); }
 
+  // Returns the handle of the blob of a blob reference if it is in the blob
+  // cache (without reading the blob file or counting a cache access), nullptr
+  // otherwise. The handle (of a BlobContents) is released by the caller with
+  // ImmutableOptions::blob_cache, which may outlive the blob source.
+  Cache::Handle* LookupCachedBlob(uint64_t file_number, uint64_t offset) const;
+
   bool TEST_BlobInCache(uint64_t file_number, uint64_t file_size,
                         uint64_t offset, size_t* charge = nullptr) const;
 
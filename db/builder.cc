@@ -11,6 +11,7 @@
 
 #include <algorithm>
 #include <deque>
+#include <map>
 #include <vector>
 
 #include "db/blob/blob_file_builder.h"
@@ -34,6 +35,7 @@
 #include "rocksdb/env.h"
 #include "rocksdb/file_system.h"
 #include "rocksdb/iterator.h"
+#include "rocksdb/lorc_iter.h"
 #include "rocksdb/options.h"
 #include "rocksdb/table.h"
 #include "seqno_to_time_mapping.h"
@@ -56,6 +58,162 @@ TableBuilder* NewTableBuilder(const TableBuilderOptions& tboptions,
   return tboptions.moptions.table_factory->NewTableBuilder(tboptions, file);
 }
 
+namespace {
+
+// Apply the merge operands of user_key flushed without a base (newest first) to
+// the range cache with a full merge. The base is the newer of the cached entry
+// and the flushed base (if any), and only the operands newer than the base are
+// applied, since they are not idempotent. The logical range is invalidated if
+// the result can not be computed in the cache. `range_cache_seq` is the
+// sequence number of the range cache before the flush. Called with the write
+// lock of the range cache held.
+void UpdateRangeCacheWithMergeOperands(
+    LogicalOrderedRangeCache* range_cache, const ImmutableOptions& ioptions,
+    const Slice& user_key,
+    const std::vector<std::pair<SequenceNumber, std::string>>& operands,
+    SequenceNumber range_cache_seq, const ParsedInternalKey* flushed_base,
+    const Slice& flushed_base_value) {
+  assert(!operands.empty());
+  std::string cached_key;
+  std::string cached_value;
+  bool found = false;
+  if (!range_cache->lookupEntry(user_key, &cached_key, &cached_value,
+                                &found)) {
+    // not in any logical range, but a spilled range containing it is stale
+    range_cache->invalidateLogicalRange(user_key);
+    return;
+  }
+  const SequenceNumber newest_seq = operands.front().first;
+  ParsedInternalKey cached_ikey;
+  if (found) {
+    if (!ParseInternalKey(cached_key, &cached_ikey, false).ok()) {
+      range_cache->invalidateLogicalRange(user_key);
+      return;
+    }
+    if (cached_ikey.sequence >= newest_seq) {
+      // e.g. filled by a scan which has read the operands from the memtable
+      return;
+    }
+  }
+
+  SequenceNumber base_seq = 0;
+  bool has_base = false;
+  Slice base_value;
+  bool supported = true;
+  if (found && (flushed_base == nullptr ||
+                cached_ikey.sequence >= flushed_base->sequence)) {
+    base_seq = cached_ikey.sequence;
+    if (cached_ikey.type == kTypeRangeCacheValue ||
+        cached_ikey.type == kTypeValue) {
+      has_base = true;
+      base_value = cached_value;
+    } else if (cached_ikey.type != kTypeDeletion &&
+               cached_ikey.type != kTypeSingleDeletion &&
+               cached_ikey.type != kTypeDeletionWithTimestamp) {
+      // e.g. a blob index in a key-only range cache
+      supported = false;
+    }
+  } else if (flushed_base != nullptr) {
+    base_seq = flushed_base->sequence;
+    if (flushed_base->type == kTypeValue ||
+        flushed_base->type == kTypeBlobIndex) {
+      // the actual value of a blob index is the value extracted by the flush
+      has_base = true;
+      base_value = flushed_base_value;
+    } else if (flushed_base->type != kTypeDeletion &&
+               flushed_base->type != kTypeSingleDeletion &&
+               flushed_base->type != kTypeDeletionWithTimestamp) {
+      supported = false;
+    }
+  } else if (operands.back().first <= range_cache_seq) {
+    // Not cached while the logical range may have been filled after the
+    // operands, so the base is unknown
+    supported = false;
+  }
+  // else the logical range was filled before the operands without the key
+  if (!supported || ioptions.merge_operator == nullptr) {
+    range_cache->invalidateLogicalRange(user_key);
+    return;
+  }
+
+  // operands newer than the base, in chronological order
+  std::vector<Slice> merge_operands;
+  for (auto it = operands.rbegin(); it != operands.rend(); ++it) {
+    if (it->first > base_seq) {
+      merge_operands.emplace_back(it->second);
+    }
+  }
+  std::string merge_result;
+  ValueType merge_result_type = kTypeValue;
+  Status s;
+  if (has_base) {
+    s = MergeHelper::TimedFullMerge(
+        ioptions.merge_operator.get(), user_key, MergeHelper::kPlainBaseValue,
+        base_value, merge_operands, ioptions.logger, ioptions.stats,
+        ioptions.clock, /* update_num_ops_stats */ false,
+        /* op_failure_scope */ nullptr, &merge_result,
+        /* result_operand */ nullptr, &merge_result_type);
+  } else {
+    s = MergeHelper::TimedFullMerge(
+        ioptions.merge_operator.get(), user_key, MergeHelper::kNoBaseValue,
+        merge_operands, ioptions.logger, ioptions.stats, ioptions.clock,
+        /* update_num_ops_stats */ false, /* op_failure_scope */ nullptr,
+        &merge_result, /* result_operand */ nullptr, &merge_result_type);
+  }
+  if (!s.ok() || merge_result_type != kTypeValue) {
+    // the range cache keeps plain values only
+    range_cache->invalidateLogicalRange(user_key);
+    return;
+  }
+  std::string merged_key;
+  AppendInternalKey(&merged_key,
+                    ParsedInternalKey(user_key, newest_seq, kTypeValue));
+  range_cache->updateEntry(merged_key, merge_result);
+}
+
+// Write deletions over the cached entries older than the flushed range
+// tombstones covering them, since the scans of cached ranges do not read the
+// tombstones in the SSTs. Called with the write lock of the range cache held.
+void UpdateRangeCacheWithRangeTombstones(
+    LogicalOrderedRangeCache* range_cache,
+    CompactionRangeDelAggregator* range_del_agg) {
+  // the newest tombstone covering each of the deleted user keys
+  std::map<std::string, SequenceNumber> deleted_keys;
+  std::unique_ptr<LogicalOrderedRangeCacheIterator> cache_iter(
+      range_cache->newLogicalOrderedRangeCacheIterator(nullptr /* arena */));
+  auto range_del_it = range_del_agg->NewIterator();
+  for (range_del_it->SeekToFirst(); range_del_it->Valid();
+       range_del_it->Next()) {
+    const Slice end_key = range_del_it->end_key();
+    const SequenceNumber tombstone_seq = range_del_it->seq();
+    InternalKey start_ikey(range_del_it->start_key(), kMaxSequenceNumber,
+                           kValueTypeForSeek);
+    for (cache_iter->Seek(start_ikey.Encode());
+         cache_iter->Valid() && cache_iter->userKey().compare(end_key) < 0;
+         cache_iter->Next()) {
+      ParsedInternalKey cached_ikey;
+      if (!ParseInternalKey(cache_iter->key(), &cached_ikey, false).ok() ||
+          cached_ikey.sequence >= tombstone_seq ||
+          cached_ikey.type == kTypeDeletion) {
+        continue;
+      }
+      auto it = deleted_keys.emplace(cached_ikey.user_key.ToString(),
+                                     tombstone_seq);
+      it.first->second = std::max(it.first->second, tombstone_seq);
+    }
+  }
+  cache_iter.reset();
+  std::string deleted_key;
+  for (const auto& [user_key, seq] : deleted_keys) {
+    deleted_key.clear();
+    AppendInternalKey(&deleted_key,
+                      ParsedInternalKey(user_key, seq, kTypeDeletion));
+    range_cache->updateEntry(deleted_key, Slice());
+  }
+}
+
+}  // namespace
+
 Status BuildTable(
     const std::string& dbname, VersionSet* versions,
     const ImmutableDBOptions& db_options, const TableBuilderOptions& tboptions,
@@ -216,9 +374,14 @@ Status BuildTable(
     std::string value_buf;
     c_iter.SeekToFirst();
     std::string last_user_key;
+    std::string range_cache_key_buf;
+    // merge operands (newest first) of last_user_key waiting for its base
+    std::vector<std::pair<SequenceNumber, std::string>> range_cache_operands;
+    SequenceNumber range_cache_seq = 0;
 
     if (range_cache) {
       range_cache->lockWrite();
+      range_cache_seq = range_cache->getRangeCacheSeqNum();
     }
     for (; c_iter.Valid(); c_iter.Next()) {
       const Slice& key = c_iter.key();
@@ -233,10 +396,46 @@ Status BuildTable(
         }
         Slice user_key = parsed_ikey.user_key;
         if (user_key.ToString() != last_user_key || last_user_key.empty()) {
+          if (!range_cache_operands.empty()) {
+            // the operands of the previous key have no base in the flush
+            UpdateRangeCacheWithMergeOperands(
+                range_cache.get(), ioptions, last_user_key,
+                range_cache_operands, range_cache_seq, nullptr, Slice());
+            range_cache_operands.clear();
+          }
           // update range cache with internal key and actual value before memtables flushed to L0
           // only update the first user key since it has the largest sequence number
-          range_cache->updateEntry(key, c_iter.actual_value());
+          if (parsed_ikey.type == kTypeMerge) {
+            // an operand is not a value, merge it once its base is known
+            range_cache_operands.emplace_back(parsed_ikey.sequence,
+                                              value.ToString());
+          } else if (parsed_ikey.type != kTypeBlobIndex) {
+            range_cache->updateEntry(key, c_iter.actual_value());
+          } else if (range_cache->getPhysicalRangeType() ==
+                     PhysicalRangeType::BLOB_INDEX) {
+            // a key-only range cache keeps the blob index written by the flush
+            range_cache->updateEntry(key, value);
+          } else {
+            // the value extracted to the blob file is cached as a plain value
+            range_cache_key_buf.assign(key.data(), key.size());
+            UpdateInternalKey(&range_cache_key_buf, parsed_ikey.sequence,
+                              kTypeValue);
+            range_cache->updateEntry(range_cache_key_buf,
+                                     c_iter.actual_value());
+          }
           last_user_key = user_key.ToString();  // TODO(jr): avoid key data copy
+        } else if (!range_cache_operands.empty()) {
+          // older entries of a key flushed as merge operands (e.g. across
+          // snapshots), until its base
+          if (parsed_ikey.type == kTypeMerge) {
+            range_cache_operands.emplace_back(parsed_ikey.sequence,
+                                              value.ToString());
+          } else {
+            UpdateRangeCacheWithMergeOperands(
+                range_cache.get(), ioptions, user_key, range_cache_operands,
+                range_cache_seq, &parsed_ikey, c_iter.actual_value());
+            range_cache_operands.clear();
+          }
         }
       }
       
@@ -294,6 +493,16 @@ Status BuildTable(
       }
     }
     if (range_cache) {
+      if (s.ok() && !range_cache_operands.empty()) {
+        UpdateRangeCacheWithMergeOperands(
+            range_cache.get(), ioptions, last_user_key, range_cache_operands,
+            range_cache_seq, nullptr, Slice());
+      }
+      if (s.ok() && blob_creation_reason == BlobFileCreationReason::kFlush &&
+          !range_del_agg->IsEmpty()) {
+        UpdateRangeCacheWithRangeTombstones(range_cache.get(),
+                                            range_del_agg.get());
+      }
       range_cache->unlockWrite();
     }
 
@@ -633,6 +633,28 @@ ColumnFamilyData::ColumnFamilyData(
     blob_source_.reset(new BlobSource(ioptions_, mutable_cf_options_, db_id,
                                       db_session_id, blob_file_cache_.get()));
     range_cache_ = ioptions_.range_cache;
+    if (range_cache_ != nullptr && range_cache_->getBudget() != nullptr &&
+        !range_cache_->isBudgetTenant()) {
+      // a template shared by column families, each gets its own range cache
+      // under the global budget of the template
+      range_cache_ = range_cache_->newTenant(name_);
+      if (range_cache_ == nullptr) {
+        ROCKS_LOG_WARN(ioptions_.logger,
+                       "Column family %s: the range cache does not support "
+                       "budgets, range cache disabled",
+                       name_.c_str());
+      }
+    }
+    if (range_cache_ != nullptr) {
+      auto bbto =
+          mutable_cf_options_.table_factory->GetOptions<BlockBasedTableOptions>();
+      if (bbto && bbto->block_cache &&
+          bbto->cache_usage_options.options_overrides
+                  .at(CacheEntryRole::kRangeCache)
+                  .charged == CacheEntryRoleOptions::Decision::kEnabled) {
+        range_cache_->setChargedCache(bbto->block_cache);
+      }
+    }
 
     if (ioptions_.compaction_style == kCompactionStyleLevel) {
       compaction_picker_.reset(
@@ -1149,6 +1149,62 @@ TEST_F(DBBlockCacheTest, CacheEntryRoleStats) {
   }
 }
 
+TEST_F(DBBlockCacheTest, RangeCacheEntryRoleStats) {
+  const size_t capacity = size_t{1} << 25;
+  std::shared_ptr<Cache> cache = NewLRUCache(capacity);
+
+  Options options = CurrentOptions();
+  SetTimeElapseOnlySleepOnReopen(&options);
+  options.create_if_missing = true;
+  // If this wakes up, it could interfere with test
+  options.stats_dump_period_sec = 0;
+  options.range_cache = NewRBTreeLogicalOrderedRangeCache(size_t{1} << 20);
+
+  BlockBasedTableOptions table_options;
+  table_options.block_cache = cache;
+  table_options.cache_usage_options.options_overrides.insert(
+      {CacheEntryRole::kRangeCache,
+       {/*.charged = */ CacheEntryRoleOptions::Decision::kEnabled}});
+  options.table_factory.reset(NewBlockBasedTableFactory(table_options));
+  DestroyAndReopen(options);
+  ASSERT_EQ(cache, options.range_cache->getChargedCache());
+
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Put(Key(i), "value" + std::to_string(i)));
+  }
+  ASSERT_OK(Flush());
+
+  // Fill the range cache
+  std::vector<std::string> keys;
+  std::vector<std::string> values;
+  ASSERT_OK(db_->Scan(ReadOptions(), db_->DefaultColumnFamily(), Key(10),
+                      Key(50), &keys, &values));
+  ASSERT_GE(keys.size(), 40u);
+  ASSERT_GT(options.range_cache->getCurrentSize(), 0u);
+
+  std::map<std::string, std::string> values_map;
+  ASSERT_TRUE(db_->GetMapProperty(DB::Properties::kBlockCacheEntryStats,
+                                  &values_map));
+  EXPECT_GE(ParseSizeT(values_map[BlockCacheEntryStatsMapKeys::EntryCount(
+                CacheEntryRole::kRangeCache)]),
+            1);
+  EXPECT_GE(ParseSizeT(values_map[BlockCacheEntryStatsMapKeys::UsedBytes(
+                CacheEntryRole::kRangeCache)]),
+            options.range_cache->getCurrentSize());
+
+  // Dropping the range cache releases the reservation
+  Close();
+  options.range_cache.reset();
+  env_->MockSleepForSeconds(10000);
+  table_options.cache_usage_options.options_overrides.clear();
+  options.table_factory.reset(NewBlockBasedTableFactory(table_options));
+  Reopen(options);
+  ASSERT_TRUE(db_->GetMapProperty(DB::Properties::kBlockCacheEntryStats,
+                                  &values_map));
+  EXPECT_EQ("0", values_map[BlockCacheEntryStatsMapKeys::EntryCount(
+                     CacheEntryRole::kRangeCache)]);
+}
+
 namespace {
 
 void DummyFillCache(Cache& cache, size_t entry_size,
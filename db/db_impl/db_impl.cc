@@ -8,6 +8,7 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 #include "db/db_impl/db_impl.h"
 
+#include <algorithm>
 #include <cstdint>
 #ifdef OS_SOLARIS
 #include <alloca.h>
@@ -15,6 +16,7 @@
 
 #include <cinttypes>
 #include <cstdio>
+#include <deque>
 #include <map>
 #include <memory>
 #include <optional>
@@ -223,6 +225,8 @@ DBImpl::DBImpl(const DBOptions& options, const std::string& dbname,
       bg_flush_scheduled_(0),
       num_running_flushes_(0),
       bg_purge_scheduled_(0),
+      bg_range_cache_warmup_scheduled_(0),
+      bg_range_cache_prefetch_scheduled_(0),
       disable_delete_obsolete_files_(0),
       pending_purge_obsolete_files_(0),
       delete_obsolete_files_last_run_(immutable_db_options_.clock->NowMicros()),
@@ -290,6 +294,9 @@ DBImpl::DBImpl(const DBOptions& options, const std::string& dbname,
   periodic_task_functions_.emplace(
       PeriodicTaskType::kRecordSeqnoTime,
       [this]() { this->RecordSeqnoToTimeMapping(); });
+  periodic_task_functions_.emplace(
+      PeriodicTaskType::kRangeCacheMaintenance,
+      [this]() { this->RangeCacheMaintenance(); });
 
   versions_.reset(new VersionSet(
       dbname_, &immutable_db_options_, file_options_, table_cache_.get(),
@@ -499,6 +506,12 @@ void DBImpl::WaitForBackgroundWork() {
 void DBImpl::CancelAllBackgroundWork(bool wait) {
   ROCKS_LOG_INFO(immutable_db_options_.info_log,
                  "Shutdown: canceling all background work");
+  if (opened_successfully_ && OwnTablesAndLogs() &&
+      !shutting_down_.load(std::memory_order_acquire)) {
+    // Record the latest hot ranges of range caches for warm-up at next open
+    Status persist_status = PersistRangeCacheHotRanges();
+    persist_status.PermitUncheckedError();
+  }
   Status s = CancelPeriodicTaskScheduler();
   s.PermitUncheckedError();
 
@@ -579,11 +592,16 @@ Status DBImpl::CloseHelper() {
   // Wait for background work to finish
   while (bg_bottom_compaction_scheduled_ || bg_compaction_scheduled_ ||
          bg_flush_scheduled_ || bg_purge_scheduled_ ||
-         pending_purge_obsolete_files_ ||
+         bg_range_cache_warmup_scheduled_ ||
+         bg_range_cache_prefetch_scheduled_ || pending_purge_obsolete_files_ ||
          error_handler_.IsRecoveryInProgress()) {
     TEST_SYNC_POINT("DBImpl::~DBImpl:WaitJob");
     bg_cv_.Wait();
   }
+  // the parallel scans have returned to their callers
+  if (scan_thread_pool_ != nullptr) {
+    scan_thread_pool_->JoinAllThreads();
+  }
   TEST_SYNC_POINT_CALLBACK("DBImpl::CloseHelper:PendingPurgeFinished",
                            &files_grabbed_for_purge_);
   EraseThreadStatusDbInfo();
@@ -842,6 +860,25 @@ Status DBImpl::StartPeriodicTaskScheduler() {
   Status s = periodic_task_scheduler_.Register(
       PeriodicTaskType::kFlushInfoLog,
       periodic_task_functions_.at(PeriodicTaskType::kFlushInfoLog));
+  if (!s.ok()) {
+    return s;
+  }
+
+  bool has_range_cache = false;
+  {
+    InstrumentedMutexLock l(&mutex_);
+    for (auto cfd : *versions_->GetColumnFamilySet()) {
+      if (!cfd->IsDropped() && cfd->GetRangeCache() != nullptr) {
+        has_range_cache = true;
+        break;
+      }
+    }
+  }
+  if (has_range_cache) {
+    s = periodic_task_scheduler_.Register(
+        PeriodicTaskType::kRangeCacheMaintenance,
+        periodic_task_functions_.at(PeriodicTaskType::kRangeCacheMaintenance));
+  }
 
   return s;
 }
@@ -2098,7 +2135,9 @@ InternalIterator* DBImpl::NewInternalIterator(
   if (s.ok() && super_version->range_cache != nullptr 
       && (read_options.read_tier == kMemtableAndRangeCacheTier)) {
     LogicalOrderedRangeCacheIterator* range_cache_iter = super_version->range_cache->newLogicalOrderedRangeCacheIterator(arena);
-    merge_iter_builder.AddIterator(range_cache_iter);
+    // with an empty range tombstone iterator along the ones of the memtables,
+    // no level iterator follows it to fill the gap
+    merge_iter_builder.AddPointAndTombstoneIterator(range_cache_iter, nullptr);
   }
 
   TEST_SYNC_POINT_CALLBACK("DBImpl::NewInternalIterator:StatusCallback", &s);
@@ -2286,6 +2325,24 @@ Status DBImpl::Scan(const ReadOptions& _read_options,
     return Status::InvalidArgument(
         "Cannot call Scan without a values vector");
   }
+  if (len != 0) {
+    keys->reserve(len);
+    values->reserve(len);
+  }
+  return Scan(_read_options, column_family, start_key, end_key, len,
+              [keys, values](const Slice& key, const Slice& value) {
+                keys->emplace_back(key.data(), key.size());
+                values->emplace_back(value.data(), value.size());
+                return true;
+              });
+}
+
+Status DBImpl::Scan(const ReadOptions& _read_options,
+                    ColumnFamilyHandle* column_family,
+                    const Slice& start_key,
+                    const Slice& end_key,
+                    size_t len,
+                    const ScanCallback& callback) {
   if (_read_options.io_activity != Env::IOActivity::kUnknown &&
       _read_options.io_activity != Env::IOActivity::kScan) {
     return Status::InvalidArgument(
@@ -2298,7 +2355,7 @@ Status DBImpl::Scan(const ReadOptions& _read_options,
     read_options.io_activity = Env::IOActivity::kScan;
   }
 
-  Status s = ScanImpl(_read_options, column_family, start_key, end_key, len, keys, values);
+  Status s = ScanImpl(_read_options, column_family, start_key, end_key, len, callback);
   return s;
 }
 
@@ -2307,12 +2364,12 @@ Status DBImpl::ScanImpl(const ReadOptions& _read_options,
                         const Slice& start_key,
                         const Slice& end_key,
                         size_t len,
-                        std::vector<std::string>* keys,
-                        std::vector<std::string>* values) {
+                        const ScanCallback& callback) {
   // TODO(jr): use scan_impl_options as parameter 
   auto lorc = column_family->GetRangeCache();
   _read_options.read_tier = kReadAllTier; // force read all tier for scan (may be reset internally)
-  Status s = ScanWithPredivision(_read_options, column_family, start_key, end_key, len, keys, values);
+  Status s = ScanWithPredivision(_read_options, column_family, start_key, end_key, len, callback,
+                                true /* record_scan_page */);
   return s;
 }
 
@@ -2321,14 +2378,24 @@ Status DBImpl::ScanWithPredivision(const ReadOptions& _read_options,
                         const Slice& start_key,
                         const Slice& end_key,
                         size_t len,
-                        std::vector<std::string>* keys,
-                        std::vector<std::string>* values) {
+                        const ScanCallback& callback,
+                        bool record_scan_page) {
   auto lorc = column_family->GetRangeCache();
+  if (!lorc) {
+    return ScanWithAllTierIterator(_read_options, column_family, start_key, end_key, len, callback);
+  }
+
   const Snapshot* snapshot = _read_options.snapshot ? _read_options.snapshot : this->GetSnapshot();
   SequenceNumber read_seq_num = snapshot->GetSequenceNumber();
+  if (_read_options.snapshot == nullptr) {
+    // only the sequence number is needed, release the implicit snapshot at once
+    this->ReleaseSnapshot(snapshot);
+  }
 
-  if (!lorc) {
-    return ScanWithAllTierIterator(_read_options, column_family, start_key, end_key, len, keys, values);
+  // Bring the spilled ranges of the scan back before dividing it, so that they
+  // are read from the range cache rather than the LSM
+  if (lorc->getSecondaryTier() != nullptr) {
+    lorc->promoteSpilledRanges(start_key, end_key);
   }
 
   // TODO(jr): control the visibility of range cache better (MVCC?)
@@ -2340,109 +2407,95 @@ Status DBImpl::ScanWithPredivision(const ReadOptions& _read_options,
     // ignore range cache is not visible
     lorc->getLogger().warn("ScanWithPredivision: range cache is not visible, read_seq_num = " + std::to_string(read_seq_num) + ", cache_seq_num = " + std::to_string(cache_seq_num));
     lorc->unlockRead();
-    return ScanWithAllTierIterator(_read_options, column_family, start_key, end_key, len, keys, values);
+    return ScanWithAllTierIterator(_read_options, column_family, start_key, end_key, len, callback);
   }
   
   // TODO(jr): Add comments to explain this method whose logic is very complicated
   std::vector<LogicalRange> divided_logical_ranges = lorc->divideLogicalRange(start_key, len, end_key);
   // lorc->printAllLogicalRanges();
+  if (lorc->getPrefixExtractor() != nullptr) {
+    lorc->recordPrefixScan(
+        start_key, std::all_of(divided_logical_ranges.begin(),
+                               divided_logical_ranges.end(),
+                               [](const LogicalRange& range) {
+                                 return range.isInRangeCache();
+                               }));
+  }
+
+  if (_read_options.scan_parallelism > 1 && len == 0 && !end_key.empty() &&
+      divided_logical_ranges.size() > 1) {
+    // all subranges are scanned to the end, scan them concurrently
+    Status s = ScanRangesInParallel(_read_options, column_family,
+                                    divided_logical_ranges, read_seq_num,
+                                    end_key, callback);
+    lorc->unlockRead();
+    lorc->tryVictim();
+    return s;
+  }
 
-  if (len != 0) {
-    keys->reserve(len);
-    values->reserve(len);
+  // remember the last key of a page of paginated scans to detect the streams
+  // of them
+  record_scan_page =
+      record_scan_page && len != 0 && lorc->getScanPrefetch() > 0;
+  std::string last_key;
+  ScanCallback recording_callback;
+  if (record_scan_page) {
+    recording_callback = [&last_key, &callback](const Slice& key,
+                                                const Slice& value) {
+      last_key.assign(key.data(), key.size());
+      return callback(key, value);
+    };
   }
+  const ScanCallback& scan_callback =
+      record_scan_page ? recording_callback : callback;
 
   size_t count = 0;
   bool terminated = false;
+  bool full_hit = true;
   for (LogicalRange& range : divided_logical_ranges) {
-    size_t range_count = 0;
     if (terminated) {
-      break;  // already terminated by len or end_key
-    }
-
-    Slice range_start_key = range.startUserKey();
-    Slice range_end_key = range.endUserKey();
-    bool in_range_cache = range.isInRangeCache();
-    auto origin_read_tier = _read_options.read_tier;
-    if (in_range_cache) {
-      _read_options.read_tier = kMemtableAndRangeCacheTier; // scan with memtable and range cache without iter on SSTs on hit ranges
-    } else {
-      _read_options.read_tier = kReadAllTier;
-    }
-    Iterator* it = this->NewIterator(_read_options, column_family);
-    if (range_start_key.empty()) {
-      it->SeekToFirst();
-    } else {
-      it->Seek(range_start_key);
-      // if (it->Valid() && it->key() != range_start_key) {
-      //   // TODO(jr): remove the debug line
-      //   assert(false);
-      // }
-    }
-
-    // ref range for the gap range not in range cache
-    ReferringRange ref_range(true, read_seq_num);
-    bool concatRightRangeInCache = false; // indicates that the right range of the current range should be concatenated with ranges in range cache
-    for (; it->Valid(); it->Next()) {
-      if (!range.isLeftIncluded() && !range_start_key.empty() && it->key() == range_start_key) {
-        it->Next();
-        if (!it->Valid()) {
-          break;
-        }
-      }
-      if (!range.isRightIncluded() && !range_end_key.empty() && it->key() == range_end_key) {
-        concatRightRangeInCache = true;
-        break;
-      }
-      if (!range_end_key.empty() && it->key() > range_end_key) {
-        break;
-      }
-
-      keys->emplace_back(it->key().ToString());
-      values->emplace_back(it->value().ToString());
-      if (lorc && !in_range_cache) {
-        // fill the gap range (with an extra copy for each key-value pair)
-        // use kTypeRangeCacheValue as the value type for internal keys of range cache
-        std::string internal_key_str = InternalKey(it->key(), read_seq_num, kTypeRangeCacheValue).Encode().ToString();
-        ref_range.emplace(Slice(keys->back()), Slice(values->back()));
-      }
-
-      count++;
-      range_count++;
-      if (len !=0 && count >= len) {
-        terminated = true;
-        break;  // terminate by len
-      }
-      if (!end_key.empty() && it->key() >= end_key) {
-        terminated = true;
-        break;  // terminate by end_key
-      }
+      break;  // already terminated by len, end_key or the callback
     }
 
-    if (lorc && !in_range_cache) {
-      // try to put non-hit range to range cache
-      if (ref_range.isValid() && ref_range.length() > 0) {
-        // not included in non-hit ranges indicates that the range should be concatenated with ranges in range cache on the corresponding side
-        // TODO(jr): temp upgrade lock in a better way
+    if (range.isInRangeCache()) {
+      // copy straight from the range cache, merging only around the keys in
+      // the memtables
+      Status s = ScanRangeCacheHitRange(_read_options, column_family, range,
+                                        end_key, len, &count, &terminated,
+                                        scan_callback);
+      if (!s.ok()) {
         lorc->unlockRead();
-        lorc->putGapPhysicalRange(std::move(ref_range), !range.isLeftIncluded(), concatRightRangeInCache, false, "", "");
-        lorc->lockRead();
-      } else if (ref_range.isValid() && ref_range.length() == 0 && !range.isLeftIncluded() && concatRightRangeInCache) {
-        // put the empty gap to concat adjacent ranges in range cache
+        // drops the range of a corrupted value, so that a retry reads the LSM
+        lorc->tryVictim();
+        return s;
+      }
+    } else {
+      // scan the gap from the LSM and put it into the range cache
+      full_hit = false;
+      RangeCacheGap gap(read_seq_num);
+      Status s = ScanRangeCacheGapRange(_read_options, column_family, range,
+                                        end_key, len, &count, &terminated,
+                                        scan_callback, &gap);
+      if (!s.ok()) {
         lorc->unlockRead();
-        lorc->putGapPhysicalRange(std::move(ref_range), true, true, true, range_start_key.ToString(), range_end_key.ToString());
-        lorc->lockRead();
+        return s;
       }
+      PutRangeCacheGap(lorc.get(), range, &gap);
     }
-
-    _read_options.read_tier = origin_read_tier; // restore read tier
   }
 
+  size_t prefetch_len = 0;
+  if (record_scan_page && count == len) {
+    prefetch_len = lorc->recordScanPage(start_key, last_key, len, full_hit);
+  }
   lorc->unlockRead();
 
   if (lorc) {
     lorc->tryVictim();
   }
+  if (prefetch_len > 0) {
+    ScheduleRangeCachePrefetch(column_family, last_key, prefetch_len);
+  }
   
   return Status();
 }
@@ -2452,26 +2505,29 @@ Status DBImpl::ScanWithAllTierIterator(const ReadOptions& _read_options,
                         const Slice& start_key,
                         const Slice& end_key,
                         size_t len,
-                        std::vector<std::string>* keys,
-                        std::vector<std::string>* values) {
+                        const ScanCallback& callback,
+                        std::unique_ptr<Iterator>* iter) {
   // no range cache
-  Iterator* it = this->NewIterator(_read_options, column_family);
+  std::unique_ptr<Iterator> local_iter;
+  if (iter == nullptr) {
+    iter = &local_iter;
+  }
+  if (*iter == nullptr) {
+    iter->reset(this->NewIterator(_read_options, column_family));
+  }
+  Iterator* it = iter->get();
   if (start_key.empty()) {
     it->SeekToFirst();
   } else {
     it->Seek(start_key);
   }
 
-  if (len != 0) {
-    keys->reserve(len);
-    values->reserve(len);
-  }
-
   size_t count = 0;
   for (; it->Valid(); it->Next()) {
-    keys->emplace_back(it->key().ToString());
-    values->emplace_back(it->value().ToString());
     count++;
+    if (!callback(it->key(), it->value())) {
+      break;  // terminate by the callback
+    }
 
     if (len !=0 && count >= len) {
       break;  // terminate by len
@@ -2484,6 +2540,151 @@ Status DBImpl::ScanWithAllTierIterator(const ReadOptions& _read_options,
   return Status();
 }
 
+Status DBImpl::MultiScan(const ReadOptions& _read_options,
+                         ColumnFamilyHandle* column_family,
+                         const std::vector<ScanRange>& ranges,
+                         std::vector<ScanResult>* results) {
+  if (results == nullptr) {
+    return Status::InvalidArgument(
+        "Cannot call MultiScan without a results vector");
+  }
+  if (_read_options.io_activity != Env::IOActivity::kUnknown &&
+      _read_options.io_activity != Env::IOActivity::kScan) {
+    return Status::InvalidArgument(
+        "Can only call MultiScan with `ReadOptions::io_activity` is "
+        "`Env::IOActivity::kUnknown` or `Env::IOActivity::kScan`");
+  }
+  results->clear();
+  results->resize(ranges.size());
+
+  ReadOptions read_options(_read_options);
+  // the ranges are read through DB iterators, which take no other activity
+  read_options.io_activity = Env::IOActivity::kUnknown;
+  read_options.read_tier = kReadAllTier;
+  auto append_to = [](ScanResult* result) -> ScanCallback {
+    return [result](const Slice& key, const Slice& value) {
+      result->keys.emplace_back(key.data(), key.size());
+      result->values.emplace_back(value.data(), value.size());
+      return true;
+    };
+  };
+
+  // scan the ranges in order of their start keys, so that the iterators only
+  // seek forward
+  std::vector<size_t> order(ranges.size());
+  for (size_t i = 0; i < ranges.size(); i++) {
+    order[i] = i;
+    if (ranges[i].len != 0) {
+      (*results)[i].keys.reserve(ranges[i].len);
+      (*results)[i].values.reserve(ranges[i].len);
+    }
+  }
+  std::stable_sort(order.begin(), order.end(), [&ranges](size_t a, size_t b) {
+    return ranges[a].start_key.compare(ranges[b].start_key) < 0;
+  });
+
+  auto lorc = column_family->GetRangeCache();
+  SequenceNumber read_seq_num = kMaxSequenceNumber;
+  bool is_range_cache_visible = false;
+  if (lorc) {
+    const Snapshot* snapshot = read_options.snapshot ? read_options.snapshot
+                                                     : this->GetSnapshot();
+    read_seq_num = snapshot->GetSequenceNumber();
+    if (read_options.snapshot == nullptr) {
+      // only the sequence number is needed, release the implicit snapshot
+      this->ReleaseSnapshot(snapshot);
+    }
+    if (lorc->getSecondaryTier() != nullptr) {
+      for (const auto& range : ranges) {
+        lorc->promoteSpilledRanges(range.start_key, range.end_key);
+      }
+    }
+    lorc->lockRead();
+    is_range_cache_visible = read_seq_num >= lorc->getRangeCacheSeqNum();
+    if (!is_range_cache_visible) {
+      lorc->unlockRead();
+    }
+  }
+  if (!is_range_cache_visible) {
+    std::unique_ptr<Iterator> iter;
+    for (size_t i : order) {
+      Status s = ScanWithAllTierIterator(
+          read_options, column_family, ranges[i].start_key, ranges[i].end_key,
+          ranges[i].len, append_to(&(*results)[i]), &iter);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    return Status::OK();
+  }
+
+  auto cfd = static_cast_with_check<ColumnFamilyHandleImpl>(column_family)->cfd();
+  RangeCacheHitIterators hit_iters;
+  std::unique_ptr<Iterator> gap_iter;
+  std::vector<std::pair<LogicalRange, std::unique_ptr<RangeCacheGap>>> gaps;
+  Status s;
+  for (size_t i : order) {
+    const ScanRange& scan_range = ranges[i];
+    ScanCallback callback = append_to(&(*results)[i]);
+    std::vector<LogicalRange> divided_logical_ranges = lorc->divideLogicalRange(
+        scan_range.start_key, scan_range.len, scan_range.end_key);
+    size_t count = 0;
+    bool terminated = false;
+    for (LogicalRange& range : divided_logical_ranges) {
+      if (terminated || !s.ok()) {
+        break;
+      }
+      if (range.isInRangeCache()) {
+        s = ScanRangeCacheHitRange(read_options, column_family, range,
+                                   scan_range.end_key, scan_range.len, &count,
+                                   &terminated, callback, &hit_iters);
+      } else {
+        std::unique_ptr<RangeCacheGap> gap(new RangeCacheGap(read_seq_num));
+        s = ScanRangeCacheGapRange(read_options, column_family, range,
+                                   scan_range.end_key, scan_range.len, &count,
+                                   &terminated, callback, gap.get(), &gap_iter);
+        if (s.ok()) {
+          gaps.emplace_back(std::move(range), std::move(gap));
+        }
+      }
+    }
+    if (!s.ok()) {
+      break;
+    }
+  }
+  ReleaseRangeCacheHitIterators(cfd, &hit_iters);
+  gap_iter.reset();
+
+  // put the gaps as a batch (in order of their start keys), skipping the
+  // ones overlapping a gap put before, as the ranges may overlap. The end of
+  // a len-bounded gap is unbounded, what is put ends at its last scanned key
+  bool has_put = false;
+  std::string last_put_end;  // the last user key covered by the gaps put
+  for (auto& [range, gap] : gaps) {
+    if (!gap->ref_range.isValid() ||
+        (gap->entries.empty() && !gap->concat_right)) {
+      // nothing to put
+      continue;
+    }
+    if (has_put) {
+      int cmp = range.startUserKey().compare(last_put_end);
+      if (cmp < 0 || (cmp == 0 && range.isLeftIncluded())) {
+        continue;
+      }
+    }
+    // a gap concatenated to its right reaches the range cached there
+    std::string put_end = gap->concat_right
+                              ? range.endUserKey().ToString()
+                              : gap->entries[gap->entries.size() - 2];
+    PutRangeCacheGap(lorc.get(), range, gap.get());
+    has_put = true;
+    last_put_end = std::move(put_end);
+  }
+  lorc->unlockRead();
+  lorc->tryVictim();
+  return s;
+}
+
 bool DBImpl::ShouldReferenceSuperVersion(const MergeContext& merge_context) {
   // If both thresholds are reached, a function returning merge operands as
   // `PinnableSlice`s should reference the `SuperVersion` to avoid large and/or
@@ -2721,16 +2922,36 @@ Status DBImpl::GetImpl(const ReadOptions& read_options, const Slice& key,
     // TODO(jr): conflict with range deletion
 
     bool found_in_range_cache = false;
+    bool is_blob_index = false;
     Slice internal_key = lkey.internal_key(); // type of internal_key is kValueTypeForSeek
     if (get_impl_options.get_value) {
-      found_in_range_cache = sv->range_cache->Get(internal_key, get_impl_options.value ? get_impl_options.value->GetSelf() : nullptr, &s);
+      found_in_range_cache = sv->range_cache->Get(internal_key, get_impl_options.value ? get_impl_options.value->GetSelf() : nullptr, &s, &is_blob_index);
     } else {
       found_in_range_cache = sv->range_cache->Get(internal_key, nullptr, &s);
     }
+    if (s.ok() && found_in_range_cache && is_blob_index) {
+      // a key-only range cache holds the blob index of the value, which is read
+      // from the LSM if the blob file is gone (blob garbage collection)
+      if (get_impl_options.value) {
+        std::string blob_index(std::move(*get_impl_options.value->GetSelf()));
+        get_impl_options.value->Reset();
+        found_in_range_cache =
+            sv->current
+                ->GetBlob(read_options, key, blob_index,
+                          nullptr /* prefetch_buffer */,
+                          get_impl_options.value, nullptr /* bytes_read */)
+                .ok();
+        if (!found_in_range_cache) {
+          get_impl_options.value->Reset();
+        }
+      } else {
+        found_in_range_cache = false;
+      }
+    }
 
     if (s.ok()) {
       done = done ? true : found_in_range_cache;
-      if (get_impl_options.value) {
+      if (get_impl_options.value && !is_blob_index) {
         get_impl_options.value->PinSelf();
       }
     } else {
@@ -3906,6 +4127,18 @@ Status DBImpl::CreateColumnFamilyImpl(const ReadOptions& read_options,
     NewThreadStatusCfInfo(
         static_cast_with_check<ColumnFamilyHandleImpl>(*handle)->cfd());
   }
+  if (s.ok() && cf_options.range_cache != nullptr) {
+    // The maintenance task is only registered at open if some column family
+    // already has a range cache. No-op if already registered.
+    Status register_status = periodic_task_scheduler_.Register(
+        PeriodicTaskType::kRangeCacheMaintenance,
+        periodic_task_functions_.at(PeriodicTaskType::kRangeCacheMaintenance));
+    if (!register_status.ok()) {
+      ROCKS_LOG_WARN(immutable_db_options_.info_log,
+                     "Failed to register range cache maintenance: %s",
+                     register_status.ToString().c_str());
+    }
+  }
   return s;
 }
 
@@ -15,6 +15,7 @@
 #include <limits>
 #include <list>
 #include <map>
+#include <mutex>
 #include <set>
 #include <string>
 #include <unordered_map>
@@ -48,6 +49,7 @@
 #include "db/write_controller.h"
 #include "db/write_thread.h"
 #include "logging/event_logger.h"
+#include "memory/arena.h"
 #include "memtable/wbwi_memtable.h"
 #include "monitoring/instrumented_mutex.h"
 #include "options/db_options.h"
@@ -55,8 +57,10 @@
 #include "rocksdb/attribute_groups.h"
 #include "rocksdb/db.h"
 #include "rocksdb/env.h"
+#include "rocksdb/lorc_iter.h"
 #include "rocksdb/memtablerep.h"
 #include "rocksdb/status.h"
+#include "rocksdb/threadpool.h"
 #include "rocksdb/trace_reader_writer.h"
 #include "rocksdb/transaction_log.h"
 #include "rocksdb/user_write_callback.h"
@@ -273,6 +277,15 @@ class DBImpl : public DB {
               const Slice& start_key, const Slice& end_key, size_t len,
               std::vector<std::string>* keys,
               std::vector<std::string>* values) override;
+  Status Scan(const ReadOptions& options, ColumnFamilyHandle* column_family,
+              const Slice& start_key, const Slice& end_key, size_t len,
+              const ScanCallback& callback) override;
+
+  using DB::MultiScan;
+  Status MultiScan(const ReadOptions& options,
+                   ColumnFamilyHandle* column_family,
+                   const std::vector<ScanRange>& ranges,
+                   std::vector<ScanResult>* results) override;
 
   using DB::GetMergeOperands;
   Status GetMergeOperands(const ReadOptions& options,
@@ -700,26 +713,108 @@ class DBImpl : public DB {
                   const Slice& start_key,
                   const Slice& end_key,
                   size_t len,
-                  std::vector<std::string>* keys,
-                  std::vector<std::string>* values);
+                  const ScanCallback& callback);
 
-  // Scan using iterator over all levels (including range cache if exists).                
+  // Scan using iterator over all levels (including range cache if exists).
+  // The iterator is created into iter (if given) to be reused by the
+  // following scans.
   Status ScanWithAllTierIterator(const ReadOptions& options,
                                   ColumnFamilyHandle* column_family,
                                   const Slice& start_key,
                                   const Slice& end_key,
                                   size_t len,
-                                  std::vector<std::string>* keys,
-                                  std::vector<std::string>* values);
+                                  const ScanCallback& callback,
+                                  std::unique_ptr<Iterator>* iter = nullptr);
 
   // Scan afte pre-division. Retrieve ranges in the range cache directly, and scan using iterator on non-hit ranges.
+  // A scan terminated by len is recorded as a page of paginated scans if record_scan_page (not for prefetches).
   Status ScanWithPredivision(const ReadOptions& options,
                                       ColumnFamilyHandle* column_family,
                                       const Slice& start_key,
                                       const Slice& end_key,
                                       size_t len,
-                                      std::vector<std::string>* keys,
-                                      std::vector<std::string>* values);
+                                      const ScanCallback& callback,
+                                      bool record_scan_page);
+
+  // Queue a prefetch of len entries from start_key into the range cache for
+  // a stream of paginated scans, see LogicalOrderedRangeCache::setScanPrefetch()
+  // REQUIRES: DB mutex not held
+  void ScheduleRangeCachePrefetch(ColumnFamilyHandle* column_family,
+                                  const Slice& start_key, size_t len);
+
+  // The entries of a gap range (not in the range cache) scanned from the
+  // LSM, to be put into the range cache
+  struct RangeCacheGap {
+    explicit RangeCacheGap(SequenceNumber seq_num) : ref_range(true, seq_num) {}
+
+    // refers to the copies of the entries (the slices of iterators are
+    // short-lived)
+    ReferringRange ref_range;
+    // key, value, key, value, ... (the blob index instead of the value of a
+    // blob in a BLOB_INDEX range cache)
+    std::deque<std::string> entries;
+    // whether the gap ends right before a range in the range cache
+    bool concat_right = false;
+  };
+
+  // Scan a gap range from the LSM into gap (with the read lock of the range
+  // cache held), delivering its entries to callback right away. The iterator
+  // is created into iter (if given) to be reused by the following gaps.
+  Status ScanRangeCacheGapRange(const ReadOptions& options,
+                                ColumnFamilyHandle* column_family,
+                                const LogicalRange& range,
+                                const Slice& end_key, size_t len,
+                                size_t* count, bool* terminated,
+                                const ScanCallback& callback,
+                                RangeCacheGap* gap,
+                                std::unique_ptr<Iterator>* iter = nullptr);
+
+  // Put a scanned gap range into the range cache, concatenated with its
+  // neighbors in it. The read lock of the range cache is held by the caller
+  // and released meanwhile.
+  void PutRangeCacheGap(LogicalOrderedRangeCache* range_cache,
+                        const LogicalRange& range, RangeCacheGap* gap);
+
+  // Scan the subranges of a scan terminated by end_key concurrently (with the
+  // read lock of the range cache held), see ReadOptions::scan_parallelism.
+  Status ScanRangesInParallel(const ReadOptions& options,
+                              ColumnFamilyHandle* column_family,
+                              const std::vector<LogicalRange>& ranges,
+                              SequenceNumber read_seq_num,
+                              const Slice& end_key,
+                              const ScanCallback& callback);
+
+  // The iterators ScanRangeCacheHitRange reads hit ranges with, reusable by
+  // the following ranges of a MultiScan
+  struct RangeCacheHitIterators {
+    SuperVersion* sv = nullptr;
+    Arena arena;
+    // empty (and cache_iter nullptr) if the memtables have range tombstones,
+    // only applied by the merging iterator
+    std::vector<ScopedArenaPtr<InternalIterator>> mem_iters;
+    ScopedArenaPtr<LogicalOrderedRangeCacheIterator> cache_iter;
+    // with the memtables and the range cache, created at the first memtable
+    // key
+    std::unique_ptr<Iterator> merged_iter;
+  };
+  void InitRangeCacheHitIterators(const ReadOptions& options,
+                                  ColumnFamilyData* cfd,
+                                  RangeCacheHitIterators* iters);
+  void ReleaseRangeCacheHitIterators(ColumnFamilyData* cfd,
+                                     RangeCacheHitIterators* iters);
+
+  // Scan a range hit in the range cache (with the read lock of it held).
+  // Entries between the keys of the memtables are copied straight from the
+  // range cache, only the memtable keys go through the merging iterator.
+  // The iterators are created into iters (if given) to be reused by the
+  // following hit ranges, released by ReleaseRangeCacheHitIterators().
+  Status ScanRangeCacheHitRange(const ReadOptions& options,
+                                ColumnFamilyHandle* column_family,
+                                const LogicalRange& range,
+                                const Slice& end_key, size_t len,
+                                size_t* count, bool* terminated,
+                                const ScanCallback& callback,
+                                RangeCacheHitIterators* iters = nullptr);
 
   // If `snapshot` == kMaxSequenceNumber, set a recent one inside the file.
   ArenaWrappedDBIter* NewIteratorImpl(const ReadOptions& options,
@@ -1191,6 +1286,9 @@ class DBImpl : public DB {
   // Wait for any background purge
   Status TEST_WaitForPurge();
 
+  // Wait for the warm-up of the range caches scheduled at open
+  void TEST_WaitForRangeCacheWarmup();
+
   // Get the background error status
   Status TEST_GetBGError();
 
@@ -1300,6 +1398,10 @@ class DBImpl : public DB {
   // For the background timer job
   void RecordSeqnoToTimeMapping();
 
+  // For the background timer job: maintain the range caches (LORC) of all
+  // column families, e.g. persist the boundaries of their hottest ranges
+  void RangeCacheMaintenance();
+
   // REQUIRES: DB mutex held
   std::pair<SequenceNumber, uint64_t> GetSeqnoToTimeSample() const;
 
@@ -2439,12 +2541,16 @@ class DBImpl : public DB {
   static void BGWorkBottomCompaction(void* arg);
   static void BGWorkFlush(void* arg);
   static void BGWorkPurge(void* arg);
+  static void BGWorkRangeCacheWarmup(void* arg);
+  static void BGWorkRangeCachePrefetch(void* arg);
   static void UnscheduleCompactionCallback(void* arg);
   static void UnscheduleFlushCallback(void* arg);
   void BackgroundCallCompaction(PrepickedCompaction* prepicked_compaction,
                                 Env::Priority thread_pri);
   void BackgroundCallFlush(Env::Priority thread_pri);
   void BackgroundCallPurge();
+  void BackgroundCallRangeCacheWarmup();
+  void BackgroundCallRangeCachePrefetch();
   Status BackgroundCompaction(bool* madeProgress, JobContext* job_context,
                               LogBuffer* log_buffer,
                               PrepickedCompaction* prepicked_compaction,
@@ -2476,6 +2582,16 @@ class DBImpl : public DB {
   // Cancel scheduled periodic tasks
   Status CancelPeriodicTaskScheduler();
 
+  // Persist the boundaries and access frequencies of the hottest logical
+  // ranges of every range cache (LORC) with `getHotRangesPersistNum() > 0`
+  // into LORC-HOT-RANGES next to the OPTIONS file.
+  Status PersistRangeCacheHotRanges();
+
+  // Queue the ranges recorded in LORC-HOT-RANGES (in hotness order) and
+  // schedule background jobs re-scanning them to warm up the range caches.
+  // REQUIRES: DB mutex not held
+  void MaybeScheduleRangeCacheWarmup();
+
   Status RegisterRecordSeqnoTimeWorker();
 
   void PrintStatistics();
@@ -3007,6 +3123,42 @@ class DBImpl : public DB {
   // number of background obsolete file purge jobs, submitted to the HIGH pool
   int bg_purge_scheduled_;
 
+  // number of background range cache warm-up jobs, submitted to the LOW pool
+  int bg_range_cache_warmup_scheduled_;
+
+  // number of background range cache prefetch jobs, submitted to the LOW pool
+  int bg_range_cache_prefetch_scheduled_;
+
+  // A range recorded in LORC-HOT-RANGES waiting to be warmed up
+  struct RangeCacheWarmupRange {
+    std::string cf_name;
+    std::string start_user_key;
+    std::string end_user_key;
+    uint64_t access_frequency;
+  };
+
+  // Ranges left to warm up. Each warm-up job handles a batch of them and
+  // re-schedules itself, so that compactions in the LOW pool can interleave.
+  // Guarded by mutex_
+  std::deque<RangeCacheWarmupRange> range_cache_warmup_queue_;
+  uint64_t range_cache_warmed_ranges_ = 0;
+  uint64_t range_cache_warmed_bytes_ = 0;
+
+  // A prefetch of a stream of paginated scans
+  struct RangeCachePrefetch {
+    uint32_t cf_id;
+    std::string start_user_key;
+    size_t len;
+  };
+
+  // Prefetches waiting for the prefetch job. Guarded by mutex_
+  std::deque<RangeCachePrefetch> range_cache_prefetch_queue_;
+
+  // Threads scanning the subranges of the scans with
+  // ReadOptions::scan_parallelism > 1, created at the first of them
+  std::once_flag scan_thread_pool_once_;
+  std::unique_ptr<ThreadPool> scan_thread_pool_;
+
   std::deque<ManualCompactionState*> manual_compaction_dequeue_;
 
   // shall we disable deletion of obsolete files
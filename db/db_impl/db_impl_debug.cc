@@ -195,6 +195,13 @@ Status DBImpl::TEST_WaitForPurge() {
   return error_handler_.GetBGError();
 }
 
+void DBImpl::TEST_WaitForRangeCacheWarmup() {
+  InstrumentedMutexLock l(&mutex_);
+  while (bg_range_cache_warmup_scheduled_ > 0) {
+    bg_cv_.Wait();
+  }
+}
+
 Status DBImpl::TEST_GetBGError() {
   InstrumentedMutexLock l(&mutex_);
   return error_handler_.GetBGError();
@@ -2675,6 +2675,7 @@ Status DBImpl::Open(const DBOptions& db_options, const std::string& dbname,
   }
   impl->options_mutex_.Unlock();
   if (s.ok()) {
+    impl->MaybeScheduleRangeCacheWarmup();
     *dbptr = std::move(impl);
   } else {
     for (auto* h : *handles) {
@@ -0,0 +1,1071 @@
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "db/arena_wrapped_db_iter.h"
+#include "db/blob/blob_contents.h"
+#include "db/blob/blob_index.h"
+#include "db/blob/blob_source.h"
+#include "db/column_family.h"
+#include "db/db_impl/db_impl.h"
+#include "file/filename.h"
+#include "logging/logging.h"
+#include "memory/arena.h"
+#include "monitoring/iostats_context_imp.h"
+#include "rocksdb/lorc.h"
+#include "rocksdb/lorc_budget.h"
+#include "rocksdb/lorc_iter.h"
+#include "rocksdb/lorc_memory_tuner.h"
+#include "rocksdb/rate_limiter.h"
+#include "table/multiget_context.h"
+#include "util/coding.h"
+#include "util/defer.h"
+
+namespace ROCKSDB_NAMESPACE {
+
+namespace {
+
+// A value of a blob file pinned in the blob cache, which the range cache
+// refers to instead of holding a copy
+class BlobCacheSharedValue : public SharedRangeValue {
+ public:
+  BlobCacheSharedValue(
+      std::shared_ptr<Cache> blob_cache, Cache::Handle* handle,
+      std::shared_ptr<LogicalOrderedRangeCache::BlobCachePins> pins,
+      size_t charge)
+      : blob_cache_(std::move(blob_cache)),
+        handle_(handle),
+        pins_(std::move(pins)),
+        charge_(charge) {}
+
+  ~BlobCacheSharedValue() override {
+    blob_cache_->Release(handle_);
+    pins_->pinned_bytes.fetch_sub(charge_, std::memory_order_relaxed);
+    pins_->pinned_values.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  Slice value() const override {
+    return static_cast<BlobContents*>(blob_cache_->Value(handle_))->data();
+  }
+
+ private:
+  std::shared_ptr<Cache> blob_cache_;
+  Cache::Handle* handle_;
+  std::shared_ptr<LogicalOrderedRangeCache::BlobCachePins> pins_;
+  size_t charge_;
+};
+
+// Pin the value of a blob index in the blob cache to share it with the range
+// cache. Returns nullptr if it is not cached, or if the entries pinned by the
+// range cache would be over their share of the blob cache with it, or the
+// blob cache over its capacity (the value is copied then).
+std::shared_ptr<SharedRangeValue> LookupBlobCacheSharedValue(
+    ColumnFamilyData* cfd, LogicalOrderedRangeCache* range_cache,
+    const Slice& blob_index_slice) {
+  const std::shared_ptr<Cache>& blob_cache = cfd->ioptions().blob_cache;
+  if (blob_cache == nullptr || cfd->blob_source() == nullptr) {
+    return nullptr;
+  }
+  BlobIndex blob_index;
+  if (!blob_index.DecodeFrom(blob_index_slice).ok() ||
+      blob_index.IsInlined() || blob_index.HasTTL()) {
+    return nullptr;
+  }
+  Cache::Handle* handle = cfd->blob_source()->LookupCachedBlob(
+      blob_index.file_number(), blob_index.offset());
+  if (handle == nullptr) {
+    return nullptr;
+  }
+  auto pins = range_cache->getBlobCachePins();
+  const size_t charge = blob_cache->GetCharge(handle);
+  const uint64_t max_pinned_bytes = static_cast<uint64_t>(
+      static_cast<double>(blob_cache->GetCapacity()) *
+      range_cache->getBlobCacheMaxPinnedRatio());
+  // reserve the charge first, concurrent gap scans can not pin past the limit
+  if (pins->pinned_bytes.fetch_add(charge, std::memory_order_relaxed) +
+              charge >
+          max_pinned_bytes ||
+      blob_cache->GetPinnedUsage() > blob_cache->GetCapacity()) {
+    pins->pinned_bytes.fetch_sub(charge, std::memory_order_relaxed);
+    pins->refused_values.fetch_add(1, std::memory_order_relaxed);
+    blob_cache->Release(handle);
+    return nullptr;
+  }
+  pins->pinned_values.fetch_add(1, std::memory_order_relaxed);
+  pins->shared_values.fetch_add(1, std::memory_order_relaxed);
+  return std::make_shared<BlobCacheSharedValue>(blob_cache, handle,
+                                                std::move(pins), charge);
+}
+
+}  // namespace
+
+// LORC-HOT-RANGES format:
+//   varint32 format version
+//   for each column family with a range cache:
+//     length-prefixed column family name
+//     varint64 number of ranges
+//     for each range (in descending order of access frequency):
+//       length-prefixed start user key
+//       length-prefixed end user key
+//       varint64 access frequency
+static const uint32_t kRangeCacheHotRangesFormatVersion = 1;
+
+// Bytes of physical ranges (de)compressed per range cache per maintenance,
+// which is done with the write lock of the range cache held
+static const size_t kRangeCacheCompressBytesPerMaintenance = 16 << 20;
+// Bytes of physical ranges merged per range cache per maintenance, also with
+// the write lock held
+static const size_t kRangeCacheDefragmentBytesPerMaintenance = 16 << 20;
+
+void DBImpl::RangeCacheMaintenance() {
+  if (shutdown_initiated_) {
+    return;
+  }
+  std::vector<std::shared_ptr<LogicalOrderedRangeCache>> range_caches;
+  {
+    InstrumentedMutexLock l(&mutex_);
+    for (auto cfd : *versions_->GetColumnFamilySet()) {
+      if (!cfd->IsDropped() && cfd->GetRangeCache() != nullptr) {
+        range_caches.push_back(cfd->GetRangeCache());
+      }
+    }
+  }
+  // move capacity between the range caches of column families sharing a
+  // budget by their hotness, once per budget
+  std::vector<std::shared_ptr<LorcBudget>> budgets;
+  for (auto& range_cache : range_caches) {
+    auto budget = range_cache->getBudget();
+    if (budget != nullptr &&
+        std::find(budgets.begin(), budgets.end(), budget) == budgets.end()) {
+      budgets.push_back(std::move(budget));
+    }
+  }
+  for (auto& budget : budgets) {
+    budget->refresh();
+  }
+  for (auto& range_cache : range_caches) {
+    // move memory between the range cache and the other caches by their
+    // marginal benefits, a tuner shared by column families runs once a period
+    auto memory_tuner = range_cache->getMemoryTuner();
+    if (memory_tuner != nullptr) {
+      memory_tuner->tune();
+    }
+    // compress the ranges gone cold and decompress the ones hot again
+    range_cache->compressColdRanges(kRangeCacheCompressBytesPerMaintenance);
+    // merge the physical ranges of logical ranges filled gap by gap
+    range_cache->defragmentRanges(kRangeCacheDefragmentBytesPerMaintenance);
+    // follow the usage of the shared cache the range cache is charged to
+    range_cache->refreshEffectiveCapacity();
+    range_cache->tryVictim();
+  }
+
+  Status s = PersistRangeCacheHotRanges();
+  if (!s.ok()) {
+    ROCKS_LOG_WARN(immutable_db_options_.info_log,
+                   "Failed to persist range cache hot ranges: %s",
+                   s.ToString().c_str());
+  }
+  // age the hotness so that the next round reflects recent scans
+  for (auto& range_cache : range_caches) {
+    range_cache->decayAccessFrequency();
+  }
+}
+
+Status DBImpl::PersistRangeCacheHotRanges() {
+  std::vector<std::pair<std::string, std::shared_ptr<LogicalOrderedRangeCache>>>
+      range_caches;
+  {
+    InstrumentedMutexLock l(&mutex_);
+    if (bg_range_cache_warmup_scheduled_ > 0) {
+      // Ranges not warmed up yet have no hotness, keep the previous file
+      return Status::OK();
+    }
+    for (auto cfd : *versions_->GetColumnFamilySet()) {
+      auto range_cache = cfd->GetRangeCache();
+      if (cfd->IsDropped() || range_cache == nullptr ||
+          range_cache->getHotRangesPersistNum() == 0) {
+        continue;
+      }
+      range_caches.emplace_back(cfd->GetName(), range_cache);
+    }
+  }
+  if (range_caches.empty()) {
+    return Status::OK();
+  }
+
+  std::string contents;
+  PutVarint32(&contents, kRangeCacheHotRangesFormatVersion);
+  uint64_t num_hot_ranges = 0;
+  for (auto& [cf_name, range_cache] : range_caches) {
+    std::vector<LogicalRange> hot_ranges =
+        range_cache->getHotLogicalRanges(range_cache->getHotRangesPersistNum());
+    PutLengthPrefixedSlice(&contents, cf_name);
+    PutVarint64(&contents, hot_ranges.size());
+    for (const auto& range : hot_ranges) {
+      PutLengthPrefixedSlice(&contents, range.startUserKey());
+      PutLengthPrefixedSlice(&contents, range.endUserKey());
+      PutVarint64(&contents, range.accessFrequency());
+    }
+    num_hot_ranges += hot_ranges.size();
+  }
+  if (num_hot_ranges == 0) {
+    // Nothing has been scanned (e.g. shortly after reopening), do not
+    // overwrite the hot ranges recorded before
+    return Status::OK();
+  }
+
+  const std::string fname = RangeCacheHotRangesFileName(dbname_);
+  const std::string temp_fname = TempRangeCacheHotRangesFileName(dbname_);
+  Status s = WriteStringToFile(env_, contents, temp_fname,
+                               true /* should_sync */);
+  if (s.ok()) {
+    s = env_->RenameFile(temp_fname, fname);
+  }
+  if (!s.ok()) {
+    env_->DeleteFile(temp_fname).PermitUncheckedError();
+  }
+  return s;
+}
+
+void DBImpl::InitRangeCacheHitIterators(const ReadOptions& read_options,
+                                        ColumnFamilyData* cfd,
+                                        RangeCacheHitIterators* iters) {
+  // not the thread-local one, iterators are created while it is held
+  SuperVersion* sv = cfd->GetReferencedSuperVersion(this);
+  iters->sv = sv;
+  // the range tombstones of the memtables are only applied by the merging
+  // iterator, read the whole ranges through it then
+  if (!read_options.ignore_range_deletions &&
+      (sv->mem->NumRangeDeletion() > 0 ||
+       sv->imm->GetTotalNumRangeDeletions() > 0)) {
+    return;
+  }
+  ReadOptions mem_read_options(read_options);
+  mem_read_options.total_order_seek = true;
+  std::vector<InternalIterator*> mem_iters;
+  mem_iters.push_back(sv->mem->NewIterator(
+      mem_read_options, sv->GetSeqnoToTimeMapping(), &iters->arena,
+      nullptr /* prefix_extractor */, false /* for_flush */));
+  sv->imm->AddIterators(mem_read_options, sv->GetSeqnoToTimeMapping(),
+                        nullptr /* prefix_extractor */, &mem_iters,
+                        &iters->arena);
+  for (auto mem_iter : mem_iters) {
+    iters->mem_iters.emplace_back(mem_iter);
+  }
+  iters->cache_iter.reset(
+      cfd->GetRangeCache()->newLogicalOrderedRangeCacheIterator(
+          &iters->arena));
+}
+
+void DBImpl::ReleaseRangeCacheHitIterators(ColumnFamilyData* /*cfd*/,
+                                           RangeCacheHitIterators* iters) {
+  iters->merged_iter.reset();
+  iters->mem_iters.clear();
+  iters->cache_iter.reset();
+  if (iters->sv != nullptr) {
+    CleanupSuperVersion(iters->sv);
+    iters->sv = nullptr;
+  }
+}
+
+Status DBImpl::ScanRangeCacheHitRange(const ReadOptions& read_options,
+                                      ColumnFamilyHandle* column_family,
+                                      const LogicalRange& range,
+                                      const Slice& end_key, size_t len,
+                                      size_t* count, bool* terminated,
+                                      const ScanCallback& callback,
+                                      RangeCacheHitIterators* iters) {
+  // A run copied from the range cache between two memtable keys shorter than
+  // this is short, after that many short runs in a row the memtables are
+  // dense in the range and the rest is read through the merging iterator
+  static const size_t kRangeCacheShortCopyRun = 16;
+  static const size_t kRangeCacheMaxShortCopyRuns = 8;
+
+  auto cfd = static_cast_with_check<ColumnFamilyHandleImpl>(column_family)->cfd();
+  const Slice range_start_key = range.startUserKey();
+  const Slice range_end_key = range.endUserKey();
+  // merge with the memtables only, without iterators on SSTs
+  ReadOptions hit_read_options(read_options);
+  hit_read_options.read_tier = kMemtableAndRangeCacheTier;
+
+  // -1 for the excluded start key, 1 for keys past the range, otherwise 0
+  auto position = [&](const Slice& user_key) {
+    if (!range.isLeftIncluded() && !range_start_key.empty() &&
+        user_key == range_start_key) {
+      return -1;
+    }
+    if (!range_end_key.empty() &&
+        (user_key.compare(range_end_key) > 0 ||
+         (!range.isRightIncluded() && user_key == range_end_key))) {
+      return 1;
+    }
+    return 0;
+  };
+  auto emit = [&](const Slice& user_key, const Slice& value) {
+    (*count)++;
+    if (!callback(user_key, value) || (len != 0 && *count >= len) ||
+        (!end_key.empty() && user_key.compare(end_key) >= 0)) {
+      *terminated = true;
+    }
+  };
+
+  RangeCacheHitIterators local_iters;
+  if (iters == nullptr) {
+    iters = &local_iters;
+  }
+  if (iters->sv == nullptr) {
+    InitRangeCacheHitIterators(hit_read_options, cfd, iters);
+  }
+  Defer release_iters([&]() {
+    if (iters == &local_iters) {
+      ReleaseRangeCacheHitIterators(cfd, iters);
+    }
+  });
+  // The entries copied from the range cache since a blob index (BLOB_INDEX
+  // range cache) wait for the blobs of the batch, read in file and offset
+  // order. The blob files of stale indexes are gone after blob garbage
+  // collection, those values are read from the LSM instead.
+  std::vector<std::string> batch_keys;
+  std::vector<std::string> batch_values;
+  std::vector<size_t> batch_blob_positions;
+  std::unique_ptr<Iterator> blob_fallback_iter;
+  auto flush_batch = [&]() {
+    const size_t num_blobs = batch_blob_positions.size();
+    std::vector<Slice> user_keys;
+    std::vector<Slice> blob_indexes;
+    user_keys.reserve(num_blobs);
+    blob_indexes.reserve(num_blobs);
+    for (size_t pos : batch_blob_positions) {
+      user_keys.emplace_back(batch_keys[pos]);
+      blob_indexes.emplace_back(batch_values[pos]);
+    }
+    std::vector<PinnableSlice> blobs(num_blobs);
+    std::vector<Status> blob_statuses(num_blobs);
+    if (num_blobs > 0) {
+      iters->sv->current->MultiGetBlob(read_options, user_keys, blob_indexes,
+                                       &blobs, &blob_statuses);
+    }
+    Status s;
+    size_t b = 0;
+    for (size_t j = 0; j < batch_keys.size() && !*terminated; j++) {
+      if (b >= num_blobs || batch_blob_positions[b] != j) {
+        emit(batch_keys[j], batch_values[j]);
+        continue;
+      }
+      if (blob_statuses[b].ok()) {
+        emit(batch_keys[j], blobs[b]);
+      } else {
+        if (blob_fallback_iter == nullptr) {
+          ReadOptions fallback_read_options(read_options);
+          fallback_read_options.read_tier = kReadAllTier;
+          blob_fallback_iter.reset(
+              NewIterator(fallback_read_options, column_family));
+        }
+        blob_fallback_iter->Seek(batch_keys[j]);
+        s = blob_fallback_iter->status();
+        if (!s.ok()) {
+          break;
+        }
+        if (blob_fallback_iter->Valid() &&
+            blob_fallback_iter->key() == batch_keys[j]) {
+          emit(batch_keys[j], blob_fallback_iter->value());
+        }
+      }
+      b++;
+    }
+    batch_keys.clear();
+    batch_values.clear();
+    batch_blob_positions.clear();
+    return s;
+  };
+
+  bool copy_from_range_cache = iters->cache_iter != nullptr;
+  auto& mem_iters = iters->mem_iters;
+  auto& cache_iter = iters->cache_iter;
+  auto& merged_iter = iters->merged_iter;
+  if (copy_from_range_cache) {
+    if (range_start_key.empty()) {
+      for (auto& mem_iter : mem_iters) {
+        mem_iter->SeekToFirst();
+      }
+      cache_iter->SeekToFirst();
+    } else {
+      InternalKey start_ikey(range_start_key, kMaxSequenceNumber,
+                             kValueTypeForSeek);
+      for (auto& mem_iter : mem_iters) {
+        mem_iter->Seek(start_ikey.Encode());
+      }
+      cache_iter->Seek(start_ikey.Encode());
+    }
+  }
+
+  // the user key of the last memtable key looked up, the entries up to it
+  // (inclusive) have been scanned
+  std::string mem_key;
+  bool has_mem_key = false;
+  size_t short_copy_runs = 0;
+  bool range_done = false;
+  while (copy_from_range_cache && !*terminated && !range_done) {
+    // the next memtable key bounds the run copied from the range cache
+    std::string bound_key;
+    bool has_bound_key = false;
+    for (auto& mem_iter : mem_iters) {
+      if (mem_iter->Valid()) {
+        Slice user_key = ExtractUserKey(mem_iter->key());
+        if (!has_bound_key || user_key.compare(bound_key) < 0) {
+          bound_key.assign(user_key.data(), user_key.size());
+          has_bound_key = true;
+        }
+      }
+    }
+
+    size_t copy_run = 0;
+    for (; cache_iter->Valid(); cache_iter->Next()) {
+      Slice user_key = cache_iter->userKey();
+      int pos = position(user_key);
+      if (pos > 0) {
+        range_done = true;
+        break;
+      }
+      if (has_bound_key && user_key.compare(bound_key) >= 0) {
+        break;
+      }
+      if (pos < 0) {
+        continue;
+      }
+      ValueType type = ExtractValueType(cache_iter->key());
+      if ((type == kTypeValue || type == kTypeRangeCacheValue) &&
+          batch_keys.empty()) {
+        Slice value = cache_iter->value();
+        if (!cache_iter->status().ok()) {
+          // a corrupted compressed range, dropped by the range cache
+          return cache_iter->status();
+        }
+        emit(user_key, value);
+        copy_run++;
+        if (*terminated) {
+          break;
+        }
+      } else if (type == kTypeValue || type == kTypeRangeCacheValue ||
+                 type == kTypeBlobIndex) {
+        if (type == kTypeBlobIndex) {
+          batch_blob_positions.push_back(batch_keys.size());
+        }
+        Slice value = cache_iter->value();
+        if (!cache_iter->status().ok()) {
+          return cache_iter->status();
+        }
+        batch_keys.emplace_back(user_key.data(), user_key.size());
+        batch_values.emplace_back(value.data(), value.size());
+        copy_run++;
+        // no more entries than needed are read
+        if (batch_blob_positions.size() >=
+                static_cast<size_t>(MultiGetContext::MAX_BATCH_SIZE) ||
+            (len != 0 && *count + batch_keys.size() >= len) ||
+            (!end_key.empty() && user_key.compare(end_key) >= 0)) {
+          Status s = flush_batch();
+          if (!s.ok()) {
+            return s;
+          }
+          if (*terminated) {
+            break;
+          }
+        }
+      } else if (type != kTypeDeletion && type != kTypeSingleDeletion) {
+        // resolved by the merging iterator like a memtable key
+        bound_key.assign(user_key.data(), user_key.size());
+        has_bound_key = true;
+        break;
+      }
+    }
+    if (!batch_keys.empty()) {
+      Status s = flush_batch();
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    if (*terminated || range_done) {
+      break;
+    }
+    if (!has_bound_key || position(bound_key) > 0) {
+      // the memtables hold no more keys in the range
+      range_done = true;
+      break;
+    }
+
+    // read the memtable key through the merging iterator
+    if (position(bound_key) == 0) {
+      if (merged_iter == nullptr) {
+        merged_iter.reset(NewIterator(hit_read_options, column_family));
+      }
+      merged_iter->Seek(bound_key);
+      Status s = merged_iter->status();
+      if (!s.ok()) {
+        return s;
+      }
+      if (merged_iter->Valid() && merged_iter->key() == bound_key) {
+        emit(merged_iter->key(), merged_iter->value());
+      }
+    }
+    mem_key.swap(bound_key);
+    has_mem_key = true;
+    for (auto& mem_iter : mem_iters) {
+      while (mem_iter->Valid() &&
+             ExtractUserKey(mem_iter->key()).compare(mem_key) <= 0) {
+        mem_iter->Next();
+      }
+    }
+    while (cache_iter->Valid() && cache_iter->userKey().compare(mem_key) <= 0) {
+      cache_iter->Next();
+    }
+
+    short_copy_runs =
+        copy_run < kRangeCacheShortCopyRun ? short_copy_runs + 1 : 0;
+    if (short_copy_runs >= kRangeCacheMaxShortCopyRuns) {
+      copy_from_range_cache = false;
+    }
+  }
+  if (*terminated || range_done) {
+    return Status::OK();
+  }
+  // read the rest of the range through the merging iterator
+  if (merged_iter == nullptr) {
+    merged_iter.reset(NewIterator(hit_read_options, column_family));
+  }
+  Iterator* it = merged_iter.get();
+  if (has_mem_key) {
+    it->Seek(mem_key);
+    while (it->Valid() && it->key().compare(mem_key) <= 0) {
+      it->Next();
+    }
+  } else if (range_start_key.empty()) {
+    it->SeekToFirst();
+  } else {
+    it->Seek(range_start_key);
+  }
+  for (; it->Valid(); it->Next()) {
+    int pos = position(it->key());
+    if (pos > 0) {
+      break;
+    }
+    if (pos < 0) {
+      continue;
+    }
+    emit(it->key(), it->value());
+    if (*terminated) {
+      break;
+    }
+  }
+  return it->status();
+}
+
+Status DBImpl::ScanRangeCacheGapRange(const ReadOptions& read_options,
+                                      ColumnFamilyHandle* column_family,
+                                      const LogicalRange& range,
+                                      const Slice& end_key, size_t len,
+                                      size_t* count, bool* terminated,
+                                      const ScanCallback& callback,
+                                      RangeCacheGap* gap,
+                                      std::unique_ptr<Iterator>* iter) {
+  auto range_cache = column_family->GetRangeCache();
+  const Slice range_start_key = range.startUserKey();
+  const Slice range_end_key = range.endUserKey();
+  auto cfh = static_cast_with_check<ColumnFamilyHandleImpl>(column_family);
+  ColumnFamilyData* cfd = cfh->cfd();
+  // a key-only range cache keeps the blob indexes of the values in blob
+  // files, taken from the iterator before it loads the values
+  const bool cache_blob_index =
+      range_cache->getPhysicalRangeType() == PhysicalRangeType::BLOB_INDEX;
+  // large values in blob files are shared with the blob cache, the values
+  // loaded by the iterator are looked up there by their blob indexes
+  const std::shared_ptr<Cache>& blob_cache = cfd->ioptions().blob_cache;
+  const size_t share_min_value_size =
+      range_cache->getPhysicalRangeType() == PhysicalRangeType::VEC &&
+              blob_cache != nullptr
+          ? range_cache->getBlobCacheValueSharing()
+          : 0;
+  ReadOptions gap_read_options(read_options);
+  gap_read_options.read_tier = kReadAllTier;
+  if (range_cache->skipBlobCacheFill() && share_min_value_size == 0) {
+    // the values of the gap range are cached by the range cache right after
+    gap_read_options.fill_blob_cache = false;
+  }
+  const bool take_blob_index = cache_blob_index || share_min_value_size > 0;
+
+  std::unique_ptr<Iterator> local_iter;
+  if (iter == nullptr) {
+    iter = &local_iter;
+  }
+  if (*iter == nullptr) {
+    if (take_blob_index) {
+      gap_read_options.allow_unprepared_value = true;
+      SuperVersion* sv = cfd->GetReferencedSuperVersion(this);
+      iter->reset(NewIteratorImpl(
+          gap_read_options, cfh, sv,
+          gap_read_options.snapshot != nullptr
+              ? gap_read_options.snapshot->GetSequenceNumber()
+              : kMaxSequenceNumber,
+          nullptr /* read_callback */));
+    } else {
+      iter->reset(NewIterator(gap_read_options, column_family));
+    }
+  }
+  Iterator* it = iter->get();
+  if (range_start_key.empty()) {
+    it->SeekToFirst();
+  } else {
+    it->Seek(range_start_key);
+  }
+  std::string blob_index_buf;
+  for (; it->Valid(); it->Next()) {
+    if (!range.isLeftIncluded() && !range_start_key.empty() &&
+        it->key() == range_start_key) {
+      it->Next();
+      if (!it->Valid()) {
+        break;
+      }
+    }
+    if (!range.isRightIncluded() && !range_end_key.empty() &&
+        it->key() == range_end_key) {
+      gap->concat_right = true;
+      break;
+    }
+    if (!range_end_key.empty() && it->key() > range_end_key) {
+      break;
+    }
+
+    // fill the gap range, and deliver the entry to the caller right away
+    gap->entries.emplace_back(it->key().data(), it->key().size());
+    Slice key(gap->entries.back());
+    Slice value;
+    Slice blob_index;
+    if (take_blob_index) {
+      blob_index = static_cast<ArenaWrappedDBIter*>(it)->lazy_blob_index();
+    }
+    if (cache_blob_index && !blob_index.empty()) {
+      gap->entries.emplace_back(blob_index.data(), blob_index.size());
+      gap->ref_range.emplaceBlobIndex(key, Slice(gap->entries.back()));
+      if (!it->PrepareValue()) {
+        break;
+      }
+      value = it->value();
+    } else {
+      blob_index_buf.assign(blob_index.data(), blob_index.size());
+      if (take_blob_index && !it->PrepareValue()) {
+        break;
+      }
+      std::shared_ptr<SharedRangeValue> shared_value;
+      if (!blob_index_buf.empty() &&
+          it->value().size() >= share_min_value_size) {
+        shared_value =
+            LookupBlobCacheSharedValue(cfd, range_cache.get(), blob_index_buf);
+      }
+      if (shared_value != nullptr) {
+        // no copy of the value, the entry keeps the pairing of keys and values
+        gap->entries.emplace_back();
+        value = shared_value->value();
+        gap->ref_range.emplaceShared(key, std::move(shared_value));
+      } else {
+        gap->entries.emplace_back(it->value().data(), it->value().size());
+        value = Slice(gap->entries.back());
+        gap->ref_range.emplace(key, value);
+      }
+    }
+    (*count)++;
+    if (!callback(key, value) || (len != 0 && *count >= len) ||
+        (!end_key.empty() && key.compare(end_key) >= 0)) {
+      *terminated = true;
+      break;
+    }
+  }
+  return it->status();
+}
+
+void DBImpl::PutRangeCacheGap(LogicalOrderedRangeCache* range_cache,
+                              const LogicalRange& range, RangeCacheGap* gap) {
+  // a side not included in the gap range is concatenated with the range in
+  // the range cache there
+  // TODO(jr): temp upgrade lock in a better way
+  if (gap->ref_range.isValid() && gap->ref_range.length() > 0) {
+    if (!range_cache->admitPrefix(range.startUserKey())) {
+      // the tenant (key prefix) of the gap holds its hard quota
+      return;
+    }
+    range_cache->unlockRead();
+    range_cache->putGapPhysicalRange(std::move(gap->ref_range),
+                                     !range.isLeftIncluded(),
+                                     gap->concat_right, false, "", "");
+    range_cache->lockRead();
+  } else if (gap->ref_range.isValid() && gap->ref_range.length() == 0 &&
+             !range.isLeftIncluded() && gap->concat_right) {
+    // put the empty gap to concat adjacent ranges in range cache
+    range_cache->unlockRead();
+    range_cache->putGapPhysicalRange(std::move(gap->ref_range), true, true,
+                                     true, range.startUserKey().ToString(),
+                                     range.endUserKey().ToString());
+    range_cache->lockRead();
+  }
+}
+
+Status DBImpl::ScanRangesInParallel(const ReadOptions& read_options,
+                                    ColumnFamilyHandle* column_family,
+                                    const std::vector<LogicalRange>& ranges,
+                                    SequenceNumber read_seq_num,
+                                    const Slice& end_key,
+                                    const ScanCallback& callback) {
+  std::call_once(scan_thread_pool_once_, [this]() {
+    scan_thread_pool_.reset(NewThreadPool(
+        static_cast<int>(std::max(1u, std::thread::hardware_concurrency()))));
+  });
+  auto range_cache = column_family->GetRangeCache();
+
+  struct SubrangeResult {
+    Status status;
+    // key, value, key, value, ... of the subrange
+    std::deque<std::string> entries;
+    // the gap range to put, holding blob indexes instead of the values in a
+    // BLOB_INDEX range cache
+    std::unique_ptr<RangeCacheGap> gap;
+  };
+  std::vector<SubrangeResult> results(ranges.size());
+  std::atomic<size_t> next_range{0};
+  // the read lock of the range cache held by the caller keeps the hit ranges
+  // for the workers, the gaps are put after they all finish
+  auto scan_subranges = [&]() {
+    size_t i;
+    while ((i = next_range.fetch_add(1, std::memory_order_relaxed)) <
+           ranges.size()) {
+      SubrangeResult& result = results[i];
+      size_t count = 0;
+      bool terminated = false;
+      auto collect = [&result](const Slice& key, const Slice& value) {
+        result.entries.emplace_back(key.data(), key.size());
+        result.entries.emplace_back(value.data(), value.size());
+        return true;
+      };
+      if (ranges[i].isInRangeCache()) {
+        result.status =
+            ScanRangeCacheHitRange(read_options, column_family, ranges[i],
+                                   end_key, 0, &count, &terminated, collect);
+      } else {
+        result.gap.reset(new RangeCacheGap(read_seq_num));
+        result.status = ScanRangeCacheGapRange(
+            read_options, column_family, ranges[i], end_key, 0, &count,
+            &terminated, collect, result.gap.get());
+      }
+    }
+  };
+
+  // the calling thread is one of the workers
+  size_t num_jobs = std::min(read_options.scan_parallelism, ranges.size()) - 1;
+  std::mutex mu;
+  std::condition_variable cv;
+  size_t running_jobs = num_jobs;
+  for (size_t j = 0; j < num_jobs; j++) {
+    scan_thread_pool_->SubmitJob([&]() {
+      scan_subranges();
+      std::lock_guard<std::mutex> lock(mu);
+      if (--running_jobs == 0) {
+        cv.notify_all();
+      }
+    });
+  }
+  scan_subranges();
+  {
+    std::unique_lock<std::mutex> lock(mu);
+    cv.wait(lock, [&running_jobs]() { return running_jobs == 0; });
+  }
+
+  // deliver the results in order
+  Status s;
+  for (auto& result : results) {
+    s = result.status;
+    if (!s.ok()) {
+      break;
+    }
+    const std::deque<std::string>& entries = result.entries;
+    bool stopped = false;
+    for (size_t j = 0; j + 1 < entries.size(); j += 2) {
+      if (!callback(entries[j], entries[j + 1])) {
+        stopped = true;
+        break;
+      }
+    }
+    if (stopped) {
+      break;
+    }
+  }
+  // each scanned gap is complete on its own, put them in order
+  for (size_t i = 0; i < ranges.size(); i++) {
+    if (results[i].gap != nullptr && results[i].status.ok()) {
+      PutRangeCacheGap(range_cache.get(), ranges[i], results[i].gap.get());
+    }
+  }
+  return s;
+}
+
+void DBImpl::MaybeScheduleRangeCacheWarmup() {
+  const std::string fname = RangeCacheHotRangesFileName(dbname_);
+  if (!env_->FileExists(fname).ok()) {
+    return;
+  }
+  std::string contents;
+  Status s = ReadFileToString(env_, fname, &contents);
+  Slice input(contents);
+  uint32_t format_version = 0;
+  if (s.ok() && (!GetVarint32(&input, &format_version) ||
+                 format_version != kRangeCacheHotRangesFormatVersion)) {
+    s = Status::Corruption("Unknown LORC-HOT-RANGES format version");
+  }
+
+  std::deque<RangeCacheWarmupRange> warmup_ranges;
+  while (s.ok() && !input.empty()) {
+    Slice cf_name;
+    uint64_t num_ranges = 0;
+    if (!GetLengthPrefixedSlice(&input, &cf_name) ||
+        !GetVarint64(&input, &num_ranges)) {
+      s = Status::Corruption("Bad column family entry in LORC-HOT-RANGES");
+      break;
+    }
+    for (uint64_t i = 0; i < num_ranges; i++) {
+      Slice start_user_key;
+      Slice end_user_key;
+      uint64_t access_frequency = 0;
+      if (!GetLengthPrefixedSlice(&input, &start_user_key) ||
+          !GetLengthPrefixedSlice(&input, &end_user_key) ||
+          !GetVarint64(&input, &access_frequency)) {
+        s = Status::Corruption("Bad range entry in LORC-HOT-RANGES");
+        break;
+      }
+      warmup_ranges.push_back({cf_name.ToString(), start_user_key.ToString(),
+                               end_user_key.ToString(), access_frequency});
+    }
+  }
+  if (!s.ok()) {
+    ROCKS_LOG_WARN(immutable_db_options_.info_log,
+                   "Skip range cache warm-up: %s", s.ToString().c_str());
+    return;
+  }
+
+  InstrumentedMutexLock l(&mutex_);
+  // drop the ranges of column families without a range cache to warm up
+  for (auto& range : warmup_ranges) {
+    auto cfd = versions_->GetColumnFamilySet()->GetColumnFamily(range.cf_name);
+    if (cfd != nullptr && !cfd->IsDropped() &&
+        cfd->GetRangeCache() != nullptr &&
+        cfd->GetRangeCache()->getHotRangesPersistNum() > 0) {
+      range_cache_warmup_queue_.push_back(std::move(range));
+    }
+  }
+  if (range_cache_warmup_queue_.empty() ||
+      shutting_down_.load(std::memory_order_acquire)) {
+    range_cache_warmup_queue_.clear();
+    return;
+  }
+  range_cache_warmed_ranges_ = 0;
+  range_cache_warmed_bytes_ = 0;
+  bg_range_cache_warmup_scheduled_++;
+  env_->Schedule(&DBImpl::BGWorkRangeCacheWarmup, this, Env::Priority::LOW,
+                 nullptr);
+}
+
+void DBImpl::BGWorkRangeCacheWarmup(void* db) {
+  IOSTATS_SET_THREAD_POOL_ID(Env::Priority::LOW);
+  static_cast<DBImpl*>(db)->BackgroundCallRangeCacheWarmup();
+}
+
+void DBImpl::BackgroundCallRangeCacheWarmup() {
+  // number of ranges re-scanned by one warm-up job
+  static const size_t kRangeCacheWarmupBatchSize = 16;
+
+  std::vector<RangeCacheWarmupRange> batch;
+  {
+    InstrumentedMutexLock l(&mutex_);
+    while (!range_cache_warmup_queue_.empty() &&
+           batch.size() < kRangeCacheWarmupBatchSize) {
+      batch.push_back(std::move(range_cache_warmup_queue_.front()));
+      range_cache_warmup_queue_.pop_front();
+    }
+  }
+
+  RateLimiter* rate_limiter = immutable_db_options_.rate_limiter.get();
+  ReadOptions read_options;
+  // the block cache has nothing to do with the warm-up
+  read_options.fill_cache = false;
+  uint64_t num_warmed_ranges = 0;
+  uint64_t num_warmed_bytes = 0;
+  for (const auto& range : batch) {
+    if (shutting_down_.load(std::memory_order_acquire)) {
+      break;
+    }
+    std::unique_ptr<ColumnFamilyHandle> cfh;
+    {
+      InstrumentedMutexLock l(&mutex_);
+      auto cfd =
+          versions_->GetColumnFamilySet()->GetColumnFamily(range.cf_name);
+      if (cfd != nullptr && !cfd->IsDropped() &&
+          cfd->GetRangeCache() != nullptr) {
+        cfh.reset(new ColumnFamilyHandleImpl(cfd, this, &mutex_));
+      }
+    }
+    if (cfh == nullptr) {
+      continue;
+    }
+    auto range_cache = cfh->GetRangeCache();
+    if (range_cache->getCurrentSize() >= range_cache->getEffectiveCapacity()) {
+      // the remaining ranges are colder, warming them up would only evict
+      // the hotter ones
+      continue;
+    }
+
+    // re-scan through the normal gap-filling path of Scan, only counting the
+    // bytes read
+    int64_t range_bytes = 0;
+    Status scan_status =
+        Scan(read_options, cfh.get(), range.start_user_key, range.end_user_key,
+             0, [&range_bytes](const Slice& key, const Slice& value) {
+               range_bytes += static_cast<int64_t>(key.size() + value.size());
+               return true;
+             });
+    if (!scan_status.ok()) {
+      ROCKS_LOG_WARN(immutable_db_options_.info_log,
+                     "[%s] Range cache warm-up scan failed: %s",
+                     range.cf_name.c_str(), scan_status.ToString().c_str());
+      continue;
+    }
+    // restore the hotness, otherwise the range is not persisted again
+    // until it is scanned
+    range_cache->seedAccessFrequency(range.start_user_key, range.end_user_key,
+                                     range.access_frequency);
+    num_warmed_ranges++;
+    num_warmed_bytes += range_bytes;
+
+    // charge the read bytes afterwards to throttle the following scans
+    while (rate_limiter != nullptr && range_bytes > 0) {
+      int64_t request_bytes =
+          std::min(range_bytes, rate_limiter->GetSingleBurstBytes());
+      rate_limiter->Request(request_bytes, Env::IO_LOW, stats_,
+                            RateLimiter::OpType::kRead);
+      range_bytes -= request_bytes;
+    }
+  }
+
+  InstrumentedMutexLock l(&mutex_);
+  range_cache_warmed_ranges_ += num_warmed_ranges;
+  range_cache_warmed_bytes_ += num_warmed_bytes;
+  if (shutting_down_.load(std::memory_order_acquire)) {
+    range_cache_warmup_queue_.clear();
+  }
+  if (!range_cache_warmup_queue_.empty()) {
+    // continue with the next batch behind the queued compactions
+    bg_range_cache_warmup_scheduled_++;
+    env_->Schedule(&DBImpl::BGWorkRangeCacheWarmup, this, Env::Priority::LOW,
+                   nullptr);
+  } else {
+    ROCKS_LOG_INFO(immutable_db_options_.info_log,
+                   "Range cache warm-up finished: %" PRIu64
+                   " ranges, %" PRIu64 " bytes",
+                   range_cache_warmed_ranges_, range_cache_warmed_bytes_);
+  }
+  assert(bg_range_cache_warmup_scheduled_ > 0);
+  bg_range_cache_warmup_scheduled_--;
+  bg_cv_.SignalAll();
+}
+
+void DBImpl::ScheduleRangeCachePrefetch(ColumnFamilyHandle* column_family,
+                                        const Slice& start_key, size_t len) {
+  // prefetches queued at most, the streams are prefetched again at their
+  // next pages
+  static const size_t kRangeCachePrefetchQueueSize = 64;
+
+  auto cfd = static_cast_with_check<ColumnFamilyHandleImpl>(column_family)->cfd();
+  InstrumentedMutexLock l(&mutex_);
+  if (shutting_down_.load(std::memory_order_acquire) ||
+      range_cache_prefetch_queue_.size() >= kRangeCachePrefetchQueueSize) {
+    return;
+  }
+  range_cache_prefetch_queue_.push_back(
+      {cfd->GetID(), start_key.ToString(), len});
+  if (bg_range_cache_prefetch_scheduled_ == 0) {
+    bg_range_cache_prefetch_scheduled_++;
+    env_->Schedule(&DBImpl::BGWorkRangeCachePrefetch, this, Env::Priority::LOW,
+                   nullptr);
+  }
+}
+
+void DBImpl::BGWorkRangeCachePrefetch(void* db) {
+  IOSTATS_SET_THREAD_POOL_ID(Env::Priority::LOW);
+  static_cast<DBImpl*>(db)->BackgroundCallRangeCachePrefetch();
+}
+
+void DBImpl::BackgroundCallRangeCachePrefetch() {
+  RateLimiter* rate_limiter = immutable_db_options_.rate_limiter.get();
+  ReadOptions read_options;
+  // the block cache has nothing to do with the prefetch
+  read_options.fill_cache = false;
+  while (true) {
+    RangeCachePrefetch prefetch;
+    std::unique_ptr<ColumnFamilyHandle> cfh;
+    {
+      InstrumentedMutexLock l(&mutex_);
+      if (range_cache_prefetch_queue_.empty() ||
+          shutting_down_.load(std::memory_order_acquire)) {
+        // unscheduled in the same critical section, or a prefetch queued
+        // after the queue was seen empty would wait for the next one
+        range_cache_prefetch_queue_.clear();
+        assert(bg_range_cache_prefetch_scheduled_ > 0);
+        bg_range_cache_prefetch_scheduled_--;
+        bg_cv_.SignalAll();
+        return;
+      }
+      prefetch = std::move(range_cache_prefetch_queue_.front());
+      range_cache_prefetch_queue_.pop_front();
+      auto cfd = versions_->GetColumnFamilySet()->GetColumnFamily(prefetch.cf_id);
+      if (cfd != nullptr && !cfd->IsDropped() &&
+          cfd->GetRangeCache() != nullptr) {
+        cfh.reset(new ColumnFamilyHandleImpl(cfd, this, &mutex_));
+      }
+    }
+    if (cfh == nullptr) {
+      continue;
+    }
+    // a prefetch reads at most max_bytes
+    const int64_t max_bytes =
+        static_cast<int64_t>(cfh->GetRangeCache()->getScanPrefetch());
+    if (max_bytes == 0) {
+      continue;
+    }
+
+    // scan through the normal gap-filling path, without counting as a page
+    int64_t prefetch_bytes = 0;
+    Status s = ScanWithPredivision(
+        read_options, cfh.get(), prefetch.start_user_key, Slice(),
+        prefetch.len,
+        [&prefetch_bytes, max_bytes](const Slice& key, const Slice& value) {
+          prefetch_bytes += static_cast<int64_t>(key.size() + value.size());
+          return prefetch_bytes < max_bytes;
+        },
+        false /* record_scan_page */);
+    if (!s.ok()) {
+      ROCKS_LOG_WARN(immutable_db_options_.info_log,
+                     "Range cache prefetch scan failed: %s",
+                     s.ToString().c_str());
+      continue;
+    }
+
+    // charge the read bytes afterwards to throttle the following prefetches
+    while (rate_limiter != nullptr && prefetch_bytes > 0) {
+      int64_t request_bytes =
+          std::min(prefetch_bytes, rate_limiter->GetSingleBurstBytes());
+      rate_limiter->Request(request_bytes, Env::IO_LOW, stats_,
+                            RateLimiter::OpType::kRead);
+      prefetch_bytes -= request_bytes;
+    }
+  }
+}
+
+}  // namespace ROCKSDB_NAMESPACE
@@ -197,6 +197,12 @@ class DBIter final : public Iterator {
     assert(valid_);
     return is_blob_;
   }
+  // The blob index of the current value until it is loaded by PrepareValue()
+  // (ReadOptions::allow_unprepared_value), empty if there is none.
+  Slice lazy_blob_index() const {
+    assert(valid_);
+    return lazy_blob_index_;
+  }
 
   Status GetProperty(std::string prop_name, std::string* prop) override;
 
@@ -0,0 +1,570 @@
+//  Copyright (c) 2011-present, Facebook, Inc.  All rights reserved.
+//  This source code is licensed under both the GPLv2 (found in the
+//  COPYING file in the root directory) and Apache 2.0 License
+//  (found in the LICENSE.Apache file in the root directory).
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "db/db_test_util.h"
+#include "db/dbformat.h"
+#include "file/filename.h"
+#include "port/stack_trace.h"
+#include "rocksdb/cache.h"
+#include "rocksdb/lorc.h"
+#include "rocksdb/lorc_secondary_tier.h"
+#include "rocksdb/merge_operator.h"
+#include "rocksdb/vec_physical_range.h"
+
+namespace ROCKSDB_NAMESPACE {
+
+// Adds decimal counters, fails on an operand which is not a number
+class DecimalAddOperator : public AssociativeMergeOperator {
+ public:
+  bool Merge(const Slice& /*key*/, const Slice* existing_value,
+             const Slice& value, std::string* new_value,
+             Logger* /*logger*/) const override {
+    uint64_t base = 0;
+    uint64_t operand = 0;
+    if ((existing_value != nullptr && !ParseDecimal(*existing_value, &base)) ||
+        !ParseDecimal(value, &operand)) {
+      return false;
+    }
+    *new_value = std::to_string(base + operand);
+    return true;
+  }
+
+  const char* Name() const override { return "DecimalAddOperator"; }
+
+ private:
+  static bool ParseDecimal(const Slice& input, uint64_t* number) {
+    if (input.empty()) {
+      return false;
+    }
+    *number = 0;
+    for (size_t i = 0; i < input.size(); i++) {
+      if (input[i] < '0' || input[i] > '9') {
+        return false;
+      }
+      *number = *number * 10 + static_cast<uint64_t>(input[i] - '0');
+    }
+    return true;
+  }
+};
+
+class DBRangeCacheTest : public DBTestBase {
+ public:
+  DBRangeCacheTest()
+      : DBTestBase("db_range_cache_test", /*env_do_fsync=*/true) {}
+
+  Options RangeCacheOptions() {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.range_cache = NewRBTreeLogicalOrderedRangeCache(size_t{1} << 24);
+    return options;
+  }
+
+  // Whether user_key is cached, with its cached value
+  static bool IsCached(LogicalOrderedRangeCache* range_cache,
+                       const std::string& user_key,
+                       std::string* value = nullptr) {
+    bool found = false;
+    range_cache->lockRead();
+    range_cache->lookupEntry(user_key, nullptr, value, &found);
+    range_cache->unlockRead();
+    return found;
+  }
+
+  // Whether user_key is in a logical range of the range cache
+  static bool IsInLogicalRange(LogicalOrderedRangeCache* range_cache,
+                               const std::string& user_key) {
+    bool found = false;
+    range_cache->lockRead();
+    bool in_range =
+        range_cache->lookupEntry(user_key, nullptr, nullptr, &found);
+    range_cache->unlockRead();
+    return in_range;
+  }
+
+  // The entries of [start_key, end_key] read through an iterator
+  void IteratorScan(const std::string& start_key, const std::string& end_key,
+                    std::vector<std::string>* keys,
+                    std::vector<std::string>* values) {
+    keys->clear();
+    values->clear();
+    std::unique_ptr<Iterator> it(db_->NewIterator(ReadOptions()));
+    for (it->Seek(start_key); it->Valid() && it->key().compare(end_key) <= 0;
+         it->Next()) {
+      keys->push_back(it->key().ToString());
+      values->push_back(it->value().ToString());
+    }
+    ASSERT_OK(it->status());
+  }
+
+  // Scan [start_key, end_key] and check it against an iterator
+  void VerifyScan(const ReadOptions& read_options,
+                  const std::string& start_key, const std::string& end_key) {
+    std::vector<std::string> expected_keys;
+    std::vector<std::string> expected_values;
+    IteratorScan(start_key, end_key, &expected_keys, &expected_values);
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    ASSERT_OK(db_->Scan(read_options, db_->DefaultColumnFamily(), start_key,
+                        end_key, &keys, &values));
+    ASSERT_EQ(expected_keys, keys);
+    ASSERT_EQ(expected_values, values);
+  }
+};
+
+TEST_F(DBRangeCacheTest, MultiScanPutsDisjointLenBoundedGaps) {
+  Options options = RangeCacheOptions();
+  DestroyAndReopen(options);
+  LogicalOrderedRangeCache* range_cache = options.range_cache.get();
+
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_OK(Put(Key(i), "value" + std::to_string(i)));
+  }
+  ASSERT_OK(Flush());
+
+  // many short disjoint ranges over an empty range cache, each divided into
+  // one gap with an unbounded end
+  const int kRanges = 20;
+  const size_t kLen = 20;
+  std::vector<std::string> start_keys;
+  for (int r = 0; r < kRanges; r++) {
+    start_keys.push_back(Key(r * 50));
+  }
+  std::vector<ScanRange> ranges;
+  for (int r = kRanges - 1; r >= 0; r--) {
+    ranges.emplace_back(start_keys[r], Slice(), kLen);
+  }
+  std::vector<ScanResult> results;
+  ASSERT_OK(db_->MultiScan(ReadOptions(), ranges, &results));
+  ASSERT_EQ(ranges.size(), results.size());
+  for (size_t i = 0; i < ranges.size(); i++) {
+    int first = (kRanges - 1 - static_cast<int>(i)) * 50;
+    ASSERT_EQ(kLen, results[i].keys.size());
+    for (size_t j = 0; j < kLen; j++) {
+      ASSERT_EQ(Key(first + static_cast<int>(j)), results[i].keys[j]);
+      ASSERT_EQ("value" + std::to_string(first + j), results[i].values[j]);
+    }
+  }
+
+  // all the ranges are cached, and only them
+  for (int r = 0; r < kRanges; r++) {
+    for (size_t j = 0; j < kLen; j++) {
+      std::string value;
+      ASSERT_TRUE(IsCached(range_cache, Key(r * 50 + static_cast<int>(j)),
+                           &value));
+      ASSERT_EQ("value" + std::to_string(r * 50 + j), value);
+    }
+    ASSERT_FALSE(IsInLogicalRange(range_cache, Key(r * 50 + 30)));
+  }
+  ASSERT_EQ(kRanges * kLen, range_cache->getTotalRangeLength());
+
+  // of overlapping gaps in one batch, the first one is put
+  ranges.clear();
+  std::string overlap_start = Key(5);
+  std::string overlap_start2 = Key(12);
+  ranges.emplace_back(overlap_start, Slice(), 30);
+  ranges.emplace_back(overlap_start2, Slice(), 30);
+  ASSERT_OK(db_->MultiScan(ReadOptions(), ranges, &results));
+  ASSERT_EQ(30u, results[0].keys.size());
+  ASSERT_EQ(Key(34), results[0].keys.back());
+  ASSERT_EQ(30u, results[1].keys.size());
+  ASSERT_EQ(Key(41), results[1].keys.back());
+  for (int i = 0; i < 35; i++) {
+    ASSERT_TRUE(IsCached(range_cache, Key(i)));
+  }
+  ASSERT_FALSE(IsInLogicalRange(range_cache, Key(35)));
+}
+
+TEST_F(DBRangeCacheTest, SecondaryTierLoadsQueuedAndSpilledRanges) {
+  LorcSecondaryTier tier(env_, dbname_ + "/lorc_tier", size_t{1} << 20,
+                         size_t{1} << 16);
+
+  // a range of keys [first, last], with its internal keys and values
+  auto build_range = [](int first, int last, std::vector<std::string>* keys,
+                        std::vector<std::string>* values) {
+    std::vector<Slice> key_slices;
+    std::vector<Slice> value_slices;
+    for (int i = first; i <= last; i++) {
+      std::string internal_key;
+      AppendInternalKey(&internal_key,
+                        ParsedInternalKey(Key(i), 100 + i, kTypeValue));
+      keys->push_back(internal_key);
+      values->push_back("value" + std::to_string(i));
+    }
+    for (size_t i = 0; i < keys->size(); i++) {
+      key_slices.emplace_back(keys->at(i));
+      value_slices.emplace_back(values->at(i));
+    }
+    std::vector<std::unique_ptr<PhysicalRange>> physical_ranges;
+    physical_ranges.push_back(
+        VecPhysicalRange::buildFromInternalEntries(key_slices, value_slices));
+    return physical_ranges;
+  };
+
+  std::vector<std::string> keys[3];
+  std::vector<std::string> values[3];
+  tier.enqueueSpill(Key(0), Key(9), build_range(0, 9, &keys[0], &values[0]));
+  tier.enqueueSpill(Key(20), Key(29),
+                    build_range(20, 29, &keys[1], &values[1]));
+  tier.enqueueSpill(Key(40), Key(49),
+                    build_range(40, 49, &keys[2], &values[2]));
+  ASSERT_EQ(3u, tier.getPendingSpillNum());
+  ASSERT_EQ(3u, tier.getSpilledRangeNum());
+  ASSERT_EQ(0u, tier.getUsage());
+
+  // a queued range is loaded from memory
+  std::vector<std::string> loaded_keys;
+  std::vector<std::string> loaded_values;
+  ASSERT_OK(tier.load(Key(0), &loaded_keys, &loaded_values));
+  ASSERT_TRUE(tier.finishLoad(Key(0)));
+  ASSERT_EQ(keys[0], loaded_keys);
+  ASSERT_EQ(values[0], loaded_values);
+  ASSERT_EQ(2u, tier.getPendingSpillNum());
+
+  // the others are written by drainPendingSpills() and loaded from a segment
+  ASSERT_OK(tier.drainPendingSpills());
+  ASSERT_EQ(0u, tier.getPendingSpillNum());
+  ASSERT_EQ(2u, tier.getSpilledRangeNum());
+  ASSERT_GT(tier.getUsage(), 0u);
+  ASSERT_TRUE(tier.mayOverlap(Key(25), Key(30)));
+  loaded_keys.clear();
+  loaded_values.clear();
+  ASSERT_OK(tier.load(Key(20), &loaded_keys, &loaded_values));
+  ASSERT_TRUE(tier.finishLoad(Key(20)));
+  ASSERT_EQ(keys[1], loaded_keys);
+  ASSERT_EQ(values[1], loaded_values);
+  ASSERT_FALSE(tier.mayOverlap(Key(25), Key(30)));
+
+  // a range updated while it is loaded is stale
+  loaded_keys.clear();
+  loaded_values.clear();
+  ASSERT_OK(tier.load(Key(40), &loaded_keys, &loaded_values));
+  tier.invalidate(Key(45), Key(45));
+  ASSERT_FALSE(tier.finishLoad(Key(40)));
+  ASSERT_EQ(0u, tier.getSpilledRangeNum());
+
+  // and so is a range evicted again while it is loaded
+  std::vector<std::string> reload_keys;
+  std::vector<std::string> reload_values;
+  tier.enqueueSpill(Key(60), Key(69),
+                    build_range(60, 69, &reload_keys, &reload_values));
+  loaded_keys.clear();
+  loaded_values.clear();
+  ASSERT_OK(tier.load(Key(60), &loaded_keys, &loaded_values));
+  reload_keys.clear();
+  reload_values.clear();
+  tier.enqueueSpill(Key(60), Key(69),
+                    build_range(60, 69, &reload_keys, &reload_values));
+  ASSERT_FALSE(tier.finishLoad(Key(60)));
+  ASSERT_EQ(1u, tier.getSpilledRangeNum());
+}
+
+TEST_F(DBRangeCacheTest, BlobCacheSharedValuesAreReleased) {
+  Options options = RangeCacheOptions();
+  options.enable_blob_files = true;
+  options.min_blob_size = 0;
+  LRUCacheOptions blob_cache_options;
+  blob_cache_options.capacity = 1 << 20;
+  blob_cache_options.num_shard_bits = 0;
+  options.blob_cache = NewLRUCache(blob_cache_options);
+  options.range_cache->setBlobCacheValueSharing(100);
+  DestroyAndReopen(options);
+  LogicalOrderedRangeCache* range_cache = options.range_cache.get();
+  Cache* blob_cache = options.blob_cache.get();
+
+  const int kNum = 100;
+  for (int i = 0; i < kNum; i++) {
+    ASSERT_OK(Put(Key(i), std::string(1000, 'a' + i % 26)));
+  }
+  ASSERT_OK(Flush());
+
+  auto scan_all = [&]() {
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    ASSERT_OK(db_->Scan(ReadOptions(), db_->DefaultColumnFamily(), Key(0),
+                        Key(kNum - 1), &keys, &values));
+    ASSERT_EQ(static_cast<size_t>(kNum), keys.size());
+    for (int i = 1; i < kNum; i++) {
+      ASSERT_EQ(std::string(1000, 'a' + i % 26), values[i]);
+    }
+  };
+  auto invalidate = [&]() {
+    range_cache->lockWrite();
+    ASSERT_TRUE(range_cache->invalidateLogicalRange(Key(kNum / 2)));
+    range_cache->unlockWrite();
+  };
+
+  // the values are pinned in the blob cache
+  scan_all();
+  auto stats = range_cache->getBlobCacheSharingStats();
+  ASSERT_EQ(static_cast<uint64_t>(kNum), stats.pinned_values);
+  ASSERT_EQ(static_cast<uint64_t>(kNum), stats.shared_values);
+  ASSERT_EQ(0u, stats.refused_values);
+  ASSERT_GE(stats.pinned_bytes, static_cast<uint64_t>(kNum) * 1000);
+  ASSERT_GE(blob_cache->GetPinnedUsage(), stats.pinned_bytes);
+
+  // an overwritten value releases its entry
+  ASSERT_OK(Put(Key(0), "new"));
+  ASSERT_OK(Flush());
+  std::string value;
+  ASSERT_TRUE(IsCached(range_cache, Key(0), &value));
+  ASSERT_EQ("new", value);
+  stats = range_cache->getBlobCacheSharingStats();
+  ASSERT_EQ(static_cast<uint64_t>(kNum - 1), stats.pinned_values);
+
+  // and an evicted range all of them
+  invalidate();
+  stats = range_cache->getBlobCacheSharingStats();
+  ASSERT_EQ(0u, stats.pinned_values);
+  ASSERT_EQ(0u, stats.pinned_bytes);
+  ASSERT_EQ(0u, blob_cache->GetPinnedUsage());
+
+  // no more than the share of the blob cache is pinned, the rest is copied
+  const double kMaxPinnedRatio = 0.02;
+  range_cache->setBlobCacheValueSharing(100, kMaxPinnedRatio);
+  scan_all();
+  stats = range_cache->getBlobCacheSharingStats();
+  ASSERT_GT(stats.pinned_values, 0u);
+  ASSERT_GT(stats.refused_values, 0u);
+  ASSERT_LE(stats.pinned_bytes,
+            static_cast<uint64_t>(blob_cache->GetCapacity() * kMaxPinnedRatio));
+  for (int i = 1; i < kNum; i++) {
+    ASSERT_TRUE(IsCached(range_cache, Key(i), &value));
+    ASSERT_EQ(std::string(1000, 'a' + i % 26), value);
+  }
+  invalidate();
+  ASSERT_EQ(0u, range_cache->getBlobCacheSharingStats().pinned_values);
+  ASSERT_EQ(0u, blob_cache->GetPinnedUsage());
+}
+
+TEST_F(DBRangeCacheTest, FlushedMergeOperandsUpdateCachedCounters) {
+  Options options = RangeCacheOptions();
+  options.merge_operator = std::make_shared<DecimalAddOperator>();
+  DestroyAndReopen(options);
+  LogicalOrderedRangeCache* range_cache = options.range_cache.get();
+
+  const int kNum = 100;
+  std::map<std::string, std::string> expected;
+  for (int i = 0; i < kNum; i++) {
+    ASSERT_OK(Put(Key(i), std::to_string(i)));
+    expected[Key(i)] = std::to_string(i);
+  }
+  ASSERT_OK(Flush());
+
+  auto scan_all = [&]() {
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    ASSERT_OK(db_->Scan(ReadOptions(), db_->DefaultColumnFamily(), Key(0),
+                        Key(kNum - 1), &keys, &values));
+    ASSERT_EQ(expected.size(), keys.size());
+    size_t i = 0;
+    for (const auto& entry : expected) {
+      ASSERT_EQ(entry.first, keys[i]);
+      ASSERT_EQ(entry.second, values[i]);
+      i++;
+    }
+  };
+  auto check_cached = [&](const std::string& key) {
+    std::string value;
+    ASSERT_TRUE(IsCached(range_cache, key, &value));
+    ASSERT_EQ(expected[key], value);
+    ASSERT_EQ(expected[key], Get(key));
+  };
+  scan_all();
+  ASSERT_TRUE(IsCached(range_cache, Key(10)));
+
+  // operands over a cached base
+  ASSERT_OK(Merge(Key(10), "5"));
+  ASSERT_OK(Merge(Key(10), "7"));
+  expected[Key(10)] = "22";
+  // operands over a flushed value and a flushed deletion, which a snapshot
+  // keeps apart from them
+  ASSERT_OK(Put(Key(20), "100"));
+  ASSERT_OK(Delete(Key(30)));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(Merge(Key(20), "1"));
+  ASSERT_OK(Merge(Key(30), "4"));
+  expected[Key(20)] = "101";
+  expected[Key(30)] = "4";
+  // operands of a key not in the DB when its logical range was filled
+  std::string new_key = Key(50) + "x";
+  ASSERT_OK(Merge(new_key, "9"));
+  expected[new_key] = "9";
+  ASSERT_OK(Flush());
+  db_->ReleaseSnapshot(snapshot);
+  for (const auto& key : {Key(10), Key(20), Key(30), new_key}) {
+    check_cached(key);
+  }
+  scan_all();
+
+  // operands over a cached deletion
+  ASSERT_OK(Delete(Key(40)));
+  ASSERT_OK(Flush());
+  ASSERT_OK(Merge(Key(40), "3"));
+  ASSERT_OK(Flush());
+  expected[Key(40)] = "3";
+  check_cached(Key(40));
+  scan_all();
+
+  // a merge failing in the range cache drops the logical range, the flush
+  // keeps the operand alone since its base is not in the memtables
+  ASSERT_OK(Put(Key(60), "abc"));
+  ASSERT_OK(Flush());
+  ASSERT_TRUE(IsInLogicalRange(range_cache, Key(60)));
+  ASSERT_OK(Merge(Key(60), "1"));
+  ASSERT_OK(Flush());
+  ASSERT_FALSE(IsInLogicalRange(range_cache, Key(60)));
+  ASSERT_FALSE(IsCached(range_cache, Key(10)));
+}
+
+TEST_F(DBRangeCacheTest, ParallelScanMatchesSequentialScan) {
+  Options options = RangeCacheOptions();
+  DestroyAndReopen(options);
+  LogicalOrderedRangeCache* range_cache = options.range_cache.get();
+
+  const int kNum = 1000;
+  for (int i = 0; i < kNum; i++) {
+    ASSERT_OK(Put(Key(i), "value" + std::to_string(i)));
+  }
+  ASSERT_OK(Flush());
+  // hits between gaps
+  for (int first : {100, 400, 700}) {
+    VerifyScan(ReadOptions(), Key(first), Key(first + 99));
+  }
+  ASSERT_FALSE(IsInLogicalRange(range_cache, Key(300)));
+
+  // memtable keys in the hits and in the gaps
+  for (int i : {150, 300, 450, 460, 950}) {
+    ASSERT_OK(Put(Key(i), "new" + std::to_string(i)));
+  }
+  ASSERT_OK(Put(Key(410) + "a", "between"));
+  ASSERT_OK(Put(Key(50) + "a", "between"));
+  for (int i : {120, 200, 720}) {
+    ASSERT_OK(Delete(Key(i)));
+  }
+
+  ReadOptions parallel_read_options;
+  parallel_read_options.scan_parallelism = 4;
+  VerifyScan(parallel_read_options, Key(0), Key(kNum - 1));
+
+  // the gaps are admitted
+  for (int i = 0; i < kNum; i++) {
+    ASSERT_TRUE(IsInLogicalRange(range_cache, Key(i)));
+  }
+  for (int i : {0, 250, 550, 999}) {
+    std::string value;
+    ASSERT_TRUE(IsCached(range_cache, Key(i), &value));
+    ASSERT_EQ("value" + std::to_string(i), value);
+  }
+
+  // all hits now, sequentially and in parallel
+  VerifyScan(ReadOptions(), Key(0), Key(kNum - 1));
+  VerifyScan(parallel_read_options, Key(0), Key(kNum - 1));
+  VerifyScan(parallel_read_options, Key(250), Key(750));
+}
+
+TEST_F(DBRangeCacheTest, HitCopiesAroundMemtableKeys) {
+  Options options = RangeCacheOptions();
+  DestroyAndReopen(options);
+  LogicalOrderedRangeCache* range_cache = options.range_cache.get();
+
+  const int kNum = 1000;
+  for (int i = 0; i < kNum; i++) {
+    ASSERT_OK(Put(Key(i), "value" + std::to_string(i)));
+  }
+  ASSERT_OK(Flush());
+  VerifyScan(ReadOptions(), Key(0), Key(kNum - 1));
+  ASSERT_TRUE(IsCached(range_cache, Key(kNum - 1)));
+
+  // sparse memtable keys: overwrites, new keys between the cached ones and
+  // deletions, at the bounds of the range too
+  for (int i : {0, 250, 500, kNum - 1}) {
+    ASSERT_OK(Put(Key(i), "new" + std::to_string(i)));
+  }
+  ASSERT_OK(Put(Key(333) + "a", "between"));
+  ASSERT_OK(Put(Key(kNum - 1) + "a", "after"));
+  for (int i : {1, 400, 401, 402}) {
+    ASSERT_OK(Delete(Key(i)));
+  }
+  ASSERT_OK(Put(Key(401), "again"));
+  VerifyScan(ReadOptions(), Key(0), Key(kNum - 1));
+  VerifyScan(ReadOptions(), Key(0), Key(kNum - 1) + "a");
+  VerifyScan(ReadOptions(), Key(333), Key(401));
+  // no memtable key in the scanned range
+  VerifyScan(ReadOptions(), Key(600), Key(699));
+
+  // dense memtable keys, the rest is read through the merging iterator
+  for (int i = 700; i < 900; i += 3) {
+    ASSERT_OK(Put(Key(i), "dense" + std::to_string(i)));
+  }
+  ASSERT_OK(Delete(Key(800)));
+  VerifyScan(ReadOptions(), Key(0), Key(kNum - 1));
+  VerifyScan(ReadOptions(), Key(650), Key(950));
+
+  // a range tombstone in the memtable
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), db_->DefaultColumnFamily(),
+                             Key(100), Key(150)));
+  VerifyScan(ReadOptions(), Key(0), Key(kNum - 1));
+  VerifyScan(ReadOptions(), Key(90), Key(160));
+
+  // and all of them flushed
+  ASSERT_OK(Flush());
+  VerifyScan(ReadOptions(), Key(0), Key(kNum - 1));
+}
+
+TEST_F(DBRangeCacheTest, HotRangesAreWarmedUpAtOpen) {
+  Options options = RangeCacheOptions();
+  options.range_cache->setHotRangesPersistNum(4);
+  DestroyAndReopen(options);
+
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_OK(Put(Key(i), "value" + std::to_string(i)));
+  }
+  ASSERT_OK(Flush());
+  // filling a range is not an access, scanning it again is
+  for (int i = 0; i < 3; i++) {
+    VerifyScan(ReadOptions(), Key(100), Key(199));
+  }
+  for (int i = 0; i < 2; i++) {
+    VerifyScan(ReadOptions(), Key(500), Key(549));
+  }
+  VerifyScan(ReadOptions(), Key(800), Key(849));
+  Close();
+  ASSERT_OK(env_->FileExists(RangeCacheHotRangesFileName(dbname_)));
+
+  options.range_cache = NewRBTreeLogicalOrderedRangeCache(size_t{1} << 24);
+  options.range_cache->setHotRangesPersistNum(4);
+  Reopen(options);
+  dbfull()->TEST_WaitForRangeCacheWarmup();
+  LogicalOrderedRangeCache* range_cache = options.range_cache.get();
+  for (int i = 100; i < 200; i++) {
+    std::string value;
+    ASSERT_TRUE(IsCached(range_cache, Key(i), &value));
+    ASSERT_EQ("value" + std::to_string(i), value);
+  }
+  for (int i = 500; i < 550; i++) {
+    ASSERT_TRUE(IsCached(range_cache, Key(i)));
+  }
+  // never accessed after being filled
+  ASSERT_FALSE(IsInLogicalRange(range_cache, Key(800)));
+  ASSERT_FALSE(IsInLogicalRange(range_cache, Key(300)));
+
+  // the warmed up ranges keep their hotness for the next close
+  std::vector<LogicalRange> hot_ranges = range_cache->getHotLogicalRanges(4);
+  ASSERT_EQ(2u, hot_ranges.size());
+  ASSERT_EQ(Key(100), hot_ranges[0].startUserKey().ToString());
+  ASSERT_EQ(Key(500), hot_ranges[1].startUserKey().ToString());
+}
+
+}  // namespace ROCKSDB_NAMESPACE
+
+int main(int argc, char** argv) {
+  ROCKSDB_NAMESPACE::port::InstallStackTraceHandler();
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
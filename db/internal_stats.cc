@@ -26,6 +26,7 @@
 #include "db/db_impl/db_impl.h"
 #include "db/write_stall_stats.h"
 #include "port/port.h"
+#include "rocksdb/lorc.h"
 #include "rocksdb/system_clock.h"
 #include "rocksdb/table.h"
 #include "table/block_based/cachable_entry.h"
@@ -321,6 +322,7 @@ static const std::string live_blob_file_garbage_size =
 static const std::string blob_cache_capacity = "blob-cache-capacity";
 static const std::string blob_cache_usage = "blob-cache-usage";
 static const std::string blob_cache_pinned_usage = "blob-cache-pinned-usage";
+static const std::string range_cache_prefix_stats = "range-cache-prefix-stats";
 
 const std::string DB::Properties::kNumFilesAtLevelPrefix =
     rocksdb_prefix + num_files_at_level_prefix;
@@ -439,6 +441,8 @@ const std::string DB::Properties::kBlobCacheUsage =
     rocksdb_prefix + blob_cache_usage;
 const std::string DB::Properties::kBlobCachePinnedUsage =
     rocksdb_prefix + blob_cache_pinned_usage;
+const std::string DB::Properties::kRangeCachePrefixStats =
+    rocksdb_prefix + range_cache_prefix_stats;
 
 const std::string InternalStats::kPeriodicCFStats =
     DB::Properties::kCFStats + ".periodic";
@@ -631,6 +635,9 @@ const UnorderedMap<std::string, DBPropertyInfo>
         {DB::Properties::kBlobCachePinnedUsage,
          {false, nullptr, &InternalStats::HandleBlobCachePinnedUsage, nullptr,
           nullptr}},
+        {DB::Properties::kRangeCachePrefixStats,
+         {true, &InternalStats::HandleRangeCachePrefixStats, nullptr,
+          &InternalStats::HandleRangeCachePrefixStatsMap, nullptr}},
 };
 
 InternalStats::InternalStats(int num_levels, SystemClock* clock,
@@ -965,6 +972,56 @@ bool InternalStats::HandleBlobCachePinnedUsage(uint64_t* value, DBImpl* /*db*/,
   return false;
 }
 
+bool InternalStats::HandleRangeCachePrefixStats(std::string* value,
+                                                Slice /*suffix*/) {
+  assert(value);
+  assert(cfd_);
+  auto range_cache = cfd_->GetRangeCache();
+  if (range_cache == nullptr || range_cache->getPrefixExtractor() == nullptr) {
+    return false;
+  }
+  std::ostringstream oss;
+  for (const auto& prefix_stats : range_cache->getPrefixStats()) {
+    const auto& stats = prefix_stats.second;
+    oss << "Prefix " << Slice(prefix_stats.first).ToString(true)
+        << ": bytes: " << stats.bytes << " soft quota: " << stats.soft_quota
+        << " hard quota: " << stats.hard_quota << " queries: " << stats.queries
+        << " full hits: " << stats.full_hits << " full hit rate: "
+        << (stats.queries == 0 ? 0.0
+                               : static_cast<double>(stats.full_hits) /
+                                     static_cast<double>(stats.queries))
+        << "\n";
+  }
+  *value = oss.str();
+  return true;
+}
+
+bool InternalStats::HandleRangeCachePrefixStatsMap(
+    std::map<std::string, std::string>* values, Slice /*suffix*/) {
+  assert(values);
+  assert(cfd_);
+  auto range_cache = cfd_->GetRangeCache();
+  if (range_cache == nullptr || range_cache->getPrefixExtractor() == nullptr) {
+    return false;
+  }
+  // keys: <hex prefix>.<stat>
+  for (const auto& prefix_stats : range_cache->getPrefixStats()) {
+    const std::string key_prefix =
+        Slice(prefix_stats.first).ToString(true) + ".";
+    const auto& stats = prefix_stats.second;
+    (*values)[key_prefix + "bytes"] = std::to_string(stats.bytes);
+    (*values)[key_prefix + "soft_quota"] = std::to_string(stats.soft_quota);
+    (*values)[key_prefix + "hard_quota"] = std::to_string(stats.hard_quota);
+    (*values)[key_prefix + "queries"] = std::to_string(stats.queries);
+    (*values)[key_prefix + "full_hits"] = std::to_string(stats.full_hits);
+    (*values)[key_prefix + "full_hit_rate"] = std::to_string(
+        stats.queries == 0 ? 0.0
+                           : static_cast<double>(stats.full_hits) /
+                                 static_cast<double>(stats.queries));
+  }
+  return true;
+}
+
 const DBPropertyInfo* GetPropertyInfo(const Slice& property) {
   std::string ppt_name = GetPropertyNameAndArg(property).first.ToString();
   auto ppt_info_iter = InternalStats::ppt_name_to_info.find(ppt_name);
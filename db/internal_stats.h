@@ -904,6 +904,9 @@ class InternalStats {
   bool HandleBlobCacheUsage(uint64_t* value, DBImpl* db, Version* version);
   bool HandleBlobCachePinnedUsage(uint64_t* value, DBImpl* db,
                                   Version* version);
+  bool HandleRangeCachePrefixStats(std::string* value, Slice suffix);
+  bool HandleRangeCachePrefixStatsMap(
+      std::map<std::string, std::string>* values, Slice suffix);
 
   // Total number of background errors encountered. Every time a flush task
   // or compaction task fails, this counter is incremented. The failure can
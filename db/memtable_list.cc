@@ -287,6 +287,14 @@ uint64_t MemTableListVersion::GetTotalNumDeletes() const {
   return total_num;
 }
 
+uint64_t MemTableListVersion::GetTotalNumRangeDeletions() const {
+  uint64_t total_num = 0;
+  for (auto& m : memlist_) {
+    total_num += m->NumRangeDeletion();
+  }
+  return total_num;
+}
+
 SequenceNumber MemTableListVersion::GetEarliestSequenceNumber(
     bool include_history) const {
   if (include_history && !memlist_history_.empty()) {
@@ -127,6 +127,8 @@ class MemTableListVersion {
 
   uint64_t GetTotalNumDeletes() const;
 
+  uint64_t GetTotalNumRangeDeletions() const;
+
   ReadOnlyMemTable::MemTableStats ApproximateStats(const Slice& start_ikey,
                                                    const Slice& end_ikey) const;
 
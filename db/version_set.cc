@@ -2394,6 +2394,55 @@ void Version::MultiGetBlob(
   }
 }
 
+void Version::MultiGetBlob(const ReadOptions& read_options,
+                           const std::vector<Slice>& user_keys,
+                           const std::vector<Slice>& blob_index_slices,
+                           std::vector<PinnableSlice>* values,
+                           std::vector<Status>* statuses) const {
+  assert(user_keys.size() == blob_index_slices.size());
+  assert(values && values->size() == user_keys.size());
+  assert(statuses && statuses->size() == user_keys.size());
+
+  // the requests of each blob file, sorted by offset by the blob source
+  std::map<uint64_t, autovector<BlobReadRequest>> blob_reqs_by_file;
+  for (size_t i = 0; i < user_keys.size(); i++) {
+    (*values)[i].Reset();
+    BlobIndex blob_index;
+    Status s = blob_index.DecodeFrom(blob_index_slices[i]);
+    if (!s.ok()) {
+      (*statuses)[i] = s;
+      continue;
+    }
+    if (blob_index.HasTTL() || blob_index.IsInlined()) {
+      (*statuses)[i] = Status::Corruption("Unexpected TTL/inlined blob index");
+      continue;
+    }
+    blob_reqs_by_file[blob_index.file_number()].emplace_back(
+        user_keys[i], blob_index.offset(), blob_index.size(),
+        blob_index.compression(), &(*values)[i], &(*statuses)[i]);
+  }
+
+  autovector<BlobFileReadRequests> blob_reqs;
+  for (auto& file_reqs : blob_reqs_by_file) {
+    const auto blob_file_meta =
+        storage_info_.GetBlobFileMetaData(file_reqs.first);
+    if (!blob_file_meta) {
+      for (auto& req : file_reqs.second) {
+        *req.status = Status::Corruption("Invalid blob file number");
+      }
+      continue;
+    }
+    blob_reqs.emplace_back(file_reqs.first, blob_file_meta->GetBlobFileSize(),
+                           file_reqs.second);
+  }
+
+  if (blob_reqs.size() > 0) {
+    assert(blob_source_);
+    blob_source_->MultiGetBlob(read_options, blob_reqs,
+                               /*bytes_read=*/nullptr);
+  }
+}
+
 void Version::Get(const ReadOptions& read_options, const LookupKey& k,
                   PinnableSlice* value, PinnableWideColumns* columns,
                   std::string* timestamp, Status* status,
@@ -956,6 +956,16 @@ class Version {
   void MultiGetBlob(const ReadOptions& read_options, MultiGetRange& range,
                     std::unordered_map<uint64_t, BlobReadContexts>& blob_ctxs);
 
+  // Retrieves the blobs of a batch of blob references (at most
+  // MultiGetContext::MAX_BATCH_SIZE per blob file), reading them in file and
+  // offset order. Sets (*values)[i] and (*statuses)[i] for the blob reference
+  // blob_index_slices[i] of user_keys[i].
+  void MultiGetBlob(const ReadOptions& read_options,
+                    const std::vector<Slice>& user_keys,
+                    const std::vector<Slice>& blob_index_slices,
+                    std::vector<PinnableSlice>* values,
+                    std::vector<Status>* statuses) const;
+
   // Loads some stats information from files (if update_stats is set) and
   // populates derived data structures. Call without mutex held. It needs to be
   // called before appending the version to the version set.
@@ -253,6 +253,14 @@ std::string IdentityFileName(const std::string& dbname) {
   return dbname + "/IDENTITY";
 }
 
+std::string RangeCacheHotRangesFileName(const std::string& dbname) {
+  return dbname + "/LORC-HOT-RANGES";
+}
+
+std::string TempRangeCacheHotRangesFileName(const std::string& dbname) {
+  return RangeCacheHotRangesFileName(dbname) + "." + kTempFileNameSuffix;
+}
+
 // Owned filenames have the form:
 //    dbname/IDENTITY
 //    dbname/CURRENT
@@ -144,6 +144,15 @@ std::string MetaDatabaseName(const std::string& dbname, uint64_t number);
 // either from a backup-image or empty
 std::string IdentityFileName(const std::string& dbname);
 
+// Return the name of the file persisting the boundaries of the hottest logical
+// ranges of the range caches (LORC), used to warm them up at DB::Open.
+// Format:  LORC-HOT-RANGES
+std::string RangeCacheHotRangesFileName(const std::string& dbname);
+
+// Return the temp file name used to atomically replace the file above.
+// Format:  LORC-HOT-RANGES.dbtmp
+std::string TempRangeCacheHotRangesFileName(const std::string& dbname);
+
 // If filename is a rocksdb file, store the type of the file in *type.
 // The number encoded in the filename is stored in *number.  If the
 // filename was successfully parsed, returns true.  Else return false.
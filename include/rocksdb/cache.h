@@ -85,6 +85,9 @@ enum class CacheEntryRole {
   // Blob cache's charge to account for its memory usage (when using a
   // separate block cache and blob cache)
   kBlobCache,
+  // Range cache (LORC)'s charge to account for its memory usage (when
+  // charging it to a shared block cache or blob cache)
+  kRangeCache,
   // Default bucket, for miscellaneous cache entries. Do not use for
   // entries that could potentially add up to large usage.
   kMisc,
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include "rocksdb/compression_type.h"
+#include "rocksdb/physical_range.h"
+#include "rocksdb/slice.h"
+
+namespace ROCKSDB_NAMESPACE {
+
+/**
+ * @brief CompressedPhysicalRange class represents a cold sorted key-value range in memory with compressed values.
+ * Internal keys are stored plainly (continuous) for binary search, values are compressed in blocks of about
+ * block_size bytes (a value never spans blocks) with an index of the blocks.
+ * update() decompresses, updates and compresses the whole range again, so the range cache rather decompresses a cold
+ * range back to a hot one before updating it (see RBTreeLogicalOrderedRangeCache).
+ */
+class CompressedPhysicalRange : public PhysicalRange {
+private:
+    struct ValueBlock {
+        size_t offset; // offset in blocks_buffer
+        size_t size; // size in blocks_buffer
+        size_t first_index; // index of the first entry in the block
+        size_t raw_offset; // offset of the first value in the uncompressed values
+        bool compressed; // false if stored plainly (not compressible)
+    };
+
+    // mutable for update(), which rebuilds the range
+    mutable uint64_t range_id; // unique id to identify the blocks in PhysicalRangeValueBuffer
+    CompressionType compression_type;
+    size_t block_size;
+
+    mutable std::string keys_buffer;
+    mutable std::vector<Slice> internal_key_slices;
+    mutable std::vector<Slice> user_key_slices;
+    mutable std::vector<size_t> value_offsets; // range_length + 1 offsets in the uncompressed values
+
+    mutable std::string blocks_buffer;
+    mutable std::vector<ValueBlock> blocks;
+
+    CompressedPhysicalRange(CompressionType compression_type_, size_t block_size_);
+
+    // Compress range, return nullptr if not supported, or if the values are not compressible and require_saving
+    static std::unique_ptr<CompressedPhysicalRange> build(const PhysicalRange& range, CompressionType compression_type,
+                                                          size_t block_size, bool require_saving);
+    size_t blockOf(size_t index) const;
+    bool uncompressBlock(size_t block, std::string* output) const;
+
+public:
+    ~CompressedPhysicalRange() override = default;
+
+    /**
+     * Build a compressed copy of the range with compression_type.
+     * Return nullptr if the compression type is not supported or the values are not compressible (saving < 1/8).
+     */
+    static std::unique_ptr<CompressedPhysicalRange> buildFromPhysicalRange(const PhysicalRange& range, CompressionType compression_type,
+                                                                           size_t block_size = 16 << 10);
+
+    /**
+     * Get all entries (e.g. to rebuild a hot range). values point into raw_values.
+     */
+    bool getEntries(std::vector<Slice>* internal_keys, std::vector<Slice>* values, std::string* raw_values) const;
+
+    CompressionType getCompressionType() const {
+        return compression_type;
+    }
+
+    Slice startUserKey() const override;
+    Slice endUserKey() const override;
+    Slice endInternalKey() const override;
+    Slice readInternalKeyAt(size_t index, PhysicalRangeKeyBuffer* buffer) const override {
+        return internalKeyAt(index);
+    }
+    // The keys are stored plainly, the results are valid until the range is updated
+    Slice startInternalKey() const;
+    Slice internalKeyAt(size_t index) const;
+    Slice userKeyAt(size_t index) const;
+    // The result may refer to a thread local buffer, valid until the next valueAt() of the thread, and is empty if the
+    // value can not be decompressed. Prefer readValueAt().
+    Slice valueAt(size_t index) const override;
+    Slice readValueAt(size_t index, PhysicalRangeValueBuffer* buffer) const override;
+    // O(n): the values are decompressed, and compressed again with the entry updated (or inserted)
+    PhysicalRangeUpdateResult update(const Slice& internal_key, const Slice& value) const override;
+    int find(const Slice& key) const override;
+    void reserve(size_t len) override;
+    std::string toString() const override;
+    bool isCompressed() const override {
+        return true;
+    }
+};
+
+}  // namespace ROCKSDB_NAMESPACE
@@ -12,55 +12,92 @@ namespace ROCKSDB_NAMESPACE {
 
 /**
  * @brief ContinuousPhysicalRange class represents a sorted key-value range in memory
- * with optimized continuous memory storage
+ * with optimized continuous memory storage.
+ * Entries are packed in chunks (like B+-tree leaves) of about kChunkTargetBytes: the internal keys of a chunk are
+ * contiguous in key order, and its values are contiguous in the value area with slack. An insertion only shifts the
+ * keys of one chunk (the value is appended to the slack), and the chunk is split when it exceeds kChunkMaxBytes.
+ * A value growing by an update is appended to the slack too, the old bytes are reclaimed when the chunk is compacted.
+ * Keys are delta encoded like the keys of a BlockBuilder block: each key stores only the suffix not shared with the
+ * previous key, and every about kRestartInterval keys a restart key is stored fully to start decoding from.
+ * The 8-byte trailers are not stored for the entries sharing the base sequence number and type of the range (all the
+ * entries of a range built from a referring range), only the entries changed by update() keep their own.
  */
 class ContinuousPhysicalRange : public PhysicalRange {
 private:
+    struct Chunk {
+        // delta encoded keys in key order, each one as
+        // varint32 shared bytes | varint32 (non-shared bytes << 1 | has trailer) | non-shared bytes of the user key
+        // | [varint64 zigzag sequence number delta to base_trailer | type]
+        // the trailer (sequence number and type) is stored only if it differs from base_trailer
+        std::string keys;
+        std::string values; // values, in the order of appending
+        std::vector<uint32_t> key_offsets; // size + 1 offsets in keys
+        std::vector<uint32_t> value_offsets; // offsets in values
+        std::vector<uint32_t> value_sizes;
+        std::vector<uint32_t> restarts; // indexes of the keys stored fully, restarts[0] == 0
+        size_t garbage_bytes = 0; // bytes of overwritten values in values
+        uint64_t base_trailer = 0; // packed sequence number and type of the range when built
+
+        size_t size() const {
+            return value_offsets.size();
+        }
+
+        Slice valueAt(size_t local_index) const {
+            return Slice(values.data() + value_offsets[local_index], value_sizes[local_index]);
+        }
+
+        // User key of the restart-th restart point
+        Slice restartUserKey(size_t restart) const;
+        // Decode the shared bytes and the non-shared bytes of a user key, and its trailer
+        void decodeEntry(size_t local_index, uint32_t* shared, Slice* non_shared, uint64_t* trailer) const;
+        bool isRestart(size_t local_index) const;
+        // Rebuild the internal key at local_index from its restart point
+        void keyAt(size_t local_index, std::string* key) const;
+
+        void append(const Slice& internal_key, const Slice& value, const Slice& prev_user_key);
+        // Insert the encoded key before local_index (the values are kept by the caller)
+        void insertEncodedKey(size_t local_index, const Slice& prev_user_key, const Slice& internal_key);
+        // Replace the encoded key at local_index, prev_user_key is empty for a restart point
+        void reencodeKey(size_t local_index, const Slice& prev_user_key, const Slice& internal_key);
+        // Add a restart point in the middle of a restart interval grown too long
+        void splitRestartInterval(size_t local_index);
+        // Rewrite the values in key order without garbage, keeping 1/8 slack
+        void compact();
+    };
+
     struct RangeData {
-        // Continuous storage for keys and values
-        std::unique_ptr<char[]> keys_buffer;
-        std::unique_ptr<char[]> values_buffer;
-        size_t keys_buffer_size;
-        size_t values_buffer_size;
-        
-        // Offset arrays to track position and size of each entry
-        std::vector<size_t> key_offsets;
-        std::vector<size_t> key_sizes;
-        std::vector<size_t> value_offsets;
-        std::vector<size_t> value_sizes;
-        std::vector<size_t> original_value_sizes; // Track original value sizes for overflow management
-        
-        // For values that exceed original size, store as separate strings
-        std::vector<std::unique_ptr<std::string>> overflow_values;
-        std::vector<bool> is_overflow; // Track which values are overflow
-        
-        // Slice vectors for fast access
-        std::vector<Slice> internal_key_slices;
-        std::vector<Slice> user_key_slices;
-        std::vector<Slice> value_slices;
+        std::vector<std::unique_ptr<Chunk>> chunks;
+        std::vector<size_t> chunk_first_index; // global index of the first entry of each chunk
+        std::string end_internal_key; // decoded last internal key
+        uint64_t base_trailer = 0; // packed sequence number and type most entries share (e.g. of the referring range)
     };
     std::shared_ptr<RangeData> data;
+    mutable uint64_t version; // unique among all ranges, renewed on every update (see PhysicalRangeKeyBuffer)
     mutable std::shared_mutex physical_range_mutex_;
 
+    // Bytes (keys and values) a chunk is filled to when built
+    static const size_t kChunkTargetBytes = 32 << 10;
+    // Bytes a chunk is split at
+    static const size_t kChunkMaxBytes = 2 * kChunkTargetBytes;
+    // Keys between two restart points when built, an interval is split when it grows to twice as long
+    static const size_t kRestartInterval = 16;
+
 private:
-    ContinuousPhysicalRange(std::shared_ptr<RangeData> data, size_t length);
-    
     // Helper functions for continuous storage management
-    void initializeFromReferringRange(const ReferringRange& refRange);
-    void initializeFromReferringRangeSubset(const ReferringRange& refRange, int start_pos, int end_pos);
-    void emplaceInternal(const Slice& internal_key, const Slice& value, size_t index);
-    void updateValueAt(size_t index, const Slice& new_value) const;
-    void rebuildSlices() const;
-    void rebuildSlicesAt(size_t index) const;
-    
+    void emplaceInternal(const Slice& internal_key, const Slice& value);
+    void finishBuilding();
+    // Locate the chunk of a global index
+    size_t chunkOf(size_t index) const;
+    void splitChunk(size_t chunk) const;
+
     // Internal functions without locking for internal use
-    const Slice& userKeyAtInternal(size_t index) const;
+    Slice readInternalKeyAtInternal(size_t index, PhysicalRangeKeyBuffer* buffer) const;
     int findInternal(const Slice& key) const;
 
 public:
     ContinuousPhysicalRange(bool valid = false);
     ~ContinuousPhysicalRange() override;
-    
+
     // Copy and move constructors/operators
     ContinuousPhysicalRange(const ContinuousPhysicalRange& other);
     ContinuousPhysicalRange(ContinuousPhysicalRange&& other) noexcept;
@@ -69,15 +106,15 @@ public:
 
     // Static factory functions
     static std::unique_ptr<ContinuousPhysicalRange> buildFromReferringRange(const ReferringRange& refRange);
+    // build from sorted internal keys (with their original sequence numbers and types) and values
+    static std::unique_ptr<ContinuousPhysicalRange> buildFromInternalEntries(const std::vector<Slice>& internal_keys, const std::vector<Slice>& values);
 
     // Override pure virtual functions from PhysicalRange
-    const Slice& startUserKey() const override;
-    const Slice& endUserKey() const override;
-    const Slice& startInternalKey() const override;
-    const Slice& endInternalKey() const override;
-    const Slice& internalKeyAt(size_t index) const override;
-    const Slice& userKeyAt(size_t index) const override;
-    const Slice& valueAt(size_t index) const override;
+    Slice startUserKey() const override;
+    Slice endUserKey() const override;
+    Slice endInternalKey() const override;
+    Slice valueAt(size_t index) const override;
+    Slice readInternalKeyAt(size_t index, PhysicalRangeKeyBuffer* buffer) const override;
     PhysicalRangeUpdateResult update(const Slice& internal_key, const Slice& value) const override;
     int find(const Slice& key) const override;
     void reserve(size_t len) override;
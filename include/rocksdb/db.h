@@ -11,6 +11,7 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include <functional>
 #include <map>
 #include <memory>
 #include <string>
@@ -126,6 +127,27 @@ struct GetMergeOperandsOptions {
   ContinueCallback continue_cb;
 };
 
+// Called by the callback variant of DB::Scan() for each key-value pair in
+// order. Returning false stops the scan.
+using ScanCallback = std::function<bool(const Slice& key, const Slice& value)>;
+
+// A range of DB::MultiScan(), terminated like DB::Scan() by len or end_key
+struct ScanRange {
+  ScanRange() = default;
+  ScanRange(const Slice& start_key_, const Slice& end_key_, size_t len_ = 0)
+      : start_key(start_key_), end_key(end_key_), len(len_) {}
+
+  Slice start_key;  // empty if start at first
+  Slice end_key;    // empty if not terminated by end key (scan to end)
+  size_t len = 0;   // max read len (0 if no limit)
+};
+
+// The keys and values read for a ScanRange
+struct ScanResult {
+  std::vector<std::string> keys;
+  std::vector<std::string> values;
+};
+
 // A collections of table properties objects, where
 //  key: is the table's file name.
 //  value: the table properties object of the given table.
@@ -823,6 +845,41 @@ class DB {
     return Scan(options, DefaultColumnFamily(), Slice(), Slice(), 0, keys, values);
   }
 
+  // Scan like above, but deliver each key-value pair in order to callback as
+  // soon as it is read instead of materializing the results, so that memory
+  // stays bounded. Ranges hit in the range cache are delivered as slices
+  // pinned in it. The slices are only valid during the call, and the callback
+  // must not call into the DB (it may run with the range cache locked).
+  // Return false from callback to stop the scan early.
+  virtual Status Scan(const ReadOptions& options,
+                      ColumnFamilyHandle* column_family,
+                      const Slice& start_key,  // empty if start at first
+                      const Slice& end_key,  // empty if not terminated by end key (scan to end)
+                      size_t len, // max read len (0 if no limit)
+                      const ScanCallback& /* callback */) {
+    return Status::NotSupported(
+        "Scan(with lorc) interface not supported in this DB implementation. (Only support db_impl)");
+  }
+
+  // Scan a batch of ranges (which may overlap) like Scan() with each, into
+  // results in the same order. The ranges share one snapshot, one read lock
+  // of the range cache and one set of iterators seeking forward from range
+  // to range, which makes a batch of short scans much cheaper than one Scan()
+  // per range. The gaps not in the range cache are put into it at the end.
+  virtual Status MultiScan(const ReadOptions& options,
+                           ColumnFamilyHandle* column_family,
+                           const std::vector<ScanRange>& ranges,
+                           std::vector<ScanResult>* results) {
+    return Status::NotSupported(
+        "MultiScan(with lorc) interface not supported in this DB implementation. (Only support db_impl)");
+  }
+
+  virtual Status MultiScan(const ReadOptions& options,
+                           const std::vector<ScanRange>& ranges,
+                           std::vector<ScanResult>* results) {
+    return MultiScan(options, DefaultColumnFamily(), ranges, results);
+  }
+
   //TODO(jr): more interfaces of Scan
 
   // Populates the `merge_operands` array with all the merge operands in the DB
@@ -1469,6 +1526,13 @@ class DB {
     // "rocksdb.blob-cache-pinned-usage" - returns the memory size for the
     //      entries being pinned in blob cache.
     static const std::string kBlobCachePinnedUsage;
+
+    // "rocksdb.range-cache-prefix-stats" - returns a multi-line string or map
+    //      with the cached bytes, the quotas and the full hit rate of scans of
+    //      each key prefix (tenant) of the range cache, if it has a prefix
+    //      extractor (see LogicalOrderedRangeCache::setPrefixExtractor). The
+    //      map keys are "<hex prefix>.<stat>".
+    static const std::string kRangeCachePrefixStats;
   };
 
   // DB implementations export properties about their state via this method.
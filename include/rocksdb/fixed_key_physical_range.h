@@ -0,0 +1,101 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <shared_mutex>
+#include "rocksdb/physical_range.h"
+#include "rocksdb/ref_range.h"
+#include "rocksdb/slice.h"
+
+namespace ROCKSDB_NAMESPACE {
+
+/**
+ * @brief FixedKeyPhysicalRange class represents a sorted key-value range in memory whose user keys are all KeyLen bytes
+ * (e.g. 16-byte UUIDs or 24-byte padded ids).
+ * Internal keys are stored as a flat array of KeyLen + 8 bytes entries without offsets, so positions are computed
+ * arithmetically and keys are compared by memcmp of a constant size. Entries are kept in chunks of at most
+ * kChunkMaxEntries (like VecPhysicalRange) so that an insertion only shifts the entries of one chunk.
+ * A key of another size can not be inserted (UNABLE_TO_INSERT), the cache rebuilds the range as a VecPhysicalRange then.
+ */
+template <size_t KeyLen>
+class FixedKeyPhysicalRange : public PhysicalRange {
+private:
+    static const size_t kEntrySize = KeyLen + internal_key_extra_bytes;
+    // Entries a chunk is filled to when built
+    static const size_t kChunkTargetEntries = 256;
+    // Entries a chunk is split at
+    static const size_t kChunkMaxEntries = 2 * kChunkTargetEntries;
+
+    struct Chunk {
+        std::string entries; // internal keys, kEntrySize bytes each
+        std::vector<std::string> values;
+
+        size_t size() const {
+            return values.size();
+        }
+
+        const char* entryAt(size_t local_index) const {
+            return entries.data() + local_index * kEntrySize;
+        }
+    };
+
+    struct RangeData {
+        std::vector<std::unique_ptr<Chunk>> chunks;
+        std::vector<size_t> chunk_first_index; // global index of the first entry of each chunk
+    };
+    std::shared_ptr<RangeData> data;
+    mutable std::shared_mutex physical_range_mutex_;
+
+private:
+    // Compare the user key of an entry with key
+    static int compareUserKey(const char* entry, const Slice& key);
+
+    // Helper functions for fixed key storage management
+    void emplaceInternal(const Slice& internal_key, const Slice& value);
+    // Locate the chunk of a global index
+    size_t chunkOf(size_t index) const;
+    void splitChunk(size_t chunk) const;
+    const char* entryAtInternal(size_t index) const;
+
+    // Internal functions without locking for internal use
+    int findInternal(const Slice& key) const;
+
+public:
+    FixedKeyPhysicalRange(bool valid = false);
+    ~FixedKeyPhysicalRange() override = default;
+
+    FixedKeyPhysicalRange(const FixedKeyPhysicalRange& other) = delete;
+    FixedKeyPhysicalRange& operator=(const FixedKeyPhysicalRange& other) = delete;
+
+    // Static factory functions, return nullptr if a user key is not KeyLen bytes
+    static std::unique_ptr<FixedKeyPhysicalRange> buildFromReferringRange(const ReferringRange& refRange);
+    // build from sorted internal keys (with their original sequence numbers and types) and values
+    static std::unique_ptr<FixedKeyPhysicalRange> buildFromInternalEntries(const std::vector<Slice>& internal_keys, const std::vector<Slice>& values);
+
+    // Override pure virtual functions from PhysicalRange
+    Slice startUserKey() const override;
+    Slice endUserKey() const override;
+    Slice endInternalKey() const override;
+    Slice valueAt(size_t index) const override;
+    Slice readInternalKeyAt(size_t index, PhysicalRangeKeyBuffer* buffer) const override {
+        return internalKeyAt(index);
+    }
+    // The keys are stored plainly, the results are valid until the range is updated
+    Slice startInternalKey() const;
+    Slice internalKeyAt(size_t index) const;
+    Slice userKeyAt(size_t index) const;
+    PhysicalRangeUpdateResult update(const Slice& internal_key, const Slice& value) const override;
+    int find(const Slice& key) const override;
+    void reserve(size_t len) override;
+    std::string toString() const override;
+};
+
+/**
+ * Build a FixedKeyPhysicalRange instantiated for the size of the user keys (8, 16, 24 or 32 bytes).
+ * Return nullptr if the user keys differ in size or the size is not supported.
+ */
+std::unique_ptr<PhysicalRange> buildFixedKeyPhysicalRangeFromReferringRange(const ReferringRange& refRange);
+std::unique_ptr<PhysicalRange> buildFixedKeyPhysicalRangeFromInternalEntries(const std::vector<Slice>& internal_keys, const std::vector<Slice>& values);
+
+}  // namespace ROCKSDB_NAMESPACE
@@ -4,6 +4,9 @@
 #include <vector>
 #include <memory>
 #include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <set>
 #include "rocksdb/slice.h"
 
 namespace ROCKSDB_NAMESPACE {
@@ -20,16 +23,20 @@ private:
     bool in_range_cache;
     bool left_included; // true if the start user key is included in the range, false if not
     bool right_included; // true if the end user key is included in the range, false if not
+    mutable uint64_t access_frequency; // number of scans hitting the range (hotness), bumped under read lock
+
+    friend class LogicalRangesView; // takes over the keys of merged ranges
 
 public:
-    LogicalRange(const std::string& startUserKey, const std::string& endUserKey, size_t length, bool inRangeCache, 
-                 bool leftIncluded, bool rightIncluded) {
-        start_user_key = startUserKey;
-        end_user_key = endUserKey;
+    LogicalRange(std::string startUserKey, std::string endUserKey, size_t length, bool inRangeCache, 
+                 bool leftIncluded, bool rightIncluded, uint64_t accessFrequency = 0) {
+        start_user_key = std::move(startUserKey);
+        end_user_key = std::move(endUserKey);
         range_length = length;
         in_range_cache = inRangeCache;
         left_included = leftIncluded;
         right_included = rightIncluded;
+        access_frequency = accessFrequency;
     }
 
     Slice startUserKey() const {
@@ -61,6 +68,23 @@ public:
         return right_included;
     }
 
+    uint64_t accessFrequency() const {
+        // use atomic read
+        auto* atomic_freq = reinterpret_cast<const std::atomic<uint64_t>*>(&access_frequency);
+        return atomic_freq->load(std::memory_order_relaxed);
+    }
+
+    // Called by scans holding only the read lock of the cache, so the counter is bumped atomically
+    void recordAccess() const {
+        auto* atomic_freq = reinterpret_cast<std::atomic<uint64_t>*>(&access_frequency);
+        atomic_freq->fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // only called with write lock held
+    void setAccessFrequency(uint64_t accessFrequency) {
+        access_frequency = accessFrequency;
+    }
+
     std::string toString() const {
         std::string endUserKeyStr = end_user_key.empty() ? "(undetermined)" : end_user_key;
         std::string str = (left_included ? "[ " : "( ") + start_user_key + " -> " + endUserKeyStr + (right_included ? " ]" : " )")
@@ -70,85 +94,130 @@ public:
 };
 
 /**
- * @brief LogicalRangesView class manages an ordered array of logical ranges.
+ * @brief LogicalRangesView class manages an ordered set of non-overlapping logical ranges.
+ * Ranges are ordered by start user key (and so by end user key), lookups by a key are O(log n) without copying.
  */
 class LogicalRangesView {
 private:
-    std::vector<LogicalRange> logical_ranges;
+    // Ordered by start user key, with heterogeneous lookup by Slice
+    struct LogicalRangeComparator {
+        using is_transparent = void;
+
+        bool operator()(const LogicalRange& lhs, const LogicalRange& rhs) const {
+            return lhs.startUserKey() < rhs.startUserKey();
+        }
+
+        bool operator()(const LogicalRange& lhs, const Slice& rhs) const {
+            return lhs.startUserKey() < rhs;
+        }
+
+        bool operator()(const Slice& lhs, const LogicalRange& rhs) const {
+            return lhs < rhs.startUserKey();
+        }
+    };
+
+public:
+    using LogicalRangeSet = std::set<LogicalRange, LogicalRangeComparator>;
+    using const_iterator = LogicalRangeSet::const_iterator;
+
+private:
+    LogicalRangeSet logical_ranges;
+
+    // Only the fields out of the order (length, access frequency) are changed through it
+    static LogicalRange& mutableRange(const_iterator it) {
+        return const_cast<LogicalRange&>(*it);
+    }
 
 public:
     LogicalRangesView() = default;
 
-    void putLogicalRange(const LogicalRange range, bool left_concat, bool right_concat) {
-        auto it = std::lower_bound(logical_ranges.begin(), logical_ranges.end(), range,
-                                  [](const LogicalRange& a, const LogicalRange& b) {
-                                      return a.startUserKey() < b.startUserKey();
-                                  });
-        
-        size_t insert_pos = it - logical_ranges.begin();
-        
-        LogicalRange merged_range = range;
-        size_t left_remove_start = insert_pos;
-        
-        if (left_concat && insert_pos > 0) {
-            const auto& left_range = logical_ranges[insert_pos - 1];
-            
-            if (left_range.startUserKey() <= merged_range.startUserKey()) {
-                merged_range = LogicalRange(
-                    left_range.startUserKey().ToString(),
-                    merged_range.endUserKey().ToString(),
-                    left_range.length() + merged_range.length(),
-                    true,
-                    true,
-                    true
-                );
-                left_remove_start = insert_pos - 1;
-            }
+    void putLogicalRange(LogicalRange range, bool left_concat, bool right_concat) {
+        auto it = logical_ranges.lower_bound(range.startUserKey());
+        bool merged = false;
+
+        if (left_concat && it != logical_ranges.begin()) {
+            // take over the start key of the left range
+            auto left_node = logical_ranges.extract(std::prev(it));
+            LogicalRange& left_range = left_node.value();
+            assert(left_range.startUserKey() <= range.startUserKey());
+            range.start_user_key = std::move(left_range.start_user_key);
+            range.range_length += left_range.length();
+            range.access_frequency = left_range.accessFrequency() + range.accessFrequency();
+            merged = true;
         }
-        
-        size_t right_remove_end = insert_pos;
-        
-        if (right_concat && insert_pos < logical_ranges.size()) {
-            const auto& right_range = logical_ranges[insert_pos];
-            if (merged_range.startUserKey() <= right_range.startUserKey()) {
-                merged_range = LogicalRange(
-                    merged_range.startUserKey().ToString(),
-                    right_range.endUserKey().ToString(),
-                    merged_range.length() + right_range.length(),
-                    true,
-                    true,
-                    true
-                );
-                right_remove_end = insert_pos + 1;
-            }
+
+        if (right_concat && it != logical_ranges.end()) {
+            // take over the end key of the right range
+            auto right_node = logical_ranges.extract(it++);
+            LogicalRange& right_range = right_node.value();
+            assert(range.startUserKey() <= right_range.startUserKey());
+            range.end_user_key = std::move(right_range.end_user_key);
+            range.range_length += right_range.length();
+            range.access_frequency = range.accessFrequency() + right_range.accessFrequency();
+            merged = true;
         }
-        
-        if (left_remove_start < right_remove_end) {
-            logical_ranges.erase(logical_ranges.begin() + left_remove_start,
-                               logical_ranges.begin() + right_remove_end);
-            insert_pos = left_remove_start;
+
+        if (merged) {
+            range.in_range_cache = true;
+            range.left_included = true;
+            range.right_included = true;
         }
-        
-        logical_ranges.insert(logical_ranges.begin() + insert_pos, merged_range);
 
-        if (insert_pos > 0 && logical_ranges[insert_pos - 1].endUserKey() >= merged_range.startUserKey()) {
+        it = logical_ranges.insert(it, std::move(range));
+
+        if (it != logical_ranges.begin() && std::prev(it)->endUserKey() >= it->startUserKey()) {
             assert(false);
         }
     }
 
     void removeRange(const Slice& startUserKey) {
-        logical_ranges.erase(
-            std::remove_if(logical_ranges.begin(), logical_ranges.end(),
-                           [&startUserKey](const LogicalRange& range) {
-                               return range.startUserKey() == startUserKey;
-                           }),
-            logical_ranges.end());
+        auto it = logical_ranges.find(startUserKey);
+        if (it != logical_ranges.end()) {
+            logical_ranges.erase(it);
+        }
     }
 
-    const std::vector<LogicalRange>& getLogicalRanges() const {
+    const LogicalRangeSet& getLogicalRanges() const {
         return logical_ranges;
     }
 
+    /**
+     * Find the first range whose end user key >= user_key, i.e. the range containing user_key if any.
+     */
+    const_iterator findRange(const Slice& user_key) const {
+        auto it = logical_ranges.upper_bound(user_key);
+        if (it != logical_ranges.begin() && std::prev(it)->endUserKey() >= user_key) {
+            --it;
+        }
+        return it;
+    }
+
+    // only used when updating entries of range cache triggers an insertion in its physical range
+    void setRangeLength(const_iterator it, size_t length) {
+        mutableRange(it).setLength(length);
+    }
+
+    /**
+     * Raise the access frequency of the ranges overlapping [startUserKey, endUserKey] to at least accessFrequency.
+     * Used to restore the hotness of warmed up ranges.
+     */
+    void seedAccessFrequency(const Slice& startUserKey, const Slice& endUserKey, uint64_t accessFrequency) {
+        for (auto it = findRange(startUserKey); it != logical_ranges.end() && it->startUserKey() <= endUserKey; ++it) {
+            if (it->accessFrequency() < accessFrequency) {
+                mutableRange(it).setAccessFrequency(accessFrequency);
+            }
+        }
+    }
+
+    /**
+     * Halve the access frequency of all ranges, so that hotness reflects recent accesses.
+     */
+    void decayAccessFrequency() {
+        for (auto it = logical_ranges.begin(); it != logical_ranges.end(); ++it) {
+            mutableRange(it).setAccessFrequency(it->accessFrequency() / 2);
+        }
+    }
+
     size_t size() const {
         return logical_ranges.size();
     }
@@ -1,12 +1,17 @@
 #pragma once
 
+#include <algorithm>
 #include <iostream>
+#include <deque>
+#include <map>
 #include <unordered_map>
 #include <vector>
 #include <string>
 #include <memory>
+#include <mutex>
 #include <chrono>
 #include <atomic>
+#include "rocksdb/compression_type.h"
 #include "rocksdb/logical_range.h"
 #include "rocksdb/physical_range.h"
 #include "rocksdb/ref_range.h"
@@ -125,6 +130,12 @@ private:
 class LogicalOrderedRangeCacheIterator;
 
 class Arena;
+class Cache;
+class CacheReservationManager;
+class LorcBudget;
+class LorcMemoryTuner;
+class LorcSecondaryTier;
+class SliceTransform;
 
 class LogicalOrderedRangeCache {
 public:
@@ -147,8 +158,9 @@ public:
     /**
      * Remove or truncate entries to maintain cache size within limits.
      * Called internally
+     * Return false if nothing can be evicted
      */
-    virtual void victim() = 0;
+    virtual bool victim() = 0;
 
     /**
      * Remove or truncate entries to maintain cache size within limits.
@@ -164,6 +176,255 @@ public:
         return capacity;
     }
 
+    /**
+     * Change the capacity. Shrinking takes effect at the next victim.
+     */
+    virtual void setCapacity(size_t capacity_) {
+        lockWrite();
+        this->capacity = capacity_;
+        unlockWrite();
+        refreshEffectiveCapacity();
+    }
+
+    /**
+     * The capacity the cache size is actually limited to (by victim).
+     * Equal to capacity unless the cache is charged to a shared cache, in which case the shared cache is the budget:
+     * the cache grows beyond capacity into the free part of the shared cache (the other users are cold), and shrinks
+     * below it when the other users pin most of the shared cache.
+     * Cheap, the value is computed by refreshEffectiveCapacity().
+     */
+    virtual size_t getEffectiveCapacity() const {
+        size_t result = capacity;
+        if (cache_res_mgr) {
+            // use atomic read
+            auto* atomic_capacity = reinterpret_cast<const std::atomic<size_t>*>(&effective_capacity);
+            result = atomic_capacity->load(std::memory_order_relaxed);
+        }
+        if (budget_tenant) {
+            // the share of the budget replaces the capacity
+            auto* atomic_budget_capacity = reinterpret_cast<const std::atomic<size_t>*>(&budget_capacity);
+            size_t share = atomic_budget_capacity->load(std::memory_order_relaxed);
+            result = cache_res_mgr ? std::min(result, share) : share;
+        }
+        return result;
+    }
+
+    /**
+     * Re-compute the effective capacity from the usage of the charged cache.
+     * Expensive (visits all shards of the charged cache), called periodically by the DB (range cache maintenance)
+     * and at most once per second by tryVictim().
+     */
+    void refreshEffectiveCapacity();
+
+    /**
+     * Charge the memory usage of the range cache to a shared cache (e.g. block cache or blob cache)
+     * with CacheEntryRole::kRangeCache, so that the range cache competes for memory with other users of it.
+     * nullptr to stop charging.
+     */
+    void setChargedCache(std::shared_ptr<Cache> charged_cache_);
+
+    std::shared_ptr<Cache> getChargedCache() const {
+        return charged_cache;
+    }
+
+    /**
+     * Make the range cache a template of per column family range caches sharing budget (see LorcBudget): each column
+     * family with it in the options gets its own range cache (newTenant()) with the settings of this one, except the
+     * memory tuner and the secondary tier, and the capacity of this one as the default maximum share.
+     * The template itself caches nothing. Set before opening the DB.
+     */
+    void setBudget(std::shared_ptr<LorcBudget> budget_) {
+        this->budget = budget_;
+    }
+
+    std::shared_ptr<LorcBudget> getBudget() const {
+        return budget;
+    }
+
+    /**
+     * Whether the range cache is the range cache of a column family created by newTenant() of a template.
+     */
+    bool isBudgetTenant() const {
+        return budget_tenant;
+    }
+
+    /**
+     * Create the range cache of column family cf_name under the budget of this template.
+     * Return nullptr if the cache has no budget or does not support it.
+     */
+    virtual std::shared_ptr<LogicalOrderedRangeCache> newTenant(const std::string& cf_name) const {
+        return nullptr;
+    }
+
+    /**
+     * Sum of the access frequency of all logical ranges (the hotness of the whole cache).
+     */
+    uint64_t getTotalAccessFrequency() const;
+
+    /**
+     * Ghost ranges remember the boundaries of recently evicted logical ranges (up to ghost_ratio * capacity bytes).
+     * Gap ranges refilled over a ghost range count as ghost hits, i.e. the hits the cache would get with more capacity.
+     * 0 (default) disables the tracking.
+     */
+    void setGhostRatio(double ghost_ratio_);
+
+    double getGhostRatio() const {
+        return ghost_ratio;
+    }
+
+    size_t getGhostCapacity() const {
+        return static_cast<size_t>(static_cast<double>(capacity) * ghost_ratio);
+    }
+
+    /**
+     * Total bytes refilled over ghost ranges since the cache was created.
+     */
+    uint64_t getGhostHitBytes() const {
+        // use atomic read
+        auto* atomic_bytes = reinterpret_cast<const std::atomic<uint64_t>*>(&ghost_hit_bytes);
+        return atomic_bytes->load(std::memory_order_relaxed);
+    }
+
+    /**
+     * The tuner to run at each range cache maintenance of the DB (see LorcMemoryTuner).
+     */
+    void setMemoryTuner(std::shared_ptr<LorcMemoryTuner> memory_tuner_) {
+        this->memory_tuner = memory_tuner_;
+    }
+
+    std::shared_ptr<LorcMemoryTuner> getMemoryTuner() const {
+        return memory_tuner;
+    }
+
+    /**
+     * Skip inserting values into the blob cache when scanning gap ranges, since they are cached by the range cache
+     * right after the scan. Avoids holding the same values twice when both caches are enabled.
+     */
+    bool skipBlobCacheFill() const {
+        return skip_blob_cache_fill;
+    }
+
+    void setSkipBlobCacheFill(bool skip_blob_cache_fill_) {
+        this->skip_blob_cache_fill = skip_blob_cache_fill_;
+    }
+
+    /**
+     * Share the values of at least min_value_size bytes read from blob files by gap scans with the blob cache: the
+     * ranges (VEC physical ranges) hold references to the blob cache entries instead of copies, so the values are
+     * charged once, to the blob cache, and only the references to the range cache.
+     * A value is copied as usual if the entries pinned by the range cache would exceed max_pinned_ratio of the
+     * capacity of the blob cache, or the pinned entries its capacity.
+     * Sharing takes precedence over skipBlobCacheFill(). 0 (default) to disable.
+     */
+    size_t getBlobCacheValueSharing() const {
+        return blob_cache_value_sharing;
+    }
+
+    double getBlobCacheMaxPinnedRatio() const {
+        return blob_cache_max_pinned_ratio;
+    }
+
+    void setBlobCacheValueSharing(size_t min_value_size, double max_pinned_ratio = 0.5) {
+        this->blob_cache_value_sharing = min_value_size;
+        this->blob_cache_max_pinned_ratio = max_pinned_ratio;
+    }
+
+    /**
+     * Counters of the blob cache entries pinned by the values shared with the blob cache. Held by the shared values,
+     * which may outlive the range cache (e.g. queued in the secondary tier).
+     */
+    struct BlobCachePins {
+        std::atomic<uint64_t> pinned_values{0}; // entries pinned now
+        std::atomic<uint64_t> pinned_bytes{0}; // charge of them to the blob cache
+        std::atomic<uint64_t> shared_values{0}; // values shared instead of copied so far
+        std::atomic<uint64_t> refused_values{0}; // values copied so far as the pinned entries were at the limit
+    };
+
+    std::shared_ptr<BlobCachePins> getBlobCachePins() const {
+        return blob_cache_pins;
+    }
+
+    struct BlobCacheSharingStats {
+        uint64_t pinned_values = 0;
+        uint64_t pinned_bytes = 0;
+        uint64_t shared_values = 0;
+        uint64_t refused_values = 0;
+    };
+
+    BlobCacheSharingStats getBlobCacheSharingStats() const;
+
+    /**
+     * The tier on local flash that evicted logical ranges are spilled to, and promoted back from on a scan.
+     * nullptr (default) to drop evicted ranges.
+     */
+    void setSecondaryTier(std::shared_ptr<LorcSecondaryTier> secondary_tier_) {
+        lockWrite();
+        this->secondary_tier = secondary_tier_;
+        unlockWrite();
+    }
+
+    std::shared_ptr<LorcSecondaryTier> getSecondaryTier() const {
+        return secondary_tier;
+    }
+
+    /**
+     * Load the spilled ranges overlapping [start_key, end_key] (user keys, empty end_key for no upper bound)
+     * from the secondary tier back to the range cache. Called before a scan.
+     * Return true if any range is promoted.
+     */
+    virtual bool promoteSpilledRanges(const Slice& start_key, const Slice& end_key) {
+        return false;
+    }
+
+    /**
+     * Compress the values of cold logical ranges (access frequency, halved every range cache maintenance of the DB,
+     * at most cold_access_frequency) with compression_type in the background, and decompress them when they are hot again.
+     * kNoCompression (default) disables it.
+     */
+    void setColdRangeCompression(CompressionType compression_type_, uint64_t cold_access_frequency_ = 0) {
+        lockWrite();
+        this->cold_range_compression = compression_type_;
+        this->cold_access_frequency = cold_access_frequency_;
+        unlockWrite();
+    }
+
+    CompressionType getColdRangeCompression() const {
+        return cold_range_compression;
+    }
+
+    /**
+     * Compress the physical ranges of cold logical ranges and decompress the ones of hot logical ranges,
+     * at most max_bytes (uncompressed) per call, continuing from where the last call stopped.
+     * Called periodically by the DB. Return the number of physical ranges (de)compressed.
+     */
+    virtual size_t compressColdRanges(size_t max_bytes) {
+        return 0;
+    }
+
+    /**
+     * Merge the physical ranges of logical ranges made of at least min_physical_ranges physical ranges (e.g. filled
+     * gap by gap) into one in the background, so that scanning them does not step across ranges.
+     * 0 (default) disables it.
+     */
+    void setDefragmentation(size_t min_physical_ranges_) {
+        lockWrite();
+        this->defragment_min_physical_ranges = min_physical_ranges_;
+        unlockWrite();
+    }
+
+    size_t getDefragmentation() const {
+        return defragment_min_physical_ranges;
+    }
+
+    /**
+     * Merge the adjacent physical ranges of fragmented logical ranges, at most max_bytes per call (at least two
+     * physical ranges), continuing from where the last call stopped. Deletion entries are purged from the merged range.
+     * Called periodically by the DB. Return the number of physical ranges merged away.
+     */
+    virtual size_t defragmentRanges(size_t max_bytes) {
+        return 0;
+    }
+
     virtual size_t getCurrentSize() const {
         return current_size;
     }
@@ -224,9 +485,28 @@ public:
 
     /**
      * Get from range cache.
-     * Return false if not found.
+     * Return false if not found, or if the value can not be read (a corrupted compressed range, read from the LSM).
+     * is_blob_index (if not null) is set to whether the value is a blob index (BLOB_INDEX range cache).
+     */
+    virtual bool Get(const Slice& internal_key, std::string* value, Status* s, bool* is_blob_index = nullptr) const = 0;
+
+    /**
+     * Look up the cached entry of user_key, called with lock held (e.g. by flush, to merge operands into it).
+     * Return false if user_key is not in any logical range, or if its value can not be read (a corrupted compressed
+     * range, dropped later). Otherwise found is set to whether the entry is cached, and if so internal_key (with the
+     * sequence number and type of the entry) and value are set.
      */
-    virtual bool Get(const Slice& internal_key, std::string* value, Status* s) const = 0;
+    virtual bool lookupEntry(const Slice& user_key, std::string* internal_key, std::string* value, bool* found) const {
+        return false;
+    }
+
+    /**
+     * Drop the logical range containing user_key (and the spilled ranges containing it), e.g. when an update of it
+     * can not be applied in the cache. Called with write lock held. Return false if user_key is not in any logical range.
+     */
+    virtual bool invalidateLogicalRange(const Slice& user_key) {
+        return false;
+    }
 
     virtual void printAllRangesWithKeys() const = 0;
 
@@ -251,8 +531,129 @@ public:
         return physical_range_type;
     }
 
+    /**
+     * Get at most max_num logical ranges in the descending order of access frequency (hotness).
+     * Only boundaries and frequencies are meaningful, which are used to warm up the cache after reopening.
+     */
+    std::vector<LogicalRange> getHotLogicalRanges(size_t max_num) const;
+
+    /**
+     * Halve the access frequency of all logical ranges (aging for hotness).
+     */
+    void decayAccessFrequency();
+
+    /**
+     * Raise the access frequency of the logical ranges overlapping [start_user_key, end_user_key] to at least
+     * access_frequency, e.g. the persisted hotness of a range warmed up after reopening.
+     */
+    void seedAccessFrequency(const Slice& start_user_key, const Slice& end_user_key, uint64_t access_frequency);
+
+    /**
+     * Number of hottest logical range boundaries to persist periodically for warming up at DB::Open.
+     * 0 (default) disables the persistence and the warm-up.
+     */
+    size_t getHotRangesPersistNum() const {
+        return hot_ranges_persist_num;
+    }
+
+    void setHotRangesPersistNum(size_t hot_ranges_persist_num_) {
+        this->hot_ranges_persist_num = hot_ranges_persist_num_;
+    }
+
+    /**
+     * Detect paginated scans (streams of scans terminated by len, each starting at or after the last key of the
+     * previous one with no cached logical range in between) and prefetch the next pages of a stream into the range
+     * cache in the background. The prefetched length starts at one page and doubles while the pages hit the
+     * prefetched ranges, each prefetch reads at most max_bytes. 0 (default) disables it.
+     */
+    void setScanPrefetch(size_t max_bytes_) {
+        std::lock_guard<std::mutex> lock(scan_stream_mutex);
+        this->scan_prefetch_max_bytes = max_bytes_;
+        if (max_bytes_ == 0) {
+            scan_streams.clear();
+        }
+    }
+
+    size_t getScanPrefetch() const {
+        return scan_prefetch_max_bytes;
+    }
+
+    /**
+     * Track the cached bytes and the scans per key prefix (tenant), extracted by prefix_extractor, and enforce quotas
+     * on the bytes of the prefixes. A physical range counts for the prefix of its start user key.
+     * A prefix above its soft quota has its ranges evicted first, and a prefix never stays above its hard quota:
+     * its gap ranges are not cached once it holds the hard quota, and its own ranges are evicted when it grows beyond
+     * it. The quotas apply to every prefix unless set per prefix by setPrefixQuota(), 0 for no quota.
+     * Keys out of the domain of the extractor have no quota. nullptr (default) to disable.
+     */
+    void setPrefixExtractor(std::shared_ptr<const SliceTransform> prefix_extractor_, size_t soft_quota = 0, size_t hard_quota = 0);
+
+    std::shared_ptr<const SliceTransform> getPrefixExtractor() const {
+        return prefix_extractor;
+    }
+
+    void setPrefixQuota(const std::string& prefix, size_t soft_quota, size_t hard_quota);
+
+    /**
+     * Bytes of the physical ranges starting with prefix. Called with lock held.
+     */
+    virtual size_t getPrefixBytes(const Slice& prefix) const {
+        return 0;
+    }
+
+    /**
+     * Whether a gap range starting at start_user_key may be cached, false if its prefix holds its hard quota.
+     * Called with read lock held.
+     */
+    bool admitPrefix(const Slice& start_user_key) const;
+
+    /**
+     * Record a scan from start_user_key for the stats of its prefix, full_hit if all of it is in the range cache.
+     * Called with read lock held.
+     */
+    void recordPrefixScan(const Slice& start_user_key, bool full_hit);
+
+    struct PrefixStats {
+        size_t bytes = 0;
+        size_t soft_quota = 0;
+        size_t hard_quota = 0;
+        uint64_t queries = 0;
+        uint64_t full_hits = 0;
+    };
+
+    /**
+     * Stats of the prefixes cached, scanned or with quotas set.
+     */
+    std::map<std::string, PrefixStats> getPrefixStats() const;
+
+    /**
+     * Record a scan of len entries (a page) from start_key to last_key, full_hit if read from the range cache only.
+     * Return the number of entries to prefetch from last_key (0 for none). Called with read lock held.
+     */
+    size_t recordScanPage(const Slice& start_key, const Slice& last_key, size_t len, bool full_hit);
+
+    /**
+     * Prefetches issued, pages read from prefetched ranges only, and prefetched ranges never read (the stream
+     * stopped or was displaced).
+     */
+    uint64_t getScanPrefetchIssued() const {
+        std::lock_guard<std::mutex> lock(scan_stream_mutex);
+        return scan_prefetch_issued;
+    }
+
+    uint64_t getScanPrefetchHits() const {
+        std::lock_guard<std::mutex> lock(scan_stream_mutex);
+        return scan_prefetch_hits;
+    }
+
+    uint64_t getScanPrefetchWasted() const {
+        std::lock_guard<std::mutex> lock(scan_stream_mutex);
+        return scan_prefetch_wasted;
+    }
+
 protected:
     friend class LogicalOrderedRangeCacheIterator;
+    friend class LorcBudget;
 
     size_t capacity;
     mutable LorcLogger logger;
@@ -267,6 +668,107 @@ protected:
     bool enable_statistic; // initialize to false
     CacheStatistic cache_statistic;
 
+    size_t hot_ranges_persist_num; // initialize to 0 (disabled)
+
+    /**
+     * Update the reservation in the charged cache to current_size. Called with write lock held after size changes.
+     */
+    void updateCacheReservation();
+
+    /**
+     * refreshEffectiveCapacity() if it has not been done in the last second.
+     */
+    void maybeRefreshEffectiveCapacity();
+
+    /**
+     * Copy the settings of a template to its tenant (see setBudget).
+     */
+    void copySettingsTo(LogicalOrderedRangeCache* tenant) const;
+
+    std::shared_ptr<LorcBudget> budget; // nullptr if not sharing a budget
+    bool budget_tenant; // initialize to false (template or standalone)
+    size_t budget_capacity; // share of the budget, only meaningful for tenants
+
+    std::shared_ptr<Cache> charged_cache; // nullptr if not charged
+    std::shared_ptr<CacheReservationManager> cache_res_mgr;
+    size_t effective_capacity; // only meaningful when charged
+    uint64_t effective_capacity_refresh_micros; // steady clock time of the last refresh
+
+    /**
+     * Remember an evicted logical range. Called with write lock held.
+     */
+    void putGhostRange(const Slice& start_user_key, const Slice& end_user_key, size_t byte_size);
+
+    /**
+     * Count a ghost hit if the filled gap range overlaps ghost ranges, which are then dropped. Called with write lock held.
+     */
+    void checkGhostRange(const Slice& start_user_key, const Slice& end_user_key, size_t byte_size);
+
+    struct GhostRange {
+        std::string end_user_key;
+        size_t byte_size;
+        uint64_t generation; // to tell whether a fifo entry still refers to this ghost range
+    };
+
+    double ghost_ratio; // initialize to 0 (disabled)
+    std::map<std::string, GhostRange> ghost_ranges; // start user key -> ghost range
+    std::deque<std::pair<std::string, uint64_t>> ghost_ranges_fifo; // (start user key, generation) in eviction order
+    size_t ghost_size; // total byte size of ghost_ranges
+    uint64_t ghost_hit_bytes;
+    uint64_t ghost_generation;
+
+    std::shared_ptr<LorcMemoryTuner> memory_tuner;
+    bool skip_blob_cache_fill; // initialize to false
+    size_t blob_cache_value_sharing; // initialize to 0 (disabled)
+    double blob_cache_max_pinned_ratio; // initialize to 0.5
+    std::shared_ptr<BlobCachePins> blob_cache_pins;
+
+    std::shared_ptr<LorcSecondaryTier> secondary_tier; // nullptr if evicted ranges are dropped
+
+    CompressionType cold_range_compression; // initialize to kNoCompression (disabled)
+    uint64_t cold_access_frequency;
+    std::string cold_range_compression_cursor; // start user key of the logical range compressColdRanges() continues from
+
+    size_t defragment_min_physical_ranges; // initialize to 0 (disabled)
+    std::string defragment_cursor; // start user key of the logical range defragmentRanges() continues from
+
+    // A stream of paginated scans (see setScanPrefetch)
+    struct ScanStream {
+        std::string last_key; // last key of the last page
+        size_t prefetch_len; // entries of the last prefetch
+        size_t prefetched_pages; // pages prefetched but not read yet
+        bool prefetch_hit; // whether a page hit the prefetched ranges since the last prefetch
+        uint64_t last_use; // for replacing the least recently used stream
+    };
+
+    size_t scan_prefetch_max_bytes; // initialize to 0 (disabled)
+    mutable std::mutex scan_stream_mutex; // guards the fields below
+    std::vector<ScanStream> scan_streams;
+    uint64_t scan_stream_clock;
+    uint64_t scan_prefetch_issued;
+    uint64_t scan_prefetch_hits;
+    uint64_t scan_prefetch_wasted;
+
+    /**
+     * The soft and hard quota of prefix. Called with lock held.
+     */
+    void getPrefixQuota(const std::string& prefix, size_t* soft_quota, size_t* hard_quota) const;
+
+    std::shared_ptr<const SliceTransform> prefix_extractor; // nullptr if prefixes are not tracked
+    size_t prefix_soft_quota; // default quotas
+    size_t prefix_hard_quota;
+    std::unordered_map<std::string, std::pair<size_t, size_t>> prefix_quotas; // prefix -> (soft quota, hard quota)
+    bool prefix_quotas_changed; // the prefixes over their quotas are looked for again by tryVictim()
+
+    // Scans of a prefix
+    struct PrefixCounter {
+        uint64_t queries = 0;
+        uint64_t full_hits = 0;
+    };
+
+    mutable std::mutex prefix_counter_mutex; // guards prefix_counters
+    std::unordered_map<std::string, PrefixCounter> prefix_counters;
+
 private:
     int full_hit_count;
     int full_query_count;
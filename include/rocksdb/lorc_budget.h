@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "rocksdb/lorc.h"
+
+namespace ROCKSDB_NAMESPACE {
+
+/**
+ * @brief LorcBudget is one global capacity shared by the range caches of many column families (tenants).
+ * Each column family keeps its own range cache (its own key space, locks and sequence number), created by
+ * newTenant() of the range cache set in the options, and the budget sets their effective capacities:
+ * every tenant keeps at least its minimum share and at most its maximum share, and the rest of the budget goes
+ * to the hottest tenants (access frequency of their logical ranges per byte cached). When the tenants hold more
+ * than the budget, the coldest tenants are shrunk first, each evicting by its own victim policy.
+ *
+ * Usage:
+ *     auto budget = std::make_shared<LorcBudget>(8ul << 30);
+ *     budget->setShare("orders", 256ul << 20, 2ul << 30);
+ *     options.range_cache = NewRBTreeLogicalOrderedRangeCache(1ul << 30); // capacity: default maximum share
+ *     options.range_cache->setBudget(budget);
+ */
+class LorcBudget {
+public:
+    explicit LorcBudget(size_t capacity_);
+
+    size_t getCapacity() const {
+        return capacity.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Change the global capacity. Shrinking takes effect at the next rebalance.
+     */
+    void setCapacity(size_t capacity_) {
+        capacity.store(capacity_, std::memory_order_relaxed);
+    }
+
+    /**
+     * Bound the capacity of the range cache of column family cf_name to [min_share, max_share].
+     * The minimum shares are granted in the order of registration while they fit in the capacity.
+     * Column families without a share keep no minimum, and at most the capacity of the template range cache.
+     */
+    void setShare(const std::string& cf_name, size_t min_share, size_t max_share);
+
+    /**
+     * Register a tenant, called by newTenant() of the template range cache.
+     */
+    void addRangeCache(const std::string& cf_name, const std::shared_ptr<LogicalOrderedRangeCache>& range_cache,
+                       size_t default_max_share);
+
+    /**
+     * Unregister a tenant (and the destroyed ones), called by the destructor of the range cache.
+     */
+    void removeRangeCache(const LogicalOrderedRangeCache* range_cache);
+
+    /**
+     * Sum of the current sizes of the tenants.
+     */
+    size_t getUsage() const;
+
+    size_t getRangeCacheNum() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return tenants.size();
+    }
+
+    /**
+     * Re-compute the hotness of the tenants, then rebalance().
+     * Expensive (visits all logical ranges), called periodically by the DB (range cache maintenance).
+     */
+    void refresh();
+
+    /**
+     * Re-compute the effective capacities of the tenants from their current sizes and the hotness of the last
+     * refresh(), and shrink the tenants above their new capacities.
+     */
+    void rebalance();
+
+    /**
+     * rebalance() if the tenants hold more than the capacity, or if it has not been done in the last second.
+     * Skipped if a rebalance is running. Called by tryVictim() of the tenants.
+     */
+    void maybeRebalance();
+
+private:
+    struct Tenant {
+        std::string cf_name;
+        const LogicalOrderedRangeCache* key; // to find the tenant when it is destroyed
+        std::weak_ptr<LogicalOrderedRangeCache> range_cache;
+        size_t default_max_share;
+        uint64_t access_frequency; // sum over the logical ranges at the last refresh()
+    };
+
+    /**
+     * Compute the effective capacity of each tenant from its current size. Called with mutex held.
+     */
+    std::vector<size_t> computeTargets(const std::vector<const Tenant*>& live_tenants, const std::vector<size_t>& sizes) const;
+
+    std::atomic<size_t> capacity;
+    std::mutex rebalance_mutex; // one rebalance at a time
+    std::atomic<bool> rebalancing; // so that tryVictim() of the tenants shrunk by a rebalance does not rebalance again
+    std::atomic<uint64_t> last_rebalance_micros; // steady clock time of the last rebalance
+
+    mutable std::mutex mutex; // guards the fields below
+    std::unordered_map<std::string, std::pair<size_t, size_t>> shares; // cf name -> (min share, max share)
+    std::vector<Tenant> tenants;
+};
+
+}  // namespace ROCKSDB_NAMESPACE
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "rocksdb/advanced_cache.h"
+#include "rocksdb/lorc.h"
+
+namespace ROCKSDB_NAMESPACE {
+
+/**
+ * @brief GhostCache wraps a block cache or blob cache to estimate the hits it would get with more capacity.
+ * It remembers the keys inserted recently (up to capacity + ghost capacity bytes of insertions), and counts a lookup
+ * miss on a key inserted between capacity and capacity + ghost capacity bytes ago as a ghost hit.
+ * The keys are tracked by hash in shards (by key hash), each with 1 / kNumShards of the capacity.
+ * Use the GhostCache as the block_cache / blob_cache of the options to let LorcMemoryTuner tune it.
+ */
+class GhostCache : public CacheWrapper {
+public:
+    GhostCache(std::shared_ptr<Cache> target, double ghost_ratio_);
+
+    const char* Name() const override {
+        return "GhostCache";
+    }
+
+    using Cache::Insert;
+    Status Insert(const Slice& key, ObjectPtr value, const CacheItemHelper* helper, size_t charge,
+                  Handle** handle = nullptr, Priority priority = Priority::LOW,
+                  const Slice& compressed_value = Slice(),
+                  CompressionType type = CompressionType::kNoCompression) override;
+
+    using Cache::Lookup;
+    Handle* Lookup(const Slice& key, const CacheItemHelper* helper, CreateContext* create_context,
+                   Priority priority = Priority::LOW, Statistics* stats = nullptr) override;
+
+    size_t getGhostCapacity() const {
+        return static_cast<size_t>(static_cast<double>(GetCapacity()) * ghost_ratio);
+    }
+
+    /**
+     * Total charge of the ghost hits since the cache was created.
+     */
+    uint64_t getGhostHitBytes() const {
+        return ghost_hit_bytes.load(std::memory_order_relaxed);
+    }
+
+private:
+    static const size_t kNumShards = 16;
+
+    struct GhostEntry {
+        uint64_t inserted_bytes; // inserted_bytes (of the shard) when the key was inserted
+        size_t charge;
+    };
+
+    struct GhostShard {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, GhostEntry> entries; // key hash -> latest insertion
+        std::deque<std::pair<uint64_t, uint64_t>> fifo; // (key hash, inserted_bytes) in insertion order
+        uint64_t inserted_bytes = 0; // total charge inserted, the "clock" of insertions
+    };
+
+    const double ghost_ratio;
+    std::array<GhostShard, kNumShards> shards;
+    std::atomic<uint64_t> ghost_hit_bytes;
+};
+
+/**
+ * @brief Options of LorcMemoryTuner.
+ */
+struct LorcMemoryTunerOptions {
+    // total capacity of the tuned caches, 0 to keep the sum of their capacities when the tuner is created
+    size_t total_budget = 0;
+    // capacity moved per tuning, in ratio of the total budget
+    double step_ratio = 0.05;
+    // capacity a tuned cache keeps at least, in ratio of the total budget
+    double min_share_ratio = 0.1;
+    // capacity is only moved if the largest marginal benefit exceeds the smallest one by this ratio (hysteresis)
+    double min_benefit_gap_ratio = 0.2;
+    // tune() shared by several column families only takes effect once per interval
+    uint64_t min_tune_interval_micros = 30 * 1000000;
+};
+
+/**
+ * @brief LorcMemoryTuner moves capacity between the range cache, the blob cache and the block cache within
+ * a total budget. Each tune() compares the ghost hits per ghost byte (the marginal benefit of one more byte)
+ * of the caches since the last tune(), and moves one step of capacity from the cache with the least benefit
+ * to the one with the most.
+ * Set it to the range cache (setMemoryTuner) to run it at each range cache maintenance of the DB.
+ */
+class LorcMemoryTuner {
+public:
+    /**
+     * blob_cache / block_cache may be nullptr if not tuned. Ghost tracking is enabled on range_cache
+     * with the ghost ratio of the cache wrappers if not done yet.
+     */
+    LorcMemoryTuner(std::shared_ptr<LogicalOrderedRangeCache> range_cache, std::shared_ptr<GhostCache> blob_cache,
+                    std::shared_ptr<GhostCache> block_cache, const LorcMemoryTunerOptions& options = LorcMemoryTunerOptions());
+
+    /**
+     * Move capacity towards the cache with the largest marginal benefit.
+     * Return true if any capacity is moved.
+     */
+    bool tune();
+
+    size_t getTotalBudget() const {
+        return total_budget;
+    }
+
+private:
+    // A tuned cache, either the range cache or a GhostCache
+    struct TunedCache {
+        std::string name;
+        std::function<size_t()> get_capacity;
+        std::function<void(size_t)> set_capacity;
+        std::function<uint64_t()> get_ghost_hit_bytes;
+        std::function<size_t()> get_ghost_capacity;
+        uint64_t last_ghost_hit_bytes;
+    };
+
+    void addCache(const std::string& name, std::function<size_t()> get_capacity, std::function<void(size_t)> set_capacity,
+                  std::function<uint64_t()> get_ghost_hit_bytes, std::function<size_t()> get_ghost_capacity);
+
+    std::weak_ptr<LogicalOrderedRangeCache> range_cache; // the range cache holds the tuner
+    std::shared_ptr<GhostCache> blob_cache;
+    std::shared_ptr<GhostCache> block_cache;
+    const LorcMemoryTunerOptions options;
+    size_t total_budget;
+
+    std::mutex tune_mutex;
+    std::vector<TunedCache> tuned_caches;
+    uint64_t last_tune_micros;
+};
+
+}  // namespace ROCKSDB_NAMESPACE
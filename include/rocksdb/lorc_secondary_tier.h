@@ -0,0 +1,167 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "rocksdb/physical_range.h"
+#include "rocksdb/slice.h"
+#include "rocksdb/status.h"
+
+namespace ROCKSDB_NAMESPACE {
+
+class Env;
+class RandomAccessFile;
+class WritableFile;
+
+/**
+ * @brief LorcSecondaryTier keeps the logical ranges evicted from the range cache on local flash.
+ * Evicted ranges are appended sequentially (internal keys and values contiguous) to segment files in a directory,
+ * and only their boundaries are indexed in memory. A scan hitting a spilled range reads it back with one sequential
+ * read and promotes it to the range cache, instead of random reads of the LSM (and blob files).
+ * The oldest segment is dropped when the tier exceeds its capacity. The tier is not persistent: segment files left
+ * in the directory are deleted when the tier is created.
+ *
+ * No I/O is done with the lock of the range cache held: the evicted ranges are queued (enqueueSpill()) and written
+ * later (drainPendingSpills()), and a promotion loads a range (load()) before it takes the write lock, then checks that
+ * the range did not go stale meanwhile (finishLoad()).
+ *
+ * Spilled range record format:
+ *   fixed32 masked crc32c of the rest of the record
+ *   varint64 number of entries
+ *   for each entry: length-prefixed internal key, length-prefixed value
+ */
+class LorcSecondaryTier {
+public:
+    /**
+     * dir: directory of the segment files, created if missing
+     * capacity: max total bytes of the segment files
+     * segment_size: bytes of a segment file before switching to a new one
+     */
+    LorcSecondaryTier(Env* env, const std::string& dir, size_t capacity, size_t segment_size = 64 << 20);
+    ~LorcSecondaryTier();
+
+    LorcSecondaryTier(const LorcSecondaryTier&) = delete;
+    LorcSecondaryTier& operator=(const LorcSecondaryTier&) = delete;
+
+    /**
+     * Append the entries of the (sorted, non-overlapping) physical ranges of the evicted logical range
+     * [start_user_key, end_user_key]. Does I/O, not to be called with the lock of the range cache held.
+     */
+    Status spill(const Slice& start_user_key, const Slice& end_user_key, const std::vector<const PhysicalRange*>& physical_ranges);
+
+    /**
+     * Queue the (sorted, non-overlapping) physical ranges detached from the range cache for the evicted logical range
+     * [start_user_key, end_user_key], to be spilled by drainPendingSpills(). Cheap, called with the write lock of the
+     * range cache held. A queued range can be loaded back before it is written. The oldest queued ranges are dropped
+     * when the queue holds more than a segment.
+     */
+    void enqueueSpill(const Slice& start_user_key, const Slice& end_user_key,
+                      std::vector<std::unique_ptr<PhysicalRange>>&& physical_ranges);
+
+    /**
+     * Spill the queued ranges. Called without the lock of the range cache (by tryVictim() and the range cache
+     * maintenance).
+     */
+    Status drainPendingSpills();
+
+    /**
+     * Whether any spilled range overlaps [start_user_key, end_user_key]. Empty end_user_key for no upper bound.
+     */
+    bool mayOverlap(const Slice& start_user_key, const Slice& end_user_key) const;
+
+    /**
+     * Get the boundaries of the spilled ranges overlapping [start_user_key, end_user_key] in key order, at most max_num.
+     */
+    std::vector<std::pair<std::string, std::string>> getOverlappingRanges(const Slice& start_user_key, const Slice& end_user_key,
+                                                                          size_t max_num) const;
+
+    /**
+     * Read the spilled (or queued) range starting at start_user_key with one sequential read, and remove it from the
+     * tier. Does I/O, called before the write lock of the range cache is taken to promote the range, and followed by
+     * finishLoad() on success.
+     */
+    Status load(const Slice& start_user_key, std::vector<std::string>* internal_keys, std::vector<std::string>* values);
+
+    /**
+     * Called with the write lock of the range cache held after load(). Return false if the loaded range went stale
+     * (invalidate()) since it was loaded, so it must not be promoted.
+     */
+    bool finishLoad(const Slice& start_user_key);
+
+    /**
+     * Drop the spilled ranges overlapping [start_user_key, end_user_key] (e.g. stale after a flush updated a key in it).
+     */
+    void invalidate(const Slice& start_user_key, const Slice& end_user_key);
+
+    size_t getCapacity() const {
+        return capacity;
+    }
+
+    /**
+     * Total bytes of the segment files
+     */
+    size_t getUsage() const;
+
+    /**
+     * Spilled ranges, including the queued ones
+     */
+    size_t getSpilledRangeNum() const;
+
+    size_t getPendingSpillNum() const;
+
+private:
+    struct PendingSpill {
+        std::vector<std::unique_ptr<PhysicalRange>> physical_ranges;
+        size_t byte_size;
+        uint64_t order; // key of pending_order
+    };
+
+    struct SpilledRange {
+        std::string end_user_key;
+        uint64_t segment; // 0 while queued
+        uint64_t offset;
+        size_t size;
+        std::shared_ptr<PendingSpill> pending; // not null while queued
+    };
+    using SpilledRangeMap = std::map<std::string, SpilledRange>;
+
+    std::string segmentFileName(uint64_t segment) const;
+    // Switch to a new segment and drop the oldest ones over capacity. REQUIRES: io_mutex held
+    Status rollSegment();
+    // Append a record to the active segment, set the segment and offset of it. REQUIRES: io_mutex held
+    Status appendRecord(const std::string& record, uint64_t* segment, uint64_t* offset);
+    // Read the entries of a spilled range. REQUIRES: io_mutex held
+    Status readRecord(const SpilledRange& spilled_range, std::vector<std::string>* internal_keys,
+                      std::vector<std::string>* values);
+    // The first range which may overlap [start_user_key, ...]. REQUIRES: mutex held
+    SpilledRangeMap::const_iterator firstOverlapping(const Slice& start_user_key) const;
+    // Erase a (spilled or queued) range. Return the iterator of the next one. REQUIRES: mutex held
+    SpilledRangeMap::iterator eraseRange(SpilledRangeMap::const_iterator it);
+    // Drop the ranges overlapping [start_user_key, end_user_key], and mark the loading ones stale. REQUIRES: mutex held
+    void dropOverlapping(const Slice& start_user_key, const Slice& end_user_key);
+
+    Env* env;
+    const std::string dir;
+    const size_t capacity;
+    const size_t segment_size;
+
+    // guards the segment files, locked before mutex if both are held
+    std::mutex io_mutex;
+    std::unique_ptr<WritableFile> active_writer;
+    uint64_t active_segment;
+    std::map<uint64_t, std::unique_ptr<RandomAccessFile>> segment_readers;
+
+    // guards the fields below
+    mutable std::mutex mutex;
+    SpilledRangeMap spilled_ranges; // start user key -> spilled (or queued) range
+    std::map<uint64_t, std::string> pending_order; // queued ranges in order of eviction
+    std::map<std::string, std::pair<std::string, bool>> loading_ranges; // start user key -> (end user key, stale)
+    std::map<uint64_t, size_t> segment_sizes; // segment number -> file size
+    size_t usage;
+    size_t pending_bytes;
+    uint64_t next_pending_order;
+};
+
+}  // namespace ROCKSDB_NAMESPACE
@@ -1785,6 +1785,20 @@ struct ReadOptions {
   // block cache.
   bool fill_cache = true;
 
+  // Should the blob values read be placed in the blob cache? Only takes
+  // effect if fill_cache is also true. Set to false by range scans whose
+  // values are cached by the range cache (LORC) anyway, see
+  // `LogicalOrderedRangeCache::setSkipBlobCacheFill()`.
+  bool fill_blob_cache = true;
+
+  // Max number of the subranges (hit in the range cache or not) of a
+  // DB::Scan() with a range cache scanned concurrently, by a thread pool
+  // shared by the scans of the DB. The results are buffered per subrange and
+  // delivered in order. Only takes effect on scans terminated by end_key
+  // (with len 0), whose subranges are all scanned to the end anyway.
+  // 1 scans the subranges one after another on the calling thread.
+  size_t scan_parallelism = 1;
+
   // If true, range tombstones handling will be skipped in key lookup paths.
   // For DB instances that don't use DeleteRange() calls, this setting can
   // be used to optimize the read performance.
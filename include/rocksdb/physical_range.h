@@ -10,7 +10,9 @@ namespace ROCKSDB_NAMESPACE {
 
 enum class PhysicalRangeType {
     CONTINUOUS,
-    VEC
+    VEC,
+    FIXED_KEY, // fixed size user keys (8, 16, 24 or 32 bytes), falls back to VEC for other keys
+    BLOB_INDEX // VEC storing the blob indexes of values in blob files instead of the values (key-only cache for BlobDB)
 };
 
 enum class PhysicalRangeUpdateResult {
@@ -21,6 +23,27 @@ enum class PhysicalRangeUpdateResult {
     ERROR
 };
 
+/**
+ * @brief Buffer of a decompressed block of values, held by a reader (e.g. an iterator) of compressed physical ranges
+ * so that consecutive reads in the same block decompress it only once.
+ */
+struct PhysicalRangeValueBuffer {
+    uint64_t range_id = 0; // id of the physical range the block belongs to, 0 if empty
+    size_t block = 0;
+    std::string data;
+    bool corrupted = false; // set by the last read if the block could not be decompressed (the value read is empty)
+};
+
+/**
+ * @brief Buffer of a key rebuilt from a delta encoded physical range, held by a reader (e.g. an iterator) so that
+ * reading the keys in order only applies the delta of each key to the previous one.
+ */
+struct PhysicalRangeKeyBuffer {
+    uint64_t version = 0; // version of the physical range the key was read from, 0 if empty
+    size_t index = 0;
+    std::string key;
+};
+
 /**
  * @brief PhysicalRange abstract base class for sorted key-value ranges in memory
  */
@@ -36,17 +59,28 @@ public:
     PhysicalRange(bool valid_ = false) : valid(valid_), range_length(0), byte_size(0), delete_length(0), timestamp(0) {}
     virtual ~PhysicalRange() = default;
     
-    virtual const Slice& startUserKey() const = 0;
-    virtual const Slice& endUserKey() const = 0;
-    virtual const Slice& startInternalKey() const = 0;
-    virtual const Slice& endInternalKey() const = 0;
-    virtual const Slice& internalKeyAt(size_t index) const = 0;
-    virtual const Slice& userKeyAt(size_t index) const = 0;
-    virtual const Slice& valueAt(size_t index) const = 0;
+    virtual Slice startUserKey() const = 0;
+    virtual Slice endUserKey() const = 0;
+    virtual Slice endInternalKey() const = 0;
+    virtual Slice valueAt(size_t index) const = 0;
+    // Same as valueAt(index), but values not stored plainly (compressed) are decompressed into buffer, which is reused
+    // by the following calls. The result is valid until the next call with the same buffer. If the value can not be
+    // decompressed, buffer->corrupted is set and the result is empty: the caller reads the key from the LSM instead.
+    virtual Slice readValueAt(size_t index, PhysicalRangeValueBuffer* buffer) const { return valueAt(index); }
+    // The internal key at index. Keys not stored plainly (delta encoded) are rebuilt into buffer, the result is valid
+    // until the next call with the same buffer (or the next update of the range).
+    virtual Slice readInternalKeyAt(size_t index, PhysicalRangeKeyBuffer* buffer) const = 0;
+    // The user key at index, see readInternalKeyAt()
+    Slice readUserKeyAt(size_t index, PhysicalRangeKeyBuffer* buffer) const {
+        Slice internal_key = readInternalKeyAt(index, buffer);
+        return Slice(internal_key.data(), internal_key.size() - internal_key_extra_bytes);
+    }
     virtual PhysicalRangeUpdateResult update(const Slice& internal_key, const Slice& value) const = 0;
     virtual int find(const Slice& key) const = 0;   // find the first index of the key >= the target key, -1 if no such key
     virtual void reserve(size_t len) = 0;
     virtual std::string toString() const = 0;
+    // Whether values are compressed (cold range), which are decompressed (slowly) by update()
+    virtual bool isCompressed() const { return false; }
     
     static std::string ToStringPlain(std::string s) {
         // Only for debug (internal internal_keys)
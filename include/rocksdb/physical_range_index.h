@@ -0,0 +1,216 @@
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <string>
+#include "rocksdb/physical_range.h"
+#include "rocksdb/slice.h"
+
+namespace ROCKSDB_NAMESPACE {
+
+/**
+ * @brief Entries, deleted entries and bytes of a set of physical ranges.
+ */
+struct PhysicalRangeStats {
+    size_t length = 0;
+    size_t delete_length = 0;
+    size_t byte_size = 0;
+
+    PhysicalRangeStats() = default;
+    explicit PhysicalRangeStats(const PhysicalRange& range)
+        : length(range.length()), delete_length(range.deleteLength()), byte_size(range.byteSize()) {}
+
+    PhysicalRangeStats& operator+=(const PhysicalRangeStats& other) {
+        length += other.length;
+        delete_length += other.delete_length;
+        byte_size += other.byte_size;
+        return *this;
+    }
+
+    PhysicalRangeStats& operator-=(const PhysicalRangeStats& other) {
+        length -= other.length;
+        delete_length -= other.delete_length;
+        byte_size -= other.byte_size;
+        return *this;
+    }
+};
+
+/**
+ * @brief PhysicalRangeIndex is an ordered index of physical ranges by start user key (replacing a std::set of ranges).
+ * It is a B+-tree whose nodes keep the 8 bytes following the common prefix of their keys (heads) inline, so that a
+ * lookup touches a few cache lines per level and only dereferences a range to break a tie of heads.
+ * Leaves own the ranges and are linked for iteration. Nodes are not merged on erase (only empty nodes are removed).
+ * Every entry also keeps the PhysicalRangeStats of its subtree, so the stats of all ranges before a key are summed
+ * in O(log n). A range updated in place must be refreshed to keep them.
+ * Start user keys must be unique and never change while a range is in the index.
+ */
+class PhysicalRangeIndex {
+private:
+    // Max entries of a node
+    static const size_t kFanout = 32;
+
+    struct InnerNode;
+    struct Node {
+        explicit Node(bool leaf_) : leaf(leaf_) {}
+        virtual ~Node() = default;
+
+        bool leaf;
+        size_t count = 0;
+        InnerNode* parent = nullptr;
+        std::string prefix; // common prefix of the first keys of all entries
+        uint64_t heads[kFanout]; // big endian 8 bytes after the prefix of the first key of each entry
+        const PhysicalRange* firsts[kFanout]; // the range of the first key of each entry, to break ties
+        PhysicalRangeStats stats[kFanout]; // stats of the range (or subtree) of each entry
+
+        // Number of entries whose first key is < key (or <= key if or_equal)
+        size_t countLess(const Slice& key, bool or_equal) const;
+        PhysicalRangeStats total() const;
+        void insertKey(size_t pos, const PhysicalRange* first, const PhysicalRangeStats& entry_stats);
+        void removeKey(size_t pos);
+        void setKey(size_t pos, const PhysicalRange* first);
+    };
+
+    struct LeafNode : public Node {
+        LeafNode() : Node(true) {}
+
+        std::unique_ptr<PhysicalRange> ranges[kFanout];
+        LeafNode* prev = nullptr;
+        LeafNode* next = nullptr;
+    };
+
+    struct InnerNode : public Node {
+        InnerNode() : Node(false) {}
+
+        std::unique_ptr<Node> children[kFanout];
+
+        size_t indexOf(const Node* child) const;
+    };
+
+public:
+    // Bidirectional iterator of the ranges in order (like the const iterator of std::set)
+    class iterator {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = std::unique_ptr<PhysicalRange>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const std::unique_ptr<PhysicalRange>*;
+        using reference = const std::unique_ptr<PhysicalRange>&;
+
+        iterator() = default;
+
+        reference operator*() const {
+            return leaf->ranges[pos];
+        }
+        pointer operator->() const {
+            return &leaf->ranges[pos];
+        }
+        iterator& operator++() {
+            if (++pos == leaf->count) {
+                leaf = leaf->next;
+                pos = 0;
+            }
+            return *this;
+        }
+        iterator operator++(int) {
+            iterator tmp = *this;
+            ++*this;
+            return tmp;
+        }
+        iterator& operator--() {
+            if (leaf == nullptr) {
+                // from end()
+                leaf = index->lastLeaf();
+                pos = leaf->count - 1;
+            } else if (pos == 0) {
+                leaf = leaf->prev;
+                pos = leaf->count - 1;
+            } else {
+                pos--;
+            }
+            return *this;
+        }
+        iterator operator--(int) {
+            iterator tmp = *this;
+            --*this;
+            return tmp;
+        }
+        bool operator==(const iterator& other) const {
+            return leaf == other.leaf && pos == other.pos;
+        }
+        bool operator!=(const iterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        friend class PhysicalRangeIndex;
+        iterator(const PhysicalRangeIndex* index_, LeafNode* leaf_, size_t pos_) : index(index_), leaf(leaf_), pos(pos_) {}
+
+        const PhysicalRangeIndex* index = nullptr;
+        LeafNode* leaf = nullptr; // nullptr for end()
+        size_t pos = 0;
+    };
+    using const_iterator = iterator;
+
+    PhysicalRangeIndex();
+    ~PhysicalRangeIndex() = default;
+
+    PhysicalRangeIndex(const PhysicalRangeIndex& other) = delete;
+    PhysicalRangeIndex& operator=(const PhysicalRangeIndex& other) = delete;
+
+    iterator begin() const;
+    iterator end() const {
+        return iterator(this, nullptr, 0);
+    }
+    size_t size() const {
+        return range_num;
+    }
+    bool empty() const {
+        return range_num == 0;
+    }
+
+    // The first range whose start key >= key
+    iterator lower_bound(const Slice& key) const;
+    // The first range whose start key > key
+    iterator upper_bound(const Slice& key) const;
+    // The range whose start key == key, or end()
+    iterator find(const Slice& key) const;
+    // Stats of the ranges whose start key < key (or <= key if or_equal)
+    PhysicalRangeStats statsBefore(const Slice& key, bool or_equal) const;
+    // Stats of all ranges
+    PhysicalRangeStats totalStats() const {
+        return root->total();
+    }
+
+    iterator insert(std::unique_ptr<PhysicalRange> range);
+    // Erase the range of it (moved to erased if not null). Return the iterator of the next range
+    iterator erase(iterator it, std::unique_ptr<PhysicalRange>* erased = nullptr);
+    // Replace the range of it by one with the same start key in place. Return the iterator of the new one
+    iterator replace(iterator it, std::unique_ptr<PhysicalRange> range);
+    // Update the stats after the range of it is updated in place (e.g. by PhysicalRange::update)
+    void refresh(iterator it);
+    void clear();
+
+private:
+    LeafNode* findLeaf(const Slice& key, bool or_equal) const;
+    LeafNode* firstLeaf() const;
+    LeafNode* lastLeaf() const;
+    // Iterator of pos in leaf, moved to the next leaf if pos is past the end
+    iterator makeIterator(LeafNode* leaf, size_t pos) const;
+
+    LeafNode* splitLeaf(LeafNode* leaf);
+    InnerNode* splitInner(InnerNode* node);
+    // Insert right (split from left) after left in the parent of left
+    void insertChild(Node* left, std::unique_ptr<Node> right);
+    // Remove an empty node from its parent
+    void removeChild(Node* node);
+    // Update the keys of the ancestors after the first key of node changed
+    void propagateFirst(Node* node);
+    // Update the stats of the ancestors after the stats of node changed from old_stats to new_stats
+    void propagateStats(Node* node, const PhysicalRangeStats& old_stats, const PhysicalRangeStats& new_stats);
+
+    std::unique_ptr<Node> root;
+    size_t range_num;
+};
+
+}  // namespace ROCKSDB_NAMESPACE
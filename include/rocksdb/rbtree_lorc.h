@@ -1,12 +1,15 @@
 #pragma once
 
-#include <set>
 #include <map>
+#include <mutex>
+#include <set>
 #include <string>
 #include <shared_mutex>
+#include <vector>
 #include "rocksdb/continuous_physical_range.h"
 #include "rocksdb/lorc.h"
 #include "rocksdb/physical_range.h"
+#include "rocksdb/physical_range_index.h"
 #include "rocksdb/vec_physical_range.h"
 
 namespace ROCKSDB_NAMESPACE {
@@ -15,37 +18,9 @@ class RBTreeRangeCacheIterator;
 class LogicalOrderedRangeCacheIterator;
 class Arena;
 
-// enum
-
-
-// Custom comparator for heterogeneous lookup
-struct PhysicalRangeComparator {
-    using is_transparent = void; // Enable heterogeneous lookup
-    
-    bool operator()(const std::unique_ptr<PhysicalRange>& lhs, const std::unique_ptr<PhysicalRange>& rhs) const {
-        return lhs->startUserKey() < rhs->startUserKey();
-    }
-    
-    bool operator()(const std::unique_ptr<PhysicalRange>& lhs, const Slice& rhs) const {
-        return lhs->startUserKey() < rhs;
-    }
-    
-    bool operator()(const Slice& lhs, const std::unique_ptr<PhysicalRange>& rhs) const {
-        return lhs < rhs->startUserKey();
-    }
-    
-    bool operator()(const std::unique_ptr<PhysicalRange>& lhs, const std::string& rhs) const {
-        return lhs->startUserKey() < Slice(rhs);
-    }
-    
-    bool operator()(const std::string& lhs, const std::unique_ptr<PhysicalRange>& rhs) const {
-        return Slice(lhs) < rhs->startUserKey();
-    }
-};
-
 /**
- * RBTreeLogicalOrderedRangeCache: A cache implementation using Red-Black Tree to store PhysicalRange data
- * Uses ordered containers to maintain ranges sorted by their start keys and lengths
+ * RBTreeLogicalOrderedRangeCache: A cache implementation using ordered containers to store PhysicalRange data
+ * Maintains ranges sorted by their start keys (in a B+-tree PhysicalRangeIndex) and lengths
  */
 class RBTreeLogicalOrderedRangeCache : public LogicalOrderedRangeCache {
 public:
@@ -54,11 +29,18 @@ public:
 
     void putGapPhysicalRange(ReferringRange&& newRefRange, bool leftConcat, bool rightConcat, bool emptyConcat, std::string emptyConcatLeftKey, std::string emptyConcatRightKey) override;
     bool updateEntry(const Slice& key, const Slice& value) override;
-    void victim() override;
+    bool victim() override;
     void tryVictim() override;
+    bool promoteSpilledRanges(const Slice& start_key, const Slice& end_key) override;
+    size_t compressColdRanges(size_t max_bytes) override;
+    size_t defragmentRanges(size_t max_bytes) override;
+    std::shared_ptr<LogicalOrderedRangeCache> newTenant(const std::string& cf_name) const override;
+    size_t getPrefixBytes(const Slice& prefix) const override;
     
-    bool Get(const Slice& internal_key, std::string* value, Status* s) const override;
-    
+    bool Get(const Slice& internal_key, std::string* value, Status* s, bool* is_blob_index = nullptr) const override;
+    bool lookupEntry(const Slice& user_key, std::string* internal_key, std::string* value, bool* found) const override;
+    bool invalidateLogicalRange(const Slice& user_key) override;
+
     LogicalOrderedRangeCacheIterator* newLogicalOrderedRangeCacheIterator(Arena* arena) const override;
 
     /**
@@ -66,6 +48,12 @@ public:
      */
     void pinRange(std::string startKey);
 
+    /**
+     * Remember a physical range whose values can not be decompressed, its logical range is dropped by tryVictim().
+     * Called by the readers with the read lock held.
+     */
+    void reportCorruptedRange(const Slice& start_user_key) const;
+
     void printAllRangesWithKeys() const override;
         
     void printAllPhysicalRanges() const override;
@@ -85,12 +73,48 @@ public:
 private:
     // Downward estimate data can be read from range cache (to avoid pre-division too many ranges)
     size_t downwardEstimateLengthInRangeCache(const Slice& start_key, const Slice& end_key, size_t remaining_length) const;
+    // Entries, deletions and bytes cached in [start_key, end_key] in O(log n). Exact for the ranges fully in it, while
+    // the deletions and bytes of the (at most two) ranges partly in it are upper bounded and proportional
+    PhysicalRangeStats statsInRangeCache(const Slice& start_key, const Slice& end_key) const;
+
+    // Build a physical range of the configured (hot) type
+    std::unique_ptr<PhysicalRange> buildPhysicalRangeFromInternalEntries(const std::vector<Slice>& internal_keys, const std::vector<Slice>& values) const;
+    // Replace a physical range by one with the same keys (e.g. compressed). Return the iterator of the new one
+    PhysicalRangeIndex::iterator replacePhysicalRange(PhysicalRangeIndex::iterator it, std::unique_ptr<PhysicalRange> newRange);
+    // Replace a compressed physical range by a hot one. Return end() on failure
+    PhysicalRangeIndex::iterator decompressPhysicalRange(PhysicalRangeIndex::iterator it);
+    // Replace a physical range by a VecPhysicalRange which accepts any key (e.g. a FixedKeyPhysicalRange). Return the iterator of the new one
+    PhysicalRangeIndex::iterator generalizePhysicalRange(PhysicalRangeIndex::iterator it);
+    // Merge num adjacent physical ranges from first into one without their deletion entries (but the first and the last
+    // entries). Return the number of deletion entries purged
+    size_t mergePhysicalRanges(PhysicalRangeIndex::iterator first, size_t num);
+    // Remove a physical range from physical_range_length_map
+    void eraseFromLengthMap(const PhysicalRange& range);
+    // Evict the logical range [start_user_key, end_user_key] of len entries, unless it holds the last physical range.
+    // An invalidated range is dropped even if it is the last one, and is neither spilled nor remembered as a ghost
+    bool evictLogicalRange(const Slice& start_user_key, const Slice& end_user_key, size_t len, bool invalidate = false);
+    // The shortest logical range of the prefix furthest above its soft quota. Return false if no prefix is above it.
+    // Only the prefixes remembered above their soft quotas are looked at, the ones back under them are forgotten
+    bool selectPrefixVictim(Slice* start_user_key, Slice* end_user_key, size_t* len);
+    // Remember the prefix of start_user_key if it is above its soft or hard quota, the latter to be shrunk by tryVictim()
+    void checkPrefixQuotas(const Slice& start_user_key);
+    // Look for the prefixes above their quotas again over all logical ranges (after the quotas changed)
+    void refreshPrefixesOverQuotas();
+    // Evict the ranges of the prefixes remembered above their hard quotas
+    void enforcePrefixHardQuotas();
+    // Drop the logical ranges of the physical ranges reported corrupted
+    void dropCorruptedRanges();
 
     friend class RBTreeLogicalOrderedRangeCacheIterator;
-    std::set<std::unique_ptr<PhysicalRange>, PhysicalRangeComparator> ordered_physical_ranges;     // Container for ranges sorted by start key
+    PhysicalRangeIndex ordered_physical_ranges;   // Index of ranges sorted by start key
     std::multimap<int, std::string> physical_range_length_map;  // Container for ranges sorted by length (for victim selection)
     uint64_t cache_timestamp;          // Timestamp for LRU-like functionality
+    size_t compressed_physical_range_num;
+    std::vector<std::string> prefixes_over_hard_quota;
+    std::set<std::string> prefixes_over_soft_quota;
     mutable std::shared_mutex logical_ranges_mutex_;
+    mutable std::mutex corrupted_ranges_mutex; // guards corrupted_range_keys, reported with the read lock held
+    mutable std::vector<std::string> corrupted_range_keys; // start user keys of the physical ranges reported corrupted
 };
 
 }  // namespace ROCKSDB_NAMESPACE
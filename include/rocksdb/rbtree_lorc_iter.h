@@ -1,13 +1,13 @@
 #pragma once
 
-#include <set>
 #include <string>
 #include "rocksdb/lorc_iter.h"
+#include "rocksdb/physical_range.h"
+#include "rocksdb/physical_range_index.h"
 
 namespace ROCKSDB_NAMESPACE {
 
 class RBTreeLogicalOrderedRangeCache;
-class PhysicalRange;
 
 class RBTreeLogicalOrderedRangeCacheIterator : public LogicalOrderedRangeCacheIterator {
 public:
@@ -29,10 +29,12 @@ public:
 
 private:
     const RBTreeLogicalOrderedRangeCache* cache;
-    std::set<std::unique_ptr<PhysicalRange>>::const_iterator current_range;
+    PhysicalRangeIndex::const_iterator current_range;
     int current_index;
-    Status iter_status;
+    mutable Status iter_status; // Corruption once a value can not be decompressed
     bool valid;
+    mutable PhysicalRangeValueBuffer value_buffer; // the decompressed block of the current value in a compressed range
+    mutable PhysicalRangeKeyBuffer key_buffer; // the current key rebuilt from a delta encoded range
 };
 
 }  // namespace ROCKSDB_NAMESPACE
@@ -8,6 +8,19 @@
 
 namespace ROCKSDB_NAMESPACE {
 
+/**
+ * @brief A value held by reference instead of a private copy (e.g. a blob pinned in the blob cache). Its memory is owned
+ * and charged by the holder of the reference, it is released when the last range referring to it is gone.
+ */
+class SharedRangeValue {
+public:
+    virtual ~SharedRangeValue() = default;
+    virtual Slice value() const = 0;
+
+    // bytes charged to a range for a value held by reference (the reference and its holder)
+    static const size_t reference_bytes = 64;
+};
+
 /**
  * @brief ReferringRange class is a range representation of key-value pairs, which inner storage
  * is slice which refers to the original data. 
@@ -20,6 +33,8 @@ private:
     struct SliceRangeData {
         std::vector<Slice> slice_keys;  // user keys, dump with seq_num to internal keys in dumpSubRange()
         std::vector<Slice> slice_values;
+        std::vector<bool> blob_index_flags;  // whether each value is a blob index, empty if none is
+        std::vector<std::shared_ptr<SharedRangeValue>> shared_values;  // the values held by reference, empty if none is
     };
     std::shared_ptr<SliceRangeData> slice_data;
     mutable size_t range_length; // size in length
@@ -44,12 +59,19 @@ public:
 
     // empalce a key-value pair Slice copy
     void emplace(const Slice& key, const Slice& value);
+    // empalce a key with the blob index of its value (for a BLOB_INDEX range cache)
+    void emplaceBlobIndex(const Slice& key, const Slice& blob_index);
+    // empalce a key with a value held by reference, which physical ranges may keep instead of a copy
+    void emplaceShared(const Slice& key, std::shared_ptr<SharedRangeValue> value);
 
     Slice startKey() const;
     Slice endKey() const;
 
     Slice keyAt(size_t index) const;
     Slice valueAt(size_t index) const;
+    bool isBlobIndexAt(size_t index) const;
+    // the reference of the value at index, nullptr if the value is not held by reference
+    const std::shared_ptr<SharedRangeValue>& sharedValueAt(size_t index) const;
 
     size_t length() const;
     size_t keysByteSize() const;
@@ -409,7 +409,22 @@ struct BlockBasedTableOptions {
   // (iii) Compatible existing behavior:
   // Same as kDisabled.
   //
-  // (e) Other CacheEntryRole
+  // (e) CacheEntryRole::kRangeCache
+  // (i) If kEnabled:
+  // Charge memory usage of the range cache (LORC, `range_cache`) to the block
+  // cache, which then becomes the budget of the range cache instead of its
+  // own `capacity`. The range cache shrinks (evicts ranges) below `capacity`
+  // when other users of the block cache pin most of it, and grows beyond
+  // `capacity` into the free part of the block cache when the other users
+  // are cold. The limit is re-computed at most once per second. See
+  // `LogicalOrderedRangeCache::setChargedCache()` for charging to another
+  // shared cache, e.g. the blob cache.
+  // (ii) If kDisabled:
+  // Does not charge the memory usage mentioned above.
+  // (iii) Compatible existing behavior:
+  // Same as kDisabled.
+  //
+  // (f) Other CacheEntryRole
   // Not supported.
   // `Status::kNotSupported` will be returned if
   // `CacheEntryRoleOptions::charged` is set to {`kEnabled`, `kDisabled`}.
@@ -13,28 +13,77 @@ namespace ROCKSDB_NAMESPACE {
 /**
  * @brief VecPhysicalRange class represents a sorted key-value range in memory.Cleanable
  * with vector-based storage
+ * Entries are kept in a sequence of chunks (vectors of at most kChunkMaxEntries entries) with the global index of the
+ * first entry of each chunk, so an insertion only shifts the entries of one chunk.
+ * Slices are derived from the strings on access instead of being stored.
+ * Values held by reference (SharedRangeValue, e.g. pinned in the blob cache) are kept as references instead of copies.
+ * find() is accelerated by dense arrays of 8-byte key heads (the big-endian bytes following the prefix shared by all the
+ * keys of the array), one of the first keys of the chunks and one per chunk, so that most probes touch no key string.
  */
 class VecPhysicalRange : public PhysicalRange {
 private:
-    struct RangeData {
+    struct Chunk {
         std::vector<std::string> internal_keys;
-        std::vector<std::string> values;
-        std::vector<Slice> internal_key_slices;
-        std::vector<Slice> user_key_slices;
-        std::vector<Slice> value_slices;
+        std::vector<std::string> values; // empty for the values held by reference
+        std::vector<std::shared_ptr<SharedRangeValue>> shared_values; // the values held by reference, empty if none is
+        std::vector<uint64_t> key_heads; // heads of the user keys after shared_prefix_size bytes
+        size_t shared_prefix_size = 0; // bytes shared by all the user keys of the chunk
+
+        size_t size() const {
+            return internal_keys.size();
+        }
+
+        Slice userKeyAt(size_t local_index) const {
+            return Slice(internal_keys[local_index].data(), internal_keys[local_index].size() - internal_key_extra_bytes);
+        }
+
+        Slice valueAt(size_t local_index) const {
+            if (local_index < shared_values.size() && shared_values[local_index]) {
+                return shared_values[local_index]->value();
+            }
+            return Slice(values[local_index]);
+        }
+
+        // bytes of the value charged to the range
+        size_t valueBytes(size_t local_index) const {
+            if (local_index < shared_values.size() && shared_values[local_index]) {
+                return SharedRangeValue::reference_bytes;
+            }
+            return values[local_index].size();
+        }
+
+        void rebuildKeyHeads();
+        // Index of the first user key >= key in the chunk, size() if none
+        size_t lowerBound(const Slice& key) const;
     };
-    Slice start_user_key_slice;
+
+    struct RangeData {
+        std::vector<std::unique_ptr<Chunk>> chunks;
+        std::vector<size_t> chunk_first_index; // global index of the first entry of each chunk
+        std::vector<uint64_t> chunk_heads; // heads of the first user keys of the chunks after chunk_shared_prefix_size bytes
+        size_t chunk_shared_prefix_size = 0; // bytes shared by all the user keys of the range
+    };
+    mutable std::string start_user_key; // copy of the first user key, read without lock
     std::shared_ptr<RangeData> data;
     mutable std::shared_mutex physical_range_mutex_;
 
+    // Entries a chunk is filled to when built
+    static const size_t kChunkTargetEntries = 256;
+    // Entries a chunk is split at
+    static const size_t kChunkMaxEntries = 2 * kChunkTargetEntries;
+
 private:
-    VecPhysicalRange(std::shared_ptr<RangeData> data, size_t length);
-    
     // Helper functions for vec storage management
-    void emplaceInternal(const Slice& internal_key, const Slice& value);
-    
+    // value is held by reference if shared_value is not null
+    void emplaceInternal(const Slice& internal_key, const Slice& value, std::shared_ptr<SharedRangeValue> shared_value = nullptr);
+    void finishBuilding();
+    // Locate the chunk of a global index
+    size_t chunkOf(size_t index) const;
+    void splitChunk(size_t chunk) const;
+    void rebuildChunkHeads() const;
+
     // Internal functions without locking for internal use
-    const Slice& userKeyAtInternal(size_t index) const;
+    Slice userKeyAtInternal(size_t index) const;
     int findInternal(const Slice& key) const;
 
 public:
@@ -49,15 +98,21 @@ public:
 
     // Static factory functions
     static std::unique_ptr<VecPhysicalRange> buildFromReferringRange(const ReferringRange& refRange);
+    // build from sorted internal keys (with their original sequence numbers and types) and values
+    static std::unique_ptr<VecPhysicalRange> buildFromInternalEntries(const std::vector<Slice>& internal_keys, const std::vector<Slice>& values);
 
     // Override pure virtual functions from PhysicalRange
-    const Slice& startUserKey() const override;
-    const Slice& endUserKey() const override;
-    const Slice& startInternalKey() const override;
-    const Slice& endInternalKey() const override;
-    const Slice& internalKeyAt(size_t index) const override;
-    const Slice& userKeyAt(size_t index) const override;
-    const Slice& valueAt(size_t index) const override;
+    Slice startUserKey() const override;
+    Slice endUserKey() const override;
+    Slice endInternalKey() const override;
+    Slice valueAt(size_t index) const override;
+    Slice readInternalKeyAt(size_t index, PhysicalRangeKeyBuffer* buffer) const override {
+        return internalKeyAt(index);
+    }
+    // The keys are stored plainly, the results are valid until the range is updated
+    Slice startInternalKey() const;
+    Slice internalKeyAt(size_t index) const;
+    Slice userKeyAt(size_t index) const;
     PhysicalRangeUpdateResult update(const Slice& internal_key, const Slice& value) const override;
     int find(const Slice& key) const override;
     void reserve(size_t len) override;
@@ -666,7 +666,7 @@ Status BlockBasedTableFactory::ValidateOptions(
         CacheEntryRole::kCompressionDictionaryBuildingBuffer,
         CacheEntryRole::kFilterConstruction,
         CacheEntryRole::kBlockBasedTableReader, CacheEntryRole::kFileMetadata,
-        CacheEntryRole::kBlobCache};
+        CacheEntryRole::kBlobCache, CacheEntryRole::kRangeCache};
     if (options.charged != CacheEntryRoleOptions::Decision::kFallback &&
         kMemoryChargingSupported.count(role) == 0) {
       return Status::NotSupported(
@@ -715,6 +715,15 @@ Status BlockBasedTableFactory::ValidateOptions(
             " but blob cache capacity is larger than block cache capacity");
       }
     }
+    if (role == CacheEntryRole::kRangeCache &&
+        options.charged == CacheEntryRoleOptions::Decision::kEnabled &&
+        cf_opts.range_cache == nullptr) {
+      return Status::InvalidArgument(
+          "Enable CacheEntryRoleOptions::charged"
+          " for CacheEntryRole " +
+          kCacheEntryRoleToCamelString[static_cast<uint32_t>(role)] +
+          " but range cache is not configured");
+    }
   }
   {
     Status s = CheckCacheOptionCompatibility(table_options_);